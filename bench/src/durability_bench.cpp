@@ -0,0 +1,79 @@
+#include <benchmark/benchmark.h>
+
+#include "tree_generator.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace path = os::path;
+
+namespace {
+    const std::string bench_root = path::joinPath(bench::benchRoot(), "durability");
+
+    // Creates `count` files of `bytes` each, spread over a few directories
+    std::string makeTree(int count, int bytes)
+    {
+        std::string root = path::joinPath(bench_root, "source_" + std::to_string(count) + "_" + std::to_string(bytes));
+        if(path::exists(root)) {
+            return root;
+        }
+
+        std::vector<std::pair<std::string, std::string>> entries;
+        for(int i = 0; i < count; i++) {
+            entries.push_back({"dir" + std::to_string(i % 8) + "/file" + std::to_string(i), std::string(bytes, 'x')});
+        }
+        path::createFiles(root, entries);
+        return root;
+    }
+
+    void BM_copyDurability(benchmark::State& state)
+    {
+        auto durability = static_cast<path::Durability>(state.range(0));
+        int count = static_cast<int>(state.range(1));
+        int bytes = static_cast<int>(state.range(2));
+        std::string from = makeTree(count, bytes) + path::directorySeparator();
+        std::string to = path::joinPath(bench_root, "destination");
+
+        for(auto _ : state) {
+            path::copy(from, to, path::CopyOption::OverwriteAll, path::TraversalOption::Recursive, durability);
+        }
+
+        state.SetItemsProcessed(state.iterations() * count);
+        state.SetBytesProcessed(state.iterations() * count * bytes);
+        path::remove(to);
+    }
+
+    void BM_createFileDurability(benchmark::State& state)
+    {
+        auto durability = static_cast<path::Durability>(state.range(0));
+        auto write_option = static_cast<path::WriteOption>(state.range(1));
+        std::string data(state.range(2), 'x');
+        std::string file = path::joinPath(bench_root, "created.txt");
+        path::createDirectory(bench_root);
+
+        for(auto _ : state) {
+            path::createFile(file, data, path::CopyOption::OverwriteExisting, write_option, durability);
+        }
+
+        state.SetBytesProcessed(state.iterations() * data.size());
+        path::remove(file);
+    }
+}
+
+// Arguments: durability, file count, file size
+BENCHMARK(BM_copyDurability)
+    ->ArgNames({"durability", "files", "bytes"})
+    ->ArgsProduct({{0, 1, 2}, {16, 1000}, {4096}})
+    ->Args({0, 4, 16 << 20})
+    ->Args({1, 4, 16 << 20})
+    ->Args({2, 4, 16 << 20})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Arguments: durability, write option, size
+BENCHMARK(BM_createFileDurability)
+    ->ArgNames({"durability", "atomic", "bytes"})
+    ->ArgsProduct({{0, 1, 2}, {0, 1}, {4096, 1 << 20}})
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
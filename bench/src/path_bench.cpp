@@ -0,0 +1,364 @@
+#include <benchmark/benchmark.h>
+
+#include "tree_generator.hpp"
+
+#include <string>
+#include <vector>
+
+namespace path = os::path;
+using bench::Shape;
+
+namespace {
+    // Reports files/s and bytes/s for a whole tree handled once per iteration.
+    void setTreeCounters(benchmark::State& state, const bench::Tree& tree)
+    {
+        state.SetItemsProcessed(state.iterations() * tree.files);
+        state.SetBytesProcessed(state.iterations() * tree.bytes);
+        state.SetLabel(bench::shapeName(static_cast<Shape>(state.range(0))));
+    }
+
+    std::string workPath(const std::string& name)
+    {
+        return path::joinPath(bench::benchRoot(), name);
+    }
+
+    void BM_copy(benchmark::State& state)
+    {
+        const bench::Tree& tree = bench::generateTree(static_cast<Shape>(state.range(0)));
+        std::string to = workPath("copy");
+
+        for(auto _ : state) {
+            path::copy(tree.root + path::directorySeparator(), to, path::CopyOption::OverwriteExisting);
+            state.PauseTiming();
+            path::remove(to);
+            state.ResumeTiming();
+        }
+        setTreeCounters(state, tree);
+    }
+
+    // Same as `BM_copy`, with the tree loaded into a `MemoryBackend`.
+    void BM_copyMemory(benchmark::State& state)
+    {
+        const bench::Tree& tree = bench::generateTree(static_cast<Shape>(state.range(0)));
+        path::MemoryBackend memory;
+        for(const auto& entry : std::filesystem::recursive_directory_iterator(tree.root)) {
+            if(entry.is_directory()) {
+                memory.createDirectories(entry.path());
+            } else {
+                memory.createDirectories(entry.path().parent_path());
+                std::ifstream file(entry.path(), std::ios::binary);
+                memory.write(entry.path(), std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+            }
+        }
+        std::string to = workPath("copy_memory");
+
+        path::setBackend(&memory);
+        for(auto _ : state) {
+            path::copy(tree.root + path::directorySeparator(), to, path::CopyOption::OverwriteExisting);
+            state.PauseTiming();
+            path::remove(to);
+            state.ResumeTiming();
+        }
+        path::setBackend(nullptr);
+        setTreeCounters(state, tree);
+    }
+
+    // Copies a package store where every file has four hard links, following or preserving the links.
+    void BM_copyLinked(benchmark::State& state)
+    {
+        std::string root = workPath("linked");
+        if(!path::exists(root)) {
+            std::string data(256 * 1024, 'x');
+            std::filesystem::create_directories(std::filesystem::path(root) / "store");
+            for(int i = 0; i < 100; i++) {
+                std::string name = "f" + std::to_string(i) + ".dat";
+                path::createFile(path::joinPath(root, "store/" + name), data);
+                for(int link = 0; link < 3; link++) {
+                    std::filesystem::path to = std::filesystem::path(root) / ("package" + std::to_string(link)) / name;
+                    std::filesystem::create_directories(to.parent_path());
+                    std::filesystem::create_hard_link(std::filesystem::path(root) / "store" / name, to);
+                }
+            }
+        }
+        path::LinkOption links = static_cast<path::LinkOption>(state.range(0));
+        std::string to = workPath("copy_linked");
+
+        for(auto _ : state) {
+            path::copy(root + path::directorySeparator(), to, path::CopyOption::OverwriteExisting, links);
+            state.PauseTiming();
+            path::remove(to);
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(state.iterations() * 400);
+        state.SetLabel(links == path::LinkOption::Preserve ? "preserve" : "follow");
+    }
+
+    // Copies the tree and checks the copy, either with a verified copy (reading back from the cache or the device) or by hashing both trees with `diff()` after it.
+    void BM_copyVerified(benchmark::State& state)
+    {
+        const bench::Tree& tree = bench::generateTree(static_cast<Shape>(state.range(0)));
+        int mode = static_cast<int>(state.range(1));
+        std::string to = workPath("copy_verified");
+        path::CopyDigests digests;
+
+        for(auto _ : state) {
+            if(mode > 0) {
+                path::VerifyOption verify = mode == 1 ? path::VerifyOption::Cache : path::VerifyOption::Device;
+                benchmark::DoNotOptimize(path::copy(tree.root + path::directorySeparator(), to, path::CopyOption::OverwriteExisting, digests,
+                                                    path::Durability::None, verify));
+            } else {
+                path::copy(tree.root + path::directorySeparator(), to, path::CopyOption::OverwriteExisting);
+                benchmark::DoNotOptimize(path::diff(tree.root, to, path::CompareOption::Hash, 1));
+            }
+            state.PauseTiming();
+            path::remove(to);
+            state.ResumeTiming();
+        }
+        state.SetBytesProcessed(state.iterations() * tree.bytes);
+        state.SetLabel(mode == 0 ? "copy+diff" : mode == 1 ? "cache" : "device");
+    }
+
+    // Packs the tree into an archive and unpacks it again, the alternative to `copy()` for shipping a tree.
+    void BM_packUnpack(benchmark::State& state)
+    {
+        const bench::Tree& tree = bench::generateTree(static_cast<Shape>(state.range(0)));
+        std::string archive = workPath("pack.tar");
+        std::string to = workPath("unpack");
+
+        for(auto _ : state) {
+            path::pack(tree.root + path::directorySeparator(), std::filesystem::path(archive));
+            path::unpack(std::filesystem::path(archive), to, path::CopyOption::OverwriteExisting);
+            state.PauseTiming();
+            path::remove(to);
+            state.ResumeTiming();
+        }
+        path::remove(archive);
+        setTreeCounters(state, tree);
+    }
+
+    void BM_move(benchmark::State& state)
+    {
+        const bench::Tree& tree = bench::generateTree(static_cast<Shape>(state.range(0)));
+        std::string from = workPath("move_from");
+        std::string to = workPath("move_to");
+
+        for(auto _ : state) {
+            state.PauseTiming();
+            path::copy(tree.root + path::directorySeparator(), from, path::CopyOption::OverwriteExisting);
+            state.ResumeTiming();
+
+            path::move(from + path::directorySeparator(), to, path::CopyOption::OverwriteExisting);
+
+            state.PauseTiming();
+            path::remove(from);
+            path::remove(to);
+            state.ResumeTiming();
+        }
+        setTreeCounters(state, tree);
+    }
+
+    void BM_remove(benchmark::State& state)
+    {
+        const bench::Tree& tree = bench::generateTree(static_cast<Shape>(state.range(0)));
+        std::string target = workPath("remove");
+
+        for(auto _ : state) {
+            state.PauseTiming();
+            path::copy(tree.root + path::directorySeparator(), target, path::CopyOption::OverwriteExisting);
+            state.ResumeTiming();
+
+            path::remove(target);
+        }
+        setTreeCounters(state, tree);
+    }
+
+    void BM_size(benchmark::State& state)
+    {
+        const bench::Tree& tree = bench::generateTree(static_cast<Shape>(state.range(0)));
+        for(auto _ : state) {
+            benchmark::DoNotOptimize(path::size(tree.root));
+        }
+        setTreeCounters(state, tree);
+    }
+
+    // The same walk as `BM_size` with rules that exclude nothing, so only the matching is added.
+    void BM_sizeFiltered(benchmark::State& state)
+    {
+        const bench::Tree& tree = bench::generateTree(static_cast<Shape>(state.range(0)));
+        path::Filter filter(".git/\nnode_modules/\n*.log\n/build/**\n");
+        for(auto _ : state) {
+            benchmark::DoNotOptimize(path::size(tree.root, filter));
+        }
+        setTreeCounters(state, tree);
+    }
+
+    void BM_find(benchmark::State& state)
+    {
+        const bench::Tree& tree = bench::generateTree(static_cast<Shape>(state.range(0)));
+        for(auto _ : state) {
+            benchmark::DoNotOptimize(path::find(tree.root, "missing.dat", path::TraversalOption::Recursive));
+        }
+        setTreeCounters(state, tree);
+    }
+
+    void BM_findAll(benchmark::State& state)
+    {
+        const bench::Tree& tree = bench::generateTree(static_cast<Shape>(state.range(0)));
+        for(auto _ : state) {
+            benchmark::DoNotOptimize(path::findAll(tree.root, "f0.dat", path::TraversalOption::Recursive));
+        }
+        setTreeCounters(state, tree);
+    }
+
+    // The same search as `BM_findAll`, as a recursive pattern.
+    void BM_glob(benchmark::State& state)
+    {
+        const bench::Tree& tree = bench::generateTree(static_cast<Shape>(state.range(0)));
+        for(auto _ : state) {
+            for(const auto& i : path::glob(tree.root + "/**/f0.dat")) {
+                benchmark::DoNotOptimize(i);
+            }
+        }
+        setTreeCounters(state, tree);
+    }
+
+    void BM_hasSameContent(benchmark::State& state)
+    {
+        const bench::Tree& tree = bench::generateTree(static_cast<Shape>(state.range(0)));
+        std::string other = workPath("same_content");
+        path::copy(tree.root + path::directorySeparator(), other, path::CopyOption::OverwriteAll);
+
+        // Directories are compared by their entries only
+        for(auto _ : state) {
+            benchmark::DoNotOptimize(path::hasSameContent(tree.root, other));
+        }
+        state.SetItemsProcessed(state.iterations() * tree.files);
+        state.SetLabel(bench::shapeName(static_cast<Shape>(state.range(0))));
+        path::remove(other);
+    }
+
+    // Argument: size of the compared files
+    void BM_hasSameContentFile(benchmark::State& state)
+    {
+        std::string first = workPath("first.dat");
+        std::string second = workPath("second.dat");
+        std::size_t bytes = static_cast<std::size_t>(state.range(0));
+        path::createDirectory(bench::benchRoot());
+        path::createFile(first, std::string(bytes, 'x'), path::CopyOption::OverwriteExisting);
+        path::createFile(second, std::string(bytes, 'x'), path::CopyOption::OverwriteExisting);
+
+        for(auto _ : state) {
+            benchmark::DoNotOptimize(path::hasSameContent(first, second));
+        }
+        state.SetItemsProcessed(state.iterations() * 2);
+        state.SetBytesProcessed(state.iterations() * bytes * 2);
+        path::remove(first);
+        path::remove(second);
+    }
+
+    const std::vector<std::string> sample_paths = {
+        "file.txt", "/usr/local/include/os.hpp", "relative/dir/", "archive.tar.gz",
+        "C:\\Users\\name\\Documents\\report.docx", ".hidden", "no_extension", "a/b/c/d/e/f/g/h/i/j.k"
+    };
+
+    void BM_joinPath(benchmark::State& state)
+    {
+        for(auto _ : state) {
+            for(const auto& p : sample_paths) {
+                benchmark::DoNotOptimize(path::joinPath(p, "child/name.txt"));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * sample_paths.size());
+    }
+
+    void BM_fileExtension(benchmark::State& state)
+    {
+        for(auto _ : state) {
+            for(const auto& p : sample_paths) {
+                benchmark::DoNotOptimize(path::fileExtension(p));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * sample_paths.size());
+    }
+
+    // Arguments: size of the data, whether it is written as lines
+    void BM_createFile(benchmark::State& state)
+    {
+        std::string file = workPath("created.dat");
+        std::size_t bytes = static_cast<std::size_t>(state.range(0));
+        path::createDirectory(bench::benchRoot());
+
+        if(state.range(1)) {
+            std::vector<std::string> lines(bytes / 64, std::string(63, 'x'));
+            for(auto _ : state) {
+                path::createFile(file, lines, path::CopyOption::OverwriteExisting);
+            }
+        } else {
+            std::string data(bytes, 'x');
+            for(auto _ : state) {
+                path::createFile(file, data, path::CopyOption::OverwriteExisting);
+            }
+        }
+        state.SetItemsProcessed(state.iterations());
+        state.SetBytesProcessed(state.iterations() * bytes);
+        path::remove(file);
+    }
+
+    void BM_executeShell(benchmark::State& state)
+    {
+        for(auto _ : state) {
+            benchmark::DoNotOptimize(os::execute("true"));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    void BM_executeArgv(benchmark::State& state)
+    {
+        for(auto _ : state) {
+            benchmark::DoNotOptimize(os::execute({"true"}));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    // Argument: number of commands run at once
+    void BM_executeMany(benchmark::State& state)
+    {
+        std::vector<std::vector<std::string>> commands(64, {"true"});
+        for(auto _ : state) {
+            benchmark::DoNotOptimize(os::executeMany(commands, static_cast<unsigned int>(state.range(0))));
+        }
+        state.SetItemsProcessed(state.iterations() * commands.size());
+    }
+}
+
+// Argument: tree shape
+#define TREE_BENCHMARK(function) \
+    BENCHMARK(function)->ArgName("shape")->DenseRange(0, 3)->Unit(benchmark::kMillisecond)->UseRealTime()
+
+TREE_BENCHMARK(BM_copy);
+TREE_BENCHMARK(BM_copyMemory);
+BENCHMARK(BM_copyLinked)->ArgName("links")->DenseRange(0, 1)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_copyVerified)->ArgNames({"shape", "verify"})->ArgsProduct({{0, 1, 2, 3}, {0, 1, 2}})->Unit(benchmark::kMillisecond)->UseRealTime();
+TREE_BENCHMARK(BM_packUnpack);
+TREE_BENCHMARK(BM_move);
+TREE_BENCHMARK(BM_remove);
+TREE_BENCHMARK(BM_size);
+TREE_BENCHMARK(BM_sizeFiltered);
+TREE_BENCHMARK(BM_find);
+TREE_BENCHMARK(BM_findAll);
+TREE_BENCHMARK(BM_glob);
+TREE_BENCHMARK(BM_hasSameContent);
+BENCHMARK(BM_hasSameContentFile)->ArgName("bytes")->Arg(4096)->Arg(1 << 20)->Arg(64 << 20)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+BENCHMARK(BM_joinPath);
+BENCHMARK(BM_fileExtension);
+
+BENCHMARK(BM_createFile)
+    ->ArgNames({"bytes", "lines"})
+    ->ArgsProduct({{0, 4096, 1 << 20, 64 << 20}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+BENCHMARK(BM_executeShell)->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_executeArgv)->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_executeMany)->ArgName("parallel")->Arg(1)->Arg(8)->Unit(benchmark::kMillisecond)->UseRealTime();
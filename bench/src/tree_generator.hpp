@@ -0,0 +1,127 @@
+#pragma once
+
+#include <os.hpp>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+    namespace path = os::path;
+
+    /*
+        Shapes of generated trees.
+
+        Enumerations:
+        `Wide`: One directory with many files.
+        `Deep`: A long chain of nested directories with a few files each.
+        `ManySmall`: Many directories full of small files.
+        `FewHuge`: A handful of very large files.
+    */
+    enum class Shape {Wide, Deep, ManySmall, FewHuge};
+
+    // A generated tree and what it holds.
+    struct Tree {
+        std::string root;
+        std::uintmax_t files = 0;
+        std::uintmax_t bytes = 0;
+    };
+
+    // Directory every benchmark works in.
+    inline std::string benchRoot()
+    {
+        static const std::string root = path::joinPath(std::filesystem::temp_directory_path().string(), "os_bench");
+        return root;
+    }
+
+    inline const char* shapeName(const Shape& shape)
+    {
+        switch(shape) {
+            case Shape::Wide: return "wide";
+            case Shape::Deep: return "deep";
+            case Shape::ManySmall: return "many_small";
+            default: return "few_huge";
+        }
+    }
+
+    // splitmix64, so every run on every platform builds the same tree.
+    class Random {
+        public:
+            explicit Random(std::uint64_t seed) : state(seed) {}
+
+            std::uint64_t next()
+            {
+                std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                return z ^ (z >> 31);
+            }
+
+            // Returns a number in [low, high].
+            std::uint64_t between(std::uint64_t low, std::uint64_t high)
+            {
+                return low + next() % (high - low + 1);
+            }
+
+        private:
+            std::uint64_t state;
+    };
+
+    /*
+        Builds a tree of the given shape, once per process.
+
+        Notes:
+        - File names are `f<n>.dat`, so every directory has an `f0.dat`.
+        - Sizes and contents only depend on the shape.
+    */
+    inline const Tree& generateTree(const Shape& shape)
+    {
+        static std::map<Shape, Tree> trees;
+        auto found = trees.find(shape);
+        if(found != trees.end()) {
+            return found->second;
+        }
+
+        Random random(static_cast<std::uint64_t>(shape) + 1);
+        std::vector<std::pair<std::string, std::string>> entries;
+        auto addFiles = [&](const std::string& directory, int count, std::uint64_t low, std::uint64_t high) {
+            for(int i = 0; i < count; i++) {
+                std::string name = directory + "f" + std::to_string(i) + ".dat";
+                entries.push_back({name, std::string(random.between(low, high), static_cast<char>('a' + random.next() % 26))});
+            }
+        };
+
+        switch(shape) {
+            case Shape::Wide:
+                addFiles("", 10000, 512, 2048);
+                break;
+            case Shape::Deep: {
+                std::string directory;
+                for(int depth = 0; depth < 100; depth++) {
+                    directory += "d" + std::to_string(depth) + "/";
+                    addFiles(directory, 2, 1024, 4096);
+                }
+                break;
+            }
+            case Shape::ManySmall:
+                for(int i = 0; i < 64; i++) {
+                    addFiles("d" + std::to_string(i) + "/", 256, 0, 4096);
+                }
+                break;
+            case Shape::FewHuge:
+                addFiles("", 4, 32 << 20, 32 << 20);
+                break;
+        }
+
+        Tree tree;
+        tree.root = path::joinPath(benchRoot(), std::string("tree_") + shapeName(shape));
+        for(const auto& entry : entries) {
+            tree.files++;
+            tree.bytes += entry.second.size();
+        }
+        path::createFiles(tree.root, entries, path::CopyOption::OverwriteAll);
+        return trees.emplace(shape, tree).first->second;
+    }
+}
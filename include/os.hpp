@@ -2,10 +2,31 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <fstream>
 #include <filesystem>
 #include <set>
+#include <map>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <future>
+#include <system_error>
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
 #if defined(_WIN32)
     #include <windows.h>
 #elif defined(__linux__)
@@ -13,13 +34,279 @@
     #include <sys/stat.h>
     #include <sys/types.h>
     #include <sys/wait.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+    #include <sys/mman.h>
+    #include <fcntl.h>
+    #include <dirent.h>
+    #include <sys/epoll.h>
+    #include <sys/inotify.h>
+    #include <sys/eventfd.h>
+    #include <spawn.h>
+    #include <poll.h>
+    #include <csignal>
     #include <cstdlib>
 #elif defined(__APPLE__)
     #include <mach-o/dyld.h>
+    #include <crt_externs.h>
+    #include <unistd.h>
+    #include <sys/stat.h>
+    #include <sys/wait.h>
+    #include <sys/mman.h>
+    #include <fcntl.h>
+    #include <spawn.h>
+    #include <poll.h>
+    #include <csignal>
     #include <cstdlib>
 #endif
 
 namespace os {
+    /*
+        Latency of the calls to one function.
+
+        Notes:
+        - Bucket `i` counts the calls that took from `2^i` up to `2^(i+1)` nanoseconds (bucket `0` also holds `0`).
+    */
+    struct LatencyHistogram {
+        std::uint64_t count = 0;
+        std::chrono::nanoseconds total {0};
+        std::chrono::nanoseconds min {0};
+        std::chrono::nanoseconds max {0};
+        std::array<std::uint64_t, 64> buckets {};
+
+        /*
+            Returns an upper bound of the latency below which a fraction of the calls finished.
+
+            Parameters:
+            `fraction`: Fraction of the calls, from `0` to `1`. (E.g. `0.99` for the 99th percentile)
+        */
+        std::chrono::nanoseconds percentile(double fraction) const
+        {
+            if(count == 0) {
+                return std::chrono::nanoseconds(0);
+            }
+
+            std::uint64_t rank = static_cast<std::uint64_t>(fraction * count);
+            std::uint64_t seen = 0;
+            for(std::size_t i = 0; i < buckets.size(); i++) {
+                seen += buckets[i];
+                if(seen > rank || seen == count) {
+                    std::chrono::nanoseconds bound(i + 1 < 63 ? (std::int64_t(1) << (i + 1)) : max.count());
+                    return std::clamp(bound, min, max);
+                }
+            }
+            return max;
+        }
+    };
+
+    /*
+        Counters collected by the library when it is compiled with `OS_ENABLE_METRICS`.
+
+        Notes:
+        - `latency` is keyed by the name of the public function. Only the outermost call is timed
+          when one public function calls another.
+    */
+    struct Metrics {
+        std::uint64_t stats = 0; // metadata lookups (stat, lstat, existence and type checks)
+        std::uint64_t opens = 0; // files and directories opened
+        std::uint64_t bytes_read = 0;
+        std::uint64_t bytes_written = 0;
+        std::uint64_t directories_walked = 0; // directories whose entries were listed
+        std::map<std::string, LatencyHistogram> latency;
+    };
+
+    namespace _private {
+        enum class Counter {Stats, Opens, BytesRead, BytesWritten, DirectoriesWalked};
+
+    #if defined(OS_ENABLE_METRICS)
+        constexpr bool metrics_enabled = true;
+
+        inline void addLatency(LatencyHistogram& histogram, std::chrono::nanoseconds latency)
+        {
+            std::uint64_t ns = latency.count() > 0 ? static_cast<std::uint64_t>(latency.count()) : 0;
+            std::size_t bucket = 0;
+            while(ns >> (bucket + 1)) {
+                bucket++;
+            }
+
+            if(histogram.count == 0 || latency < histogram.min) {
+                histogram.min = latency;
+            }
+            if(latency > histogram.max) {
+                histogram.max = latency;
+            }
+            histogram.count++;
+            histogram.total += latency;
+            histogram.buckets[bucket]++;
+        }
+
+        inline void mergeLatency(LatencyHistogram& into, const LatencyHistogram& from)
+        {
+            if(from.count == 0) {
+                return;
+            }
+            if(into.count == 0 || from.min < into.min) {
+                into.min = from.min;
+            }
+            if(from.max > into.max) {
+                into.max = from.max;
+            }
+            into.count += from.count;
+            into.total += from.total;
+            for(std::size_t i = 0; i < into.buckets.size(); i++) {
+                into.buckets[i] += from.buckets[i];
+            }
+        }
+
+        // Counters of one thread. Only that thread updates them, so the atomics are never contended.
+        struct ThreadMetrics {
+            std::array<std::atomic<std::uint64_t>, 5> counters {};
+            std::mutex mutex; // guards `latency`
+            std::map<const char*, LatencyHistogram> latency; // keyed by `__func__`
+            unsigned int depth = 0; // public calls in progress on this thread
+        };
+
+        // Every thread's counters, plus the totals of threads that already exited.
+        class MetricsRegistry {
+            public:
+                ThreadMetrics* attach()
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    threads.push_back(std::make_unique<ThreadMetrics>());
+                    return threads.back().get();
+                }
+
+                void detach(ThreadMetrics* metrics)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    collect(*metrics, retired, true);
+                    threads.erase(std::find_if(threads.begin(), threads.end(), [&](const auto& thread) { return thread.get() == metrics; }));
+                }
+
+                Metrics snapshot(bool reset)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    Metrics total = retired;
+                    for(auto& thread : threads) {
+                        collect(*thread, total, reset);
+                    }
+                    if(reset) {
+                        retired = Metrics();
+                    }
+                    return total;
+                }
+
+            private:
+                std::mutex mutex;
+                std::vector<std::unique_ptr<ThreadMetrics>> threads;
+                Metrics retired;
+
+                static void collect(ThreadMetrics& thread, Metrics& into, bool reset)
+                {
+                    std::uint64_t* fields[] = {&into.stats, &into.opens, &into.bytes_read, &into.bytes_written, &into.directories_walked};
+                    for(std::size_t i = 0; i < thread.counters.size(); i++) {
+                        *fields[i] += reset ? thread.counters[i].exchange(0, std::memory_order_relaxed)
+                                            : thread.counters[i].load(std::memory_order_relaxed);
+                    }
+
+                    std::lock_guard<std::mutex> lock(thread.mutex);
+                    for(const auto& function : thread.latency) {
+                        mergeLatency(into.latency[function.first], function.second);
+                    }
+                    if(reset) {
+                        thread.latency.clear();
+                    }
+                }
+        };
+
+        inline MetricsRegistry& metricsRegistry()
+        {
+            static MetricsRegistry* registry = new MetricsRegistry(); // never destroyed, threads may outlive static destruction
+            return *registry;
+        }
+
+        inline ThreadMetrics& threadMetrics()
+        {
+            struct Handle {
+                ThreadMetrics* metrics = metricsRegistry().attach();
+                ~Handle() { metricsRegistry().detach(metrics); }
+            };
+            thread_local Handle handle;
+            return *handle.metrics;
+        }
+
+        inline void countMetric(const Counter& counter, std::uint64_t amount = 1)
+        {
+            threadMetrics().counters[static_cast<std::size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+        }
+
+        // Times a public function for as long as it is in scope.
+        class MetricsScope {
+            public:
+                explicit MetricsScope(const char* function) : thread(threadMetrics())
+                {
+                    if(thread.depth++ == 0) {
+                        this->function = function;
+                        start = std::chrono::steady_clock::now();
+                    }
+                }
+
+                ~MetricsScope()
+                {
+                    thread.depth--;
+                    if(function) {
+                        std::chrono::nanoseconds latency = std::chrono::steady_clock::now() - start;
+                        std::lock_guard<std::mutex> lock(thread.mutex);
+                        addLatency(thread.latency[function], latency);
+                    }
+                }
+
+                MetricsScope(const MetricsScope&) = delete;
+                MetricsScope& operator=(const MetricsScope&) = delete;
+
+            private:
+                ThreadMetrics& thread;
+                const char* function = nullptr;
+                std::chrono::steady_clock::time_point start;
+        };
+    #else
+        constexpr bool metrics_enabled = false;
+
+        inline void countMetric(const Counter&, std::uint64_t = 1) {}
+
+        class MetricsScope {
+            public:
+                explicit MetricsScope(const char*) {}
+        };
+    #endif
+    }
+
+    /*
+        Returns the metrics collected so far by every thread.
+
+        Return Value:
+        - Counters and latency histograms summed over all threads, including threads that already exited.
+        - Everything is zero unless the library is compiled with `OS_ENABLE_METRICS` defined.
+
+        Parameters:
+        `reset`: Set to `true` to also set everything back to zero. (Defaults `false`)
+    */
+    inline Metrics metrics(bool reset = false)
+    {
+        #if defined(OS_ENABLE_METRICS)
+            return _private::metricsRegistry().snapshot(reset);
+        #else
+            (void)reset;
+            return Metrics();
+        #endif
+    }
+
+    // Sets every metric back to zero.
+    inline void resetMetrics()
+    {
+        metrics(true);
+    }
+
     // path namespace
     namespace path {
         
@@ -31,8 +318,9 @@ namespace os {
             `SkipExisting`: Skip existing files and directories.
             `OverwriteExisting`: Overwrites existing files and directories.
             `OverwriteAll`: Deletes contents of an entire directory before copying.
+            `ReplaceAll`: Builds the new contents next to the destination, then swaps them in at once.
         */
-        enum class CopyOption {None, SkipExisting, OverwriteExisting, OverwriteAll};
+        enum class CopyOption {None, SkipExisting, OverwriteExisting, OverwriteAll, ReplaceAll};
 
         /*
             Options for filesystem traversal.
@@ -46,980 +334,9755 @@ namespace os {
         // Options for file sizes.
         enum class SizeMetric {Byte, Kilobyte, Megabyte, Gigabyte};
 
+        /*
+            Options for which platform's filename rules to use.
+
+            Enumerations:
+            `Native`: Rules of the current operating system.
+            `Posix`: Only `/` and the null character are reserved.
+            `Windows`: Reserved characters, control characters and device names (E.g. `CON`, `NUL`).
+        */
+        enum class PlatformOption {Native, Posix, Windows};
+
+        /*
+            Options for how files are written.
+
+            Enumerations:
+            `Direct`: Writes into the file in place.
+            `Atomic`: Writes a temporary file next to it, then renames it over the file. Readers
+                      see either the old or the new contents, never a partly written file.
+        */
+        enum class WriteOption {Direct, Atomic};
+
+        /*
+            Options for how much is flushed to disk before an operation returns.
+
+            Enumerations:
+            `None`: Leaves flushing to the operating system.
+            `GroupCommit`: Flushes everything that was written once, at the end of the operation.
+            `Strict`: Flushes each file and its parent directory right after it is written.
+        */
+        enum class Durability {None, GroupCommit, Strict};
+
+        /*
+            Options for how links in a tree are copied.
+
+            Enumerations:
+            `Follow`: Copies what symbolic links point to, and each hard link as a file of its own.
+            `Preserve`: Copies symbolic links as links without following them. A file with several hard
+                        links is copied once, and its other links are made hard links to that copy.
+        */
+        enum class LinkOption {Follow, Preserve};
+
+        /*
+            Options for how a mapped file will be read.
+
+            Enumerations:
+            `Normal`: No particular order.
+            `Sequential`: From start to end. The kernel reads ahead aggressively and drops pages already read.
+            `Random`: In no predictable order. The kernel does not read ahead.
+        */
+        enum class AccessPattern {Normal, Sequential, Random};
+
+        /*
+            Options for the disk priority of background work.
+
+            Enumerations:
+            `Normal`: Same priority as the rest of the process.
+            `Low`: Lowest best-effort priority.
+            `Idle`: Only uses the disk when no one else does.
+        */
+        enum class IOPriority {Normal, Low, Idle};
+
+        /*
+            Options for how `diff()` decides that a file was modified.
+
+            Enumerations:
+            `Metadata`: The size or the last write time differ. Reads no file data.
+            `Hash`: The size or a hash of the contents differ. Reads each file on its own, from start to end.
+            `Bytes`: The size or the contents differ. Reads both files side by side and stops at the first difference.
+        */
+        enum class CompareOption {Metadata, Hash, Bytes};
+
+        /*
+            Options for how a verified `copy()` reads back its copies.
+
+            Enumerations:
+            `Cache`: Hashes each copy right after it is written, mostly out of the page cache.
+            `Device`: Reads each copy back with `O_DIRECT` where the filesystem allows it, so the check sees what
+                      reached the device. This waits for the copies to be written out.
+        */
+        enum class VerifyOption {Cache, Device};
+
+        // Statistics of a remove operation.
+        struct RemoveStats {
+            std::uintmax_t entries = 0; // files, links and directories removed
+            std::uintmax_t bytes = 0; // total size of the removed files
+        };
+
+        // Digests of the files written by a verified copy, keyed by source path.
+        struct CopyDigests {
+            std::map<std::string, std::uint64_t> files; // 64-bit FNV-1a hash of each copied file, as `hashAsync()` computes it
+            std::vector<std::string> mismatched; // files whose copy read back different from the source
+        };
+
+        // Changes between an old and a new directory tree, as paths relative to their roots.
+        struct TreeDiff {
+            std::set<std::string> added; // only in the new tree, listed with everything below them
+            std::set<std::string> removed; // only in the old tree, listed without anything below them
+            std::set<std::string> type_changed; // a file in one tree and a directory or link in the other
+            std::set<std::string> modified; // files or links in both trees that differ
+
+            // Paths to copy from the new tree to bring the old one up to date.
+            std::set<std::string> changes() const
+            {
+                std::set<std::string> paths = added;
+                paths.insert(type_changed.begin(), type_changed.end());
+                paths.insert(modified.begin(), modified.end());
+                return paths;
+            }
+
+            bool empty() const
+            {
+                return added.empty() && removed.empty() && type_changed.empty() && modified.empty();
+            }
+        };
+
         namespace _private { // forward declaration
             std::string errorMessage(const std::string& function_name, const std::string& message);
             char copyWarning(const std::filesystem::path& path);
+            bool writeFile(const std::filesystem::path& path, const std::string* data, std::size_t count, bool lines,
+                           const WriteOption& write_option, const Durability& durability);
+            void removeTree(const std::filesystem::path& path, bool keep_root, RemoveStats& stats, unsigned int threads = 0,
+                            const std::function<bool()>& on_entry = nullptr);
+            bool replaceDirectory(const std::filesystem::path& target, const std::function<bool(const std::filesystem::path&)>& fill);
+        #if defined(__linux__)
+            bool writeAll(int fd, iovec* iov, int count);
+        #endif
 
             bool copy(const std::filesystem::path& source, const std::filesystem::path& destination, 
-                      const CopyOption& op, const TraversalOption& t_op);
+                      const CopyOption& op, const TraversalOption& t_op, const Durability& durability = Durability::None);
 
             bool copy(const std::filesystem::path& source, const std::set<std::string>& paths, 
-                      const std::filesystem::path& destination, const CopyOption& op);
+                      const std::filesystem::path& destination, const CopyOption& op, const Durability& durability = Durability::None,
+                      std::vector<std::filesystem::path>* copied = nullptr);
 
             bool move(const std::filesystem::path& source, const std::filesystem::path& destination, 
-                      const CopyOption& op, const TraversalOption& t_op);
+                      const CopyOption& op, const TraversalOption& t_op, const Durability& durability = Durability::None);
 
             bool move(const std::filesystem::path& source, const std::set<std::string>& paths, 
-                      const std::filesystem::path& destination, const CopyOption& op);
-        }
+                      const std::filesystem::path& destination, const CopyOption& op, const Durability& durability = Durability::None);
 
-        // Checks if a path exists.
-        inline bool exists(const std::filesystem::path& path)
-        {
-            return std::filesystem::exists(path);
-        }
+            bool copyLinks(const std::filesystem::path& source, const std::filesystem::path& destination,
+                           const CopyOption& op, const Durability& durability);
 
-        // Checks if a directory is empty.
-        inline bool isEmpty(const std::filesystem::path& path)
-        {
-            return std::filesystem::is_empty(path);
+            class DigestBatch;
+            bool copyVerified(const std::filesystem::path& source, const std::filesystem::path& destination,
+                              const CopyOption& op, CopyDigests& digests, const Durability& durability, const VerifyOption& verify);
         }
 
-        // Checks if a path is an absolute path.
-        inline bool isAbsolutePath(const std::filesystem::path& path)
-        {
-            return path.is_absolute();
-        }
+        namespace _private {
+            // Returns the error code of the exception being handled, for overloads that report through `std::error_code`.
+            inline std::error_code currentError() noexcept
+            {
+                try {
+                    throw;
+                } catch(const std::system_error& e) {
+                    return e.code();
+                } catch(const std::bad_alloc&) {
+                    return std::make_error_code(std::errc::not_enough_memory);
+                } catch(...) {
+                    return std::make_error_code(std::errc::invalid_argument);
+                }
+            }
 
-        // Checks if a path is a relative path.
-        inline bool isRelativePath(const std::filesystem::path& path)
-        {
-            return path.is_relative();
-        }
+            // Returns `errno` as an error code, or an I/O error if it was not set.
+            inline std::error_code lastError() noexcept
+            {
+                return std::error_code(errno ? errno : EIO, std::generic_category());
+            }
 
-        // Checks if a character is a valid filename character.
-        inline bool isValidFilenameChar(char ch) // checks if character passed is a valid character for filenames
-        {
-            switch(ch) {
-            #if defined(_WIN32)
-                case '<':
-                case '>':
-                case ':':
-                case '\"':
-                case '/':
-                case '\\':
-                case '|':
-                case '?':
-                case '*':
-            #else
-                case '/':
-            #endif
-                    return false;
-                default:
-                    return true;
+            // Returns the status of a path. A missing path is not an error.
+            inline std::filesystem::file_status statusOf(const std::filesystem::path& path, std::error_code& ec) noexcept
+            {
+                std::filesystem::file_status status = std::filesystem::status(path, ec);
+                if(status.type() == std::filesystem::file_type::not_found) {
+                    ec.clear();
+                }
+                return status;
+            }
+
+            // Throws a `std::filesystem::filesystem_error` carrying `error`, as backends report failures.
+            [[noreturn]] inline void fail(const std::string& message, const std::filesystem::path& path, const std::errc& error)
+            {
+                throw std::filesystem::filesystem_error(message, path, std::make_error_code(error));
             }
         }
 
         /*
-            Check if a character is a directory separator.
+            Asks the asynchronous functions it is passed to stop. Copies share the same state.
 
-            Parameters:
-            `ch`: Character to check.
-            `any_separator`: Set to `true` to detect separators of other operating systems.
+            Notes:
+            - An operation checks the token between entries and between chunks of a file. Once it
+              sees the cancellation its future throws a `std::system_error` with `operation_canceled`.
         */
-        inline bool isDirectorySeparator(char ch, bool any_separator = false) 
-        {
-            char preferred = std::filesystem::path::preferred_separator;
+        class CancellationToken {
+            public:
+                CancellationToken() : state(std::make_shared<std::atomic<bool>>(false)) {}
+
+                // Asks every operation holding this token to stop.
+                void cancel()
+                {
+                    state->store(true, std::memory_order_relaxed);
+                }
 
-            if(any_separator) {
-                return ch == '/' || ch == '\\';
-            }
+                // Checks if `cancel()` was called.
+                bool cancelled() const
+                {
+                    return state->load(std::memory_order_relaxed);
+                }
+            private:
+                std::shared_ptr<std::atomic<bool>> state;
+        };
 
-            return ch == preferred;
-        }
+        /*
+            Token buckets for the bytes and entries per second that operations may use. Copies share the
+            same budget, so several operations in flight can be kept within one share of the disk together.
 
-        // Returns the file extension of a given path.
-        inline std::string fileExtension(const std::filesystem::path& path)
-        {
-            std::string temp = path.filename().empty() ? path.parent_path().filename().string() : path.filename().string();
-            int i = temp.size()-1;
-            while(i > 0 && (temp[i] == ' ' || isDirectorySeparator(temp[i]))) {
-                i--;
-            }
-            while(i > 0 && temp[i] != '.' && !isDirectorySeparator(temp[i])) {
-                i--;
-            }
+            Notes:
+            - A rate of `0` does not limit. A bucket holds a tenth of a second of its rate, so short bursts
+              are smoothed out instead of saved up.
+            - Every user waits for the budget it took beyond what was left, in the order it asked.
+        */
+        class RateLimiter {
+            public:
+                /*
+                    Parameters:
+                    `bytes_per_second`: Bytes that may be copied per second, `0` for no limit. A copied byte is taken once, not once for reading and once for writing.
+                    `entries_per_second`: Files and directories that may be created or deleted per second. (Defaults `0`)
+                    `priority`: Disk priority of the threads doing the work. (Defaults `Normal`)
+                */
+                explicit RateLimiter(std::uintmax_t bytes_per_second, std::uintmax_t entries_per_second = 0, const IOPriority& priority = IOPriority::Normal)
+                    : state(std::make_shared<State>())
+                {
+                    state->priority = priority;
+                    setRate(bytes_per_second, entries_per_second);
+                }
 
-            std::string result;
-            if(i >= 1 && i < temp.size()-1 && temp[i] == '.' && isValidFilenameChar(temp[i-1])) {
-                for(int j = i+1; j < temp.size() && isValidFilenameChar(temp[j]); j++) {
-                    result.push_back(temp[j]);
+                // Changes the rates for every operation sharing this budget.
+                void setRate(std::uintmax_t bytes_per_second, std::uintmax_t entries_per_second)
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->bytes.rate = static_cast<double>(bytes_per_second);
+                    state->entries.rate = static_cast<double>(entries_per_second);
+                }
+
+                // Takes `bytes` and `entries` from the budget, waiting until they are covered.
+                void acquire(std::uintmax_t bytes, std::uintmax_t entries = 0) const
+                {
+                    std::chrono::nanoseconds wait {0};
+                    {
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        auto now = std::chrono::steady_clock::now();
+                        wait = std::max(state->bytes.take(static_cast<double>(bytes), now), state->entries.take(static_cast<double>(entries), now));
+                    }
+                    if(wait.count() > 0) {
+                        std::this_thread::sleep_for(wait);
+                    }
                 }
+
+                // Returns the disk priority of the threads doing the work.
+                IOPriority priority() const
+                {
+                    return state->priority;
+                }
+            private:
+                struct Bucket {
+                    double rate = 0;
+                    double tokens = 0; // negative while users wait for what they took
+                    std::chrono::steady_clock::time_point filled = std::chrono::steady_clock::now();
+
+                    // Returns how long to wait until `amount` is covered.
+                    std::chrono::nanoseconds take(double amount, std::chrono::steady_clock::time_point now)
+                    {
+                        if(rate <= 0 || amount <= 0) {
+                            return std::chrono::nanoseconds(0);
+                        }
+                        tokens = std::min(rate / 10, tokens + rate * std::chrono::duration<double>(now - filled).count());
+                        filled = now;
+                        tokens -= amount;
+                        return tokens >= 0 ? std::chrono::nanoseconds(0)
+                                           : std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(-tokens / rate));
+                    }
+                };
+
+                struct State {
+                    std::mutex mutex;
+                    Bucket bytes;
+                    Bucket entries;
+                    IOPriority priority = IOPriority::Normal;
+                };
+
+                std::shared_ptr<State> state;
+        };
+
+        namespace _private {
+            // Budget of the throttled operation running on this thread, if any.
+            inline const RateLimiter*& activeLimiter()
+            {
+                thread_local const RateLimiter* limiter = nullptr;
+                return limiter;
             }
-            return result;
-        }
 
-        /*
-            Adds a file extension to a given path.
+            // Checks of the verified copy running on this thread, if any.
+            inline DigestBatch*& activeDigests()
+            {
+                thread_local DigestBatch* batch = nullptr;
+                return batch;
+            }
 
-            Parameters:
-            `path`: Path to add extension to.
-            `extension`: Extension to add.
-            `force`: Set to `true` to add extension even if the path already has one.
-        */
-        inline std::string appendFileExtension(std::string path, const std::string& extension, bool force = false)
-        {
-            int i = 0;
-            while(extension[i] == '.') {
-                i++;
+            // Waits for `bytes` and `entries` from the budget of the operation running on this thread.
+            inline void throttle(std::uintmax_t bytes, std::uintmax_t entries)
+            {
+                if(const RateLimiter* limiter = activeLimiter()) {
+                    limiter->acquire(bytes, entries);
+                }
             }
 
-            int extension_len = extension.size() - i;
-            if(!force && path.size() > extension_len && path.substr(path.size()-extension_len) == extension.substr(i, extension_len)) {
-                return path;
+            // Token of the asynchronous operation running on this thread, if any.
+            inline const CancellationToken*& activeToken()
+            {
+                thread_local const CancellationToken* token = nullptr;
+                return token;
             }
 
-            path.push_back('.');
-            while(i < extension.size()) {
-                path.push_back(extension[i]);
-                i++;
+            inline bool isCancelled()
+            {
+                const CancellationToken* token = activeToken();
+                return token && token->cancelled();
             }
 
-            return path;
+            // Throws `operation_canceled` if the asynchronous operation running on this thread was cancelled.
+            inline void checkCancelled()
+            {
+                if(isCancelled()) {
+                    throw std::system_error(std::make_error_code(std::errc::operation_canceled), _private::errorMessage("checkCancelled", "Cancelled"));
+                }
+            }
         }
 
-        // Checks if a given path has a file extension.
-        inline bool hasFileExtension(const std::filesystem::path& path)
-        {
-            return !fileExtension(path).empty();
-        }
+        /*
+            Filesystem that the functions of `os::path` can be pointed at with `setBackend()`.
 
-        // Checks if a given string is a directory path. (E.g. `home/user/`) 
-        inline bool isDirectoryString(const std::filesystem::path& path)
-        {
-            return !path.empty() && path.filename().empty();
-        }
+            Notes:
+            - The native filesystem is not a `Backend`. It keeps its own code paths, and `copy()`, `move()` and
+              `remove()` on a backend are separate versions built on the members below. They support the plain
+              options only: links are followed, and preserving them or verifying a copy throws.
+            - Paths are handed over as they were given to the public functions.
+            - Failures are thrown as `std::filesystem::filesystem_error`, so the overloads taking
+              `std::error_code` can report their code.
+            - Implementations have to be safe to call from several threads.
+        */
+        class Backend {
+            public:
+                virtual ~Backend() = default;
 
-        // Checks if a given path is a directory.
-        inline bool isDirectory(const std::filesystem::path& path)
-        {
-            return std::filesystem::is_directory(path);
-        }
+                // Returns the type of a path, `not_found` if it does not exist.
+                virtual std::filesystem::file_type type(const std::filesystem::path& path) const = 0;
 
-        // Checks if a given path is a file.
-        inline bool isFile(const std::filesystem::path& path)
-        {
-            return std::filesystem::is_regular_file(path);
-        }
+                // Returns the size of a file.
+                virtual std::uintmax_t fileSize(const std::filesystem::path& path) const = 0;
 
-        // Returns the filename of a path.
-        inline std::string filename(const std::filesystem::path& path) 
-        {
-            return path.filename().empty() ? path.parent_path().filename().string() : path.filename().string();
-        }
+                // Returns the names and types of the entries in a directory, sorted by name.
+                virtual std::vector<std::pair<std::string, std::filesystem::file_type>> list(const std::filesystem::path& directory) const = 0;
+
+                // Returns the contents of a file.
+                virtual std::string read(const std::filesystem::path& path) const = 0;
+
+                // Creates or replaces a file. Its parent directory has to exist.
+                virtual void write(const std::filesystem::path& path, std::string data) = 0;
+
+                // Creates a directory and its missing parents. Returns `false` if it already existed.
+                virtual bool createDirectories(const std::filesystem::path& path) = 0;
+
+                // Removes a file or an empty directory. Returns `false` if it did not exist.
+                virtual bool remove(const std::filesystem::path& path) = 0;
+
+                // Moves a path within the backend, replacing a file or an empty directory at `to`.
+                virtual void rename(const std::filesystem::path& from, const std::filesystem::path& to) = 0;
+
+                // Copies a file, creating the parent directories of `to`.
+                virtual void copyFile(const std::filesystem::path& from, const std::filesystem::path& to)
+                {
+                    if(!to.parent_path().empty()) {
+                        createDirectories(to.parent_path());
+                    }
+                    write(to, read(from));
+                }
+
+                /*
+                    Removes a path with everything below it.
+
+                    Parameters:
+                    `path`: Path to remove.
+                    `keep_root`: Set to `true` to only remove what is inside a directory.
+                    `stats`: Gets the removed entries and file bytes added to it.
+                */
+                virtual void removeAll(const std::filesystem::path& path, bool keep_root, RemoveStats& stats)
+                {
+                    std::filesystem::file_type file_type = type(path);
+                    if(file_type == std::filesystem::file_type::directory) {
+                        for(const auto& entry : list(path)) {
+                            removeAll(path / entry.first, false, stats);
+                        }
+                    } else if(file_type == std::filesystem::file_type::regular) {
+                        stats.bytes += fileSize(path);
+                    }
+                    if(!keep_root && remove(path)) {
+                        stats.entries++;
+                    }
+                }
+        };
 
         /*
-            Returns the total size of a given path.
+            Backend that keeps a whole directory tree in memory.
 
-            Parameters:
-            `path`: Path to check size.
-            `metric`: What size metric to use.
+            Notes:
+            - Relative and absolute paths are resolved from the same root, so `a/b` and `/a/b` name the
+              same entry. `.` and `..` are resolved without looking at the tree.
+            - Copied files share their data until one of them is written again.
+            - Every call holds one mutex.
         */
-        inline double size(const std::filesystem::path& path, const SizeMetric& metric = SizeMetric::Byte)
-        {
-            if(std::filesystem::exists(path)) {
-                std::uintmax_t space = 0;
-                if(std::filesystem::is_directory(path)) {
-                    for(const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
-                        if(!std::filesystem::is_directory(entry.path())) {
-                            space += std::filesystem::file_size(entry.path());
+        class MemoryBackend : public Backend {
+            public:
+                std::filesystem::file_type type(const std::filesystem::path& path) const override
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    std::vector<std::string> parts = split(path);
+                    const Node* node = lookup(parts, parts.size());
+                    if(!node) {
+                        return std::filesystem::file_type::not_found;
+                    }
+                    return node->directory ? std::filesystem::file_type::directory : std::filesystem::file_type::regular;
+                }
+
+                std::uintmax_t fileSize(const std::filesystem::path& path) const override
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    return file(path).data->size();
+                }
+
+                std::vector<std::pair<std::string, std::filesystem::file_type>> list(const std::filesystem::path& directory) const override
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    std::vector<std::pair<std::string, std::filesystem::file_type>> entries;
+                    for(const auto& child : this->directory(directory, 0).children) {
+                        entries.emplace_back(child.first, child.second->directory ? std::filesystem::file_type::directory : std::filesystem::file_type::regular);
+                    }
+                    return entries;
+                }
+
+                std::string read(const std::filesystem::path& path) const override
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    return *file(path).data;
+                }
+
+                void write(const std::filesystem::path& path, std::string data) override
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    newFile(path, false).data = std::make_shared<const std::string>(std::move(data));
+                }
+
+                bool createDirectories(const std::filesystem::path& path) override
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    bool created = false;
+                    Node* node = root.get();
+                    for(const auto& part : split(path)) {
+                        std::unique_ptr<Node>& child = node->children[part];
+                        if(!child) {
+                            child = std::make_unique<Node>();
+                            child->directory = true;
+                            created = true;
+                        } else if(!child->directory) {
+                            _private::fail("MemoryBackend", path, std::errc::not_a_directory);
                         }
+                        node = child.get();
                     }
-                } else {
-                    space = std::filesystem::file_size(path);
+                    return created;
                 }
 
-                if(metric == SizeMetric::Kilobyte) {
-                    return (double)space / 1024;
-                } else if(metric == SizeMetric::Megabyte) {
-                    return (double)space / (1024*1024);
-                } else if(metric == SizeMetric::Gigabyte) {
-                    return (double)space / (1024*1024*1024);
-                } else {
-                    return (double)space;
+                bool remove(const std::filesystem::path& path) override
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    std::vector<std::string> parts = split(path);
+                    Node* parent = lookup(parts, parts.size() - std::min<std::size_t>(parts.size(), 1));
+                    if(parts.empty() || !parent || !parent->directory) {
+                        return false;
+                    }
+
+                    auto child = parent->children.find(parts.back());
+                    if(child == parent->children.end()) {
+                        return false;
+                    }
+                    if(!child->second->children.empty()) {
+                        _private::fail("MemoryBackend", path, std::errc::directory_not_empty);
+                    }
+                    parent->children.erase(child);
+                    return true;
                 }
-            } else {
-                return -1;
+
+                void rename(const std::filesystem::path& from, const std::filesystem::path& to) override
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    std::vector<std::string> source = split(from);
+                    std::vector<std::string> target = split(to);
+                    if(source.empty() || !lookup(source, source.size())) {
+                        _private::fail("MemoryBackend", from, std::errc::no_such_file_or_directory);
+                    }
+                    if(target.size() > source.size() && std::equal(source.begin(), source.end(), target.begin())) {
+                        _private::fail("MemoryBackend", to, std::errc::invalid_argument); // into itself
+                    }
+                    if(source == target) {
+                        return;
+                    }
+
+                    Node& to_parent = directory(to, 1);
+                    Node& from_parent = *lookup(source, source.size() - 1);
+                    auto existing = to_parent.children.find(target.back());
+                    if(existing != to_parent.children.end()) {
+                        bool from_directory = from_parent.children[source.back()]->directory;
+                        if(existing->second->directory && !from_directory) {
+                            _private::fail("MemoryBackend", to, std::errc::is_a_directory);
+                        } else if(!existing->second->directory && from_directory) {
+                            _private::fail("MemoryBackend", to, std::errc::not_a_directory);
+                        } else if(!existing->second->children.empty()) {
+                            _private::fail("MemoryBackend", to, std::errc::directory_not_empty);
+                        }
+                    }
+
+                    std::unique_ptr<Node> node = std::move(from_parent.children[source.back()]);
+                    from_parent.children.erase(source.back());
+                    to_parent.children[target.back()] = std::move(node);
+                }
+
+                void copyFile(const std::filesystem::path& from, const std::filesystem::path& to) override
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    std::shared_ptr<const std::string> data = file(from).data;
+                    newFile(to, true).data = data;
+                }
+
+                void removeAll(const std::filesystem::path& path, bool keep_root, RemoveStats& stats) override
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    std::vector<std::string> parts = split(path);
+                    Node* node = lookup(parts, parts.size());
+                    if(!node) {
+                        return;
+                    }
+
+                    if(keep_root || parts.empty()) {
+                        for(const auto& child : node->children) {
+                            count(*child.second, stats);
+                        }
+                        node->children.clear();
+                    } else {
+                        count(*node, stats);
+                        lookup(parts, parts.size() - 1)->children.erase(parts.back());
+                    }
+                }
+
+            private:
+                struct Node {
+                    bool directory = false;
+                    std::shared_ptr<const std::string> data = std::make_shared<const std::string>();
+                    std::map<std::string, std::unique_ptr<Node>> children;
+                };
+
+                mutable std::mutex mutex;
+                std::unique_ptr<Node> root = std::make_unique<Node>(Node {true, nullptr, {}});
+
+                // Splits a path into names, scanning the string rather than building a path per element.
+                static std::vector<std::string> split(const std::filesystem::path& path)
+                {
+                    std::string text = path.generic_string();
+                    std::size_t start = path.has_root_name() ? path.root_name().generic_string().size() : 0;
+                    std::vector<std::string> parts;
+                    parts.reserve(8);
+                    while(start < text.size()) {
+                        std::size_t end = std::min(text.find('/', start), text.size());
+                        std::string_view name(text.data() + start, end - start);
+                        if(name == "..") {
+                            if(!parts.empty()) {
+                                parts.pop_back();
+                            }
+                        } else if(!name.empty() && name != ".") {
+                            parts.emplace_back(name);
+                        }
+                        start = end + 1;
+                    }
+                    return parts;
+                }
+
+                // Returns the node of the first `count` parts, or `nullptr`.
+                Node* lookup(const std::vector<std::string>& parts, std::size_t count) const
+                {
+                    Node* node = root.get();
+                    for(std::size_t i = 0; i < count; i++) {
+                        auto child = node->children.find(parts[i]);
+                        if(child == node->children.end()) {
+                            return nullptr;
+                        }
+                        node = child->second.get();
+                    }
+                    return node;
+                }
+
+                // Returns the directory `path`, or its parent with `up` set to `1`.
+                Node& directory(const std::filesystem::path& path, std::size_t up) const
+                {
+                    std::vector<std::string> parts = split(path);
+                    if(parts.size() < up) {
+                        _private::fail("MemoryBackend", path, std::errc::invalid_argument);
+                    }
+                    Node* node = lookup(parts, parts.size() - up);
+                    if(!node) {
+                        _private::fail("MemoryBackend", path, std::errc::no_such_file_or_directory);
+                    }
+                    if(!node->directory) {
+                        _private::fail("MemoryBackend", path, std::errc::not_a_directory);
+                    }
+                    return *node;
+                }
+
+                const Node& file(const std::filesystem::path& path) const
+                {
+                    std::vector<std::string> parts = split(path);
+                    const Node* node = lookup(parts, parts.size());
+                    if(!node) {
+                        _private::fail("MemoryBackend", path, std::errc::no_such_file_or_directory);
+                    }
+                    if(node->directory) {
+                        _private::fail("MemoryBackend", path, std::errc::is_a_directory);
+                    }
+                    return *node;
+                }
+
+                // Returns the file at `path`, creating it, and its missing parent directories with `parents`.
+                Node& newFile(const std::filesystem::path& path, bool parents)
+                {
+                    std::vector<std::string> parts = split(path);
+                    if(parts.empty()) {
+                        _private::fail("MemoryBackend", path, std::errc::is_a_directory);
+                    }
+
+                    Node* parent = root.get();
+                    for(std::size_t i = 0; i + 1 < parts.size(); i++) {
+                        std::unique_ptr<Node>& child = parent->children[parts[i]];
+                        if(!child && parents) {
+                            child = std::make_unique<Node>();
+                            child->directory = true;
+                        } else if(!child) {
+                            parent->children.erase(parts[i]);
+                            _private::fail("MemoryBackend", path, std::errc::no_such_file_or_directory);
+                        } else if(!child->directory) {
+                            _private::fail("MemoryBackend", path, std::errc::not_a_directory);
+                        }
+                        parent = child.get();
+                    }
+
+                    std::unique_ptr<Node>& node = parent->children[parts.back()];
+                    if(!node) {
+                        node = std::make_unique<Node>();
+                    } else if(node->directory) {
+                        _private::fail("MemoryBackend", path, std::errc::is_a_directory);
+                    }
+                    return *node;
+                }
+
+                static void count(const Node& node, RemoveStats& stats)
+                {
+                    stats.entries++;
+                    if(!node.directory) {
+                        stats.bytes += node.data->size();
+                    }
+                    for(const auto& child : node.children) {
+                        count(*child.second, stats);
+                    }
+                }
+        };
+
+        namespace _private {
+            inline std::atomic<Backend*>& backendSlot()
+            {
+                static std::atomic<Backend*> backend {nullptr};
+                return backend;
             }
-        }
 
-        // Returns the preferred directory separator character of the operating system.
-        inline char directorySeparator() 
-        {
-            return std::filesystem::path::preferred_separator;
-        }
+            // Returns the backend set with `setBackend()`, or `nullptr` for the native filesystem.
+            inline Backend* activeBackend()
+            {
+                return backendSlot().load(std::memory_order_acquire);
+            }
 
-        // Returns the platform specific path string of the operating system.
-        inline std::string normalizePath(const std::filesystem::path& path)
-        {
-            std::string p = path.string();
-            
-            for(int i = 0; i < p.size(); i++) {
-                if(isDirectorySeparator(p[i], true)) {
-                    p[i] = directorySeparator();
+            // Runs an operation on a backend, reporting what it throws through `ec`.
+            template<typename Result, typename Operation>
+            Result onBackend(std::error_code& ec, Result failed, Operation&& operation) noexcept
+            {
+                ec.clear();
+                try {
+                    return operation();
+                } catch(...) {
+                    ec = _private::currentError();
+                    return failed;
                 }
             }
 
-            return p;
-        }
+            /*
+                Calls `visit` with the path relative to `directory` and the type of everything below it,
+                in sorted order, until it returns `false`.
 
-        // Returns the absolute path of a given path.
-        inline std::string absolutePath(const std::filesystem::path& path)
-        {
-            return std::filesystem::absolute(path).string();
+                Parameters:
+                `max_depth`: How deep to go, `-1` for no limit.
+            */
+            inline bool walk(const Backend& backend, const std::filesystem::path& directory, int max_depth,
+                             const std::function<bool(const std::filesystem::path&, std::filesystem::file_type)>& visit,
+                             const std::filesystem::path& relative = std::filesystem::path(), int depth = 0)
+            {
+                for(const auto& [name, type] : backend.list(directory / relative)) {
+                    std::filesystem::path path = relative / name;
+                    if(!visit(path, type)) {
+                        return false;
+                    }
+                    if(type == std::filesystem::file_type::directory && (max_depth < 0 || depth < max_depth) &&
+                       !walk(backend, directory, max_depth, visit, path, depth + 1)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            inline bool isEmptyOn(const Backend& backend, const std::filesystem::path& path)
+            {
+                std::filesystem::file_type type = backend.type(path);
+                if(type == std::filesystem::file_type::not_found) {
+                    _private::fail(_private::errorMessage("isEmpty", "\"" + path.string() + "\" does not exist"), path, std::errc::no_such_file_or_directory);
+                }
+                return type == std::filesystem::file_type::directory ? backend.list(path).empty() : backend.fileSize(path) == 0;
+            }
+
+            inline std::uintmax_t sizeOn(const Backend& backend, const std::filesystem::path& path)
+            {
+                std::filesystem::file_type type = backend.type(path);
+                if(type == std::filesystem::file_type::not_found) {
+                    _private::fail(_private::errorMessage("size", "\"" + path.string() + "\" does not exist"), path, std::errc::no_such_file_or_directory);
+                }
+                if(type != std::filesystem::file_type::directory) {
+                    return backend.fileSize(path);
+                }
+
+                std::uintmax_t space = 0;
+                walk(backend, path, -1, [&](const std::filesystem::path& relative, std::filesystem::file_type type) {
+                    if(type == std::filesystem::file_type::regular) {
+                        space += backend.fileSize(path / relative);
+                    }
+                    return true;
+                });
+                return space;
+            }
+
+            inline bool createFileOn(Backend& backend, const std::filesystem::path& path, const std::string* data, std::size_t count, bool lines,
+                                     const CopyOption& op)
+            {
+                if(op == CopyOption::SkipExisting) {
+                    return false;
+                }
+
+                if(op == CopyOption::None && backend.type(path) != std::filesystem::file_type::not_found) {
+                    char ch = _private::copyWarning(path.filename());
+                    if(ch != 'y' && ch != 'Y' && ch != 'a' && ch != 'A') {
+                        return false;
+                    }
+                }
+
+                std::string contents;
+                for(std::size_t i = 0; i < count; i++) {
+                    if(lines && i > 0) {
+                        contents += '\n';
+                    }
+                    contents += data[i];
+                }
+                backend.write(path, std::move(contents));
+                return true;
+            }
+
+            inline bool sameContentOn(const Backend& backend, const std::filesystem::path& p1, const std::filesystem::path& p2)
+            {
+                std::filesystem::file_type t1 = backend.type(p1);
+                std::filesystem::file_type t2 = backend.type(p2);
+                for(const auto& [path, type] : {std::make_pair(p1, t1), std::make_pair(p2, t2)}) {
+                    if(type == std::filesystem::file_type::not_found) {
+                        _private::fail(_private::errorMessage("hasSameContent", "\"" + path.string() + "\" does not exist"), path,
+                                       std::errc::no_such_file_or_directory);
+                    }
+                }
+                bool is_p1_dir = t1 == std::filesystem::file_type::directory;
+                if(is_p1_dir != (t2 == std::filesystem::file_type::directory)) {
+                    _private::fail(_private::errorMessage("hasSameContent", "Arguments need to be both files or both folders"), p1, std::errc::invalid_argument);
+                }
+
+                if(!is_p1_dir) {
+                    return backend.fileSize(p1) == backend.fileSize(p2) && backend.read(p1) == backend.read(p2);
+                }
+
+                std::vector<std::filesystem::path> paths[2];
+                for(int i = 0; i < 2; i++) {
+                    walk(backend, i == 0 ? p1 : p2, -1, [&](const std::filesystem::path& relative, std::filesystem::file_type) {
+                        paths[i].push_back(relative);
+                        return true;
+                    });
+                }
+                return paths[0] == paths[1];
+            }
         }
 
         /*
-            Returns the relative path from the base path.
+            Points the functions of `os::path` at another filesystem.
+
+            Return Value:
+            - Returns the backend used before, `nullptr` for the native filesystem.
 
             Parameters:
-            `path`: Path to get relative path.
-            `base_path`: Path where `path` will be relative to.
+            `backend`: Backend to use, `nullptr` for the native filesystem.
+
+            Notes:
+            - Followed by `exists()`, `isEmpty()`, `isDirectory()`, `isFile()`, `size()`, `createDirectory()`,
+              `createFile()`, `rename()`, `copy()`, `move()`, `remove()`, `find()`, `findAll()` and
+              `hasSameContent()`. Every other function keeps using the native filesystem.
+            - Applies to every thread. Only switch while no other thread is using `os::path`.
+            - The backend has to outlive its use. `Durability` and `WriteOption` do not apply to it.
+            - The native filesystem is not a backend itself, so what a backend supports is listed with `Backend`.
         */
-        inline std::string relativePath(const std::filesystem::path& path, const std::filesystem::path& base_path = std::filesystem::current_path())
+        inline Backend* setBackend(Backend* backend)
         {
-            return std::filesystem::relative(path, base_path).string();
+            return _private::backendSlot().exchange(backend, std::memory_order_acq_rel);
+        }
+
+        // Checks if a path exists.
+        inline bool exists(const std::filesystem::path& path)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                return backend->type(path) != std::filesystem::file_type::not_found;
+            }
+            os::_private::countMetric(os::_private::Counter::Stats);
+            return std::filesystem::exists(path);
         }
 
         /*
-            Returns the parent path of a given path.
+            Checks if a path exists.
 
             Parameters:
-            `path`: Path to get parent path.
-            `pop`: How many paths to move back.
+            `path`: Path to check.
+            `ec`: Gets the error if the path could not be checked. A missing path is not an error.
         */
-        inline std::string parentPath(std::filesystem::path path, int pop = 1)
+        inline bool exists(const std::filesystem::path& path, std::error_code& ec) noexcept
         {
-            for(int i = 1; i <= pop; i++) {
-                path = path.parent_path();
+            if(Backend* backend = _private::activeBackend()) {
+                return _private::onBackend(ec, false, [&]() { return backend->type(path) != std::filesystem::file_type::not_found; });
             }
+            os::_private::countMetric(os::_private::Counter::Stats);
+            return std::filesystem::exists(_private::statusOf(path, ec));
+        }
 
-            return path.string();
+        // Checks if a directory is empty.
+        inline bool isEmpty(const std::filesystem::path& path)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                return _private::isEmptyOn(*backend, path);
+            }
+            os::_private::countMetric(os::_private::Counter::Stats);
+            return std::filesystem::is_empty(path);
         }
 
         /*
-            Returns the concatenation of two paths.
+            Checks if a directory is empty.
 
-            Notes:
-            - Returned path is already normalized.
+            Parameters:
+            `path`: Directory to check.
+            `ec`: Gets the error if the path could not be checked.
         */
-        inline std::string joinPath(const std::filesystem::path& p1, const std::filesystem::path& p2)
+        inline bool isEmpty(const std::filesystem::path& path, std::error_code& ec) noexcept
         {
-            std::string result;
-            
-            if(p2.empty()) {
-                result = std::filesystem::weakly_canonical(p1).string();
-                bool exist = std::filesystem::exists(result);
-                if(exist && p1.filename().empty()) {
-                    result.push_back(directorySeparator());
-                } else if(!exist && (p1.filename() == "." || p1.filename() == "..")) {
-                    result.pop_back();
-                }
-                return result;
+            if(Backend* backend = _private::activeBackend()) {
+                return _private::onBackend(ec, false, [&]() { return _private::isEmptyOn(*backend, path); });
             }
-
-            result = std::filesystem::weakly_canonical(p1 / p2).string();
-            bool exist = std::filesystem::exists(result);
-            if(exist && p2.filename().empty()) {
-                result.push_back(directorySeparator());
-            } else if(!exist && (p2.filename() == "." || p2.filename() == "..")) {
-                result.pop_back();
+            try {
+                os::_private::countMetric(os::_private::Counter::Stats);
+                return std::filesystem::is_empty(path, ec);
+            } catch(...) {
+                ec = _private::currentError();
+                return false;
             }
-            return result;
         }
 
-        /*
-            Returns the concatenation of two or more paths.
-
-            Notes:
-            - Returned path is already normalized.
-        */
-        inline std::string joinPath(const std::vector<std::filesystem::path>& paths)
+        // Checks if a path is an absolute path.
+        inline bool isAbsolutePath(const std::filesystem::path& path)
         {
-            if(paths.empty()) {
-                return std::string();
-            } else if(paths.size() < 2) {
-                return joinPath(paths[0], "");
-            }
-
-            std::filesystem::path result = paths[0];
-            for(int i = 1; i < paths.size()-1; i++) {
-                result /= paths[i];
-            }
-            return joinPath(result, paths.back());
+            return path.is_absolute();
         }
 
-        // Returns the path you are in the command-line.
-        inline std::string currentPath() 
+        // Checks if a path is a relative path.
+        inline bool isRelativePath(const std::filesystem::path& path)
         {
-            return std::filesystem::current_path().string();
+            return path.is_relative();
         }
 
-        /*
-            Returns the path to the source or executable.
-
-            Parameters:
-            `parent_path`: When `true`, returns the path to the parent directory of the source. (Default `true`)
-        */
-        inline std::string sourcePath(bool parent_path = true) 
+        // Checks if a character is a valid filename character.
+        inline bool isValidFilenameChar(char ch) // checks if character passed is a valid character for filenames
         {
-            std::filesystem::path source_path;
+            switch(ch) {
             #if defined(_WIN32)
-                char path[MAX_PATH];
-                GetModuleFileName(NULL, path, MAX_PATH);
-                source_path = path;
-            #elif defined(__linux__) || defined(__apple__)
-                source_path = std::filesystem::canonical("/proc/self/exe");
+                case '<':
+                case '>':
+                case ':':
+                case '\"':
+                case '/':
+                case '\\':
+                case '|':
+                case '?':
+                case '*':
             #else
-                throw std::runtime_error(_private::errorMessage(__func__, "Unknown Operating System"));
+                case '/':
             #endif
+                    return false;
+                default:
+                    return true;
+            }
+        }
 
-            if(parent_path) {
-                return source_path.parent_path().string();
+        namespace _private {
+            // Bit flags for `filename_char_table`.
+            constexpr unsigned char posix_reserved = 1;
+            constexpr unsigned char windows_reserved = 2;
+
+            constexpr std::size_t max_filename_length = 255;
+
+            constexpr std::array<unsigned char, 256> makeFilenameCharTable()
+            {
+                std::array<unsigned char, 256> table {};
+                for(int i = 0; i < 32; i++) {
+                    table[i] |= windows_reserved;
+                }
+                for(unsigned char ch : {'<', '>', ':', '\"', '/', '\\', '|', '?', '*'}) {
+                    table[ch] |= windows_reserved;
+                }
+                table['/'] |= posix_reserved;
+                table['\0'] |= posix_reserved;
+                return table;
             }
 
-            return source_path.string();
-        }
+            // Lookup table of reserved filename characters, indexed by byte value.
+            constexpr std::array<unsigned char, 256> filename_char_table = makeFilenameCharTable();
 
-        // Returns the root name of the path.
-        inline std::string rootName(const std::filesystem::path& path)
-        {
-            return path.root_name().string();
-        }
+            inline unsigned char platformMask(const PlatformOption& platform)
+            {
+                if(platform == PlatformOption::Native) {
+                    #if defined(_WIN32)
+                        return windows_reserved;
+                    #else
+                        return posix_reserved;
+                    #endif
+                }
 
-        // Create directories leading to the given path if there is none.
-        inline bool createDirectory(const std::filesystem::path& path)
-        {
-            return std::filesystem::create_directories(path);
+                return platform == PlatformOption::Windows ? windows_reserved : posix_reserved;
+            }
+
+            // Returns the index of the first reserved character in `name`, or `name.size()` if there is none.
+            inline std::size_t findReservedChar(const std::string& name, unsigned char mask)
+            {
+                const char* data = name.data();
+                std::size_t n = name.size();
+                std::size_t i = 0;
+
+                #if defined(__SSE2__)
+                    const __m128i zero = _mm_setzero_si128();
+                    const __m128i slash = _mm_set1_epi8('/');
+                    const __m128i control = _mm_set1_epi8(31);
+                    for(; i + 16 <= n; i += 16) {
+                        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                        __m128i hits;
+                        if(mask == windows_reserved) {
+                            hits = _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk); // bytes 0-31
+                            for(char ch : {'<', '>', ':', '\"', '/', '\\', '|', '?', '*'}) {
+                                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(ch)));
+                            }
+                        } else {
+                            hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, zero), _mm_cmpeq_epi8(chunk, slash));
+                        }
+                        if(_mm_movemask_epi8(hits) != 0) {
+                            break; // let the scalar loop pinpoint the position
+                        }
+                    }
+                #else
+                    // Check a block at a time without branching on every byte
+                    for(; i + 16 <= n; i += 16) {
+                        unsigned char hits = 0;
+                        for(std::size_t j = 0; j < 16; j++) {
+                            hits |= filename_char_table[static_cast<unsigned char>(data[i+j])];
+                        }
+                        if(hits & mask) {
+                            break;
+                        }
+                    }
+                #endif
+
+                for(; i < n; i++) {
+                    if(filename_char_table[static_cast<unsigned char>(data[i])] & mask) {
+                        return i;
+                    }
+                }
+                return n;
+            }
+
+            // Checks if the part of `name` before the first `.` is a reserved Windows device name.
+            inline bool isReservedDeviceName(const std::string& name)
+            {
+                std::size_t stem_len = name.find('.');
+                if(stem_len == std::string::npos) {
+                    stem_len = name.size();
+                }
+                if(stem_len != 3 && stem_len != 4) {
+                    return false;
+                }
+
+                char stem[4];
+                for(std::size_t i = 0; i < stem_len; i++) {
+                    char ch = name[i];
+                    stem[i] = (ch >= 'a' && ch <= 'z') ? ch - ('a' - 'A') : ch;
+                }
+
+                auto is = [&](const char* reserved) {
+                    return stem[0] == reserved[0] && stem[1] == reserved[1] && stem[2] == reserved[2];
+                };
+
+                if(stem_len == 3) {
+                    return is("CON") || is("PRN") || is("AUX") || is("NUL");
+                }
+                return (is("COM") || is("LPT")) && stem[3] >= '0' && stem[3] <= '9';
+            }
         }
 
         /*
-            Creates a file in the given path.
+            Checks if a string is a valid filename.
 
             Parameters:
-            `path`: File to create.
-            `data`: Text to place in the file.
-            `op`: Copy option to use.
+            `name`: Filename to check. (Not a path)
+            `platform`: Which platform's filename rules to use. (Defaults `Native`)
+
+            Notes:
+            - Empty names, `.`, `..` and names longer than 255 bytes are invalid.
+            - On `Windows`, names ending with a space or a period and reserved device names are invalid.
         */
-        inline bool createFile(const std::filesystem::path& path, const std::string& data, const CopyOption& op = CopyOption::None)
+        inline bool validateFilename(const std::string& name, const PlatformOption& platform = PlatformOption::Native)
         {
-            if(op == CopyOption::SkipExisting) {
+            if(name.empty() || name.size() > _private::max_filename_length || name == "." || name == "..") {
                 return false;
             }
 
-            if(!std::filesystem::exists(path) || op == CopyOption::OverwriteExisting || op == CopyOption::OverwriteAll) {
-                std::ofstream file(path);
-                file << data;
-                file.close();
-                return true;
-            } else {
-                char ch = _private::copyWarning(path.filename());
-                if(ch == 'y' || ch == 'Y' || ch == 'a' || ch == 'A') {
-                    std::ofstream file(path);
-                    file << data;
-                    file.close();
-                    return true;
-                }
+            unsigned char mask = _private::platformMask(platform);
+            if(_private::findReservedChar(name, mask) != name.size()) {
                 return false;
             }
+
+            if(mask == _private::windows_reserved) {
+                if(name.back() == ' ' || name.back() == '.' || _private::isReservedDeviceName(name)) {
+                    return false;
+                }
+            }
+
+            return true;
         }
 
         /*
-            Creates a file in the given path.
+            Checks if each string in a list is a valid filename.
 
             Parameters:
-            `path`: File to create.
-            `data`: Text to place in the file.
-            `op`: Copy option to use.
+            `names`: Filenames to check.
+            `platform`: Which platform's filename rules to use. (Defaults `Native`)
         */
-        inline bool createFile(const std::filesystem::path& path, const std::vector<std::string>& data, const CopyOption& op = CopyOption::None)
+        inline std::vector<bool> validateFilename(const std::vector<std::string>& names, const PlatformOption& platform = PlatformOption::Native)
         {
-            if(op == CopyOption::SkipExisting) {
-                return false;
+            std::vector<bool> results(names.size());
+            for(std::size_t i = 0; i < names.size(); i++) {
+                results[i] = validateFilename(names[i], platform);
             }
+            return results;
+        }
 
-            if(!std::filesystem::exists(path) || op == CopyOption::OverwriteExisting || op == CopyOption::OverwriteAll) {
-                std::ofstream file(path);
-                for(int i = 0; i < data.size(); i++) {
-                    file << data[i];
-                    if(i < data.size()-1) {
-                        file << std::endl;
-                    }
+        /*
+            Returns a valid filename made from a given string.
+
+            Parameters:
+            `name`: Filename to sanitize. (Not a path)
+            `platform`: Which platform's filename rules to use. (Defaults `Native`)
+            `replacement`: Character to put in place of reserved characters. (Defaults `_`)
+
+            Notes:
+            - Reserved Windows device names get `replacement` appended to them. (E.g. `CON.txt` to `CON_.txt`)
+            - Names longer than 255 bytes are truncated without splitting UTF-8 characters.
+        */
+        inline std::string sanitizeFilename(std::string name, const PlatformOption& platform = PlatformOption::Native, char replacement = '_')
+        {
+            unsigned char mask = _private::platformMask(platform);
+            if(_private::filename_char_table[static_cast<unsigned char>(replacement)] & mask || replacement == '.' || replacement == ' ') {
+                replacement = '_';
+            }
+
+            if(name.empty() || name == "." || name == "..") {
+                return std::string(name.empty() ? 1 : name.size(), replacement);
+            }
+
+            for(std::size_t i = _private::findReservedChar(name, mask); i < name.size(); i++) {
+                if(_private::filename_char_table[static_cast<unsigned char>(name[i])] & mask) {
+                    name[i] = replacement;
                 }
-                file.close();
-                return true;
-            } else {
-                char ch = _private::copyWarning(path.filename());
-                if(ch == 'y' || ch == 'Y' || ch == 'a' || ch == 'A') {
-                    std::ofstream file(path);
-                    for(int i = 0; i < data.size(); i++) {
-                        file << data[i] << std::endl;
-                        if(i < data.size()-1) {
-                            file << std::endl;
-                        }
-                    }
-                    file.close();
-                    return true;
+            }
+
+            if(mask == _private::windows_reserved && _private::isReservedDeviceName(name)) {
+                std::size_t stem_len = name.find('.');
+                name.insert(stem_len == std::string::npos ? name.size() : stem_len, 1, replacement);
+            }
+
+            if(name.size() > _private::max_filename_length) {
+                std::size_t len = _private::max_filename_length;
+                while(len > 0 && (static_cast<unsigned char>(name[len]) & 0xC0) == 0x80) { // UTF-8 continuation byte
+                    len--;
+                }
+                name.resize(len);
+            }
+
+            if(mask == _private::windows_reserved) {
+                for(std::size_t i = name.size(); i > 0 && (name[i-1] == ' ' || name[i-1] == '.'); i--) {
+                    name[i-1] = replacement;
                 }
-                return false;
             }
+
+            return name;
         }
 
         /*
-            Creates a file in the given path.
+            Returns a valid filename for each string in a list.
 
             Parameters:
-            `path`: File to create.
-            `op`: Copy option to use.
+            `names`: Filenames to sanitize.
+            `platform`: Which platform's filename rules to use. (Defaults `Native`)
+            `replacement`: Character to put in place of reserved characters. (Defaults `_`)
         */
-        inline bool createFile(const std::filesystem::path& path, const CopyOption& op = CopyOption::None)
+        inline std::vector<std::string> sanitizeFilename(const std::vector<std::string>& names, const PlatformOption& platform = PlatformOption::Native,
+                                                         char replacement = '_')
         {
-            return createFile(path, "", op);
+            std::vector<std::string> results;
+            results.reserve(names.size());
+            for(const auto& name : names) {
+                results.push_back(sanitizeFilename(name, platform, replacement));
+            }
+            return results;
         }
 
         /*
-            Rename a given path.
+            Check if a character is a directory separator.
 
             Parameters:
-            `path`: Path to rename.
-            `new_name`: Name to give.
+            `ch`: Character to check.
+            `any_separator`: Set to `true` to detect separators of other operating systems.
         */
-        inline void rename(const std::filesystem::path& path, const std::string& new_name)
+        inline bool isDirectorySeparator(char ch, bool any_separator = false) 
         {
-            std::filesystem::rename(path, path.parent_path() / new_name);
+            char preferred = std::filesystem::path::preferred_separator;
+
+            if(any_separator) {
+                return ch == '/' || ch == '\\';
+            }
+
+            return ch == preferred;
+        }
+
+        // Returns the file extension of a given path.
+        inline std::string fileExtension(const std::filesystem::path& path)
+        {
+            std::string temp = path.filename().empty() ? path.parent_path().filename().string() : path.filename().string();
+            int i = temp.size()-1;
+            while(i > 0 && (temp[i] == ' ' || isDirectorySeparator(temp[i]))) {
+                i--;
+            }
+            while(i > 0 && temp[i] != '.' && !isDirectorySeparator(temp[i])) {
+                i--;
+            }
+
+            std::string result;
+            if(i >= 1 && i < temp.size()-1 && temp[i] == '.' && isValidFilenameChar(temp[i-1])) {
+                for(int j = i+1; j < temp.size() && isValidFilenameChar(temp[j]); j++) {
+                    result.push_back(temp[j]);
+                }
+            }
+            return result;
         }
 
         /*
-            Copy a path to another path.
+            Adds a file extension to a given path.
 
             Parameters:
-            `from`: Path to copy.
-            `to`: Path to copy to.
-            `traversal_option`: Traversal to use.
-            `copy_option`: Copy option to use. (Defaults `None`)
+            `path`: Path to add extension to.
+            `extension`: Extension to add.
+            `force`: Set to `true` to add extension even if the path already has one.
         */
-        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, const TraversalOption& traversal_option,
-                        const CopyOption& copy_option = CopyOption::None)
+        inline std::string appendFileExtension(std::string path, const std::string& extension, bool force = false)
+        {
+            int i = 0;
+            while(extension[i] == '.') {
+                i++;
+            }
+
+            int extension_len = extension.size() - i;
+            if(!force && path.size() > extension_len && path.substr(path.size()-extension_len) == extension.substr(i, extension_len)) {
+                return path;
+            }
+
+            path.push_back('.');
+            while(i < extension.size()) {
+                path.push_back(extension[i]);
+                i++;
+            }
+
+            return path;
+        }
+
+        // Checks if a given path has a file extension.
+        inline bool hasFileExtension(const std::filesystem::path& path)
+        {
+            return !fileExtension(path).empty();
+        }
+
+        // Checks if a given string is a directory path. (E.g. `home/user/`) 
+        inline bool isDirectoryString(const std::filesystem::path& path)
+        {
+            return !path.empty() && path.filename().empty();
+        }
+
+        // Checks if a given path is a directory.
+        inline bool isDirectory(const std::filesystem::path& path)
         {
-            return _private::copy(from, to, copy_option, traversal_option);
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                return backend->type(path) == std::filesystem::file_type::directory;
+            }
+            os::_private::countMetric(os::_private::Counter::Stats);
+            return std::filesystem::is_directory(path);
         }
 
         /*
-            Copy a path to another path.
+            Checks if a given path is a directory.
 
             Parameters:
-            `from`: Path to copy.
-            `to`: Path to copy to.
-            `copy_option`: Copy option to use.
-            `traversal_option`: Traversal to use. (Defaults `Recursive`)
+            `path`: Path to check.
+            `ec`: Gets the error if the path could not be checked. A missing path is not an error.
         */
-        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& copy_option,
-                         const TraversalOption& traversal_option = TraversalOption::Recursive)
+        inline bool isDirectory(const std::filesystem::path& path, std::error_code& ec) noexcept
         {
-            return _private::copy(from, to, copy_option, traversal_option);
+            if(Backend* backend = _private::activeBackend()) {
+                return _private::onBackend(ec, false, [&]() { return backend->type(path) == std::filesystem::file_type::directory; });
+            }
+            os::_private::countMetric(os::_private::Counter::Stats);
+            return std::filesystem::is_directory(_private::statusOf(path, ec));
         }
 
-        /*
-            Copy a path to another path.
+        // Checks if a given path is a file.
+        inline bool isFile(const std::filesystem::path& path)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                return backend->type(path) == std::filesystem::file_type::regular;
+            }
+            os::_private::countMetric(os::_private::Counter::Stats);
+            return std::filesystem::is_regular_file(path);
+        }
+
+        /*
+            Checks if a given path is a file.
+
+            Parameters:
+            `path`: Path to check.
+            `ec`: Gets the error if the path could not be checked. A missing path is not an error.
+        */
+        inline bool isFile(const std::filesystem::path& path, std::error_code& ec) noexcept
+        {
+            if(Backend* backend = _private::activeBackend()) {
+                return _private::onBackend(ec, false, [&]() { return backend->type(path) == std::filesystem::file_type::regular; });
+            }
+            os::_private::countMetric(os::_private::Counter::Stats);
+            return std::filesystem::is_regular_file(_private::statusOf(path, ec));
+        }
+
+        // Returns the filename of a path.
+        inline std::string filename(const std::filesystem::path& path) 
+        {
+            return path.filename().empty() ? path.parent_path().filename().string() : path.filename().string();
+        }
+
+        namespace _private {
+            // Converts a number of bytes to `metric`.
+            inline double sizeIn(std::uintmax_t space, const SizeMetric& metric)
+            {
+                if(metric == SizeMetric::Kilobyte) {
+                    return (double)space / 1024;
+                } else if(metric == SizeMetric::Megabyte) {
+                    return (double)space / (1024*1024);
+                } else if(metric == SizeMetric::Gigabyte) {
+                    return (double)space / (1024*1024*1024);
+                } else {
+                    return (double)space;
+                }
+            }
+        }
+
+        /*
+            Returns the total size of a given path.
+
+            Parameters:
+            `path`: Path to check size.
+            `metric`: What size metric to use.
+        */
+        inline double size(const std::filesystem::path& path, const SizeMetric& metric = SizeMetric::Byte)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                if(backend->type(path) == std::filesystem::file_type::not_found) {
+                    return -1;
+                }
+                return _private::sizeIn(_private::sizeOn(*backend, path), metric);
+            }
+            os::_private::countMetric(os::_private::Counter::Stats, 2);
+            if(std::filesystem::exists(path)) {
+                std::uintmax_t space = 0;
+                if(std::filesystem::is_directory(path)) {
+                    os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                    for(const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+                        _private::checkCancelled();
+                        if(!std::filesystem::is_directory(entry.path())) {
+                            space += std::filesystem::file_size(entry.path());
+                            os::_private::countMetric(os::_private::Counter::Stats, 2);
+                        } else {
+                            os::_private::countMetric(os::_private::Counter::Stats);
+                            os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                        }
+                    }
+                } else {
+                    space = std::filesystem::file_size(path);
+                    os::_private::countMetric(os::_private::Counter::Stats);
+                }
+
+                return _private::sizeIn(space, metric);
+            } else {
+                return -1;
+            }
+        }
+
+        /*
+            Returns the total size of a given path.
+
+            Return Value:
+            - Returns `-1` if the size could not be read.
+
+            Parameters:
+            `path`: Path to check size.
+            `metric`: What size metric to use.
+            `ec`: Gets the error, `no_such_file_or_directory` if the path does not exist.
+        */
+        inline double size(const std::filesystem::path& path, const SizeMetric& metric, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                std::uintmax_t space = _private::onBackend(ec, std::uintmax_t(0), [&]() { return _private::sizeOn(*backend, path); });
+                return ec ? -1 : _private::sizeIn(space, metric);
+            }
+
+            std::uintmax_t space = 0;
+            os::_private::countMetric(os::_private::Counter::Stats);
+            std::filesystem::file_status status = std::filesystem::status(path, ec);
+            if(ec) {
+                return -1;
+            }
+
+            if(std::filesystem::is_directory(status)) {
+                os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                std::filesystem::recursive_directory_iterator i(path, ec);
+                for(; !ec && i != std::filesystem::recursive_directory_iterator(); i.increment(ec)) {
+                    bool is_directory = i->is_directory(ec);
+                    os::_private::countMetric(os::_private::Counter::Stats);
+                    if(!ec && !is_directory) {
+                        space += i->file_size(ec);
+                        os::_private::countMetric(os::_private::Counter::Stats);
+                    } else if(!ec) {
+                        os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                    }
+                    if(ec) {
+                        break;
+                    }
+                }
+            } else {
+                space = std::filesystem::file_size(path, ec);
+                os::_private::countMetric(os::_private::Counter::Stats);
+            }
+            if(ec) {
+                return -1;
+            }
+
+            return _private::sizeIn(space, metric);
+        }
+
+        /*
+            Returns the total size of a given path in bytes.
+
+            Parameters:
+            `path`: Path to check size.
+            `ec`: Gets the error, `no_such_file_or_directory` if the path does not exist.
+        */
+        inline double size(const std::filesystem::path& path, std::error_code& ec) noexcept
+        {
+            return size(path, SizeMetric::Byte, ec);
+        }
+
+        // Returns the preferred directory separator character of the operating system.
+        inline char directorySeparator() 
+        {
+            return std::filesystem::path::preferred_separator;
+        }
+
+        // Returns the platform specific path string of the operating system.
+        inline std::string normalizePath(const std::filesystem::path& path)
+        {
+            std::string p = path.string();
+            
+            for(int i = 0; i < p.size(); i++) {
+                if(isDirectorySeparator(p[i], true)) {
+                    p[i] = directorySeparator();
+                }
+            }
+
+            return p;
+        }
+
+        // Returns the absolute path of a given path.
+        inline std::string absolutePath(const std::filesystem::path& path)
+        {
+            return std::filesystem::absolute(path).string();
+        }
+
+        // Returns the absolute path of a given path, or an empty string with `ec` set on failure.
+        inline std::string absolutePath(const std::filesystem::path& path, std::error_code& ec) noexcept
+        {
+            try {
+                std::filesystem::path absolute = std::filesystem::absolute(path, ec);
+                return ec ? std::string() : absolute.string();
+            } catch(...) {
+                ec = _private::currentError();
+                return std::string();
+            }
+        }
+
+        /*
+            Returns the relative path from the base path.
+
+            Parameters:
+            `path`: Path to get relative path.
+            `base_path`: Path where `path` will be relative to.
+        */
+        inline std::string relativePath(const std::filesystem::path& path, const std::filesystem::path& base_path = std::filesystem::current_path())
+        {
+            return std::filesystem::relative(path, base_path).string();
+        }
+
+        // Returns a path relative to `base_path`, or an empty string with `ec` set on failure.
+        inline std::string relativePath(const std::filesystem::path& path, const std::filesystem::path& base_path, std::error_code& ec) noexcept
+        {
+            try {
+                std::filesystem::path relative = std::filesystem::relative(path, base_path, ec);
+                return ec ? std::string() : relative.string();
+            } catch(...) {
+                ec = _private::currentError();
+                return std::string();
+            }
+        }
+
+        /*
+            Returns the parent path of a given path.
+
+            Parameters:
+            `path`: Path to get parent path.
+            `pop`: How many paths to move back.
+        */
+        inline std::string parentPath(std::filesystem::path path, int pop = 1)
+        {
+            for(int i = 1; i <= pop; i++) {
+                path = path.parent_path();
+            }
+
+            return path.string();
+        }
+
+        /*
+            Returns the concatenation of two paths.
+
+            Notes:
+            - Returned path is already normalized.
+        */
+        inline std::string joinPath(const std::filesystem::path& p1, const std::filesystem::path& p2)
+        {
+            std::string result;
+            
+            if(p2.empty()) {
+                result = std::filesystem::weakly_canonical(p1).string();
+                bool exist = std::filesystem::exists(result);
+                if(exist && p1.filename().empty()) {
+                    result.push_back(directorySeparator());
+                } else if(!exist && (p1.filename() == "." || p1.filename() == "..")) {
+                    result.pop_back();
+                }
+                return result;
+            }
+
+            result = std::filesystem::weakly_canonical(p1 / p2).string();
+            bool exist = std::filesystem::exists(result);
+            if(exist && p2.filename().empty()) {
+                result.push_back(directorySeparator());
+            } else if(!exist && (p2.filename() == "." || p2.filename() == "..")) {
+                result.pop_back();
+            }
+            return result;
+        }
+
+        /*
+            Returns the concatenation of two or more paths.
+
+            Notes:
+            - Returned path is already normalized.
+        */
+        inline std::string joinPath(const std::vector<std::filesystem::path>& paths)
+        {
+            if(paths.empty()) {
+                return std::string();
+            } else if(paths.size() < 2) {
+                return joinPath(paths[0], "");
+            }
+
+            std::filesystem::path result = paths[0];
+            for(int i = 1; i < paths.size()-1; i++) {
+                result /= paths[i];
+            }
+            return joinPath(result, paths.back());
+        }
+
+        // Returns the path you are in the command-line.
+        inline std::string currentPath() 
+        {
+            return std::filesystem::current_path().string();
+        }
+
+        // Returns the current working directory, or an empty string with `ec` set on failure.
+        inline std::string currentPath(std::error_code& ec) noexcept
+        {
+            try {
+                std::filesystem::path current = std::filesystem::current_path(ec);
+                return ec ? std::string() : current.string();
+            } catch(...) {
+                ec = _private::currentError();
+                return std::string();
+            }
+        }
+
+        /*
+            Returns the path to the source or executable.
+
+            Parameters:
+            `parent_path`: When `true`, returns the path to the parent directory of the source. (Default `true`)
+        */
+        inline std::string sourcePath(bool parent_path = true) 
+        {
+            std::filesystem::path source_path;
+            #if defined(_WIN32)
+                char path[MAX_PATH];
+                GetModuleFileName(NULL, path, MAX_PATH);
+                source_path = path;
+            #elif defined(__linux__) || defined(__apple__)
+                source_path = std::filesystem::canonical("/proc/self/exe");
+            #else
+                throw std::runtime_error(_private::errorMessage(__func__, "Unknown Operating System"));
+            #endif
+
+            if(parent_path) {
+                return source_path.parent_path().string();
+            }
+
+            return source_path.string();
+        }
+
+        // Returns the root name of the path.
+        inline std::string rootName(const std::filesystem::path& path)
+        {
+            return path.root_name().string();
+        }
+
+        // Create directories leading to the given path if there is none.
+        inline bool createDirectory(const std::filesystem::path& path)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                return backend->createDirectories(path);
+            }
+            return std::filesystem::create_directories(path);
+        }
+
+        // Create directories leading to the given path if there is none, setting `ec` on failure.
+        inline bool createDirectory(const std::filesystem::path& path, std::error_code& ec) noexcept
+        {
+            if(Backend* backend = _private::activeBackend()) {
+                return _private::onBackend(ec, false, [&]() { return backend->createDirectories(path); });
+            }
+            try {
+                return std::filesystem::create_directories(path, ec);
+            } catch(...) {
+                ec = _private::currentError();
+                return false;
+            }
+        }
+
+        /*
+            Creates a file in the given path.
+
+            Parameters:
+            `path`: File to create.
+            `data`: Text to place in the file.
+            `op`: Copy option to use.
+            `write_option`: How the file is written. (Defaults `Direct`)
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+        */
+        inline bool createFile(const std::filesystem::path& path, const std::string& data, const CopyOption& op = CopyOption::None,
+                               const WriteOption& write_option = WriteOption::Direct, const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                return _private::createFileOn(*backend, path, &data, 1, false, op);
+            }
+            if(op == CopyOption::SkipExisting) {
+                return false;
+            }
+
+            if(op == CopyOption::None && std::filesystem::exists(path)) {
+                char ch = _private::copyWarning(path.filename());
+                if(ch != 'y' && ch != 'Y' && ch != 'a' && ch != 'A') {
+                    return false;
+                }
+            }
+
+            return _private::writeFile(path, &data, 1, false, op == CopyOption::ReplaceAll ? WriteOption::Atomic : write_option, durability);
+        }
+
+        /*
+            Creates a file in the given path.
+
+            Parameters:
+            `path`: File to create.
+            `data`: Lines of text to place in the file.
+            `op`: Copy option to use.
+            `write_option`: How the file is written. (Defaults `Direct`)
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+
+            Notes:
+            - Lines are separated by `\n` with no trailing newline, and are written in large batches.
+        */
+        inline bool createFile(const std::filesystem::path& path, const std::vector<std::string>& data, const CopyOption& op = CopyOption::None,
+                               const WriteOption& write_option = WriteOption::Direct, const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                return _private::createFileOn(*backend, path, data.data(), data.size(), true, op);
+            }
+            if(op == CopyOption::SkipExisting) {
+                return false;
+            }
+
+            if(op == CopyOption::None && std::filesystem::exists(path)) {
+                char ch = _private::copyWarning(path.filename());
+                if(ch != 'y' && ch != 'Y' && ch != 'a' && ch != 'A') {
+                    return false;
+                }
+            }
+
+            return _private::writeFile(path, data.data(), data.size(), true, op == CopyOption::ReplaceAll ? WriteOption::Atomic : write_option, durability);
+        }
+
+        namespace _private {
+            // Shared body of the `createFile()` overloads that report through `std::error_code`.
+            inline bool createFile(const std::filesystem::path& path, const std::string* data, std::size_t count, bool lines, const CopyOption& op,
+                                   const WriteOption& write_option, const Durability& durability, std::error_code& ec) noexcept
+            {
+                if(Backend* backend = _private::activeBackend()) {
+                    return _private::onBackend(ec, false, [&]() { return _private::createFileOn(*backend, path, data, count, lines, op); });
+                }
+                ec.clear();
+                if(op == CopyOption::SkipExisting) {
+                    return false;
+                }
+
+                try {
+                    if(op == CopyOption::None && path::exists(path, ec)) {
+                        char ch = _private::copyWarning(path.filename());
+                        if(ch != 'y' && ch != 'Y' && ch != 'a' && ch != 'A') {
+                            return false;
+                        }
+                    }
+                    if(ec) {
+                        return false;
+                    }
+
+                    errno = 0;
+                    if(!_private::writeFile(path, data, count, lines, op == CopyOption::ReplaceAll ? WriteOption::Atomic : write_option, durability)) {
+                        ec = _private::lastError();
+                        return false;
+                    }
+                    return true;
+                } catch(...) {
+                    ec = _private::currentError();
+                    return false;
+                }
+            }
+        }
+
+        /*
+            Creates a file in the given path.
+
+            Parameters:
+            `path`: File to create.
+            `data`: Text to place in the file.
+            `op`: Copy option to use.
+            `write_option`: How the file is written.
+            `durability`: How much is flushed to disk before returning.
+            `ec`: Gets the error if the file could not be written.
+        */
+        inline bool createFile(const std::filesystem::path& path, const std::string& data, const CopyOption& op,
+                               const WriteOption& write_option, const Durability& durability, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::createFile(path, &data, 1, false, op, write_option, durability, ec);
+        }
+
+        /*
+            Creates a file in the given path.
+
+            Parameters:
+            `path`: File to create.
+            `data`: Text to place in the file.
+            `ec`: Gets the error if the file could not be written.
+        */
+        inline bool createFile(const std::filesystem::path& path, const std::string& data, std::error_code& ec) noexcept
+        {
+            return createFile(path, data, CopyOption::None, WriteOption::Direct, Durability::None, ec);
+        }
+
+        /*
+            Creates a file in the given path.
+
+            Parameters:
+            `path`: File to create.
+            `data`: Lines of text to place in the file.
+            `op`: Copy option to use.
+            `write_option`: How the file is written.
+            `durability`: How much is flushed to disk before returning.
+            `ec`: Gets the error if the file could not be written.
+        */
+        inline bool createFile(const std::filesystem::path& path, const std::vector<std::string>& data, const CopyOption& op,
+                               const WriteOption& write_option, const Durability& durability, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::createFile(path, data.data(), data.size(), true, op, write_option, durability, ec);
+        }
+
+        /*
+            Creates a file in the given path.
+
+            Parameters:
+            `path`: File to create.
+            `op`: Copy option to use.
+        */
+        inline bool createFile(const std::filesystem::path& path, const CopyOption& op = CopyOption::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return createFile(path, "", op);
+        }
+
+        namespace _private {
+            // Calls `function(i)` for every `i` below `count`, spread over `threads` workers. (`0` for one per hardware thread)
+            inline void parallelFor(std::size_t count, unsigned int threads, const std::function<void(std::size_t)>& function)
+            {
+                if(threads == 0) {
+                    threads = std::max(1u, std::thread::hardware_concurrency());
+                }
+                if(threads > count) {
+                    threads = static_cast<unsigned int>(count);
+                }
+
+                std::atomic<std::size_t> next {0};
+                auto work = [&]() {
+                    for(std::size_t i = next++; i < count; i = next++) {
+                        function(i);
+                    }
+                };
+
+                std::vector<std::thread> workers;
+                for(unsigned int i = 1; i < threads; i++) {
+                    workers.emplace_back(work);
+                }
+                work();
+                for(auto& worker : workers) {
+                    worker.join();
+                }
+            }
+
+            // Checks if a path stays inside the directory it is relative to.
+            inline bool isContainedPath(const std::filesystem::path& path)
+            {
+                if(path.empty() || path.has_root_path()) {
+                    return false;
+                }
+                for(const auto& part : path) {
+                    if(part == "..") {
+                        return false;
+                    }
+                }
+                return true;
+            }
+        }
+
+        /*
+            Creates many files and directories under a root directory.
+
+            Parameters:
+            `root`: Directory to create the entries in.
+            `entries`: Pairs of relative paths and file contents. Paths with a trailing separator
+                       are created as directories and their contents are ignored.
+            `op`: Copy option to use.
+            `threads`: Number of workers writing files. (`0` for one per hardware thread)
+
+            Notes:
+            - Every directory is created once, parents first, and files are written in parallel,
+              one directory at a time per worker.
+            - With `None`, the user is asked about existing files after every new file is written.
+            - With `ReplaceAll`, the files are written into a staging directory that is then swapped with `root`.
+        */
+        inline bool createFiles(const std::filesystem::path& root, const std::vector<std::pair<std::string, std::string>>& entries,
+                                const CopyOption& op = CopyOption::None, unsigned int threads = 0)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            std::set<std::string> directories;
+            std::map<std::string, std::vector<std::size_t>> files; // parent directory to entry indexes
+            for(std::size_t i = 0; i < entries.size(); i++) {
+                std::filesystem::path relative = std::filesystem::path(entries[i].first).lexically_normal();
+                if(!_private::isContainedPath(relative) || relative == ".") {
+                    throw std::runtime_error(_private::errorMessage(__func__, "\"" + entries[i].first + "\" is not a path inside the root"));
+                }
+
+                std::filesystem::path parent = relative.parent_path(); // the directory itself for directory strings
+                if(!isDirectoryString(relative)) {
+                    files[parent.string()].push_back(i);
+                }
+                for(; !parent.empty(); parent = parent.parent_path()) {
+                    if(!directories.insert(parent.string()).second) {
+                        break; // the rest of the ancestors are already there
+                    }
+                }
+            }
+
+            if(op == CopyOption::ReplaceAll) {
+                return _private::replaceDirectory(root, [&](const std::filesystem::path& staging) {
+                    return createFiles(staging, entries, CopyOption::OverwriteExisting, threads);
+                });
+            }
+
+            std::filesystem::create_directories(root);
+            if(op == CopyOption::OverwriteAll) {
+                RemoveStats stats;
+                _private::removeTree(root, true, stats);
+            }
+
+            bool ok = true;
+            #if defined(__linux__)
+                int root_fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if(root_fd < 0) {
+                    return false;
+                }
+
+                // Sorted order puts every directory after its parents
+                for(const auto& dir : directories) {
+                    if(mkdirat(root_fd, dir.c_str(), 0777) != 0 && errno != EEXIST) {
+                        close(root_fd);
+                        return false;
+                    }
+                }
+            #else
+                for(const auto& dir : directories) {
+                    std::error_code ec;
+                    std::filesystem::create_directory(root / dir, ec);
+                    if(ec) {
+                        return false;
+                    }
+                }
+            #endif
+
+            std::vector<const std::pair<const std::string, std::vector<std::size_t>>*> groups;
+            for(const auto& group : files) {
+                groups.push_back(&group);
+            }
+
+            std::mutex mutex;
+            std::vector<std::size_t> conflicts;
+            std::atomic<bool> failed {false};
+            bool overwrite = op == CopyOption::OverwriteExisting || op == CopyOption::OverwriteAll;
+
+            // Writes one file, returns `false` if it already exists and `replace` is not set.
+            auto write = [&](int dir_fd, const std::filesystem::path& dir, std::size_t index, bool replace) {
+                const auto& entry = entries[index];
+                std::filesystem::path name = std::filesystem::path(entry.first).lexically_normal().filename();
+                #if defined(__linux__)
+                    (void)dir; // files are opened relative to `dir_fd`
+                    int fd = openat(dir_fd, name.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (replace ? O_TRUNC : O_EXCL), 0666);
+                    if(fd < 0) {
+                        if(errno != EEXIST) {
+                            failed = true;
+                        }
+                        return errno != EEXIST;
+                    }
+                    iovec iov = {const_cast<char*>(entry.second.data()), entry.second.size()};
+                    if(!_private::writeAll(fd, &iov, 1) || close(fd) != 0) {
+                        failed = true;
+                    }
+                #else
+                    (void)dir_fd;
+                    std::filesystem::path file = root / dir / name;
+                    if(!replace && std::filesystem::exists(file)) {
+                        return false;
+                    }
+                    if(!_private::writeFile(file, &entry.second, 1, false, WriteOption::Direct, Durability::None)) {
+                        failed = true;
+                    }
+                #endif
+                return true;
+            };
+
+            _private::parallelFor(groups.size(), threads, [&](std::size_t g) {
+                const std::string& dir = groups[g]->first;
+                int dir_fd = -1;
+                #if defined(__linux__)
+                    dir_fd = dir.empty() ? root_fd : openat(root_fd, dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                    if(dir_fd < 0) {
+                        failed = true;
+                        return;
+                    }
+                #endif
+
+                for(std::size_t index : groups[g]->second) {
+                    if(!write(dir_fd, dir, index, overwrite) && op == CopyOption::None) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        conflicts.push_back(index);
+                    }
+                }
+
+                #if defined(__linux__)
+                    if(dir_fd != root_fd) {
+                        close(dir_fd);
+                    }
+                #endif
+            });
+
+            // Ask about existing files one at a time, in input order
+            std::sort(conflicts.begin(), conflicts.end());
+            char ch = 'n';
+            for(std::size_t index : conflicts) {
+                if(ch != 'a' && ch != 'A') {
+                    ch = _private::copyWarning(entries[index].first);
+                }
+                if(ch == 'x' || ch == 'X') {
+                    ok = false;
+                    break;
+                }
+                if(ch == 'y' || ch == 'Y' || ch == 'a' || ch == 'A') {
+                    std::filesystem::path relative = std::filesystem::path(entries[index].first).lexically_normal();
+                    int dir_fd = -1;
+                    #if defined(__linux__)
+                        dir_fd = relative.parent_path().empty() ? root_fd : openat(root_fd, relative.parent_path().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                    #endif
+                    write(dir_fd, relative.parent_path(), index, true);
+                    #if defined(__linux__)
+                        if(dir_fd != root_fd && dir_fd >= 0) {
+                            close(dir_fd);
+                        }
+                    #endif
+                }
+            }
+
+            #if defined(__linux__)
+                close(root_fd);
+            #endif
+            return ok && !failed;
+        }
+
+        /*
+            Creates files and directories under a root directory.
+
+            Parameters:
+            `root`: Directory to create everything in.
+            `entries`: Relative paths and the text to place in each file.
+            `op`: Copy option to use.
+            `threads`: Number of files written at once, `0` for one per hardware thread.
+            `ec`: Gets the error if an entry is not inside the root or could not be created.
+        */
+        inline bool createFiles(const std::filesystem::path& root, const std::vector<std::pair<std::string, std::string>>& entries,
+                                const CopyOption& op, unsigned int threads, std::error_code& ec) noexcept
+        {
+            ec.clear();
+            try {
+                if(!createFiles(root, entries, op, threads)) {
+                    if(op != CopyOption::None) { // with `None` the user may have cancelled
+                        ec = std::make_error_code(std::errc::io_error); // files are written on other threads, so `errno` is lost
+                    }
+                    return false;
+                }
+                return true;
+            } catch(...) {
+                ec = _private::currentError();
+                return false;
+            }
+        }
+
+        /*
+            Read-only view of a file mapped into memory.
+
+            Notes:
+            - The mapping is released when the object is destroyed. Pointers and views into it are
+              only valid until then.
+            - An empty file maps to an empty view with a null `data()`.
+        */
+        class MappedFile {
+            public:
+                MappedFile() = default;
+
+                /*
+                    Maps a file into memory.
+
+                    Parameters:
+                    `path`: File to map.
+                    `pattern`: How the file will be read. (Defaults `Sequential`)
+                */
+                explicit MappedFile(const std::filesystem::path& path, const AccessPattern& pattern = AccessPattern::Sequential)
+                {
+                    std::error_code ec;
+                    if(const char* failure = map(path, pattern, ec)) {
+                        throw std::runtime_error(_private::errorMessage(__func__, "\"" + path.string() + "\" " + failure));
+                    }
+                }
+
+                /*
+                    Maps a file into memory, without throwing.
+
+                    Parameters:
+                    `path`: File to map.
+                    `pattern`: How the file will be read.
+                    `ec`: Gets the error if the file could not be mapped. The object is then empty.
+                */
+                MappedFile(const std::filesystem::path& path, const AccessPattern& pattern, std::error_code& ec) noexcept
+                {
+                    map(path, pattern, ec);
+                }
+
+                MappedFile(const MappedFile&) = delete;
+                MappedFile& operator=(const MappedFile&) = delete;
+
+                MappedFile(MappedFile&& other) noexcept
+                {
+                    swap(other);
+                }
+
+                MappedFile& operator=(MappedFile&& other) noexcept
+                {
+                    if(this != &other) {
+                        release();
+                        swap(other);
+                    }
+                    return *this;
+                }
+
+                ~MappedFile()
+                {
+                    release();
+                }
+
+                const char* data() const { return address; }
+                std::size_t size() const { return length; }
+                bool empty() const { return length == 0; }
+                const char* begin() const { return address; }
+                const char* end() const { return address + length; }
+                std::string_view view() const { return std::string_view(address, length); }
+
+                /*
+                    Tells the kernel how the rest of the file will be read.
+
+                    Parameters:
+                    `pattern`: Expected access pattern.
+
+                    Notes:
+                    - Has no effect on Windows, where the pattern is only used when the file is opened.
+                */
+                void advise(const AccessPattern& pattern) const
+                {
+                    #if !defined(_WIN32)
+                        if(length == 0) {
+                            return;
+                        }
+
+                        int advice = MADV_NORMAL;
+                        if(pattern == AccessPattern::Sequential) {
+                            advice = MADV_SEQUENTIAL;
+                        } else if(pattern == AccessPattern::Random) {
+                            advice = MADV_RANDOM;
+                        }
+                        madvise(address, length, advice);
+                    #endif
+                }
+
+            private:
+                // Maps the file. Returns `nullptr`, or what failed with `ec` set.
+                const char* map(const std::filesystem::path& path, const AccessPattern& pattern, std::error_code& ec) noexcept
+                {
+                    ec.clear();
+                    #if defined(_WIN32)
+                        DWORD flags = FILE_ATTRIBUTE_NORMAL;
+                        if(pattern == AccessPattern::Sequential) {
+                            flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+                        } else if(pattern == AccessPattern::Random) {
+                            flags |= FILE_FLAG_RANDOM_ACCESS;
+                        }
+
+                        os::_private::countMetric(os::_private::Counter::Opens);
+                        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                                  nullptr, OPEN_EXISTING, flags, nullptr);
+                        LARGE_INTEGER file_size;
+                        if(file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size)) {
+                            ec = std::error_code(static_cast<int>(GetLastError()), std::system_category());
+                            if(file != INVALID_HANDLE_VALUE) {
+                                CloseHandle(file);
+                            }
+                            return "could not be opened";
+                        }
+
+                        length = static_cast<std::size_t>(file_size.QuadPart);
+                        if(length > 0) {
+                            mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                            address = mapping ? static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+                            if(!address) {
+                                ec = std::error_code(static_cast<int>(GetLastError()), std::system_category());
+                            }
+                        }
+                        CloseHandle(file);
+
+                        if(length > 0 && !address) {
+                            release();
+                            return "could not be mapped";
+                        }
+                    #else
+                        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                        os::_private::countMetric(os::_private::Counter::Opens);
+                        os::_private::countMetric(os::_private::Counter::Stats);
+                        struct stat st;
+                        if(fd < 0 || fstat(fd, &st) != 0) {
+                            ec = _private::lastError();
+                            if(fd >= 0) {
+                                close(fd);
+                            }
+                            return "could not be opened as a file";
+                        }
+                        if(!S_ISREG(st.st_mode)) {
+                            ec = std::make_error_code(S_ISDIR(st.st_mode) ? std::errc::is_a_directory : std::errc::invalid_argument);
+                            close(fd);
+                            return "could not be opened as a file";
+                        }
+
+                        length = static_cast<std::size_t>(st.st_size);
+                        if(length > 0) {
+                            void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                            address = mapped == MAP_FAILED ? nullptr : static_cast<char*>(mapped);
+                        }
+                        close(fd);
+
+                        if(length > 0 && !address) {
+                            ec = _private::lastError();
+                            length = 0;
+                            return "could not be mapped";
+                        }
+                        advise(pattern);
+                    #endif
+                    return nullptr;
+                }
+
+                void release()
+                {
+                    #if defined(_WIN32)
+                        if(address) {
+                            UnmapViewOfFile(address);
+                        }
+                        if(mapping) {
+                            CloseHandle(mapping);
+                        }
+                        mapping = nullptr;
+                    #else
+                        if(address) {
+                            munmap(address, length);
+                        }
+                    #endif
+                    address = nullptr;
+                    length = 0;
+                }
+
+                void swap(MappedFile& other) noexcept
+                {
+                    std::swap(address, other.address);
+                    std::swap(length, other.length);
+                    #if defined(_WIN32)
+                        std::swap(mapping, other.mapping);
+                    #endif
+                }
+
+                char* address = nullptr;
+                std::size_t length = 0;
+            #if defined(_WIN32)
+                HANDLE mapping = nullptr;
+            #endif
+        };
+
+        /*
+            Reads records separated by a delimiter out of a buffer without copying them.
+
+            Notes:
+            - With the `\n` delimiter, a `\r` before it is dropped so CRLF files read the same.
+            - A delimiter at the very end does not produce an empty last record.
+            - The records point into the buffer, which has to outlive them.
+        */
+        class RecordReader {
+            public:
+                class iterator {
+                    public:
+                        using iterator_category = std::input_iterator_tag;
+                        using value_type = std::string_view;
+                        using difference_type = std::ptrdiff_t;
+                        using pointer = const std::string_view*;
+                        using reference = const std::string_view&;
+
+                        iterator() = default;
+
+                        explicit iterator(RecordReader* reader) : reader(reader)
+                        {
+                            ++*this;
+                        }
+
+                        reference operator*() const { return record; }
+                        pointer operator->() const { return &record; }
+
+                        iterator& operator++()
+                        {
+                            if(reader && !reader->next(record)) {
+                                reader = nullptr;
+                            }
+                            return *this;
+                        }
+
+                        bool operator==(const iterator& other) const { return reader == other.reader; }
+                        bool operator!=(const iterator& other) const { return reader != other.reader; }
+
+                    private:
+                        RecordReader* reader = nullptr;
+                        std::string_view record;
+                };
+
+                /*
+                    Parameters:
+                    `data`: Buffer to read.
+                    `delimiter`: Character that ends each record. (Defaults `\n`)
+                */
+                explicit RecordReader(std::string_view data, char delimiter = '\n') : buffer(data), delimiter(delimiter) {}
+
+                /*
+                    Parameters:
+                    `file`: Mapped file to read.
+                    `delimiter`: Character that ends each record. (Defaults `\n`)
+                */
+                explicit RecordReader(const MappedFile& file, char delimiter = '\n') : RecordReader(file.view(), delimiter) {}
+
+                /*
+                    Gets the next record.
+
+                    Return Value:
+                    - Returns `false` once every record has been read.
+                */
+                bool next(std::string_view& record)
+                {
+                    if(position >= buffer.size()) {
+                        return false;
+                    }
+
+                    const char* start = buffer.data() + position;
+                    std::size_t remaining = buffer.size() - position;
+                    const char* found = static_cast<const char*>(std::memchr(start, delimiter, remaining));
+                    std::size_t length = found ? static_cast<std::size_t>(found - start) : remaining;
+                    position += length + 1;
+
+                    if(delimiter == '\n' && length > 0 && start[length - 1] == '\r') {
+                        length--;
+                    }
+                    record = std::string_view(start, length);
+                    return true;
+                }
+
+                // Starts over from the first record.
+                void reset() { position = 0; }
+
+                iterator begin() { return iterator(this); }
+                iterator end() { return iterator(); }
+
+            private:
+                std::string_view buffer;
+                char delimiter;
+                std::size_t position = 0;
+        };
+
+        /*
+            Maps a file into memory for reading.
+
+            Return Value:
+            - Returns a read-only view of the file.
+
+            Parameters:
+            `path`: File to map.
+            `pattern`: How the file will be read. (Defaults `Sequential`)
+
+            Notes:
+            - Throws `std::runtime_error` if the file cannot be opened or mapped.
+        */
+        inline MappedFile mapFile(const std::filesystem::path& path, const AccessPattern& pattern = AccessPattern::Sequential)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return MappedFile(path, pattern);
+        }
+
+        /*
+            Maps a file into memory for reading, without throwing.
+
+            Return Value:
+            - Returns a read-only view of the file, or an empty one if it could not be mapped.
+
+            Parameters:
+            `path`: File to map.
+            `pattern`: How the file will be read.
+            `ec`: Gets the error if the file could not be opened or mapped.
+        */
+        inline MappedFile mapFile(const std::filesystem::path& path, const AccessPattern& pattern, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return MappedFile(path, pattern, ec);
+        }
+
+        /*
+            Rename a given path.
+
+            Parameters:
+            `path`: Path to rename.
+            `new_name`: Name to give.
+        */
+        inline void rename(const std::filesystem::path& path, const std::string& new_name)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                backend->rename(path, path.parent_path() / new_name);
+                return;
+            }
+            std::filesystem::rename(path, path.parent_path() / new_name);
+        }
+
+        /*
+            Rename a given path.
+
+            Parameters:
+            `path`: Path to rename.
+            `new_name`: Name to give.
+            `ec`: Gets the error if the path could not be renamed.
+        */
+        inline void rename(const std::filesystem::path& path, const std::string& new_name, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                _private::onBackend(ec, false, [&]() { backend->rename(path, path.parent_path() / new_name); return true; });
+                return;
+            }
+            try {
+                std::filesystem::rename(path, path.parent_path() / new_name, ec);
+            } catch(...) {
+                ec = _private::currentError();
+            }
+        }
+
+        /*
+            Copy a path to another path.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+            `traversal_option`: Traversal to use.
+            `copy_option`: Copy option to use. (Defaults `None`)
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+        */
+        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, const TraversalOption& traversal_option,
+                        const CopyOption& copy_option = CopyOption::None, const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::copy(from, to, copy_option, traversal_option, durability);
+        }
+
+        /*
+            Copy a path to another path.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+            `copy_option`: Copy option to use.
+            `traversal_option`: Traversal to use. (Defaults `Recursive`)
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+        */
+        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& copy_option,
+                         const TraversalOption& traversal_option = TraversalOption::Recursive, const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::copy(from, to, copy_option, traversal_option, durability);
+        }
+
+        /*
+            Copy a path to another path.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+        */
+        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::copy(from, to, CopyOption::None, TraversalOption::Recursive);
+        }
+
+        /*
+            Copy a path to another path.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+            `paths_to_copy`: Selected paths in `from` to be copied.
+            `op`: Copy option to use.
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+
+            Notes:
+            - Selected paths are joined to `from` without resolving them, so a selected link is copied as a link.
+        */
+        inline bool copy(const std::filesystem::path& from, const std::set<std::string>& paths_to_copy, const std::filesystem::path& to, const CopyOption& op = CopyOption::None,
+                         const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::copy(from, paths_to_copy, to, op, durability);
+        }
+
+        namespace _private {
+            /*
+                Runs a copy or move that reports through `ec` instead of throwing.
+
+                Notes:
+                - The common failures, a missing source or a directory copied onto a file, are
+                  found up front so they never throw.
+            */
+            template<typename Operation>
+            bool transfer(const std::filesystem::path& from, const std::filesystem::path& to, std::error_code& ec, Operation&& operation) noexcept
+            {
+                if(_private::activeBackend()) {
+                    return _private::onBackend(ec, false, operation);
+                }
+                std::filesystem::file_status source = std::filesystem::status(from, ec);
+                if(ec) {
+                    return false;
+                }
+                std::filesystem::file_status destination = _private::statusOf(to, ec);
+                if(ec) {
+                    return false;
+                }
+                if(std::filesystem::is_directory(source) && std::filesystem::exists(destination) && !std::filesystem::is_directory(destination)) {
+                    ec = std::make_error_code(std::errc::not_a_directory);
+                    return false;
+                }
+
+                try {
+                    return operation();
+                } catch(...) {
+                    ec = _private::currentError();
+                    return false;
+                }
+            }
+        }
+
+        /*
+            Copy a path to another path.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+            `copy_option`: Copy option to use.
+            `traversal_option`: Traversal to use.
+            `durability`: How much is flushed to disk before returning.
+            `ec`: Gets the error, `no_such_file_or_directory` if `from` does not exist.
+        */
+        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& copy_option,
+                         const TraversalOption& traversal_option, const Durability& durability, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::transfer(from, to, ec, [&]() { return _private::copy(from, to, copy_option, traversal_option, durability); });
+        }
+
+        /*
+            Copy a path to another path.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+            `ec`: Gets the error, `no_such_file_or_directory` if `from` does not exist.
+        */
+        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, std::error_code& ec) noexcept
+        {
+            return copy(from, to, CopyOption::None, TraversalOption::Recursive, Durability::None, ec);
+        }
+
+        /*
+            Copy a path to another path.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+            `paths_to_copy`: Selected paths in `from` to be copied.
+            `op`: Copy option to use.
+            `durability`: How much is flushed to disk before returning.
+            `ec`: Gets the error, `no_such_file_or_directory` if `from` does not exist.
+        */
+        inline bool copy(const std::filesystem::path& from, const std::set<std::string>& paths_to_copy, const std::filesystem::path& to, const CopyOption& op,
+                         const Durability& durability, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::transfer(from, to, ec, [&]() { return _private::copy(from, paths_to_copy, to, op, durability); });
+        }
+
+        /*
+            Copy a path to another path, choosing how links are copied.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+            `op`: Copy option to use.
+            `links`: How symbolic and hard links are copied.
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+
+            Notes:
+            - With `LinkOption::Preserve`, links are never followed, so links that loop back into the
+              tree are copied as they are. Each inode with several links is read and written once.
+            - With `LinkOption::Preserve`, pipes, sockets and devices are skipped.
+            - `LinkOption::Preserve` is not supported on a `Backend` and throws there.
+        */
+        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& op, const LinkOption& links,
+                         const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(links == LinkOption::Follow) {
+                return _private::copy(from, to, op, TraversalOption::Recursive, durability);
+            } else if(_private::activeBackend()) {
+                throw std::runtime_error(_private::errorMessage(__func__, "Preserving links is not supported on a backend"));
+            }
+            return _private::copyLinks(from, to, op, durability);
+        }
+
+        /*
+            Copy a path to another path, choosing how links are copied.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+            `op`: Copy option to use.
+            `links`: How symbolic and hard links are copied.
+            `durability`: How much is flushed to disk before returning.
+            `ec`: Gets the error, `no_such_file_or_directory` if `from` does not exist.
+        */
+        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& op, const LinkOption& links,
+                         const Durability& durability, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::transfer(from, to, ec, [&]() { return path::copy(from, to, op, links, durability); });
+        }
+
+        /*
+            Copy a path to another path, checking each copied file and returning its digest.
+
+            Return Value:
+            - `false` if any file read back different from its source. Those files are listed in `digests.mismatched`.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+            `op`: Copy option to use.
+            `digests`: Gets the hash of every copied file, keyed by its source path.
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+            `verify`: How the copies are read back. (Defaults `Cache`)
+
+            Notes:
+            - Files are copied as usual, by the kernel where it can. Right after each file is copied, the source
+              and the copy are hashed through the descriptors the copy used, while their pages are still cached.
+            - With `VerifyOption::Device`, files are streamed through memory and hashed on the way, so the source is
+              read once. The copies are then read back with `O_DIRECT`, 128 at a time after their writeback was started together.
+            - The digests are the same 64-bit FNV-1a hashes as `hashAsync()` and `CompareOption::Hash`.
+            - Not supported on a `Backend`.
+        */
+        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& op, CopyDigests& digests,
+                         const Durability& durability = Durability::None, const VerifyOption& verify = VerifyOption::Cache)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(_private::activeBackend()) {
+                throw std::runtime_error(_private::errorMessage(__func__, "Verified copies are not supported on a backend"));
+            }
+            return _private::copyVerified(from, to, op, digests, durability, verify);
+        }
+
+        /*
+            Copy a path to another path, checking each copied file and returning its digest.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+            `op`: Copy option to use.
+            `digests`: Gets the hash of every copied file, keyed by its source path.
+            `durability`: How much is flushed to disk before returning.
+            `verify`: How the copies are read back.
+            `ec`: Gets the error, `no_such_file_or_directory` if `from` does not exist.
+        */
+        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& op, CopyDigests& digests,
+                         const Durability& durability, const VerifyOption& verify, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::transfer(from, to, ec, [&]() { return path::copy(from, to, op, digests, durability, verify); });
+        }
+
+        /*
+            Moves a path to another path.
+
+            Parameters:
+            `from`: Path to move.
+            `to`: Path to move to.
+            `traversal_option`: Traversal to use.
+            `copy_option`: Copy option to use. (Defaults `None`)
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+        */
+        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to, const TraversalOption& traversal_option,
+                        const CopyOption& copy_option = CopyOption::None, const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::move(from, to, copy_option, traversal_option, durability);
+        }
+
+        /*
+            Moves a path to another path.
+
+            Parameters:
+            `from`: Path to move.
+            `to`: Path to move to.
+            `copy_option`: Copy option to use.
+            `traversal_option`: Traversal to use. (Defaults `Recursive`)
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+        */
+        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& copy_option,
+                         const TraversalOption& traversal_option = TraversalOption::Recursive, const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::move(from, to, copy_option, traversal_option, durability);
+        }
+
+        /*
+            Moves a path to another path.
+
+            Parameters:
+            `from`: Path to move.
+            `to`: Path to move to.
+        */
+        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::move(from, to, CopyOption::None, TraversalOption::Recursive);
+        }
+
+        /*
+            Move a path to another path.
+
+            Parameters:
+            `from`: Path to Move.
+            `to`: Path to move to.
+            `paths_to_move`: Selected paths in `from` to be moved.
+            `op`: Copy option to use. (Defaults `None`)
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+
+            Notes:
+            - Selected links are moved as links, and only the paths that were copied are removed from `from`.
+        */
+        inline bool move(const std::filesystem::path& from, const std::set<std::string>& paths_to_move, const std::filesystem::path& to, const CopyOption& op = CopyOption::None,
+                         const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::move(from, paths_to_move, to, op, durability);
+        }
+
+        /*
+            Moves a path to another path.
+
+            Parameters:
+            `from`: Path to move.
+            `to`: Path to move to.
+            `copy_option`: Copy option to use.
+            `traversal_option`: Traversal to use.
+            `durability`: How much is flushed to disk before returning.
+            `ec`: Gets the error, `no_such_file_or_directory` if `from` does not exist.
+        */
+        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& copy_option,
+                         const TraversalOption& traversal_option, const Durability& durability, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::transfer(from, to, ec, [&]() { return _private::move(from, to, copy_option, traversal_option, durability); });
+        }
+
+        /*
+            Moves a path to another path.
+
+            Parameters:
+            `from`: Path to move.
+            `to`: Path to move to.
+            `ec`: Gets the error, `no_such_file_or_directory` if `from` does not exist.
+        */
+        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to, std::error_code& ec) noexcept
+        {
+            return move(from, to, CopyOption::None, TraversalOption::Recursive, Durability::None, ec);
+        }
+
+        /*
+            Move a path to another path.
+
+            Parameters:
+            `from`: Path to Move.
+            `to`: Path to move to.
+            `paths_to_move`: Selected paths in `from` to be moved.
+            `op`: Copy option to use.
+            `durability`: How much is flushed to disk before returning.
+            `ec`: Gets the error, `no_such_file_or_directory` if `from` does not exist.
+        */
+        inline bool move(const std::filesystem::path& from, const std::set<std::string>& paths_to_move, const std::filesystem::path& to, const CopyOption& op,
+                         const Durability& durability, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::transfer(from, to, ec, [&]() { return _private::move(from, paths_to_move, to, op, durability); });
+        }
+
+        namespace _private {
+            /*
+                Deletes a path if it exists, the way `remove()` does.
+
+                Parameters:
+                `threads`: Number of workers deleting directories. (`0` for one per hardware thread)
+                `on_entry`: Called before each entry is deleted. Deleting stops where it returns `false`.
+            */
+            inline bool removePath(const std::filesystem::path& path, RemoveStats& stats, unsigned int threads = 0,
+                                   const std::function<bool()>& on_entry = nullptr)
+            {
+                stats = RemoveStats();
+                if(Backend* backend = activeBackend()) {
+                    std::filesystem::file_type type = backend->type(path);
+                    if(type == std::filesystem::file_type::not_found) {
+                        return false;
+                    }
+                    backend->removeAll(path, isDirectoryString(path) && type == std::filesystem::file_type::directory, stats);
+                    return true;
+                }
+                if(!std::filesystem::exists(path)) {
+                    return false;
+                }
+
+                removeTree(path, isDirectoryString(path) && std::filesystem::is_directory(path), stats, threads, on_entry);
+                return true;
+            }
+        }
+
+        /*
+            Deletes a given path if it exists.
+
+            Parameters:
+            `path`: Path to delete.
+            `stats`: Gets the number of entries and bytes that were removed.
+
+            Notes:
+            - If the give path is a directory string (E.g. `home/user/`) then only the contents of
+              the path will be deleted.
+            - Directories are deleted in parallel, with up to one worker per hardware thread. Workers are only
+              started while directories are waiting to be deleted.
+        */
+        inline bool remove(const std::filesystem::path& path, RemoveStats& stats)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::removePath(path, stats);
+        }
+
+        /*
+            Deletes a given path if it exists.
+
+            Notes:
+            - If the give path is a directory string (E.g. `home/user/`) then only the contents of
+              the path will be deleted.
+        */
+        inline bool remove(const std::filesystem::path& path)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            RemoveStats stats;
+            return remove(path, stats);
+        }
+
+        /*
+            Deletes a given path if it exists.
+
+            Parameters:
+            `path`: Path to delete.
+            `stats`: Gets the number of entries and bytes that were removed.
+            `ec`: Gets the error if something could not be deleted. A missing path is not an error.
+        */
+        inline bool remove(const std::filesystem::path& path, RemoveStats& stats, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(_private::activeBackend()) {
+                return _private::onBackend(ec, false, [&]() { return remove(path, stats); });
+            }
+            stats = RemoveStats();
+            std::filesystem::file_status status = _private::statusOf(path, ec);
+            if(ec || !std::filesystem::exists(status)) {
+                return false;
+            }
+
+            try {
+                _private::removeTree(path, isDirectoryString(path) && std::filesystem::is_directory(status), stats);
+                return true;
+            } catch(...) {
+                ec = _private::currentError();
+                return false;
+            }
+        }
+
+        /*
+            Deletes a given path if it exists.
+
+            Parameters:
+            `path`: Path to delete.
+            `ec`: Gets the error if something could not be deleted. A missing path is not an error.
+        */
+        inline bool remove(const std::filesystem::path& path, std::error_code& ec) noexcept
+        {
+            RemoveStats stats;
+            return remove(path, stats, ec);
+        }
+
+        /*
+            Moves a path to another path, choosing how links are copied.
+
+            Parameters:
+            `from`: Path to move.
+            `to`: Path to move to.
+            `op`: Copy option to use.
+            `links`: How symbolic and hard links are copied.
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+
+            Notes:
+            - `LinkOption::Preserve` is not supported on a `Backend` and throws there.
+        */
+        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& op, const LinkOption& links,
+                         const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(!path::copy(from, to, op, links, durability)) {
+                return false;
+            }
+
+            path::remove(from);
+            return true;
+        }
+
+        /*
+            Moves a path to another path, choosing how links are copied.
+
+            Parameters:
+            `from`: Path to move.
+            `to`: Path to move to.
+            `op`: Copy option to use.
+            `links`: How symbolic and hard links are copied.
+            `durability`: How much is flushed to disk before returning.
+            `ec`: Gets the error, `no_such_file_or_directory` if `from` does not exist.
+        */
+        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& op, const LinkOption& links,
+                         const Durability& durability, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::transfer(from, to, ec, [&]() { return path::move(from, to, op, links, durability); });
+        }
+
+        namespace _private {
+            constexpr const char* trash_name = ".os_trash";
+
+            // Sets the disk priority of the calling thread.
+            inline bool setIOPriority(const IOPriority& priority)
+            {
+                #if defined(__linux__) && defined(SYS_ioprio_set)
+                    const int who_process = 1; // IOPRIO_WHO_PROCESS, with an id of 0 it targets the calling thread
+                    const int class_shift = 13;
+                    int value = 0; // IOPRIO_CLASS_NONE
+                    if(priority == IOPriority::Low) {
+                        value = (2 << class_shift) | 7; // IOPRIO_CLASS_BE at its lowest level
+                    } else if(priority == IOPriority::Idle) {
+                        value = 3 << class_shift; // IOPRIO_CLASS_IDLE
+                    }
+                    return syscall(SYS_ioprio_set, who_process, 0, value) == 0;
+                #else
+                    return priority == IOPriority::Normal;
+                #endif
+            }
+
+            // Returns a string that is unique across threads and processes. (E.g. `4242.1726000000000000000.7`)
+            inline std::string uniqueSuffix()
+            {
+                static std::atomic<std::uintmax_t> counter {0};
+                #if defined(_WIN32)
+                    unsigned long pid = GetCurrentProcessId();
+                #else
+                    long pid = getpid();
+                #endif
+                auto now = std::chrono::system_clock::now().time_since_epoch();
+                return std::to_string(pid) + '.' + std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count())
+                       + '.' + std::to_string(counter++);
+            }
+
+            // Returns a name for `path` that is unique inside a trash directory.
+            inline std::string trashEntryName(const std::filesystem::path& path)
+            {
+                return path::filename(path) + '.' + uniqueSuffix();
+            }
+
+            /*
+                Background thread that deletes what `removeDeferred()` moved into trash directories.
+
+                Anything left when the process exits stays in the trash and is picked up again the
+                next time that trash directory is used.
+            */
+            class Reaper {
+            public:
+                ~Reaper()
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        stopping = true;
+                    }
+                    cv.notify_all();
+                    if(worker.joinable()) {
+                        worker.join();
+                    }
+                }
+
+                void configure(std::uintmax_t entries_per_second, const IOPriority& io_priority)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    rate = entries_per_second;
+                    priority = io_priority;
+                    priority_changed = true;
+                }
+
+                // Queues the leftovers of a trash directory the first time it is seen, or every time with `rescan`.
+                void watch(const std::filesystem::path& trash, bool rescan = false)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if(!known.insert(trash.string()).second && !rescan) {
+                        return;
+                    }
+
+                    std::error_code ec;
+                    for(auto i = std::filesystem::directory_iterator(trash, ec); !ec && i != std::filesystem::directory_iterator(); i.increment(ec)) {
+                        if(i->path() != current && std::find(queue.begin(), queue.end(), i->path()) == queue.end()) {
+                            queue.push_back(i->path());
+                        }
+                    }
+                    start();
+                }
+
+                void push(const std::filesystem::path& path)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    queue.push_back(path);
+                    start();
+                }
+
+                void wait()
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    idle_cv.wait(lock, [this]() { return (queue.empty() && !busy) || stopping; });
+                }
+
+            private:
+                std::mutex mutex;
+                std::condition_variable cv;
+                std::condition_variable idle_cv;
+                std::deque<std::filesystem::path> queue;
+                std::set<std::string> known;
+                std::filesystem::path current; // entry being deleted
+                std::thread worker;
+                bool busy = false;
+                bool stopping = false;
+                std::uintmax_t rate = 0; // entries per second, `0` for no limit
+                IOPriority priority = IOPriority::Idle;
+                bool priority_changed = true;
+
+                void start()
+                {
+                    if(!worker.joinable()) {
+                        worker = std::thread(&Reaper::run, this);
+                    }
+                    cv.notify_all();
+                }
+
+                void run()
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while(true) {
+                        cv.wait(lock, [this]() { return !queue.empty() || stopping; });
+                        if(stopping) {
+                            return;
+                        }
+
+                        std::filesystem::path path = queue.front();
+                        queue.pop_front();
+                        current = path;
+                        busy = true;
+                        if(priority_changed) {
+                            setIOPriority(priority);
+                            priority_changed = false;
+                        }
+
+                        lock.unlock();
+                        reap(path);
+                        lock.lock();
+
+                        current.clear();
+                        busy = false;
+                        if(queue.empty()) {
+                            idle_cv.notify_all();
+                        }
+                    }
+                }
+
+                void reap(const std::filesystem::path& path)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    std::uintmax_t count = 0;
+                    auto on_entry = [&]() {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        if(rate > 0) {
+                            count++;
+                            auto due = start + std::chrono::nanoseconds(count * 1000000000 / rate);
+                            cv.wait_until(lock, due, [this]() { return stopping; });
+                        }
+                        return !stopping;
+                    };
+
+                    try {
+                        RemoveStats stats;
+                        removeTree(path, false, stats, 1, on_entry);
+                    } catch(const std::exception&) {
+                        // entries that cannot be removed stay in the trash
+                    }
+
+                    std::error_code ec;
+                    std::filesystem::remove(path.parent_path(), ec); // only succeeds once the trash is empty
+                }
+            };
+
+            inline Reaper& reaper()
+            {
+                static Reaper instance;
+                return instance;
+            }
+        }
+
+        /*
+            Deletes a path in the background.
+
+            Parameters:
+            `path`: Path to delete.
+
+            Notes:
+            - The path is renamed into a hidden `.os_trash` directory next to it and a background
+              thread deletes it from there, so the call returns right away.
+            - If the give path is a directory string (E.g. `home/user/`) then only the contents of
+              the path will be deleted.
+            - Falls back to `remove()` when the path cannot be renamed. (E.g. it is a mount point)
+        */
+        inline bool removeDeferred(const std::filesystem::path& path)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(!std::filesystem::exists(path)) {
+                return false;
+            }
+
+            bool contents_only = isDirectoryString(path) && std::filesystem::is_directory(path);
+            std::filesystem::path target = contents_only ? path.parent_path() : path;
+            std::filesystem::path trash = std::filesystem::absolute(target).lexically_normal();
+            if(trash.filename().empty()) {
+                trash = trash.parent_path();
+            }
+            trash = trash.parent_path() / _private::trash_name;
+            _private::Reaper& reaper = _private::reaper();
+
+            for(int attempt = 0; attempt < 3; attempt++) {
+                std::error_code ec;
+                std::filesystem::create_directory(trash, ec);
+                reaper.watch(trash);
+
+                std::filesystem::path entry = trash / _private::trashEntryName(target);
+                if(contents_only) {
+                    std::filesystem::create_directory(entry, ec);
+                    for(auto i = std::filesystem::directory_iterator(target, ec); !ec && i != std::filesystem::directory_iterator(); i.increment(ec)) {
+                        std::error_code moved;
+                        std::filesystem::rename(i->path(), entry / i->path().filename(), moved);
+                        if(moved) {
+                            ec = moved; // the rest is deleted right here
+                            break;
+                        }
+                    }
+                    if(ec && std::filesystem::exists(entry)) {
+                        reaper.push(entry);
+                        break; // delete whatever could not be moved right here
+                    }
+                } else {
+                    std::filesystem::rename(target, entry, ec);
+                }
+
+                if(!ec) {
+                    reaper.push(entry);
+                    return true;
+                }
+
+                if(ec != std::errc::no_such_file_or_directory) {
+                    break;
+                }
+            }
+
+            return path::remove(path);
+        }
+
+        /*
+            Deletes a path in the background, without throwing.
+
+            Parameters:
+            `path`: Path to delete.
+            `ec`: Gets the error if the path could not be moved aside or deleted. A missing path is not an error.
+        */
+        inline bool removeDeferred(const std::filesystem::path& path, std::error_code& ec) noexcept
+        {
+            if(!path::exists(path, ec)) {
+                return false;
+            }
+
+            try {
+                return removeDeferred(path);
+            } catch(...) {
+                ec = _private::currentError();
+                return false;
+            }
+        }
+
+        /*
+            Deletes what is left in the trash of a directory, E.g. after a crash.
+
+            Parameters:
+            `directory`: Directory that holds the `.os_trash` directory.
+        */
+        inline bool recoverDeferred(const std::filesystem::path& directory)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            std::filesystem::path trash = std::filesystem::absolute(directory).lexically_normal();
+            if(trash.filename().empty()) {
+                trash = trash.parent_path();
+            }
+            trash /= _private::trash_name;
+
+            if(!std::filesystem::is_directory(trash)) {
+                return false;
+            }
+
+            _private::reaper().watch(trash, true);
+            return true;
+        }
+
+        /*
+            Deletes leftovers of deferred removals under a directory, without throwing.
+
+            Parameters:
+            `directory`: Directory whose trash should be emptied.
+            `ec`: Gets the error if the trash could not be checked.
+        */
+        inline bool recoverDeferred(const std::filesystem::path& directory, std::error_code& ec) noexcept
+        {
+            ec.clear();
+            try {
+                return recoverDeferred(directory);
+            } catch(...) {
+                ec = _private::currentError();
+                return false;
+            }
+        }
+
+        // Blocks until every deferred removal is done.
+        inline void waitDeferred()
+        {
+            _private::reaper().wait();
+        }
+
+        /*
+            Sets how deferred removals run.
+
+            Parameters:
+            `entries_per_second`: Maximum entries deleted per second. (`0` for no limit)
+            `priority`: Disk priority of the background thread. (Defaults `Idle`)
+        */
+        inline void configureDeferred(std::uintmax_t entries_per_second, const IOPriority& priority = IOPriority::Idle)
+        {
+            _private::reaper().configure(entries_per_second, priority);
+        }
+
+        namespace _private {
+            /*
+                Checks if two files or directories have the same content, reporting failures through `ec`.
+
+                Parameters:
+                `failed`: Gets the path that could not be read, when `ec` is set.
+            */
+            inline bool sameContent(const std::filesystem::path& p1, const std::filesystem::path& p2, std::error_code& ec,
+                                    std::filesystem::path& failed)
+            {
+                failed = p1;
+                std::filesystem::file_status s1 = std::filesystem::status(p1, ec);
+                if(ec) {
+                    return false;
+                }
+                failed = p2;
+                std::filesystem::file_status s2 = std::filesystem::status(p2, ec);
+                if(ec) {
+                    return false;
+                }
+                os::_private::countMetric(os::_private::Counter::Stats, 2);
+
+                bool is_p1_dir = std::filesystem::is_directory(s1);
+                if(is_p1_dir != std::filesystem::is_directory(s2)) {
+                    ec = std::make_error_code(std::errc::invalid_argument);
+                    return false;
+                }
+
+                if(is_p1_dir) {
+                    failed = p1;
+                    std::filesystem::recursive_directory_iterator i(p1, ec), end;
+                    if(ec) {
+                        return false;
+                    }
+                    failed = p2;
+                    std::filesystem::recursive_directory_iterator j(p2, ec);
+                    std::error_code ignored;
+                    os::_private::countMetric(os::_private::Counter::DirectoriesWalked, 2);
+                    while(!ec && i != end && j != end) {
+                        if(i->path().lexically_relative(p1) != j->path().lexically_relative(p2)) {
+                            return false;
+                        }
+                        if(os::_private::metrics_enabled && i->is_directory(ignored)) {
+                            os::_private::countMetric(os::_private::Counter::DirectoriesWalked, 2);
+                        }
+                        failed = i->path();
+                        i.increment(ec);
+                        if(!ec) {
+                            failed = j->path();
+                            j.increment(ec);
+                        }
+                    }
+                    return !ec && i == end && j == end;
+                }
+
+                std::ifstream f1(p1, std::ifstream::binary|std::ifstream::ate);
+                std::ifstream f2(p2, std::ifstream::binary|std::ifstream::ate);
+                os::_private::countMetric(os::_private::Counter::Opens, 2);
+                if(f1.fail() || f2.fail()) {
+                    ec = _private::lastError();
+                    failed = f1.fail() ? p1 : p2;
+                    return false;
+                }
+                if(f1.tellg() != f2.tellg()) {
+                    return false;
+                }
+
+                f1.seekg(0, std::ifstream::beg);
+                f2.seekg(0, std::ifstream::beg);
+                bool same = std::equal(std::istreambuf_iterator<char>(f1.rdbuf()),
+                                       std::istreambuf_iterator<char>(),
+                                       std::istreambuf_iterator<char>(f2.rdbuf()));
+                if(os::_private::metrics_enabled) {
+                    os::_private::countMetric(os::_private::Counter::BytesRead, std::streamoff(f1.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::in)) +
+                                                                                 std::streamoff(f2.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::in)));
+                }
+                return same;
+            }
+        }
+
+        /*
+            Checks if two files or directories have the same content.
+
+            Notes:
+            - Both parameters need to point to either both a file or directory. Else it will throw an error.
+        */
+        inline bool hasSameContent(const std::filesystem::path& p1, const std::filesystem::path& p2)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                return _private::sameContentOn(*backend, p1, p2);
+            }
+            std::error_code ec;
+            std::filesystem::path failed;
+            bool same = _private::sameContent(p1, p2, ec, failed);
+            if(ec == std::errc::no_such_file_or_directory) {
+                throw std::runtime_error(_private::errorMessage(__func__, "\"" + failed.string() + "\" does not exist"));
+            }
+            if(ec == std::errc::invalid_argument) {
+                throw std::runtime_error(_private::errorMessage(__func__, "Arguments need to be both files or both folders"));
+            }
+            if(ec) {
+                throw std::filesystem::filesystem_error(_private::errorMessage(__func__, "Failed to read \"" + failed.string() + "\""), failed, ec);
+            }
+            return same;
+        }
+
+        /*
+            Checks if two directories have the same files or if two files have the same data, without throwing.
+
+            Parameters:
+            `p1`: First path.
+            `p2`: Second path.
+            `ec`: Gets the error, `no_such_file_or_directory` if a path does not exist and `invalid_argument`
+                  if one is a file and the other a directory.
+        */
+        inline bool hasSameContent(const std::filesystem::path& p1, const std::filesystem::path& p2, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                return _private::onBackend(ec, false, [&]() { return _private::sameContentOn(*backend, p1, p2); });
+            }
+            try {
+                std::filesystem::path failed;
+                return _private::sameContent(p1, p2, ec, failed);
+            } catch(...) {
+                ec = _private::currentError();
+                return false;
+            }
+        }
+        
+        namespace _private {
+            enum class EntryKind {File, Directory, Symlink, Other};
+
+            struct DiffEntry {
+                std::string name;
+                EntryKind kind = EntryKind::Other;
+                std::uintmax_t size = 0;
+                std::filesystem::file_time_type time;
+            };
+
+            // A directory to compare, present in the old tree, the new tree or both.
+            struct DiffTask {
+                std::filesystem::path path;
+                bool in_old = true;
+                bool in_new = true;
+            };
+
+            // What comparing one directory found.
+            struct DiffFound {
+                std::vector<std::string> added;
+                std::vector<std::string> removed;
+                std::vector<std::string> type_changed;
+                std::vector<std::string> modified;
+                std::vector<std::string> same_size; // files to compare by content
+                std::vector<DiffTask> next;
+                std::error_code ec;
+                std::filesystem::path failed;
+            };
+
+            // Lists a directory sorted by name. File sizes and last write times are only read when `sizes` and `times` are set.
+            inline std::vector<DiffEntry> listDirectory(const std::filesystem::path& directory, bool sizes, bool times, std::error_code& ec)
+            {
+                std::vector<DiffEntry> entries;
+                os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                for(std::filesystem::directory_iterator i(directory, ec), end; !ec && i != end; i.increment(ec)) {
+                    DiffEntry entry;
+                    entry.name = i->path().filename().string();
+
+                    // The entry caches the type read with the listing, so no stat is needed for it
+                    if(i->is_symlink(ec)) {
+                        entry.kind = EntryKind::Symlink;
+                    } else if(!ec && i->is_directory(ec)) {
+                        entry.kind = EntryKind::Directory;
+                    } else if(!ec && i->is_regular_file(ec)) {
+                        entry.kind = EntryKind::File;
+                        if(sizes) {
+                            entry.size = i->file_size(ec);
+                            if(times && !ec) {
+                                entry.time = i->last_write_time(ec);
+                            }
+                            os::_private::countMetric(os::_private::Counter::Stats);
+                        }
+                    }
+                    if(ec) {
+                        break;
+                    }
+                    entries.push_back(std::move(entry));
+                }
+
+                std::sort(entries.begin(), entries.end(), [](const DiffEntry& a, const DiffEntry& b) { return a.name < b.name; });
+                return entries;
+            }
+
+            // Merges the sorted listings of one directory in both trees.
+            inline void diffDirectory(const std::filesystem::path& old_root, const std::filesystem::path& new_root, const DiffTask& task,
+                                      const CompareOption& compare, DiffFound& found)
+            {
+                std::vector<DiffEntry> old_entries;
+                std::vector<DiffEntry> new_entries;
+                if(task.in_old) {
+                    old_entries = listDirectory(old_root / task.path, true, compare == CompareOption::Metadata, found.ec);
+                    if(found.ec) {
+                        found.failed = old_root / task.path;
+                        return;
+                    }
+                }
+                if(task.in_new) {
+                    new_entries = listDirectory(new_root / task.path, true, compare == CompareOption::Metadata, found.ec);
+                    if(found.ec) {
+                        found.failed = new_root / task.path;
+                        return;
+                    }
+                }
+
+                auto i = old_entries.begin();
+                auto j = new_entries.begin();
+                while(i != old_entries.end() || j != new_entries.end()) {
+                    if(j == new_entries.end() || (i != old_entries.end() && i->name < j->name)) {
+                        found.removed.push_back((task.path / i->name).string());
+                        i++;
+                        continue;
+                    }
+
+                    std::filesystem::path path = task.path / j->name;
+                    if(i == old_entries.end() || j->name < i->name) {
+                        found.added.push_back(path.string());
+                        if(j->kind == EntryKind::Directory) {
+                            found.next.push_back({path, false, true});
+                        }
+                        j++;
+                        continue;
+                    }
+
+                    if(i->kind != j->kind) {
+                        found.type_changed.push_back(path.string());
+                        if(j->kind == EntryKind::Directory) {
+                            found.next.push_back({path, false, true});
+                        }
+                    } else if(i->kind == EntryKind::Directory) {
+                        found.next.push_back({path, true, true});
+                    } else if(i->kind == EntryKind::Symlink) {
+                        std::error_code ignored;
+                        if(std::filesystem::read_symlink(old_root / path, ignored) != std::filesystem::read_symlink(new_root / path, ignored)) {
+                            found.modified.push_back(path.string());
+                        }
+                    } else if(i->kind == EntryKind::File) {
+                        if(i->size != j->size || (compare == CompareOption::Metadata && i->time != j->time)) {
+                            found.modified.push_back(path.string());
+                        } else if(compare != CompareOption::Metadata) {
+                            found.same_size.push_back(path.string());
+                        }
+                    }
+                    i++;
+                    j++;
+                }
+            }
+
+            constexpr std::uint64_t fnv_offset = 14695981039346656037ull;
+
+            // Adds bytes to a 64-bit FNV-1a hash.
+            inline std::uint64_t hashBytes(std::uint64_t hash, const char* data, std::size_t size)
+            {
+                for(std::size_t i = 0; i < size; i++) {
+                    hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+                }
+                return hash;
+            }
+
+            // Hashes the contents of a file with 64-bit FNV-1a. Not meant to hold up against deliberate collisions.
+            inline bool hashFile(const std::filesystem::path& path, std::uint64_t& hash)
+            {
+                std::ifstream file(path, std::ifstream::binary);
+                os::_private::countMetric(os::_private::Counter::Opens);
+                if(file.fail()) {
+                    return false;
+                }
+
+                std::vector<char> buffer(1 << 16);
+                std::uint64_t total = 0;
+                hash = fnv_offset;
+                while(file) {
+                    _private::checkCancelled();
+                    file.read(buffer.data(), buffer.size());
+                    std::streamsize count = file.gcount();
+                    hash = hashBytes(hash, buffer.data(), static_cast<std::size_t>(count));
+                    total += count;
+                }
+                os::_private::countMetric(os::_private::Counter::BytesRead, total);
+                return !file.bad();
+            }
+
+            // Compares two files block by block. Returns `false` if either cannot be read.
+            inline bool compareBytes(const std::filesystem::path& p1, const std::filesystem::path& p2, bool& same)
+            {
+                std::ifstream f1(p1, std::ifstream::binary);
+                std::ifstream f2(p2, std::ifstream::binary);
+                os::_private::countMetric(os::_private::Counter::Opens, 2);
+                if(f1.fail() || f2.fail()) {
+                    return false;
+                }
+
+                std::vector<char> b1(1 << 16);
+                std::vector<char> b2(1 << 16);
+                std::uint64_t total = 0;
+                same = true;
+                while(same && f1 && f2) {
+                    f1.read(b1.data(), b1.size());
+                    f2.read(b2.data(), b2.size());
+                    std::streamsize count = f1.gcount();
+                    same = count == f2.gcount() && std::memcmp(b1.data(), b2.data(), count) == 0;
+                    total += 2 * count;
+                }
+                os::_private::countMetric(os::_private::Counter::BytesRead, total);
+                return !f1.bad() && !f2.bad();
+            }
+
+            inline bool diffTrees(const std::filesystem::path& old_path, const std::filesystem::path& new_path, const CompareOption& compare,
+                                  unsigned int threads, TreeDiff& result, std::error_code& ec, std::filesystem::path& failed)
+            {
+                for(const auto& root : {old_path, new_path}) {
+                    std::filesystem::file_status status = std::filesystem::status(root, ec);
+                    os::_private::countMetric(os::_private::Counter::Stats);
+                    if(!ec && !std::filesystem::is_directory(status)) {
+                        ec = std::make_error_code(std::errc::not_a_directory);
+                    }
+                    if(ec) {
+                        failed = root;
+                        return false;
+                    }
+                }
+
+                // walk both trees one depth at a time, comparing the directories of a level in parallel
+                std::vector<std::string> same_size;
+                std::vector<DiffTask> level(1);
+                while(!level.empty()) {
+                    std::vector<DiffFound> found(level.size());
+                    parallelFor(level.size(), threads, [&](std::size_t i) {
+                        diffDirectory(old_path, new_path, level[i], compare, found[i]);
+                    });
+
+                    level.clear();
+                    for(auto& f : found) {
+                        if(f.ec) {
+                            ec = f.ec;
+                            failed = f.failed;
+                            return false;
+                        }
+                        result.added.insert(f.added.begin(), f.added.end());
+                        result.removed.insert(f.removed.begin(), f.removed.end());
+                        result.type_changed.insert(f.type_changed.begin(), f.type_changed.end());
+                        result.modified.insert(f.modified.begin(), f.modified.end());
+                        same_size.insert(same_size.end(), f.same_size.begin(), f.same_size.end());
+                        level.insert(level.end(), f.next.begin(), f.next.end());
+                    }
+                }
+
+                // files of the same size are only read if the option asks for it
+                std::vector<char> differs(same_size.size());
+                std::vector<char> unreadable(same_size.size());
+                parallelFor(same_size.size(), threads, [&](std::size_t i) {
+                    bool same = true;
+                    if(compare == CompareOption::Hash) {
+                        std::uint64_t h1 = 0;
+                        std::uint64_t h2 = 0;
+                        unreadable[i] = !hashFile(old_path / same_size[i], h1) || !hashFile(new_path / same_size[i], h2);
+                        same = h1 == h2;
+                    } else {
+                        unreadable[i] = !compareBytes(old_path / same_size[i], new_path / same_size[i], same);
+                    }
+                    differs[i] = !same;
+                });
+
+                for(std::size_t i = 0; i < same_size.size(); i++) {
+                    if(unreadable[i]) {
+                        ec = std::make_error_code(std::errc::io_error);
+                        failed = same_size[i];
+                        return false;
+                    }
+                    if(differs[i]) {
+                        result.modified.insert(same_size[i]);
+                    }
+                }
+                return true;
+            }
+        }
+
+        /*
+            Finds what changed between two directory trees.
+
+            Return Value:
+            - Paths relative to both roots that were added, removed, changed type or were modified.
+
+            Parameters:
+            `old_path`: Directory to compare from.
+            `new_path`: Directory to compare to.
+            `compare`: How files of the same name are compared. (Defaults `Metadata`)
+            `threads`: Number of threads used to walk and compare. (Defaults `0` for one per hardware thread)
+
+            Notes:
+            - Both trees are walked one depth at a time, and the sorted entries of each directory are merged.
+            - Symbolic links are not followed. They are modified when their targets differ.
+            - `changes()` of the result can be passed to `copy()` with `OverwriteExisting`, after the `removed` and
+              `type_changed` paths were removed from `old_path`, to make it match `new_path`.
+        */
+        inline TreeDiff diff(const std::filesystem::path& old_path, const std::filesystem::path& new_path, const CompareOption& compare = CompareOption::Metadata,
+                             unsigned int threads = 0)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            TreeDiff result;
+            std::error_code ec;
+            std::filesystem::path failed;
+            if(!_private::diffTrees(old_path, new_path, compare, threads, result, ec, failed)) {
+                if(ec == std::errc::no_such_file_or_directory) {
+                    throw std::runtime_error(_private::errorMessage(__func__, "\"" + failed.string() + "\" does not exist"));
+                }
+                if(ec == std::errc::not_a_directory) {
+                    throw std::runtime_error(_private::errorMessage(__func__, "\"" + failed.string() + "\" is not a directory"));
+                }
+                throw std::runtime_error(_private::errorMessage(__func__, "Failed to read \"" + failed.string() + "\": " + ec.message()));
+            }
+            return result;
+        }
+
+        /*
+            Finds what changed between two directory trees, without throwing.
+
+            Parameters:
+            `old_path`: Directory to compare from.
+            `new_path`: Directory to compare to.
+            `compare`: How files of the same name are compared.
+            `threads`: Number of threads used to walk and compare.
+            `ec`: Gets the error, `not_a_directory` if a path is not a directory.
+        */
+        inline TreeDiff diff(const std::filesystem::path& old_path, const std::filesystem::path& new_path, const CompareOption& compare,
+                             unsigned int threads, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            try {
+                TreeDiff result;
+                std::filesystem::path failed;
+                if(!_private::diffTrees(old_path, new_path, compare, threads, result, ec, failed)) {
+                    return TreeDiff();
+                }
+                return result;
+            } catch(...) {
+                ec = _private::currentError();
+                return TreeDiff();
+            }
+        }
+
+        /*
+            Watches a directory tree and reports what changed in it, in batches.
+
+            Notes:
+            - Built on inotify. New subdirectories are watched as they appear, and whatever was created
+              in them before their watch was added is found by listing them.
+            - Events are collected until none arrived for the given latency, or for at most ten times
+              as long during a steady stream of events. The paths touched are then compared with their
+              last known size, time, inode and type, so a file created and deleted within one batch is
+              not reported, and a file written many times is reported once.
+            - Batches are reported like `diff()` would between the tree before and after them. A directory
+              replaced by another one of the same name is reported in `type_changed`.
+            - When the kernel queue overflows, every watched directory is listed again and compared with
+              what was last known of it. No file contents are read.
+            - The callback runs on a thread owned by the watcher. It must not destroy the watcher.
+            - Changes still being collected when the watcher is destroyed are not reported.
+            - Watching stops once the root directory is removed or moved away.
+            - Only supported on Linux.
+        */
+        class Watcher {
+            public:
+                /*
+                    Starts watching a directory tree.
+
+                    Parameters:
+                    `root`: Directory to watch, with everything below it.
+                    `on_change`: Called with each batch of changes, as paths relative to `root`.
+                    `latency`: How long to wait for more events before a batch is reported. (Defaults `50ms`)
+
+                    Notes:
+                    - Throws `std::runtime_error` if `root` is not a directory or cannot be watched. Subdirectories
+                      that cannot be watched later on, for instance past `fs.inotify.max_user_watches`, are skipped.
+                */
+                Watcher(const std::filesystem::path& root, const std::function<void(const TreeDiff& changes)>& on_change,
+                        const std::chrono::milliseconds& latency = std::chrono::milliseconds(50))
+                    : root(root), on_change(on_change), latency(latency)
+                {
+                #if defined(__linux__)
+                    if(!std::filesystem::is_directory(root)) {
+                        throw std::runtime_error(_private::errorMessage(__func__, "\"" + root.string() + "\" is not a directory"));
+                    }
+
+                    inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+                    stop_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+                    if(inotify_fd < 0 || stop_fd < 0) {
+                        int error = errno;
+                        close();
+                        throw std::runtime_error(_private::errorMessage(__func__, std::string("Failed to start watching: ") + std::strerror(error)));
+                    }
+
+                    if(int error = addTree("", nullptr)) {
+                        close();
+                        throw std::runtime_error(_private::errorMessage(__func__, "Failed to watch \"" + root.string() + "\": " + std::strerror(error)));
+                    }
+                    worker = std::thread(&Watcher::run, this);
+                #else
+                    throw std::runtime_error(_private::errorMessage(__func__, "Not supported on this platform"));
+                #endif
+                }
+
+                Watcher(const Watcher&) = delete;
+                Watcher& operator=(const Watcher&) = delete;
+
+                ~Watcher()
+                {
+                #if defined(__linux__)
+                    if(worker.joinable()) {
+                        std::uint64_t one = 1;
+                        if(::write(stop_fd, &one, sizeof(one)) < 0) {
+                            // the counter cannot overflow from a single write
+                        }
+                        worker.join();
+                    }
+                    close();
+                #endif
+                }
+
+            private:
+                struct Entry {
+                    _private::EntryKind kind = _private::EntryKind::Other;
+                    std::int64_t size = 0;
+                    std::int64_t time = 0; // last write time in nanoseconds
+                    std::uint64_t inode = 0;
+                };
+
+                struct Directory {
+                    int wd = -1;
+                    std::map<std::string, Entry> entries;
+                };
+
+                std::filesystem::path root;
+                std::function<void(const TreeDiff&)> on_change;
+                std::chrono::milliseconds latency;
+                std::map<std::filesystem::path, Directory> directories; // by path relative to `root`
+                std::map<int, std::filesystem::path> watches;
+                std::map<std::filesystem::path, bool> pending; // paths touched, and whether they were written
+                std::thread worker;
+                int inotify_fd = -1;
+                int stop_fd = -1;
+
+            #if defined(__linux__)
+                static constexpr std::uint32_t watch_mask = IN_CREATE|IN_DELETE|IN_MODIFY|IN_CLOSE_WRITE|IN_ATTRIB|IN_MOVED_FROM|IN_MOVED_TO|
+                                                            IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR|IN_DONT_FOLLOW|IN_EXCL_UNLINK;
+
+                void close()
+                {
+                    if(inotify_fd >= 0) {
+                        ::close(inotify_fd);
+                        inotify_fd = -1;
+                    }
+                    if(stop_fd >= 0) {
+                        ::close(stop_fd);
+                        stop_fd = -1;
+                    }
+                }
+
+                static bool readEntry(const std::filesystem::path& path, Entry& entry)
+                {
+                    struct stat info;
+                    os::_private::countMetric(os::_private::Counter::Stats);
+                    if(lstat(path.c_str(), &info) != 0) {
+                        return false;
+                    }
+
+                    if(S_ISLNK(info.st_mode)) {
+                        entry.kind = _private::EntryKind::Symlink;
+                    } else if(S_ISDIR(info.st_mode)) {
+                        entry.kind = _private::EntryKind::Directory;
+                    } else if(S_ISREG(info.st_mode)) {
+                        entry.kind = _private::EntryKind::File;
+                    } else {
+                        entry.kind = _private::EntryKind::Other;
+                    }
+                    entry.size = info.st_size;
+                    entry.time = std::int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+                    entry.inode = info.st_ino;
+                    return true;
+                }
+
+                // Watches and lists a directory and everything below it. Returns `errno` if `relative` itself cannot be watched.
+                int addTree(const std::filesystem::path& relative, TreeDiff* changes)
+                {
+                    std::vector<std::filesystem::path> stack = {relative};
+                    while(!stack.empty()) {
+                        std::filesystem::path current = stack.back();
+                        stack.pop_back();
+
+                        int wd = inotify_add_watch(inotify_fd, (root / current).c_str(), watch_mask);
+                        if(wd < 0 || watches.count(wd)) { // already watched through another path, such as a bind mount
+                            if(current == relative && wd < 0) {
+                                return errno;
+                            }
+                            continue;
+                        }
+                        watches[wd] = current;
+                        Directory& directory = directories[current];
+                        directory.wd = wd;
+                        directory.entries.clear();
+
+                        // listed after the watch is added, so nothing created in between is missed
+                        std::error_code ec;
+                        os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                        for(std::filesystem::directory_iterator i(root / current, ec), end; !ec && i != end; i.increment(ec)) {
+                            std::string name = i->path().filename().string();
+                            Entry entry;
+                            if(!readEntry(i->path(), entry)) {
+                                continue;
+                            }
+                            directory.entries[name] = entry;
+                            if(changes) {
+                                changes->added.insert((current / name).string());
+                            }
+                            if(entry.kind == _private::EntryKind::Directory) {
+                                stack.push_back(current / name);
+                            }
+                        }
+                    }
+                    return 0;
+                }
+
+                // Stops watching a directory and everything below it.
+                void dropTree(const std::filesystem::path& relative)
+                {
+                    auto i = directories.lower_bound(relative);
+                    while(i != directories.end() && isBelow(i->first, relative)) {
+                        inotify_rm_watch(inotify_fd, i->second.wd);
+                        watches.erase(i->second.wd);
+                        i = directories.erase(i);
+                    }
+                }
+
+                static bool isBelow(const std::filesystem::path& path, const std::filesystem::path& directory)
+                {
+                    auto i = path.begin();
+                    for(const auto& part : directory) {
+                        if(i == path.end() || *i != part) {
+                            return false;
+                        }
+                        i++;
+                    }
+                    return true;
+                }
+
+                // Marks everything in every watched directory as touched, after events were lost.
+                void rescan()
+                {
+                    for(const auto& [relative, directory] : directories) {
+                        for(const auto& entry : directory.entries) {
+                            pending.emplace(relative / entry.first, false);
+                        }
+
+                        std::error_code ec;
+                        os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                        for(std::filesystem::directory_iterator i(root / relative, ec), end; !ec && i != end; i.increment(ec)) {
+                            pending.emplace(relative / i->path().filename(), false);
+                        }
+                    }
+                }
+
+                // Reads the queued events. Returns `false` once the root is gone.
+                bool readEvents()
+                {
+                    alignas(inotify_event) char buffer[64 * 1024];
+                    bool root_exists = true;
+                    while(true) {
+                        ssize_t count = ::read(inotify_fd, buffer, sizeof(buffer));
+                        if(count <= 0) {
+                            return root_exists;
+                        }
+
+                        for(char* i = buffer; i < buffer + count; ) {
+                            const inotify_event* event = reinterpret_cast<const inotify_event*>(i);
+                            i += sizeof(inotify_event) + event->len;
+
+                            if(event->mask & IN_Q_OVERFLOW) {
+                                rescan();
+                                continue;
+                            }
+                            auto watch = watches.find(event->wd);
+                            if(watch == watches.end()) {
+                                continue;
+                            }
+                            if(event->mask & (IN_DELETE_SELF|IN_MOVE_SELF|IN_IGNORED)) {
+                                if(watch->second.empty()) {
+                                    root_exists = false;
+                                }
+                                continue;
+                            }
+                            if(event->len == 0) {
+                                continue;
+                            }
+
+                            bool& written = pending[watch->second / event->name];
+                            written = written || (event->mask & (IN_MODIFY|IN_CLOSE_WRITE));
+                        }
+                    }
+                }
+
+                // Compares the touched paths with what was last known of them and reports the difference.
+                void flush()
+                {
+                    TreeDiff changes;
+                    std::vector<std::filesystem::path> dropped;
+                    std::vector<std::filesystem::path> added;
+                    std::vector<std::filesystem::path> replaced; // directories reported as a whole
+                    for(const auto& [path, written] : pending) {
+                        if(std::any_of(replaced.begin(), replaced.end(), [&](const auto& i) { return isBelow(path, i); })) {
+                            continue;
+                        }
+                        auto directory = directories.find(path.parent_path());
+                        if(directory == directories.end()) {
+                            continue;
+                        }
+
+                        auto& entries = directory->second.entries;
+                        auto before = entries.find(path.filename().string());
+                        Entry now;
+                        bool exists = readEntry(root / path, now);
+                        if(before == entries.end() && !exists) {
+                            continue;
+                        }
+
+                        bool was_directory = before != entries.end() && before->second.kind == _private::EntryKind::Directory;
+                        bool is_directory = exists && now.kind == _private::EntryKind::Directory;
+                        if(before == entries.end()) {
+                            changes.added.insert(path.string());
+                        } else if(!exists) {
+                            changes.removed.insert(path.string());
+                        } else if(before->second.kind != now.kind || (is_directory && before->second.inode != now.inode)) {
+                            changes.type_changed.insert(path.string());
+                        } else if(!is_directory && (written || before->second.size != now.size || before->second.time != now.time ||
+                                                     before->second.inode != now.inode)) {
+                            changes.modified.insert(path.string());
+                        }
+
+                        bool same_directory = was_directory && is_directory && before->second.inode == now.inode;
+                        if(was_directory && !same_directory) {
+                            dropped.push_back(path);
+                            replaced.push_back(path);
+                        }
+                        if(is_directory && !same_directory) {
+                            added.push_back(path);
+                            replaced.push_back(path);
+                        }
+                        if(exists) {
+                            entries[path.filename().string()] = now;
+                        } else {
+                            entries.erase(before);
+                        }
+                    }
+                    pending.clear();
+
+                    // dropped first, since a directory moved within the tree keeps its watch
+                    for(const auto& path : dropped) {
+                        dropTree(path);
+                    }
+                    for(const auto& path : added) {
+                        addTree(path, &changes);
+                    }
+
+                    if(!changes.empty()) {
+                        try {
+                            on_change(changes);
+                        } catch(...) {
+                            // an exception must not end the watch
+                        }
+                    }
+                }
+
+                void run()
+                {
+                    using clock = std::chrono::steady_clock;
+                    clock::time_point first;
+                    clock::time_point last;
+                    pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+                    while(true) {
+                        int timeout = -1;
+                        if(!pending.empty()) {
+                            clock::time_point due = std::min(last + latency, first + latency * 10);
+                            timeout = int(std::max<std::int64_t>(0, std::chrono::ceil<std::chrono::milliseconds>(due - clock::now()).count()));
+                        }
+
+                        int ready = poll(fds, 2, timeout);
+                        if((ready < 0 && errno != EINTR) || (ready > 0 && fds[1].revents)) {
+                            return;
+                        }
+                        if(ready > 0 && fds[0].revents) {
+                            bool was_empty = pending.empty();
+                            bool root_exists = readEvents();
+                            last = clock::now();
+                            if(was_empty) {
+                                first = last;
+                            }
+                            if(!root_exists) {
+                                flush();
+                                return;
+                            }
+                        }
+                        if(!pending.empty() && clock::now() >= std::min(last + latency, first + latency * 10)) {
+                            flush();
+                        }
+                    }
+                }
+            #endif
+        };
+
+        namespace _private {
+        #if defined(__linux__)
+            constexpr std::size_t tar_block = 512;
+            constexpr std::size_t tar_buffer = 1 << 20; // size of archive reads and writes, and of the largest file read whole
+
+            // Returns the number of zero bytes that fill `size` bytes up to a whole block.
+            inline std::size_t tarPadding(std::uint64_t size)
+            {
+                return static_cast<std::size_t>((tar_block - size % tar_block) % tar_block);
+            }
+
+            // Writes a header number as octal, or as GNU base-256 when it does not fit.
+            inline void writeTarNumber(char* field, std::size_t width, std::uint64_t value)
+            {
+                if(value < (std::uint64_t(1) << (3 * (width - 1)))) {
+                    field[width - 1] = '\0';
+                    for(std::size_t i = width - 1; i-- > 0; value >>= 3) {
+                        field[i] = static_cast<char>('0' + (value & 7));
+                    }
+                } else {
+                    for(std::size_t i = width - 1; i > 0; i--, value >>= 8) {
+                        field[i] = static_cast<char>(value & 0xff);
+                    }
+                    field[0] = static_cast<char>(0x80);
+                }
+            }
+
+            // Reads an octal or GNU base-256 header number.
+            inline std::uint64_t readTarNumber(const char* field, std::size_t width)
+            {
+                std::uint64_t value = 0;
+                if(static_cast<unsigned char>(field[0]) & 0x80) {
+                    for(std::size_t i = 1; i < width; i++) {
+                        value = value << 8 | static_cast<unsigned char>(field[i]);
+                    }
+                    return value;
+                }
+
+                std::size_t i = 0;
+                while(i < width && field[i] == ' ') {
+                    i++;
+                }
+                for(; i < width && field[i] >= '0' && field[i] <= '7'; i++) {
+                    value = value << 3 | static_cast<std::uint64_t>(field[i] - '0');
+                }
+                return value;
+            }
+
+            // Returns a header text field up to its first null.
+            inline std::string readTarString(const char* field, std::size_t width)
+            {
+                return std::string(field, strnlen(field, width));
+            }
+
+            // Returns the checksum of a header block, counting its checksum field as spaces.
+            inline std::uint64_t tarChecksum(const char* header)
+            {
+                std::uint64_t sum = 0;
+                for(std::size_t i = 0; i < tar_block; i++) {
+                    sum += (i >= 148 && i < 156) ? ' ' : static_cast<unsigned char>(header[i]);
+                }
+                return sum;
+            }
+
+            /*
+                Appends the GNU tar header of one entry.
+
+                Parameters:
+                `out`: Archive data to append to.
+                `name`: Path of the entry in the archive.
+                `type`: Type flag, like `'0'` for a file or `'5'` for a directory.
+                `size`: Number of data bytes following the header.
+                `info`: Permissions, owner and last write time of the entry, `nullptr` for extension blocks.
+                `link`: Target of a link.
+
+                Notes:
+                - Names and link targets longer than 100 characters are put in GNU long name blocks before the header.
+            */
+            inline void tarHeader(std::string& out, const std::string& name, char type, std::uint64_t size, const struct stat* info,
+                                  const std::string& link = "")
+            {
+                if(name.size() > 100) {
+                    tarHeader(out, "././@LongLink", 'L', name.size() + 1, nullptr);
+                    out.append(name);
+                    out.append(tarPadding(name.size() + 1) + 1, '\0');
+                }
+                if(link.size() > 100) {
+                    tarHeader(out, "././@LongLink", 'K', link.size() + 1, nullptr);
+                    out.append(link);
+                    out.append(tarPadding(link.size() + 1) + 1, '\0');
+                }
+
+                char header[tar_block] = {};
+                std::memcpy(header, name.data(), std::min<std::size_t>(name.size(), 100));
+                writeTarNumber(header + 100, 8, info ? info->st_mode & 07777 : 0644);
+                writeTarNumber(header + 108, 8, info ? info->st_uid : 0);
+                writeTarNumber(header + 116, 8, info ? info->st_gid : 0);
+                writeTarNumber(header + 124, 12, size);
+                writeTarNumber(header + 136, 12, info && info->st_mtime > 0 ? info->st_mtime : 0);
+                header[156] = type;
+                std::memcpy(header + 157, link.data(), std::min<std::size_t>(link.size(), 100));
+                std::memcpy(header + 257, "ustar  ", 8); // GNU magic and version
+                writeTarNumber(header + 148, 7, tarChecksum(header));
+                header[155] = ' ';
+                out.append(header, tar_block);
+            }
+
+            /*
+                Read-ahead stage of `pack()`.
+
+                A walker thread lists the tree in sorted order, each directory before its contents, and
+                reader threads stat and read the listed entries in parallel. At most `window` entries and
+                `max_buffered` bytes of file contents are kept ahead of the archive writer. Files larger
+                than `tar_buffer` are only opened, the writer streams them.
+            */
+            class PackReader {
+                public:
+                    struct Entry {
+                        std::string name; // inside the archive
+                        std::string path; // on disk
+                        EntryKind kind = EntryKind::Other;
+                        bool ready = false;
+                        bool failed = false;
+                        int fd = -1; // open large file, for the writer to stream and close
+                        struct stat info {};
+                        std::string data; // contents of a small file or target of a link
+                    };
+
+                    /*
+                        Starts reading.
+
+                        Parameters:
+                        `source`: Path of the first entry.
+                        `name`: Name of the first entry in the archive. Only the contents of a directory are read when empty.
+                        `kind`: Type of the first entry.
+                        `archive`: The archive being written, which is left out if it is inside the tree.
+                        `threads`: Number of reader threads. (`0` for one per hardware thread)
+                    */
+                    PackReader(const std::string& source, const std::string& name, const EntryKind& kind, const struct stat& archive, unsigned int threads)
+                        : archive(archive)
+                    {
+                        if(threads == 0) {
+                            threads = std::max(1u, std::thread::hardware_concurrency());
+                        }
+                        walker = std::thread([this, source, name, kind]() {
+                            if(!name.empty()) {
+                                Entry entry;
+                                entry.name = name;
+                                entry.path = source;
+                                entry.kind = kind;
+                                add(std::move(entry));
+                            }
+                            if(kind == EntryKind::Directory) {
+                                walk(source, name.empty() ? name : name + '/');
+                            }
+
+                            std::lock_guard<std::mutex> lock(mutex);
+                            walked = true;
+                            changed.notify_all();
+                        });
+                        for(unsigned int i = 0; i < threads; i++) {
+                            readers.emplace_back(&PackReader::read, this);
+                        }
+                    }
+
+                    PackReader(const PackReader&) = delete;
+                    PackReader& operator=(const PackReader&) = delete;
+
+                    ~PackReader()
+                    {
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            stopping = true;
+                            changed.notify_all();
+                        }
+                        walker.join();
+                        for(auto& reader : readers) {
+                            reader.join();
+                        }
+                        for(const auto& entry : entries) {
+                            if(entry.fd >= 0) {
+                                close(entry.fd);
+                            }
+                        }
+                    }
+
+                    // Waits for the next entry in archive order. Returns `nullptr` after the last one.
+                    Entry* next()
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        changed.wait(lock, [&]() { return entries.empty() ? walked : entries.front().ready; });
+                        return entries.empty() ? nullptr : &entries.front();
+                    }
+
+                    // Drops the entry returned by `next()`, making room for more to be read.
+                    void release()
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        buffered -= entries.front().data.size();
+                        entries.pop_front();
+                        first++;
+                        changed.notify_all();
+                    }
+
+                    // Checks if a directory could not be listed.
+                    bool failed()
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        return walk_failed;
+                    }
+
+                private:
+                    static constexpr std::size_t window = 4096;
+                    static constexpr std::size_t max_buffered = 64 * tar_buffer;
+
+                    struct stat archive;
+                    std::mutex mutex;
+                    std::condition_variable changed;
+                    std::deque<Entry> entries; // from the entry being written on, references stay valid while it grows
+                    std::size_t first = 0; // index of `entries.front()`
+                    std::size_t claimed = 0; // index of the next entry to read
+                    std::size_t buffered = 0;
+                    bool walked = false;
+                    bool walk_failed = false;
+                    bool stopping = false;
+                    std::thread walker;
+                    std::vector<std::thread> readers;
+
+                    // Queues an entry, waiting while the walk is too far ahead. Returns `false` when stopping.
+                    bool add(Entry entry)
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        changed.wait(lock, [&]() { return stopping || entries.size() < window * 4; });
+                        if(stopping) {
+                            return false;
+                        }
+                        entries.push_back(std::move(entry));
+                        changed.notify_all();
+                        return true;
+                    }
+
+                    // Queues everything below a directory.
+                    bool walk(const std::string& directory, const std::string& prefix)
+                    {
+                        std::error_code ec;
+                        std::vector<DiffEntry> listed = listDirectory(directory, false, false, ec);
+                        if(ec) {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            walk_failed = true;
+                        }
+
+                        for(auto& listed_entry : listed) {
+                            if(listed_entry.kind == EntryKind::Other) {
+                                continue;
+                            }
+
+                            Entry entry;
+                            entry.name = prefix + listed_entry.name;
+                            entry.path = directory + '/' + listed_entry.name;
+                            entry.kind = listed_entry.kind;
+                            std::string name = entry.name;
+                            std::string path = entry.path;
+                            if(!add(std::move(entry))) {
+                                return false;
+                            }
+                            if(listed_entry.kind == EntryKind::Directory && !walk(path, name + '/')) {
+                                return false;
+                            }
+                        }
+                        return true;
+                    }
+
+                    // Stats and reads entries in archive order until every entry was claimed.
+                    void read()
+                    {
+                        while(true) {
+                            Entry* entry = nullptr;
+                            {
+                                std::unique_lock<std::mutex> lock(mutex);
+                                changed.wait(lock, [&]() {
+                                    std::size_t ahead = claimed - first;
+                                    return stopping || (walked && ahead >= entries.size())
+                                        || (ahead < entries.size() && ahead < window && (buffered < max_buffered || ahead == 0));
+                                });
+                                if(stopping || claimed - first >= entries.size()) {
+                                    return;
+                                }
+                                entry = &entries[claimed++ - first];
+                            }
+
+                            load(*entry);
+
+                            std::lock_guard<std::mutex> lock(mutex);
+                            entry->ready = true;
+                            buffered += entry->data.size();
+                            changed.notify_all();
+                        }
+                    }
+
+                    void load(Entry& entry)
+                    {
+                        if(entry.kind != EntryKind::File) {
+                            os::_private::countMetric(os::_private::Counter::Stats);
+                            entry.failed = lstat(entry.path.c_str(), &entry.info) != 0;
+                            if(!entry.failed && entry.kind == EntryKind::Symlink) {
+                                entry.data.resize(static_cast<std::size_t>(entry.info.st_size) + PATH_MAX);
+                                ssize_t length = readlink(entry.path.c_str(), &entry.data[0], entry.data.size());
+                                entry.failed = length < 0;
+                                entry.data.resize(length < 0 ? 0 : static_cast<std::size_t>(length));
+                            }
+                            return;
+                        }
+
+                        int fd = open(entry.path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+                        os::_private::countMetric(os::_private::Counter::Opens);
+                        if(fd < 0 || fstat(fd, &entry.info) != 0 || !S_ISREG(entry.info.st_mode)) {
+                            entry.failed = true;
+                        } else if(entry.info.st_dev == archive.st_dev && entry.info.st_ino == archive.st_ino) {
+                            entry.kind = EntryKind::Other; // the archive itself
+                        } else if(static_cast<std::uintmax_t>(entry.info.st_size) > tar_buffer) {
+                            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                            entry.fd = fd;
+                            return;
+                        } else {
+                            entry.data.resize(static_cast<std::size_t>(entry.info.st_size));
+                            std::size_t done = 0;
+                            while(done < entry.data.size()) {
+                                ssize_t bytes = ::read(fd, &entry.data[done], entry.data.size() - done);
+                                if(bytes < 0 && errno == EINTR) {
+                                    continue;
+                                } else if(bytes <= 0) {
+                                    break;
+                                }
+                                done += static_cast<std::size_t>(bytes);
+                            }
+                            os::_private::countMetric(os::_private::Counter::BytesRead, done);
+                            if(done < entry.data.size()) {
+                                entry.failed = true; // shrank or could not be read
+                                entry.data.clear();
+                            }
+                        }
+                        if(fd >= 0) {
+                            close(fd);
+                        }
+                    }
+            };
+
+            // Reads an archive from a descriptor in large blocks.
+            class ArchiveInput {
+                public:
+                    explicit ArchiveInput(int fd) : fd(fd), buffer(tar_buffer) {}
+
+                    // Takes up to `limit` buffered bytes without copying them. Returns `false` at the end of the archive.
+                    bool next(std::uint64_t limit, std::string_view& chunk)
+                    {
+                        while(begin == end) {
+                            ssize_t bytes = ::read(fd, buffer.data(), buffer.size());
+                            if(bytes < 0 && errno == EINTR) {
+                                continue;
+                            } else if(bytes < 0) {
+                                throw std::filesystem::filesystem_error("Failed to read archive", lastError());
+                            } else if(bytes == 0) {
+                                return false;
+                            }
+                            os::_private::countMetric(os::_private::Counter::BytesRead, bytes);
+                            begin = 0;
+                            end = static_cast<std::size_t>(bytes);
+                        }
+
+                        std::size_t size = static_cast<std::size_t>(std::min<std::uint64_t>(limit, end - begin));
+                        chunk = std::string_view(buffer.data() + begin, size);
+                        begin += size;
+                        return true;
+                    }
+
+                    // Copies the next `size` bytes into `into`, or skips them when it is null. Returns `false` at the end of the archive.
+                    bool read(char* into, std::uint64_t size)
+                    {
+                        std::string_view chunk;
+                        while(size > 0) {
+                            if(!next(size, chunk)) {
+                                return false;
+                            }
+                            if(into) {
+                                std::memcpy(into, chunk.data(), chunk.size());
+                                into += chunk.size();
+                            }
+                            size -= chunk.size();
+                        }
+                        return true;
+                    }
+
+                private:
+                    int fd;
+                    std::vector<char> buffer;
+                    std::size_t begin = 0;
+                    std::size_t end = 0;
+            };
+
+            /*
+                Creates the entries of an archive being unpacked, under a directory.
+
+                Directories are made in archive order by the calling thread. Small files are handed in
+                batches to a pool of workers, and large files are streamed by the calling thread. Links
+                are made once every file was written, so no file from the archive is written through a
+                link from the archive.
+            */
+            class UnpackWriter {
+                public:
+                    struct File {
+                        std::string name;
+                        std::string data;
+                        mode_t mode = 0644;
+                        std::int64_t time = 0;
+                        std::size_t index = 0; // position in the archive
+                    };
+
+                    // Takes ownership of `root_fd`. (`0` threads for one per hardware thread)
+                    UnpackWriter(int root_fd, const CopyOption& op, unsigned int threads) : root_fd(root_fd), op(op)
+                    {
+                        overwrite = op == CopyOption::OverwriteExisting || op == CopyOption::OverwriteAll;
+                        if(threads == 0) {
+                            threads = std::max(1u, std::thread::hardware_concurrency());
+                        }
+                        for(unsigned int i = 0; i < threads; i++) {
+                            workers.emplace_back(&UnpackWriter::work, this);
+                        }
+                    }
+
+                    UnpackWriter(const UnpackWriter&) = delete;
+                    UnpackWriter& operator=(const UnpackWriter&) = delete;
+
+                    ~UnpackWriter()
+                    {
+                        stop();
+                        close(root_fd);
+                    }
+
+                    void directory(const std::string& name, mode_t mode, std::int64_t time)
+                    {
+                        makeDirectories(name, mode);
+                        directories.push_back({name, time});
+                    }
+
+                    // Queues a small file for the workers.
+                    void file(File file)
+                    {
+                        makeParents(file.name);
+                        batch_bytes += file.data.size();
+                        batch.push_back(std::move(file));
+                        if(batch_bytes >= tar_buffer || batch.size() >= 256) {
+                            submit();
+                        }
+                    }
+
+                    // Writes a file streamed from the archive. Returns `false` if the user cancelled.
+                    bool largeFile(const File& file, std::uint64_t size, ArchiveInput& input)
+                    {
+                        makeParents(file.name);
+                        int fd = openFile(file, overwrite);
+                        if(fd < 0 && errno == EEXIST && op == CopyOption::None) {
+                            int answer = confirm(file.name);
+                            if(answer < 0) {
+                                return false;
+                            }
+                            fd = answer ? openFile(file, true) : -1;
+                        } else if(fd < 0 && errno != EEXIST) {
+                            failed = true;
+                        }
+
+                        std::string_view chunk;
+                        bool ok = true;
+                        while(size > 0) {
+                            if(!input.next(size, chunk)) {
+                                throw std::runtime_error(errorMessage("unpack", "The archive ends inside \"" + file.name + "\""));
+                            }
+                            size -= chunk.size();
+                            if(fd >= 0 && ok) {
+                                iovec iov = {const_cast<char*>(chunk.data()), chunk.size()};
+                                ok = writeAll(fd, &iov, 1);
+                                os::_private::countMetric(os::_private::Counter::BytesWritten, chunk.size());
+                            }
+                        }
+                        if(fd >= 0 && !closeFile(fd, file, ok)) {
+                            failed = true;
+                        }
+                        return true;
+                    }
+
+                    void link(const std::string& name, const std::string& target, bool hard, std::int64_t time)
+                    {
+                        makeParents(name);
+                        links.push_back({name, target, hard, time});
+                    }
+
+                    /*
+                        Waits for the workers, asks about the files that existed, then makes the links.
+
+                        Return Value:
+                        - Returns `false` if an entry could not be created or the user cancelled.
+                    */
+                    bool finish()
+                    {
+                        submit();
+                        stop();
+
+                        // Ask about existing files one at a time, in archive order
+                        std::sort(conflicts.begin(), conflicts.end(), [](const File& a, const File& b) { return a.index < b.index; });
+                        for(const auto& file : conflicts) {
+                            int answer = confirm(file.name);
+                            if(answer < 0) {
+                                return false;
+                            } else if(answer > 0) {
+                                write(file, true);
+                            }
+                        }
+
+                        for(const auto& link : links) {
+                            if(!makeLink(link)) {
+                                return false;
+                            }
+                        }
+
+                        // Files written into the directories changed their times
+                        for(auto i = directories.rbegin(); i != directories.rend(); i++) {
+                            timespec times[2] = {{0, UTIME_OMIT}, {static_cast<time_t>(i->time), 0}};
+                            utimensat(root_fd, i->name.c_str(), times, AT_SYMLINK_NOFOLLOW);
+                        }
+                        return !failed;
+                    }
+
+                private:
+                    struct Link {
+                        std::string name;
+                        std::string target;
+                        bool hard = false;
+                        std::int64_t time = 0;
+                    };
+
+                    struct Directory {
+                        std::string name;
+                        std::int64_t time = 0;
+                    };
+
+                    static constexpr std::size_t max_queued = 64 * tar_buffer;
+
+                    int root_fd;
+                    CopyOption op;
+                    bool overwrite = false;
+                    char ch = 'n';
+                    std::set<std::string> made; // directories already made or found
+                    std::vector<Directory> directories;
+                    std::vector<Link> links;
+                    std::vector<File> batch;
+                    std::size_t batch_bytes = 0;
+
+                    std::mutex mutex;
+                    std::condition_variable ready;
+                    std::condition_variable space;
+                    std::deque<std::pair<std::vector<File>, std::size_t>> queue; // batches and their sizes
+                    std::size_t queued = 0;
+                    bool done = false;
+                    std::vector<File> conflicts;
+                    std::atomic<bool> failed {false};
+                    std::vector<std::thread> workers;
+
+                    void submit()
+                    {
+                        if(batch.empty()) {
+                            return;
+                        }
+                        std::unique_lock<std::mutex> lock(mutex);
+                        space.wait(lock, [&]() { return queued < max_queued; });
+                        queued += batch_bytes;
+                        queue.emplace_back(std::move(batch), batch_bytes);
+                        ready.notify_one();
+                        batch.clear();
+                        batch_bytes = 0;
+                    }
+
+                    void stop()
+                    {
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            done = true;
+                            ready.notify_all();
+                        }
+                        for(auto& worker : workers) {
+                            worker.join();
+                        }
+                        workers.clear();
+                    }
+
+                    void work()
+                    {
+                        while(true) {
+                            std::pair<std::vector<File>, std::size_t> taken;
+                            {
+                                std::unique_lock<std::mutex> lock(mutex);
+                                ready.wait(lock, [&]() { return done || !queue.empty(); });
+                                if(queue.empty()) {
+                                    return;
+                                }
+                                taken = std::move(queue.front());
+                                queue.pop_front();
+                                queued -= taken.second;
+                                space.notify_one();
+                            }
+
+                            for(auto& file : taken.first) {
+                                if(!write(file, overwrite) && op == CopyOption::None) {
+                                    std::lock_guard<std::mutex> lock(mutex);
+                                    conflicts.push_back(std::move(file));
+                                }
+                            }
+                        }
+                    }
+
+                    // Opens a file for writing, replacing a link in its place when `replace` is set.
+                    int openFile(const File& file, bool replace)
+                    {
+                        int flags = O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC | (replace ? O_TRUNC : O_EXCL);
+                        os::_private::countMetric(os::_private::Counter::Opens);
+                        int fd = openat(root_fd, file.name.c_str(), flags, file.mode & 07777);
+                        if(fd < 0 && errno == ELOOP && replace && unlinkat(root_fd, file.name.c_str(), 0) == 0) {
+                            fd = openat(root_fd, file.name.c_str(), flags, file.mode & 07777);
+                        }
+                        return fd;
+                    }
+
+                    // Sets the last write time of a written file and closes it.
+                    bool closeFile(int fd, const File& file, bool ok)
+                    {
+                        timespec times[2] = {{0, UTIME_OMIT}, {static_cast<time_t>(file.time), 0}};
+                        ok = futimens(fd, times) == 0 && ok;
+                        return close(fd) == 0 && ok;
+                    }
+
+                    // Writes a small file. Returns `false` if it already exists and `replace` is not set.
+                    bool write(const File& file, bool replace)
+                    {
+                        int fd = openFile(file, replace);
+                        if(fd < 0) {
+                            if(errno == EEXIST && !replace) {
+                                return false;
+                            }
+                            failed = true;
+                            return true;
+                        }
+
+                        iovec iov = {const_cast<char*>(file.data.data()), file.data.size()};
+                        bool ok = writeAll(fd, &iov, 1);
+                        os::_private::countMetric(os::_private::Counter::BytesWritten, file.data.size());
+                        if(!closeFile(fd, file, ok)) {
+                            failed = true;
+                        }
+                        return true;
+                    }
+
+                    // Asks before overwriting, remembering "all" answers. Returns `1` to write, `0` to skip and `-1` to cancel.
+                    int confirm(const std::string& name)
+                    {
+                        if(ch != 'a' && ch != 'A') {
+                            ch = copyWarning(name);
+                        }
+                        if(ch == 'x' || ch == 'X') {
+                            return -1;
+                        }
+                        return ch == 'y' || ch == 'Y' || ch == 'a' || ch == 'A';
+                    }
+
+                    // Makes a directory and its missing parents.
+                    void makeDirectories(const std::string& name, mode_t mode = 0777)
+                    {
+                        if(made.count(name)) {
+                            return;
+                        }
+                        for(std::size_t end = name.find('/'); ; end = name.find('/', end + 1)) {
+                            std::string directory = name.substr(0, end);
+                            if(made.insert(directory).second && mkdirat(root_fd, directory.c_str(), end == std::string::npos ? (mode | 0700) : 0777) != 0
+                               && errno != EEXIST) {
+                                failed = true;
+                            }
+                            if(end == std::string::npos) {
+                                break;
+                            }
+                        }
+                    }
+
+                    void makeParents(const std::string& name)
+                    {
+                        std::size_t end = name.rfind('/');
+                        if(end != std::string::npos) {
+                            makeDirectories(name.substr(0, end));
+                        }
+                    }
+
+                    // Makes a link, dealing with an existing entry in its place. Returns `false` if the user cancelled.
+                    bool makeLink(const Link& link)
+                    {
+                        auto make = [&]() {
+                            return link.hard ? linkat(root_fd, link.target.c_str(), root_fd, link.name.c_str(), 0)
+                                             : symlinkat(link.target.c_str(), root_fd, link.name.c_str());
+                        };
+
+                        int result = make();
+                        if(result != 0 && errno == EEXIST) {
+                            int answer = overwrite ? 1 : 0;
+                            if(op == CopyOption::None) {
+                                answer = confirm(link.name);
+                            }
+                            if(answer < 0) {
+                                return false;
+                            }
+                            if(answer == 0) {
+                                return true;
+                            }
+                            result = unlinkat(root_fd, link.name.c_str(), 0) == 0 ? make() : -1;
+                        }
+
+                        if(result != 0) {
+                            failed = true;
+                        } else if(!link.hard) {
+                            timespec times[2] = {{0, UTIME_OMIT}, {static_cast<time_t>(link.time), 0}};
+                            utimensat(root_fd, link.name.c_str(), times, AT_SYMLINK_NOFOLLOW);
+                        }
+                        return true;
+                    }
+            };
+
+            /*
+                Turns a path from an archive into a path relative to the directory it is unpacked in.
+
+                Return Value:
+                - Returns `false` if the path leaves the directory. `relative` is empty for the directory itself.
+            */
+            inline bool archivePath(const std::string& name, std::string& relative)
+            {
+                std::filesystem::path path = std::filesystem::path(name).lexically_normal();
+                relative = path.generic_string();
+                while(!relative.empty() && relative.back() == '/') {
+                    relative.pop_back();
+                }
+                if(relative == ".") {
+                    relative.clear();
+                }
+                return relative.empty() ? !path.has_root_path() : isContainedPath(relative);
+            }
+
+            // Reads the path, link target and size records of a pax extended header.
+            inline void readPaxHeader(const std::string& data, std::string& name, std::string& link, std::uint64_t& size)
+            {
+                std::size_t at = 0;
+                while(at < data.size()) {
+                    char* after = nullptr;
+                    std::uint64_t length = std::strtoull(data.c_str() + at, &after, 10);
+                    std::size_t space = static_cast<std::size_t>(after - data.c_str());
+                    if(length == 0 || *after != ' ' || at + length > data.size()) {
+                        break;
+                    }
+
+                    std::string record = data.substr(space + 1, at + length - space - 2); // without the newline
+                    std::size_t equals = record.find('=');
+                    std::string key = record.substr(0, equals);
+                    std::string value = equals == std::string::npos ? "" : record.substr(equals + 1);
+                    if(key == "path") {
+                        name = value;
+                    } else if(key == "linkpath") {
+                        link = value;
+                    } else if(key == "size") {
+                        size = std::strtoull(value.c_str(), nullptr, 10);
+                    }
+                    at += static_cast<std::size_t>(length);
+                }
+            }
+
+            // Unpacks an archive read from `fd` into `destination`.
+            inline bool unpackArchive(int fd, const std::filesystem::path& destination, const CopyOption& op, unsigned int threads)
+            {
+                if(op == CopyOption::ReplaceAll) {
+                    return replaceDirectory(destination, [&](const std::filesystem::path& staging) {
+                        return unpackArchive(fd, staging, CopyOption::OverwriteExisting, threads);
+                    });
+                }
+
+                std::filesystem::create_directories(destination);
+                if(op == CopyOption::OverwriteAll) {
+                    RemoveStats stats;
+                    removeTree(destination, true, stats);
+                }
+
+                int root_fd = open(destination.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                os::_private::countMetric(os::_private::Counter::Opens);
+                if(root_fd < 0) {
+                    throw std::filesystem::filesystem_error("Failed to open directory", destination, lastError());
+                }
+
+                UnpackWriter writer(root_fd, op, threads);
+                ArchiveInput input(fd);
+                std::string long_name;
+                std::string long_link;
+                std::uint64_t long_size = UINT64_MAX;
+                bool ok = true;
+                char header[tar_block];
+                for(std::size_t index = 0; input.read(header, tar_block); index++) {
+                    if(std::all_of(header, header + tar_block, [](char c) { return c == '\0'; })) {
+                        break; // end of archive
+                    }
+                    if(readTarNumber(header + 148, 8) != tarChecksum(header)) {
+                        throw std::runtime_error(errorMessage("unpack", "The archive is damaged"));
+                    }
+
+                    char type = header[156];
+                    std::uint64_t size = readTarNumber(header + 124, 12);
+                    if(type == 'L' || type == 'K' || type == 'x' || type == 'g') {
+                        if(size > tar_buffer) {
+                            throw std::runtime_error(errorMessage("unpack", "The archive is damaged"));
+                        }
+                        std::string data(static_cast<std::size_t>(size), '\0');
+                        if(!input.read(&data[0], size) || !input.read(nullptr, tarPadding(size))) {
+                            throw std::runtime_error(errorMessage("unpack", "The archive ends inside a header"));
+                        }
+                        if(type == 'L') {
+                            long_name = data.c_str();
+                        } else if(type == 'K') {
+                            long_link = data.c_str();
+                        } else if(type == 'x') {
+                            readPaxHeader(data, long_name, long_link, long_size);
+                        }
+                        continue;
+                    }
+
+                    std::string name = long_name;
+                    if(name.empty()) {
+                        name = readTarString(header, 100);
+                        if(std::memcmp(header + 257, "ustar\0", 6) == 0 && header[345] != '\0') {
+                            name = readTarString(header + 345, 155) + '/' + name;
+                        }
+                    }
+                    std::string link = long_link.empty() ? readTarString(header + 157, 100) : long_link;
+                    if(long_size != UINT64_MAX) {
+                        size = long_size;
+                    }
+                    long_name.clear();
+                    long_link.clear();
+                    long_size = UINT64_MAX;
+
+                    if(type == '1' || type == '2') {
+                        size = 0; // links carry no data
+                    }
+                    std::uint64_t data_size = size;
+                    mode_t mode = static_cast<mode_t>(readTarNumber(header + 100, 8) & 07777);
+                    std::int64_t time = static_cast<std::int64_t>(readTarNumber(header + 136, 12));
+
+                    std::string relative;
+                    std::string target;
+                    bool contained = archivePath(name, relative) && (type != '1' || archivePath(link, target));
+                    bool is_file = type == '0' || type == '\0' || type == '7';
+                    if(!contained || (relative.empty() && type != '5') || (type == '1' && target.empty())) {
+                        ok = false; // would be written outside the directory
+                    } else if(type == '5') {
+                        if(!relative.empty()) {
+                            writer.directory(relative, mode, time);
+                        }
+                    } else if(type == '2') {
+                        writer.link(relative, link, false, time);
+                    } else if(type == '1') {
+                        writer.link(relative, target, true, time);
+                    } else if(is_file && size <= tar_buffer) {
+                        UnpackWriter::File file {relative, std::string(static_cast<std::size_t>(size), '\0'), mode, time, index};
+                        if(!input.read(&file.data[0], size)) {
+                            throw std::runtime_error(errorMessage("unpack", "The archive ends inside \"" + name + "\""));
+                        }
+                        writer.file(std::move(file));
+                        size = 0;
+                    } else if(is_file) {
+                        if(!writer.largeFile({relative, "", mode, time, index}, size, input)) {
+                            return false; // cancelled
+                        }
+                        size = 0;
+                    }
+
+                    // Skip what was not used, then the padding
+                    if(!input.read(nullptr, size) || !input.read(nullptr, tarPadding(data_size))) {
+                        throw std::runtime_error(errorMessage("unpack", "The archive ends inside \"" + name + "\""));
+                    }
+                }
+
+                return writer.finish() && ok;
+            }
+        #endif
+        }
+
+        /*
+            Writes a file or directory tree to a tar archive in one sequential pass.
+
+            Return Value:
+            - Returns `false` if an entry could not be read. It is left out of the archive, or filled
+              with zeros if it shrank while being written.
+
+            Parameters:
+            `source`: File or directory to pack. With a trailing separator only the contents of the
+                      directory are packed, like `copy()` copies them.
+            `fd`: Descriptor the archive is written to, like a file, pipe or socket. It is not closed.
+            `threads`: Number of threads reading files ahead of the writer. (`0` for one per hardware thread)
+
+            Notes:
+            - Writes GNU tar, with names longer than 100 characters in long name blocks. Entries are
+              sorted by name, each directory before its contents.
+            - Files up to 1 MiB are read whole, in parallel and ahead of the writer. Larger ones are
+              streamed. The archive is written in 1 MiB blocks.
+            - Regular files, directories and symbolic links are stored with their permissions, owner ids
+              and last write times. Hard links are stored as separate files, other types are skipped.
+            - Only supported on Linux.
+        */
+        inline bool pack(const std::filesystem::path& source, int fd, unsigned int threads = 0)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+        #if defined(__linux__)
+            struct stat root {};
+            os::_private::countMetric(os::_private::Counter::Stats);
+            if(lstat(source.c_str(), &root) != 0) {
+                throw std::runtime_error(_private::errorMessage(__func__, "\"" + source.string() + "\" does not exist"));
+            }
+            struct stat archive {};
+            if(fstat(fd, &archive) != 0) {
+                throw std::filesystem::filesystem_error("Failed to write archive", _private::lastError());
+            }
+
+            _private::EntryKind kind = S_ISDIR(root.st_mode) ? _private::EntryKind::Directory
+                                     : S_ISLNK(root.st_mode) ? _private::EntryKind::Symlink
+                                     : S_ISREG(root.st_mode) ? _private::EntryKind::File : _private::EntryKind::Other;
+            if(kind == _private::EntryKind::Other) {
+                throw std::runtime_error(_private::errorMessage(__func__, "\"" + source.string() + "\" is not a file or directory"));
+            }
+
+            std::string path = source.string();
+            while(path.size() > 1 && path.back() == '/') {
+                path.pop_back();
+            }
+            std::string name = isDirectoryString(source) ? "" : source.filename().string();
+            _private::PackReader reader(path, name, kind, archive, threads);
+
+            std::string out;
+            out.reserve(_private::tar_buffer * 2);
+            auto flush = [&]() {
+                iovec iov = {&out[0], out.size()};
+                if(!_private::writeAll(fd, &iov, 1)) {
+                    throw std::filesystem::filesystem_error("Failed to write archive", _private::lastError());
+                }
+                os::_private::countMetric(os::_private::Counter::BytesWritten, out.size());
+                out.clear();
+            };
+
+            bool ok = true;
+            while(_private::PackReader::Entry* entry = reader.next()) {
+                if(entry->failed) {
+                    ok = false;
+                } else if(entry->kind == _private::EntryKind::Directory) {
+                    _private::tarHeader(out, entry->name + '/', '5', 0, &entry->info);
+                } else if(entry->kind == _private::EntryKind::Symlink) {
+                    _private::tarHeader(out, entry->name, '2', 0, &entry->info, entry->data);
+                } else if(entry->kind == _private::EntryKind::File) {
+                    std::uint64_t size = static_cast<std::uint64_t>(entry->info.st_size);
+                    _private::tarHeader(out, entry->name, '0', size, &entry->info);
+                    if(entry->fd < 0) {
+                        out.append(entry->data);
+                    } else {
+                        // Stream a large file through the output buffer
+                        for(std::uint64_t left = size; left > 0;) {
+                            if(out.size() >= _private::tar_buffer) {
+                                flush();
+                            }
+                            std::size_t at = out.size();
+                            std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(left, _private::tar_buffer * 2 - at));
+                            out.resize(at + chunk);
+                            ssize_t bytes = read(entry->fd, &out[at], chunk);
+                            if(bytes < 0 && errno == EINTR) {
+                                out.resize(at);
+                                continue;
+                            } else if(bytes <= 0) {
+                                out.resize(at);
+                                out.append(static_cast<std::size_t>(left), '\0'); // the file shrank
+                                ok = false;
+                                break;
+                            }
+                            out.resize(at + static_cast<std::size_t>(bytes));
+                            left -= static_cast<std::uint64_t>(bytes);
+                            os::_private::countMetric(os::_private::Counter::BytesRead, bytes);
+                        }
+                        close(entry->fd);
+                        entry->fd = -1;
+                    }
+                    out.append(_private::tarPadding(size), '\0');
+                }
+                reader.release();
+
+                if(out.size() >= _private::tar_buffer) {
+                    flush();
+                }
+            }
+
+            out.append(_private::tar_block * 2, '\0'); // end of archive
+            flush();
+            return ok && !reader.failed();
+        #else
+            throw std::runtime_error(_private::errorMessage(__func__, "Not supported on this platform"));
+        #endif
+        }
+
+        /*
+            Writes a file or directory tree to a tar archive file.
+
+            Parameters:
+            `source`: File or directory to pack. With a trailing separator only the contents of the directory are packed.
+            `archive`: Archive file to create or replace.
+            `threads`: Number of threads reading files ahead of the writer. (`0` for one per hardware thread)
+        */
+        inline bool pack(const std::filesystem::path& source, const std::filesystem::path& archive, unsigned int threads = 0)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+        #if defined(__linux__)
+            os::_private::countMetric(os::_private::Counter::Opens);
+            int fd = open(archive.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+            if(fd < 0) {
+                throw std::filesystem::filesystem_error("Failed to create archive", archive, _private::lastError());
+            }
+
+            bool ok = false;
+            try {
+                ok = pack(source, fd, threads);
+            } catch(...) {
+                close(fd);
+                throw;
+            }
+            if(close(fd) != 0) {
+                throw std::filesystem::filesystem_error("Failed to write archive", archive, _private::lastError());
+            }
+            return ok;
+        #else
+            throw std::runtime_error(_private::errorMessage(__func__, "Not supported on this platform"));
+        #endif
+        }
+
+        /*
+            Writes a file or directory tree to a tar archive.
+
+            Parameters:
+            `source`: File or directory to pack.
+            `fd`: Descriptor the archive is written to.
+            `threads`: Number of threads reading ahead, `0` for one per hardware thread.
+            `ec`: Gets the error if the archive could not be written, or an I/O error if an entry could not be read.
+        */
+        inline bool pack(const std::filesystem::path& source, int fd, unsigned int threads, std::error_code& ec) noexcept
+        {
+            ec.clear();
+            try {
+                if(!std::filesystem::exists(std::filesystem::symlink_status(source, ec)) && !ec) {
+                    ec = std::make_error_code(std::errc::no_such_file_or_directory);
+                }
+                if(ec) {
+                    return false;
+                }
+                if(!pack(source, fd, threads)) {
+                    ec = std::make_error_code(std::errc::io_error);
+                    return false;
+                }
+                return true;
+            } catch(...) {
+                ec = _private::currentError();
+                return false;
+            }
+        }
+
+        /*
+            Writes a file or directory tree to a tar archive file.
+
+            Parameters:
+            `source`: File or directory to pack.
+            `archive`: Archive file to create or replace.
+            `threads`: Number of threads reading ahead, `0` for one per hardware thread.
+            `ec`: Gets the error if the archive could not be written, or an I/O error if an entry could not be read.
+        */
+        inline bool pack(const std::filesystem::path& source, const std::filesystem::path& archive, unsigned int threads, std::error_code& ec) noexcept
+        {
+            ec.clear();
+            try {
+                if(!std::filesystem::exists(std::filesystem::symlink_status(source, ec)) && !ec) {
+                    ec = std::make_error_code(std::errc::no_such_file_or_directory);
+                }
+                if(ec) {
+                    return false;
+                }
+                if(!pack(source, archive, threads)) {
+                    ec = std::make_error_code(std::errc::io_error);
+                    return false;
+                }
+                return true;
+            } catch(...) {
+                ec = _private::currentError();
+                return false;
+            }
+        }
+
+        /*
+            Unpacks a tar archive into a directory, reading it in one sequential pass.
+
+            Return Value:
+            - Returns `false` if the user cancelled or an entry could not be created. Entries that
+              would end up outside `destination` are skipped and also make it return `false`.
+
+            Parameters:
+            `fd`: Descriptor the archive is read from, like a file, pipe or socket. It is not closed.
+            `destination`: Directory to unpack into. It is created if it does not exist.
+            `op`: Copy option to use.
+            `threads`: Number of threads writing files. (`0` for one per hardware thread)
+
+            Notes:
+            - Reads GNU, ustar and pax archives.
+            - Directories are made in archive order and files up to 1 MiB are written in parallel by
+              the workers. Larger files are streamed by the calling thread. Links are made last.
+            - Options work as in `createFiles()`. With `None` the user is asked about existing files
+              once everything else was written, and about large files as they are reached.
+            - Permissions are kept minus the umask, and last write times are kept. Owners are not restored.
+            - Throws `std::runtime_error` if the archive is damaged or ends early.
+            - Only supported on Linux.
+        */
+        inline bool unpack(int fd, const std::filesystem::path& destination, const CopyOption& op = CopyOption::None, unsigned int threads = 0)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+        #if defined(__linux__)
+            return _private::unpackArchive(fd, destination, op, threads);
+        #else
+            throw std::runtime_error(_private::errorMessage(__func__, "Not supported on this platform"));
+        #endif
+        }
+
+        /*
+            Unpacks a tar archive file into a directory.
+
+            Parameters:
+            `archive`: Archive file to read.
+            `destination`: Directory to unpack into. It is created if it does not exist.
+            `op`: Copy option to use.
+            `threads`: Number of threads writing files. (`0` for one per hardware thread)
+        */
+        inline bool unpack(const std::filesystem::path& archive, const std::filesystem::path& destination, const CopyOption& op = CopyOption::None,
+                           unsigned int threads = 0)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+        #if defined(__linux__)
+            os::_private::countMetric(os::_private::Counter::Opens);
+            int fd = open(archive.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd < 0) {
+                throw std::filesystem::filesystem_error("Failed to open archive", archive, _private::lastError());
+            }
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+            bool ok = false;
+            try {
+                ok = _private::unpackArchive(fd, destination, op, threads);
+            } catch(...) {
+                close(fd);
+                throw;
+            }
+            close(fd);
+            return ok;
+        #else
+            throw std::runtime_error(_private::errorMessage(__func__, "Not supported on this platform"));
+        #endif
+        }
+
+        /*
+            Unpacks a tar archive into a directory.
+
+            Parameters:
+            `fd`: Descriptor the archive is read from.
+            `destination`: Directory to unpack into.
+            `op`: Copy option to use.
+            `threads`: Number of threads writing files, `0` for one per hardware thread.
+            `ec`: Gets the error if the archive could not be read, or an I/O error if an entry could not be created.
+        */
+        inline bool unpack(int fd, const std::filesystem::path& destination, const CopyOption& op, unsigned int threads, std::error_code& ec) noexcept
+        {
+            ec.clear();
+            try {
+                if(!unpack(fd, destination, op, threads)) {
+                    if(op != CopyOption::None) { // with `None` the user may have cancelled
+                        ec = std::make_error_code(std::errc::io_error);
+                    }
+                    return false;
+                }
+                return true;
+            } catch(...) {
+                ec = _private::currentError();
+                return false;
+            }
+        }
+
+        /*
+            Unpacks a tar archive file into a directory.
+
+            Parameters:
+            `archive`: Archive file to read.
+            `destination`: Directory to unpack into.
+            `op`: Copy option to use.
+            `threads`: Number of threads writing files, `0` for one per hardware thread.
+            `ec`: Gets the error if the archive could not be read, or an I/O error if an entry could not be created.
+        */
+        inline bool unpack(const std::filesystem::path& archive, const std::filesystem::path& destination, const CopyOption& op, unsigned int threads,
+                           std::error_code& ec) noexcept
+        {
+            ec.clear();
+            try {
+                if(!unpack(archive, destination, op, threads)) {
+                    if(op != CopyOption::None) { // with `None` the user may have cancelled
+                        ec = std::make_error_code(std::errc::io_error);
+                    }
+                    return false;
+                }
+                return true;
+            } catch(...) {
+                ec = _private::currentError();
+                return false;
+            }
+        }
+
+        inline std::string find(const std::filesystem::path& search_path, const std::string& file_to_find, int max_depth)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(Backend* backend = _private::activeBackend()) {
+                if(backend->type(search_path) == std::filesystem::file_type::not_found) {
+                    throw std::runtime_error(_private::errorMessage(__func__, "Path does not exist"));
+                }
+                std::string match;
+                _private::walk(*backend, search_path, max_depth, [&](const std::filesystem::path& relative, std::filesystem::file_type) {
+                    if(relative.filename() == file_to_find) {
+                        match = (search_path / relative).string();
+                        return false;
+                    }
+                    return true;
+                });
+                return match;
+            }
+            os::_private::countMetric(os::_private::Counter::Stats);
+            if(std::filesystem::exists(search_path)) {
+                os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                for(auto i = std::filesystem::recursive_directory_iterator(search_path); i != std::filesystem::recursive_directory_iterator(); i++) {
+                    if(max_depth >= 0 && i.depth() >= max_depth) {
+                        i.disable_recursion_pending();
+                    } else if(os::_private::metrics_enabled && i->is_directory()) {
+                        os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                    }
+                    if(i->path().filename() == file_to_find) {
+                        return i->path().string();
+                    }
+                }
+                return std::string();
+            } else {
+                throw std::runtime_error(_private::errorMessage(__func__, "Path does not exist"));
+            }
+        }
+
+        inline std::string find(const std::filesystem::path& search_path, const std::string& file_to_find, const TraversalOption& pt = TraversalOption::NonRecursive)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            int n = pt == TraversalOption::NonRecursive ? 0 : -1;
+            return path::find(search_path, file_to_find, n);
+        }
+
+        inline std::vector<std::string> findAll(const std::filesystem::path& search_path, const std::string& file_to_find, int max_depth)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            std::vector<std::string> matches;
+            if(Backend* backend = _private::activeBackend()) {
+                if(backend->type(search_path) == std::filesystem::file_type::not_found) {
+                    throw std::runtime_error(_private::errorMessage(__func__, "Path does not exist"));
+                }
+                _private::walk(*backend, search_path, max_depth, [&](const std::filesystem::path& relative, std::filesystem::file_type) {
+                    if(relative.filename() == file_to_find) {
+                        matches.push_back((search_path / relative).string());
+                    }
+                    return true;
+                });
+                return matches;
+            }
+            os::_private::countMetric(os::_private::Counter::Stats);
+            if(std::filesystem::exists(search_path)) {
+                os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                for(auto i = std::filesystem::recursive_directory_iterator(search_path); i != std::filesystem::recursive_directory_iterator(); i++) {
+                    if(max_depth >= 0 && i.depth() >= max_depth) {
+                        i.disable_recursion_pending();
+                    } else if(os::_private::metrics_enabled && i->is_directory()) {
+                        os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                    }
+                    if(i->path().filename() == file_to_find) {
+                        matches.push_back(i->path().string());
+                    }
+                }
+                return matches;
+            } else {
+                throw std::runtime_error(_private::errorMessage(__func__, "Path does not exist"));
+            }
+        }
+
+        inline std::vector<std::string> findAll(const std::filesystem::path& search_path, const std::string& file_to_find, const TraversalOption& pt = TraversalOption::NonRecursive)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            int n = pt == TraversalOption::NonRecursive ? 0 : -1;
+            return path::findAll(search_path, file_to_find, n);
+        }
+
+        namespace _private {
+            // Walks `search_path` down to `max_depth`, calling `found` with every path named `file_to_find` until it returns `false`.
+            template<typename Found>
+            void findPaths(const std::filesystem::path& search_path, const std::string& file_to_find, int max_depth, std::error_code& ec, Found&& found)
+            {
+                if(Backend* backend = _private::activeBackend()) {
+                    walk(*backend, search_path, max_depth, [&](const std::filesystem::path& relative, std::filesystem::file_type) {
+                        return relative.filename() != file_to_find || found(search_path / relative);
+                    });
+                    return;
+                }
+                os::_private::countMetric(os::_private::Counter::Stats);
+                std::filesystem::recursive_directory_iterator i(search_path, ec), end;
+                if(ec) {
+                    return;
+                }
+                os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                std::error_code ignored;
+                for(; !ec && i != end; i.increment(ec)) {
+                    if(max_depth >= 0 && i.depth() >= max_depth) {
+                        i.disable_recursion_pending();
+                    } else if(os::_private::metrics_enabled && i->is_directory(ignored)) {
+                        os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                    }
+                    if(i->path().filename() == file_to_find && !found(i->path())) {
+                        return;
+                    }
+                }
+            }
+        }
+
+        /*
+            Finds a file or directory by name, without throwing.
+
+            Return Value:
+            - Returns the first match, or an empty string.
+
+            Parameters:
+            `search_path`: Directory to search.
+            `file_to_find`: Name to look for.
+            `max_depth`: How deep to search, `-1` for no limit.
+            `ec`: Gets the error, `no_such_file_or_directory` if `search_path` does not exist.
+        */
+        inline std::string find(const std::filesystem::path& search_path, const std::string& file_to_find, int max_depth, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            std::string match;
+            try {
+                _private::findPaths(search_path, file_to_find, max_depth, ec, [&](const std::filesystem::path& path) {
+                    match = path.string();
+                    return false;
+                });
+            } catch(...) {
+                ec = _private::currentError();
+            }
+            return ec ? std::string() : match;
+        }
+
+        /*
+            Finds a file or directory by name, without throwing.
+
+            Return Value:
+            - Returns the first match, or an empty string.
+
+            Parameters:
+            `search_path`: Directory to search.
+            `file_to_find`: Name to look for.
+            `pt`: Whether to search subdirectories.
+            `ec`: Gets the error, `no_such_file_or_directory` if `search_path` does not exist.
+        */
+        inline std::string find(const std::filesystem::path& search_path, const std::string& file_to_find, const TraversalOption& pt, std::error_code& ec) noexcept
+        {
+            return path::find(search_path, file_to_find, pt == TraversalOption::NonRecursive ? 0 : -1, ec);
+        }
+
+        /*
+            Finds every file or directory with a name, without throwing.
+
+            Return Value:
+            - Returns every match, or nothing if there was an error.
+
+            Parameters:
+            `search_path`: Directory to search.
+            `file_to_find`: Name to look for.
+            `max_depth`: How deep to search, `-1` for no limit.
+            `ec`: Gets the error, `no_such_file_or_directory` if `search_path` does not exist.
+        */
+        inline std::vector<std::string> findAll(const std::filesystem::path& search_path, const std::string& file_to_find, int max_depth, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            std::vector<std::string> matches;
+            try {
+                _private::findPaths(search_path, file_to_find, max_depth, ec, [&](const std::filesystem::path& path) {
+                    matches.push_back(path.string());
+                    return true;
+                });
+            } catch(...) {
+                ec = _private::currentError();
+            }
+            return ec ? std::vector<std::string>() : matches;
+        }
+
+        /*
+            Finds every file or directory with a name, without throwing.
+
+            Return Value:
+            - Returns every match, or nothing if there was an error.
+
+            Parameters:
+            `search_path`: Directory to search.
+            `file_to_find`: Name to look for.
+            `pt`: Whether to search subdirectories.
+            `ec`: Gets the error, `no_such_file_or_directory` if `search_path` does not exist.
+        */
+        inline std::vector<std::string> findAll(const std::filesystem::path& search_path, const std::string& file_to_find, const TraversalOption& pt, std::error_code& ec) noexcept
+        {
+            return path::findAll(search_path, file_to_find, pt == TraversalOption::NonRecursive ? 0 : -1, ec);
+        }
+
+        namespace _private {
+            // One character or wildcard of a compiled glob component.
+            struct GlobToken {
+                enum class Kind {Char, Any, Star, Set};
+
+                Kind kind = Kind::Char;
+                char ch = '\0';
+                std::array<std::uint64_t, 4> set {}; // characters matched by a `[...]` set
+
+                bool has(unsigned char c) const
+                {
+                    return (set[c >> 6] >> (c & 63)) & 1;
+                }
+            };
+
+            // One path component of a compiled glob pattern.
+            struct GlobPart {
+                enum class Kind {Literal, Wildcard, Recursive};
+
+                Kind kind = Kind::Literal;
+                std::string literal; // name of a literal component, without escapes
+                std::vector<GlobToken> tokens;
+            };
+
+            // Compiles one component of a glob pattern. An unclosed `[` is taken literally.
+            inline GlobPart compileGlobPart(const std::string& text)
+            {
+                GlobPart part;
+                if(text == "**") {
+                    part.kind = GlobPart::Kind::Recursive;
+                    return part;
+                }
+
+                for(std::size_t i = 0; i < text.size(); i++) {
+                    GlobToken token;
+                    if(text[i] == '*') {
+                        token.kind = GlobToken::Kind::Star;
+                        while(i + 1 < text.size() && text[i + 1] == '*') {
+                            i++;
+                        }
+                    } else if(text[i] == '?') {
+                        token.kind = GlobToken::Kind::Any;
+                    } else if(text[i] == '[' && text.find(']', i + 2) != std::string::npos) {
+                        std::size_t j = i + 1;
+                        bool negate = text[j] == '!' || text[j] == '^';
+                        if(negate) {
+                            j++;
+                        }
+                        // A `]` right after the opening bracket is part of the set
+                        for(std::size_t first = j; j < text.size() && (text[j] != ']' || j == first); j++) {
+                            unsigned char low = static_cast<unsigned char>(text[j]);
+                            unsigned char high = low;
+                            if(j + 2 < text.size() && text[j + 1] == '-' && text[j + 2] != ']') {
+                                high = static_cast<unsigned char>(text[j + 2]);
+                                j += 2;
+                            }
+                            for(unsigned int c = low; c <= high; c++) {
+                                token.set[c >> 6] |= std::uint64_t(1) << (c & 63);
+                            }
+                        }
+                        if(j >= text.size()) { // the only `]` closed nothing, take the bracket literally
+                            token.ch = '[';
+                            part.tokens.push_back(token);
+                            continue;
+                        }
+                        if(negate) {
+                            for(auto& bits : token.set) {
+                                bits = ~bits;
+                            }
+                        }
+                        token.kind = GlobToken::Kind::Set;
+                        i = j;
+                    } else {
+                        if(text[i] == '\\' && i + 1 < text.size()) {
+                            i++;
+                        }
+                        token.ch = text[i];
+                    }
+                    part.tokens.push_back(token);
+                }
+
+                bool literal = std::all_of(part.tokens.begin(), part.tokens.end(), [](const GlobToken& token) {
+                    return token.kind == GlobToken::Kind::Char;
+                });
+                part.kind = literal ? GlobPart::Kind::Literal : GlobPart::Kind::Wildcard;
+                if(literal) {
+                    for(const auto& token : part.tokens) {
+                        part.literal.push_back(token.ch);
+                    }
+                }
+                return part;
+            }
+
+            // Checks if a name matches a compiled glob component. Wildcards do not match a leading dot unless `hidden` is set.
+            inline bool matchGlobPart(const GlobPart& part, const std::string& name, bool hidden = false)
+            {
+                if(part.kind == GlobPart::Kind::Literal) {
+                    return name == part.literal;
+                }
+                const auto& tokens = part.tokens;
+                if(!hidden && !name.empty() && name[0] == '.' && (tokens.empty() || tokens[0].kind != GlobToken::Kind::Char || tokens[0].ch != '.')) {
+                    return false;
+                }
+
+                // Match left to right, going back to the last star on a mismatch
+                std::size_t t = 0;
+                std::size_t n = 0;
+                std::size_t star = std::string::npos;
+                std::size_t star_n = 0;
+                while(n < name.size()) {
+                    unsigned char c = static_cast<unsigned char>(name[n]);
+                    if(t < tokens.size() && tokens[t].kind == GlobToken::Kind::Star) {
+                        star = t++;
+                        star_n = n;
+                    } else if(t < tokens.size() && (tokens[t].kind == GlobToken::Kind::Any
+                                                    || (tokens[t].kind == GlobToken::Kind::Char && tokens[t].ch == name[n])
+                                                    || (tokens[t].kind == GlobToken::Kind::Set && tokens[t].has(c)))) {
+                        t++;
+                        n++;
+                    } else if(star != std::string::npos) {
+                        t = star + 1;
+                        n = ++star_n;
+                    } else {
+                        return false;
+                    }
+                }
+                while(t < tokens.size() && tokens[t].kind == GlobToken::Kind::Star) {
+                    t++;
+                }
+                return t == tokens.size();
+            }
+        }
+
+        /*
+            Lazily lists the paths that match a glob pattern, in sorted order.
+
+            Notes:
+            - `*` matches any characters, `?` one character and `[...]` one character of a set, like
+              `[a-z]`, or not of it with `[!...]`. `\` takes the next character literally.
+            - `**` as a whole component matches any number of directories, including none.
+            - Wildcards do not match names starting with a dot unless the component starts with one, and
+              `**` does not enter hidden directories or links to directories.
+            - The pattern is compiled once. Literal components are looked up directly instead of listing
+              their directory, and a directory is only opened while a part of the pattern can still match below it.
+            - A trailing separator matches only directories, which are returned with a trailing separator.
+            - Directories that cannot be read are skipped.
+        */
+        class Glob {
+            public:
+                class iterator {
+                    public:
+                        using iterator_category = std::input_iterator_tag;
+                        using value_type = std::string;
+                        using difference_type = std::ptrdiff_t;
+                        using pointer = const std::string*;
+                        using reference = const std::string&;
+
+                        iterator() = default;
+
+                        explicit iterator(Glob* glob) : glob(glob)
+                        {
+                            ++*this;
+                        }
+
+                        reference operator*() const { return path; }
+                        pointer operator->() const { return &path; }
+
+                        iterator& operator++()
+                        {
+                            if(glob && !glob->next(path)) {
+                                glob = nullptr;
+                            }
+                            return *this;
+                        }
+
+                        bool operator==(const iterator& other) const { return glob == other.glob; }
+                        bool operator!=(const iterator& other) const { return glob != other.glob; }
+
+                    private:
+                        Glob* glob = nullptr;
+                        std::string path;
+                };
+
+                /*
+                    Parameters:
+                    `pattern`: Pattern to match, relative to the current directory or absolute, with `/` between components.
+                */
+                explicit Glob(const std::string& pattern)
+                {
+                    std::size_t start = 0;
+                    std::string root;
+                    if(!pattern.empty() && pattern[0] == '/') {
+                        root = "/";
+                    }
+                    while(start < pattern.size()) {
+                        std::size_t end = pattern.find('/', start);
+                        if(end == std::string::npos) {
+                            end = pattern.size();
+                        }
+                        if(end > start) {
+                            parts.push_back(_private::compileGlobPart(pattern.substr(start, end - start)));
+                        }
+                        start = end + 1;
+                    }
+                    directories_only = !pattern.empty() && pattern.back() == '/';
+
+                    if(!parts.empty()) {
+                        stack.emplace_back(root, closure({0}));
+                    }
+                }
+
+                /*
+                    Gets the next matching path.
+
+                    Return Value:
+                    - Returns `false` once every match has been found.
+                */
+                bool next(std::string& path)
+                {
+                    while(!stack.empty()) {
+                        if(!stack.back().expanded) {
+                            expand(stack.back());
+                        }
+
+                        Frame& frame = stack.back();
+                        if(frame.next >= frame.children.size()) {
+                            stack.pop_back();
+                            continue;
+                        }
+
+                        Child child = std::move(frame.children[frame.next++]);
+                        std::string child_path = frame.path.empty() ? child.name
+                                               : frame.path.back() == '/' ? frame.path + child.name : frame.path + '/' + child.name;
+                        if(!child.states.empty()) {
+                            stack.emplace_back(child_path, std::move(child.states));
+                        }
+                        if(child.match) {
+                            path = directories_only ? child_path + '/' : child_path;
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+
+                iterator begin() { return iterator(this); }
+                iterator end() { return iterator(); }
+
+            private:
+                // An entry to report or to descend into.
+                struct Child {
+                    std::string name;
+                    bool match = false;
+                    std::vector<std::size_t> states; // parts to match below it, empty if it is not entered
+                };
+
+                // A directory with the parts its entries are matched against.
+                struct Frame {
+                    Frame(std::string path, std::vector<std::size_t> states) : path(std::move(path)), states(std::move(states)) {}
+
+                    std::string path;
+                    std::vector<std::size_t> states;
+                    bool expanded = false;
+                    std::vector<Child> children;
+                    std::size_t next = 0;
+                };
+
+                std::vector<_private::GlobPart> parts;
+                bool directories_only = false;
+                std::vector<Frame> stack;
+
+                // Adds the parts reached by letting each `**` match no directory.
+                std::vector<std::size_t> closure(std::vector<std::size_t> states) const
+                {
+                    for(std::size_t i = 0; i < states.size(); i++) {
+                        std::size_t state = states[i];
+                        if(state < parts.size() && parts[state].kind == _private::GlobPart::Kind::Recursive
+                           && std::find(states.begin(), states.end(), state + 1) == states.end()) {
+                            states.push_back(state + 1);
+                        }
+                    }
+                    std::sort(states.begin(), states.end());
+                    states.erase(std::unique(states.begin(), states.end()), states.end());
+                    return states;
+                }
+
+                // Finds the entries of a directory that match or can lead to a match.
+                void expand(Frame& frame)
+                {
+                    frame.expanded = true;
+                    std::string directory = frame.path.empty() ? "." : frame.path;
+
+                    // Literal parts are looked up, every other part needs a listing
+                    std::vector<_private::DiffEntry> entries;
+                    bool literal = std::all_of(frame.states.begin(), frame.states.end(), [&](std::size_t state) {
+                        return state == parts.size() || parts[state].kind == _private::GlobPart::Kind::Literal;
+                    });
+                    if(literal) {
+                        std::set<std::string> names;
+                        for(std::size_t state : frame.states) {
+                            if(state < parts.size()) {
+                                names.insert(parts[state].literal);
+                            }
+                        }
+                        for(const auto& name : names) {
+                            std::error_code ec;
+                            std::filesystem::file_status status = std::filesystem::symlink_status(directory + '/' + name, ec);
+                            os::_private::countMetric(os::_private::Counter::Stats);
+                            if(!ec && std::filesystem::exists(status)) {
+                                _private::DiffEntry entry;
+                                entry.name = name;
+                                entry.kind = std::filesystem::is_symlink(status) ? _private::EntryKind::Symlink
+                                           : std::filesystem::is_directory(status) ? _private::EntryKind::Directory : _private::EntryKind::File;
+                                entries.push_back(std::move(entry));
+                            }
+                        }
+                    } else {
+                        std::error_code ec;
+                        entries = _private::listDirectory(directory, false, false, ec);
+                    }
+
+                    for(const auto& entry : entries) {
+                        bool link = entry.kind == _private::EntryKind::Symlink;
+                        bool hidden = entry.name[0] == '.';
+                        auto advance = [&](bool recursive) {
+                            std::vector<std::size_t> states;
+                            for(std::size_t state : frame.states) {
+                                if(state == parts.size()) {
+                                    continue;
+                                }
+                                const _private::GlobPart& part = parts[state];
+                                if(part.kind == _private::GlobPart::Kind::Recursive) {
+                                    if(recursive && !hidden) {
+                                        states.push_back(state);
+                                    }
+                                } else if(_private::matchGlobPart(part, entry.name)) {
+                                    states.push_back(state + 1);
+                                }
+                            }
+                            return states.empty() ? states : closure(std::move(states));
+                        };
+
+                        std::vector<std::size_t> states = advance(true);
+                        if(states.empty()) {
+                            continue; // pruned without being opened
+                        }
+                        bool ends = states.back() == parts.size();
+                        std::vector<std::size_t> below = link ? advance(false) : std::move(states); // `**` does not follow links
+                        if(!below.empty() && below.back() == parts.size()) {
+                            below.pop_back();
+                        }
+
+                        bool directory_entry = entry.kind == _private::EntryKind::Directory;
+                        if(link && (!below.empty() || directories_only)) {
+                            std::error_code ec;
+                            directory_entry = std::filesystem::is_directory(directory + '/' + entry.name, ec);
+                            os::_private::countMetric(os::_private::Counter::Stats);
+                        }
+
+                        Child child;
+                        child.name = entry.name;
+                        child.match = ends && (directory_entry || !directories_only);
+                        if(directory_entry) {
+                            child.states = std::move(below);
+                        }
+                        if(child.match || !child.states.empty()) {
+                            frame.children.push_back(std::move(child));
+                        }
+                    }
+                }
+        };
+
+        /*
+            Lists the paths that match a glob pattern, lazily and in sorted order.
+
+            Return Value:
+            - Returns a `Glob` to iterate over or to read with `next()`.
+
+            Parameters:
+            `pattern`: Pattern to match, relative to the current directory or absolute, with `/` between components.
+
+            Notes:
+            - See `Glob` for the syntax. Nothing is read until the first path is asked for.
+        */
+        inline Glob glob(const std::string& pattern)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return Glob(pattern);
+        }
+
+        /*
+            Ordered include and exclude rules for the paths below a directory, with the syntax of a `.gitignore` file.
+
+            Notes:
+            - A rule is a glob pattern. Without a `/`, or with only a trailing one, it matches the name at any
+              depth. Otherwise it matches the path from the top directory, and a leading `/` only anchors it.
+            - `*`, `?` and `[...]` match within one component and also match names starting with a dot.
+              `**` as a whole component matches any number of directories, and a trailing `**` component everything inside.
+            - A trailing `/` matches only directories.
+            - The last rule that matches a path decides. Include rules only bring back paths an earlier rule
+              excluded, and a path inside an excluded directory cannot be brought back.
+            - The rules are compiled once, and excluded directories are never opened by the functions taking a `Filter`.
+        */
+        class Filter {
+            public:
+                Filter() = default;
+
+                /*
+                    Creates a filter from the lines of a `.gitignore` file.
+
+                    Parameters:
+                    `rules`: Rules, one per line. A leading `!` makes a rule an include rule, and lines starting with `#` are comments.
+                */
+                explicit Filter(const std::string& rules)
+                {
+                    std::size_t start = 0;
+                    while(start <= rules.size()) {
+                        std::size_t end = std::min(rules.find('\n', start), rules.size());
+                        add(rules.substr(start, end - start));
+                        start = end + 1;
+                    }
+                }
+
+                // Adds one line of a `.gitignore` file. Blank lines and comments are ignored.
+                Filter& add(std::string rule)
+                {
+                    if(!rule.empty() && rule.back() == '\r') {
+                        rule.pop_back();
+                    }
+                    if(rule.empty() || rule[0] == '#') {
+                        return *this;
+                    }
+                    return rule[0] == '!' ? addRule(rule.substr(1), true) : addRule(rule, false);
+                }
+
+                // Adds a rule that excludes the paths matching `pattern`.
+                Filter& exclude(const std::string& pattern)
+                {
+                    return addRule(pattern, false);
+                }
+
+                // Adds a rule that brings back the paths matching `pattern`.
+                Filter& include(const std::string& pattern)
+                {
+                    return addRule(pattern, true);
+                }
+
+                /*
+                    Checks if a path is excluded by the rules.
+
+                    Parameters:
+                    `relative`: Path relative to the top directory.
+                    `is_directory`: Whether the path is a directory.
+
+                    Notes:
+                    - Only the path itself is checked, not the directories it is in.
+                */
+                bool excludes(const std::filesystem::path& relative, bool is_directory) const
+                {
+                    std::vector<std::string> components;
+                    for(const auto& component : relative) {
+                        if(!component.empty() && component != ".") {
+                            components.push_back(component.string());
+                        }
+                    }
+                    return excludes(components, is_directory);
+                }
+
+                // Checks if the path made of `components`, relative to the top directory, is excluded by the rules.
+                bool excludes(const std::vector<std::string>& components, bool is_directory) const
+                {
+                    if(components.empty()) {
+                        return false;
+                    }
+                    for(auto rule = rules.rbegin(); rule != rules.rend(); rule++) {
+                        if(rule->directory_only && !is_directory) {
+                            continue;
+                        }
+                        bool matched = rule->any_depth ? _private::matchGlobPart(rule->parts[0], components.back(), true)
+                                                       : matchParts(*rule, 0, components, 0);
+                        if(matched) {
+                            return !rule->include;
+                        }
+                    }
+                    return false;
+                }
+
+                // Checks if there are no rules.
+                bool empty() const
+                {
+                    return rules.empty();
+                }
+            private:
+                struct Rule {
+                    bool include = false;
+                    bool directory_only = false;
+                    bool any_depth = false; // matches the last component only
+                    std::vector<_private::GlobPart> parts;
+                };
+
+                std::vector<Rule> rules;
+
+                Filter& addRule(std::string pattern, bool include)
+                {
+                    // Trailing spaces are dropped unless escaped
+                    while(!pattern.empty() && pattern.back() == ' ' && (pattern.size() < 2 || pattern[pattern.size() - 2] != '\\')) {
+                        pattern.pop_back();
+                    }
+
+                    Rule rule;
+                    rule.include = include;
+                    if(!pattern.empty() && pattern.back() == '/') {
+                        rule.directory_only = true;
+                        pattern.pop_back();
+                    }
+                    rule.any_depth = pattern.find('/') == std::string::npos;
+                    if(!pattern.empty() && pattern[0] == '/') {
+                        pattern.erase(0, 1);
+                    }
+                    if(pattern.empty()) {
+                        return *this;
+                    }
+
+                    std::size_t start = 0;
+                    while(start <= pattern.size()) {
+                        std::size_t end = std::min(pattern.find('/', start), pattern.size());
+                        if(end > start) {
+                            rule.parts.push_back(_private::compileGlobPart(pattern.substr(start, end - start)));
+                        }
+                        start = end + 1;
+                    }
+                    if(rule.any_depth && rule.parts[0].kind == _private::GlobPart::Kind::Recursive) {
+                        rule.parts[0] = _private::compileGlobPart("*");
+                    }
+                    rules.push_back(std::move(rule));
+                    return *this;
+                }
+
+                static bool matchParts(const Rule& rule, std::size_t p, const std::vector<std::string>& components, std::size_t c)
+                {
+                    for(; p < rule.parts.size(); p++, c++) {
+                        if(rule.parts[p].kind == _private::GlobPart::Kind::Recursive) {
+                            if(p + 1 == rule.parts.size()) { // a trailing `**` matches what is inside, not the directory itself
+                                return c < components.size();
+                            }
+                            for(std::size_t skip = c; skip <= components.size(); skip++) {
+                                if(matchParts(rule, p + 1, components, skip)) {
+                                    return true;
+                                }
+                            }
+                            return false;
+                        }
+                        if(c == components.size() || !_private::matchGlobPart(rule.parts[p], components[c], true)) {
+                            return false;
+                        }
+                    }
+                    return c == components.size();
+                }
+        };
+
+        namespace _private {
+            /*
+                Calls `visit` with the path relative to `directory`, the name and the type of everything below it
+                that `filter` does not exclude, until it returns `false`. Excluded directories are not opened.
+
+                Notes:
+                - Links are reported as links and not followed.
+            */
+            template<typename Visit>
+            void walkFiltered(const std::filesystem::path& directory, const Filter& filter, std::error_code& ec, Visit&& visit)
+            {
+                std::vector<std::string> components;
+                std::string relative;
+                auto enter = [&](const std::string& name, std::filesystem::file_type type) {
+                    components.push_back(name);
+                    relative.clear();
+                    for(const auto& component : components) {
+                        if(!relative.empty()) {
+                            relative.push_back('/');
+                        }
+                        relative.append(component);
+                    }
+                    return !filter.excludes(components, type == std::filesystem::file_type::directory);
+                };
+
+                if(Backend* backend = _private::activeBackend()) {
+                    std::function<bool()> list = [&]() {
+                        for(const auto& [name, type] : backend->list(relative.empty() ? directory : directory / relative)) {
+                            bool included = enter(name, type);
+                            if(included && (!visit(relative, name, type) || (type == std::filesystem::file_type::directory && !list()))) {
+                                return false;
+                            }
+                            components.pop_back();
+                            relative.resize(relative.size() > name.size() ? relative.size() - name.size() - 1 : 0);
+                        }
+                        return true;
+                    };
+                    list();
+                    return;
+                }
+
+                os::_private::countMetric(os::_private::Counter::Stats);
+                std::filesystem::recursive_directory_iterator i(directory, ec), end;
+                if(ec) {
+                    return;
+                }
+                os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                std::error_code ignored;
+                for(; !ec && i != end; i.increment(ec)) {
+                    // The type comes from the directory listing, so no entry is stat'ed to be filtered
+                    std::filesystem::file_type type = std::filesystem::file_type::regular;
+                    if(i->is_symlink(ignored)) {
+                        type = std::filesystem::file_type::symlink;
+                    } else if(i->is_directory(ignored)) {
+                        type = std::filesystem::file_type::directory;
+                    } else if(!i->is_regular_file(ignored)) {
+                        type = std::filesystem::file_type::unknown;
+                    }
+
+                    components.resize(i.depth());
+                    std::string name = i->path().filename().string();
+                    if(!enter(name, type)) {
+                        i.disable_recursion_pending();
+                        continue;
+                    }
+                    if(type == std::filesystem::file_type::directory) {
+                        os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                    }
+                    if(!visit(relative, name, type)) {
+                        return;
+                    }
+                }
+            }
+
+            // Throws the error a filtered walk of `path` stopped with.
+            inline void throwWalkError(const std::string& function_name, const std::filesystem::path& path, const std::error_code& ec)
+            {
+                if(ec) {
+                    throw std::filesystem::filesystem_error(_private::errorMessage(function_name, "Failed to read \"" + path.string() + "\""), path, ec);
+                }
+            }
+
+            // Returns the paths below `directory` that `filter` does not exclude, including `directory` itself unless it has a trailing separator.
+            inline std::set<std::string> filteredPaths(const std::filesystem::path& directory, const Filter& filter, std::filesystem::path& base)
+            {
+                std::set<std::string> paths;
+                std::string prefix;
+                base = directory;
+                if(!isDirectoryString(directory)) {
+                    prefix = path::filename(directory) + "/";
+                    base = directory.has_parent_path() ? directory.parent_path() : std::filesystem::path(".");
+                    paths.insert(path::filename(directory));
+                }
+
+                std::error_code ec;
+                walkFiltered(directory, filter, ec, [&](const std::string& relative, const std::string&, std::filesystem::file_type) {
+                    paths.insert(prefix + relative);
+                    return true;
+                });
+                throwWalkError("filteredPaths", directory, ec);
+                return paths;
+            }
+
+            // Checks if a path is a directory on the active backend or on disk.
+            inline bool isFilteredDirectory(const std::filesystem::path& path)
+            {
+                if(Backend* backend = _private::activeBackend()) {
+                    return backend->type(path) == std::filesystem::file_type::directory;
+                }
+                return std::filesystem::is_directory(path);
+            }
+
+            bool copyFiltered(const std::filesystem::path& source, const std::filesystem::path& destination, const Filter& filter,
+                              const CopyOption& op, const Durability& durability, std::vector<std::filesystem::path>* copied = nullptr);
+            bool moveFiltered(const std::filesystem::path& source, const std::filesystem::path& destination, const Filter& filter,
+                              const CopyOption& op, const Durability& durability);
+        }
+
+        /*
+            Copies a directory, skipping the paths a filter excludes.
+
+            Parameters:
+            `from`: Directory to copy. With a trailing separator only its contents are copied.
+            `to`: Directory to copy to.
+            `filter`: Rules for the paths below `from`.
+            `op`: Copy option to use. (Defaults `None`)
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+
+            Notes:
+            - Excluded directories are not opened. A file given as `from` is copied as usual.
+            - Links below `from` are copied as links, and a link already where a path goes is replaced rather than followed.
+        */
+        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, const Filter& filter, const CopyOption& op = CopyOption::None,
+                         const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(!_private::isFilteredDirectory(from)) {
+                return _private::copy(from, to, op, TraversalOption::Recursive, durability);
+            }
+            if(_private::activeBackend()) {
+                std::filesystem::path base;
+                std::set<std::string> paths = _private::filteredPaths(from, filter, base);
+                return _private::copy(base, paths, to, op, durability);
+            }
+            return _private::copyFiltered(from, to, filter, op, durability);
+        }
+
+        /*
+            Copies a directory, skipping the paths a filter excludes.
+
+            Parameters:
+            `from`: Directory to copy. With a trailing separator only its contents are copied.
+            `to`: Directory to copy to.
+            `filter`: Rules for the paths below `from`.
+            `op`: Copy option to use.
+            `durability`: How much is flushed to disk before returning.
+            `ec`: Gets the error, `no_such_file_or_directory` if `from` does not exist.
+        */
+        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, const Filter& filter, const CopyOption& op,
+                         const Durability& durability, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::transfer(from, to, ec, [&]() { return copy(from, to, filter, op, durability); });
+        }
+
+        /*
+            Moves a directory, leaving behind the paths a filter excludes.
+
+            Parameters:
+            `from`: Directory to move. With a trailing separator only its contents are moved.
+            `to`: Directory to move to.
+            `filter`: Rules for the paths below `from`.
+            `op`: Copy option to use. (Defaults `None`)
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+
+            Notes:
+            - Directories that still hold excluded paths are kept in `from`.
+            - Links below `from` are moved as links.
+        */
+        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to, const Filter& filter, const CopyOption& op = CopyOption::None,
+                         const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(!_private::isFilteredDirectory(from)) {
+                return _private::move(from, to, op, TraversalOption::Recursive, durability);
+            }
+            if(_private::activeBackend()) {
+                std::filesystem::path base;
+                std::set<std::string> paths = _private::filteredPaths(from, filter, base);
+                return _private::move(base, paths, to, op, durability);
+            }
+            return _private::moveFiltered(from, to, filter, op, durability);
+        }
+
+        /*
+            Moves a directory, leaving behind the paths a filter excludes.
+
+            Parameters:
+            `from`: Directory to move. With a trailing separator only its contents are moved.
+            `to`: Directory to move to.
+            `filter`: Rules for the paths below `from`.
+            `op`: Copy option to use.
+            `durability`: How much is flushed to disk before returning.
+            `ec`: Gets the error, `no_such_file_or_directory` if `from` does not exist.
+        */
+        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to, const Filter& filter, const CopyOption& op,
+                         const Durability& durability, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::transfer(from, to, ec, [&]() { return move(from, to, filter, op, durability); });
+        }
+
+        /*
+            Deletes the paths below a directory that a filter does not exclude.
+
+            Return Value:
+            - Returns `false` if the path does not exist.
+
+            Parameters:
+            `path`: Directory to delete from. Without a trailing separator it is deleted too once nothing is left in it.
+            `filter`: Rules for the paths below `path`.
+
+            Notes:
+            - Directories that still hold excluded paths are kept. A file given as `path` is deleted as usual.
+        */
+        inline bool remove(const std::filesystem::path& path, const Filter& filter)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(!_private::isFilteredDirectory(path)) {
+                return path::remove(path);
+            }
+            std::filesystem::path base;
+            std::set<std::string> paths = _private::filteredPaths(path, filter, base);
+            Backend* backend = _private::activeBackend();
+            for(auto it = paths.rbegin(); it != paths.rend(); it++) { // children come before their directory
+                std::filesystem::path full_path = base / *it;
+                if(backend) {
+                    if(backend->type(full_path) != std::filesystem::file_type::directory || backend->list(full_path).empty()) {
+                        RemoveStats stats;
+                        backend->removeAll(full_path, false, stats);
+                    }
+                } else if(!std::filesystem::is_directory(std::filesystem::symlink_status(full_path)) || std::filesystem::is_empty(full_path)) {
+                    std::filesystem::remove(full_path);
+                }
+            }
+            return true;
+        }
+
+        /*
+            Deletes the paths below a directory that a filter does not exclude.
+
+            Parameters:
+            `path`: Directory to delete from. Without a trailing separator it is deleted too once nothing is left in it.
+            `filter`: Rules for the paths below `path`.
+            `ec`: Gets the error if something could not be deleted. A missing path is not an error.
+        */
+        inline bool remove(const std::filesystem::path& path, const Filter& filter, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::onBackend(ec, false, [&]() { return path::remove(path, filter); });
+        }
+
+        /*
+            Returns the total size of the files below a directory that a filter does not exclude.
+
+            Parameters:
+            `path`: Path to check size.
+            `filter`: Rules for the paths below `path`.
+            `metric`: What size metric to use. (Defaults `Byte`)
+
+            Notes:
+            - Returns `-1` if the path does not exist. Excluded directories are not opened.
+        */
+        inline double size(const std::filesystem::path& path, const Filter& filter, const SizeMetric& metric = SizeMetric::Byte)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(!_private::isFilteredDirectory(path)) {
+                return path::size(path, metric);
+            }
+            Backend* backend = _private::activeBackend();
+            std::uintmax_t space = 0;
+            std::error_code ec;
+            _private::walkFiltered(path, filter, ec, [&](const std::string& relative, const std::string&, std::filesystem::file_type type) {
+                if(type == std::filesystem::file_type::regular) {
+                    space += backend ? backend->fileSize(path / relative) : std::filesystem::file_size(path / relative);
+                    os::_private::countMetric(os::_private::Counter::Stats);
+                }
+                return true;
+            });
+            _private::throwWalkError(__func__, path, ec);
+            return _private::sizeIn(space, metric);
+        }
+
+        /*
+            Returns the total size of the files below a directory that a filter does not exclude.
+
+            Return Value:
+            - Returns `-1` if the size could not be read.
+
+            Parameters:
+            `path`: Path to check size.
+            `filter`: Rules for the paths below `path`.
+            `metric`: What size metric to use.
+            `ec`: Gets the error, `no_such_file_or_directory` if the path does not exist.
+        */
+        inline double size(const std::filesystem::path& path, const Filter& filter, const SizeMetric& metric, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(!_private::activeBackend() && !std::filesystem::exists(path, ec)) {
+                if(!ec) {
+                    ec = std::make_error_code(std::errc::no_such_file_or_directory);
+                }
+                return -1;
+            }
+            return _private::onBackend(ec, -1.0, [&]() { return path::size(path, filter, metric); });
+        }
+
+        /*
+            Finds a file or directory by name, skipping the paths a filter excludes.
+
+            Return Value:
+            - Returns the first match, or an empty string.
+
+            Parameters:
+            `search_path`: Directory to search, with all of its subdirectories.
+            `file_to_find`: Name to look for.
+            `filter`: Rules for the paths below `search_path`.
+        */
+        inline std::string find(const std::filesystem::path& search_path, const std::string& file_to_find, const Filter& filter)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            std::string match;
+            std::error_code ec;
+            _private::walkFiltered(search_path, filter, ec, [&](const std::string& relative, const std::string& name, std::filesystem::file_type) {
+                if(name == file_to_find) {
+                    match = (search_path / relative).string();
+                    return false;
+                }
+                return true;
+            });
+            _private::throwWalkError(__func__, search_path, ec);
+            return match;
+        }
+
+        /*
+            Finds a file or directory by name, skipping the paths a filter excludes, without throwing.
+
+            Return Value:
+            - Returns the first match, or an empty string.
+
+            Parameters:
+            `search_path`: Directory to search, with all of its subdirectories.
+            `file_to_find`: Name to look for.
+            `filter`: Rules for the paths below `search_path`.
+            `ec`: Gets the error, `no_such_file_or_directory` if `search_path` does not exist.
+        */
+        inline std::string find(const std::filesystem::path& search_path, const std::string& file_to_find, const Filter& filter, std::error_code& ec) noexcept
+        {
+            return _private::onBackend(ec, std::string(), [&]() { return path::find(search_path, file_to_find, filter); });
+        }
+
+        /*
+            Finds every file or directory with a name, skipping the paths a filter excludes.
+
+            Parameters:
+            `search_path`: Directory to search, with all of its subdirectories.
+            `file_to_find`: Name to look for.
+            `filter`: Rules for the paths below `search_path`.
+        */
+        inline std::vector<std::string> findAll(const std::filesystem::path& search_path, const std::string& file_to_find, const Filter& filter)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            std::vector<std::string> matches;
+            std::error_code ec;
+            _private::walkFiltered(search_path, filter, ec, [&](const std::string& relative, const std::string& name, std::filesystem::file_type) {
+                if(name == file_to_find) {
+                    matches.push_back((search_path / relative).string());
+                }
+                return true;
+            });
+            _private::throwWalkError(__func__, search_path, ec);
+            return matches;
+        }
+
+        /*
+            Finds every file or directory with a name, skipping the paths a filter excludes, without throwing.
+
+            Return Value:
+            - Returns every match, or nothing if there was an error.
+
+            Parameters:
+            `search_path`: Directory to search, with all of its subdirectories.
+            `file_to_find`: Name to look for.
+            `filter`: Rules for the paths below `search_path`.
+            `ec`: Gets the error, `no_such_file_or_directory` if `search_path` does not exist.
+        */
+        inline std::vector<std::string> findAll(const std::filesystem::path& search_path, const std::string& file_to_find, const Filter& filter, std::error_code& ec) noexcept
+        {
+            return _private::onBackend(ec, std::vector<std::string>(), [&]() { return path::findAll(search_path, file_to_find, filter); });
+        }
+
+
+        namespace _private {
+            // Shared pool that runs the asynchronous functions, started on first use.
+            class AsyncExecutor {
+                public:
+                    AsyncExecutor()
+                    {
+                        unsigned int count = std::max(2u, std::thread::hardware_concurrency());
+                        for(unsigned int i = 0; i < count; i++) {
+                            workers.emplace_back([this]() { run(); });
+                        }
+                    }
+
+                    // Lets the queued operations finish before the workers are joined.
+                    ~AsyncExecutor()
+                    {
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            stopping = true;
+                        }
+                        cv.notify_all();
+                        for(auto& worker : workers) {
+                            worker.join();
+                        }
+                    }
+
+                    template<typename Result, typename Task>
+                    std::future<Result> submit(Task&& task)
+                    {
+                        auto job = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+                        std::future<Result> result = job->get_future();
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            queue.push_back([job]() { (*job)(); });
+                        }
+                        cv.notify_one();
+                        return result;
+                    }
+
+                private:
+                    std::mutex mutex;
+                    std::condition_variable cv;
+                    std::deque<std::function<void()>> queue;
+                    std::vector<std::thread> workers;
+                    bool stopping = false;
+
+                    void run()
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        while(true) {
+                            cv.wait(lock, [this]() { return !queue.empty() || stopping; });
+                            if(queue.empty()) {
+                                return;
+                            }
+
+                            std::function<void()> job = std::move(queue.front());
+                            queue.pop_front();
+                            lock.unlock();
+                            job();
+                            lock.lock();
+                        }
+                    }
+            };
+
+            inline AsyncExecutor& asyncExecutor()
+            {
+                static AsyncExecutor instance;
+                return instance;
+            }
+
+            // Runs `operation` on the shared executor with `token` as the token of its thread.
+            template<typename Result, typename Operation>
+            std::future<Result> runAsync(const CancellationToken& token, Operation&& operation)
+            {
+                return asyncExecutor().submit<Result>([token, operation = std::forward<Operation>(operation)]() {
+                    struct Scope {
+                        explicit Scope(const CancellationToken& token) { activeToken() = &token; }
+                        ~Scope() { activeToken() = nullptr; }
+                    } scope(token);
+                    _private::checkCancelled(); // cancelled while queued
+                    return operation();
+                });
+            }
+        }
+
+        /*
+            Copies a path to another path on the shared executor.
+
+            Return Value:
+            - Returns a future with the result of `copy()`. It throws what `copy()` would, or a
+              `std::system_error` with `operation_canceled` once `token` is cancelled.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+            `op`: Copy option to use. (Defaults `None`)
+            `token`: Token to cancel the copy with.
+
+            Notes:
+            - The token is checked between entries and between chunks of a file. A partly copied file
+              is removed, and with `ReplaceAll` nothing is swapped in.
+            - With `CopyOption::None` the executor thread asks on standard input about existing files.
+        */
+        inline std::future<bool> copyAsync(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& op = CopyOption::None,
+                                           const CancellationToken& token = CancellationToken())
+        {
+            return _private::runAsync<bool>(token, [from, to, op]() { return path::copy(from, to, op); });
+        }
+
+        /*
+            Moves a path to another path on the shared executor.
+
+            Return Value:
+            - Returns a future with the result of `move()`. It throws what `move()` would, or a
+              `std::system_error` with `operation_canceled` once `token` is cancelled.
+
+            Parameters:
+            `from`: Path to move.
+            `to`: Path to move to.
+            `op`: Copy option to use. (Defaults `None`)
+            `token`: Token to cancel the move with.
+
+            Notes:
+            - The source is only removed once everything is copied, so a cancelled move leaves it whole.
+        */
+        inline std::future<bool> moveAsync(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& op = CopyOption::None,
+                                           const CancellationToken& token = CancellationToken())
+        {
+            return _private::runAsync<bool>(token, [from, to, op]() { return path::move(from, to, op); });
+        }
+
+        /*
+            Deletes a path on the shared executor.
+
+            Return Value:
+            - Returns a future with the result of `remove()`. It throws what `remove()` would, or a
+              `std::system_error` with `operation_canceled` once `token` is cancelled.
+
+            Parameters:
+            `path`: Path to delete. With a trailing separator only its contents are deleted.
+            `token`: Token to cancel the removal with.
+
+            Notes:
+            - The token is checked before each entry. What was not reached yet is left in place.
+        */
+        inline std::future<bool> removeAsync(const std::filesystem::path& path, const CancellationToken& token = CancellationToken())
+        {
+            return _private::runAsync<bool>(token, [path, token]() {
+                RemoveStats stats;
+                bool removed = _private::removePath(path, stats, 0, [&token]() { return !token.cancelled(); });
+                _private::checkCancelled();
+                return removed;
+            });
+        }
+
+        /*
+            Returns the total size of a path, computed on the shared executor.
+
+            Return Value:
+            - Returns a future with the result of `size()`. It throws what `size()` would, or a
+              `std::system_error` with `operation_canceled` once `token` is cancelled.
+
+            Parameters:
+            `path`: Path to check size.
+            `metric`: What size metric to use. (Defaults `Byte`)
+            `token`: Token to cancel the walk with.
+        */
+        inline std::future<double> sizeAsync(const std::filesystem::path& path, const SizeMetric& metric = SizeMetric::Byte,
+                                             const CancellationToken& token = CancellationToken())
+        {
+            return _private::runAsync<double>(token, [path, metric]() { return path::size(path, metric); });
+        }
+
+        /*
+            Hashes the contents of a file with 64-bit FNV-1a on the shared executor.
+
+            Return Value:
+            - Returns a future with the hash. It throws a `std::filesystem::filesystem_error` if the file
+              cannot be read, or a `std::system_error` with `operation_canceled` once `token` is cancelled.
+
+            Parameters:
+            `path`: File to hash.
+            `token`: Token to cancel the hashing with.
+
+            Notes:
+            - The hash tells files apart quickly, as `CompareOption::Hash` does, but does not hold up
+              against deliberate collisions.
+            - The token is checked between chunks of the file.
+        */
+        inline std::future<std::uint64_t> hashAsync(const std::filesystem::path& path, const CancellationToken& token = CancellationToken())
+        {
+            return _private::runAsync<std::uint64_t>(token, [path]() {
+                os::_private::MetricsScope metrics_scope("hashAsync");
+                if(Backend* backend = _private::activeBackend()) {
+                    std::filesystem::file_type type = backend->type(path);
+                    if(type != std::filesystem::file_type::regular) {
+                        _private::fail(_private::errorMessage("hashAsync", "\"" + path.string() + "\" is not a file"), path,
+                                       type == std::filesystem::file_type::not_found ? std::errc::no_such_file_or_directory : std::errc::invalid_argument);
+                    }
+                    std::string data = backend->read(path);
+                    return _private::hashBytes(_private::fnv_offset, data.data(), data.size());
+                }
+
+                std::error_code ec;
+                std::filesystem::file_status status = std::filesystem::status(path, ec);
+                if(!ec && !std::filesystem::is_regular_file(status)) {
+                    ec = std::make_error_code(std::filesystem::is_directory(status) ? std::errc::is_a_directory : std::errc::invalid_argument);
+                }
+                std::uint64_t hash = 0;
+                if(ec || !_private::hashFile(path, hash)) {
+                    throw std::filesystem::filesystem_error(_private::errorMessage("hashAsync", "Failed to read \"" + path.string() + "\""), path,
+                                                            ec ? ec : _private::lastError());
+                }
+                return hash;
+            });
+        }
+
+
+        namespace _private {
+            // Makes `limiter` the budget of the calling thread and sets its disk priority, until the scope ends.
+            class ThrottleScope {
+                public:
+                    explicit ThrottleScope(const RateLimiter& limiter) : previous(activeLimiter())
+                    {
+                        activeLimiter() = &limiter;
+                        #if defined(__linux__) && defined(SYS_ioprio_get) && defined(SYS_ioprio_set)
+                            if(limiter.priority() != IOPriority::Normal) {
+                                const int who_process = 1; // IOPRIO_WHO_PROCESS, with an id of 0 it targets the calling thread
+                                old_priority = static_cast<int>(syscall(SYS_ioprio_get, who_process, 0));
+                                setIOPriority(limiter.priority());
+                            }
+                        #endif
+                    }
+
+                    ~ThrottleScope()
+                    {
+                        activeLimiter() = previous;
+                        #if defined(__linux__) && defined(SYS_ioprio_get) && defined(SYS_ioprio_set)
+                            if(old_priority >= 0) {
+                                syscall(SYS_ioprio_set, 1, 0, old_priority);
+                            }
+                        #endif
+                    }
+
+                    ThrottleScope(const ThrottleScope&) = delete;
+                    ThrottleScope& operator=(const ThrottleScope&) = delete;
+
+                private:
+                    const RateLimiter* previous;
+                    int old_priority = -1;
+            };
+        }
+
+        /*
+            Copies a path to another path within a bandwidth budget.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+            `op`: Copy option to use.
+            `limiter`: Budget to copy within, which can be shared with other operations.
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+
+            Notes:
+            - Each copied byte and each entry is taken from the budget. Files are copied in 1 MiB chunks so
+              the rate stays even within large files.
+            - The copy runs on the calling thread with the disk priority of `limiter`.
+        */
+        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& op, const RateLimiter& limiter,
+                         const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            _private::ThrottleScope scope(limiter);
+            return _private::copy(from, to, op, TraversalOption::Recursive, durability);
+        }
+
+        /*
+            Deletes a given path if it exists, within a budget of entries per second.
+
+            Parameters:
+            `path`: Path to delete. With a trailing separator only its contents are deleted.
+            `limiter`: Budget to delete within, which can be shared with other operations.
+
+            Notes:
+            - Each deleted entry is taken from the budget. The entries are deleted one at a time on the
+              calling thread, with the disk priority of `limiter`.
+        */
+        inline bool remove(const std::filesystem::path& path, const RateLimiter& limiter)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            _private::ThrottleScope scope(limiter);
+            RemoveStats stats;
+            return _private::removePath(path, stats, 1, [&]() {
+                limiter.acquire(0, 1);
+                return true;
+            });
+        }
+
+        /*
+            Moves a path to another path within a bandwidth budget.
+
+            Parameters:
+            `from`: Path to move.
+            `to`: Path to move to.
+            `op`: Copy option to use.
+            `limiter`: Budget to move within, which can be shared with other operations.
+            `durability`: How much is flushed to disk before returning. (Defaults `None`)
+
+            Notes:
+            - The copy and the removal of the source both take from the budget, as with `copy()` and `remove()`.
+        */
+        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& op, const RateLimiter& limiter,
+                         const Durability& durability = Durability::None)
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            if(!path::copy(from, to, op, limiter, durability)) {
+                return false;
+            }
+
+            path::remove(from, limiter);
+            return true;
+        }
+
+        /*
+            Copies a path to another path within a bandwidth budget.
+
+            Parameters:
+            `from`: Path to copy.
+            `to`: Path to copy to.
+            `op`: Copy option to use.
+            `limiter`: Budget to copy within, which can be shared with other operations.
+            `durability`: How much is flushed to disk before returning.
+            `ec`: Gets the error, `no_such_file_or_directory` if `from` does not exist.
+        */
+        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& op, const RateLimiter& limiter,
+                         const Durability& durability, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::transfer(from, to, ec, [&]() { return path::copy(from, to, op, limiter, durability); });
+        }
+
+        /*
+            Moves a path to another path within a bandwidth budget.
+
+            Parameters:
+            `from`: Path to move.
+            `to`: Path to move to.
+            `op`: Copy option to use.
+            `limiter`: Budget to move within, which can be shared with other operations.
+            `durability`: How much is flushed to disk before returning.
+            `ec`: Gets the error, `no_such_file_or_directory` if `from` does not exist.
+        */
+        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& op, const RateLimiter& limiter,
+                         const Durability& durability, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::transfer(from, to, ec, [&]() { return path::move(from, to, op, limiter, durability); });
+        }
+
+        /*
+            Deletes a given path if it exists, within a budget of entries per second.
+
+            Parameters:
+            `path`: Path to delete.
+            `limiter`: Budget to delete within, which can be shared with other operations.
+            `ec`: Gets the error if something could not be deleted. A missing path is not an error.
+        */
+        inline bool remove(const std::filesystem::path& path, const RateLimiter& limiter, std::error_code& ec) noexcept
+        {
+            os::_private::MetricsScope metrics_scope(__func__);
+            return _private::onBackend(ec, false, [&]() { return path::remove(path, limiter); });
+        }
+
+        namespace _private {
+
+            inline std::string errorMessage(const std::string& function_name, const std::string& message)
+            {
+                std::string error = "[Error]";
+                #ifdef _DEBUG
+                    error.append("[" + function_name + "]");
+                #endif
+                error.push_back(' ');
+                error.append(message);
+
+                return error;
+            }
+
+            inline char copyWarning(const std::filesystem::path& path)
+            {
+                char ch;
+                std::cout << "[Warning] \"" << path.string() << "\" already exists. Would you like to overwrite?" << std::endl;
+                std::cout << "[Y] for yes, [N] for no, [A] for yes to all, [X] to cancel: ";
+                std::cin >> ch;
+                std::cin.clear();
+                std::cin.ignore(256, '\n');
+                return ch;
+            }
+
+        #if defined(__linux__)
+            /*
+                Deletes a directory tree with a pool of workers.
+
+                Each worker takes a directory from the stack, opens it relative to its parent's file descriptor,
+                unlinks its files relative to its own and pushes its subdirectories. A directory is removed
+                through its parent's descriptor once its own scan and the removal of all its subdirectories are
+                done, so no path is resolved twice. Taking the newest directory first finishes subtrees early,
+                which keeps few descriptors open, and workers are only started while directories are waiting.
+            */
+            class TreeRemover {
+            public:
+                TreeRemover(RemoveStats& stats, const std::function<bool()>& on_entry) : stats(stats), on_entry(on_entry) {}
+
+                void run(const std::filesystem::path& root, bool keep_root, unsigned int threads)
+                {
+                    struct stat st;
+                    os::_private::countMetric(os::_private::Counter::Stats);
+                    if(lstat(root.c_str(), &st) != 0) {
+                        throw std::filesystem::filesystem_error("remove", root, std::error_code(errno, std::generic_category()));
+                    }
+
+                    if(!S_ISDIR(st.st_mode)) {
+                        if(unlink(root.c_str()) != 0) {
+                            throw std::filesystem::filesystem_error("remove", root, std::error_code(errno, std::generic_category()));
+                        }
+                        stats.entries = 1;
+                        stats.bytes = S_ISREG(st.st_mode) ? st.st_size : 0;
+                        return;
+                    }
+
+                    max_workers = (threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threads) - 1;
+                    directories.emplace_back(nullptr, root.string(), keep_root);
+                    queue.push_back(&directories.back());
+                    outstanding = 1;
+
+                    work();
+                    for(auto& worker : workers) { // none are started once nothing is outstanding
+                        worker.join();
+                    }
+                    for(auto& dir : directories) { // left open by a failure or a stop
+                        if(dir.stream) {
+                            closedir(dir.stream);
+                        }
+                    }
+
+                    stats.entries = entries;
+                    stats.bytes = bytes;
+                    if(error && !stopped) {
+                        throw std::filesystem::filesystem_error("remove", error_path, error);
+                    }
+                }
+
+            private:
+                struct Directory {
+                    Directory(Directory* parent, std::string name, bool keep) : parent(parent), name(std::move(name)), pending(1), keep(keep) {}
+
+                    Directory* parent;
+                    std::string name; // the whole path for the root
+                    DIR* stream = nullptr; // open from the scan until the directory is removed
+                    std::atomic<std::size_t> pending; // own scan plus subdirectories not yet removed
+                    bool keep;
+                };
+
+                RemoveStats& stats;
+                const std::function<bool()>& on_entry; // called before each entry, returns `false` to stop
+                std::atomic<bool> stopped {false};
+                std::deque<Directory> directories; // owns every directory, addresses stay stable
+                std::vector<Directory*> queue; // taken from the back
+                std::size_t outstanding = 0; // directories queued or being scanned
+                std::vector<std::thread> workers;
+                std::size_t max_workers = 0; // besides the calling thread
+                std::size_t idle = 0; // workers waiting for a directory
+                std::mutex mutex;
+                std::condition_variable cv;
+                std::atomic<std::uintmax_t> entries {0};
+                std::atomic<std::uintmax_t> bytes {0};
+                std::error_code error;
+                std::string error_path;
+
+                void work()
+                {
+                    while(true) {
+                        Directory* dir;
+                        {
+                            std::unique_lock<std::mutex> lock(mutex);
+                            idle++;
+                            cv.wait(lock, [this]() { return !queue.empty() || outstanding == 0; });
+                            idle--;
+                            if(outstanding == 0) {
+                                return;
+                            }
+                            dir = queue.back();
+                            queue.pop_back();
+                            if(stopped) { // left in place
+                                if(--outstanding == 0) {
+                                    cv.notify_all();
+                                }
+                                continue;
+                            }
+                        }
+
+                        scan(dir);
+
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if(--outstanding == 0) {
+                            cv.notify_all();
+                        }
+                    }
+                }
+
+                void scan(Directory* dir)
+                {
+                    int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+                    int fd = dir->parent ? openat(dirfd(dir->parent->stream), dir->name.c_str(), flags) : open(dir->name.c_str(), flags);
+                    dir->stream = fd < 0 ? nullptr : fdopendir(fd);
+                    os::_private::countMetric(os::_private::Counter::Opens);
+                    if(!dir->stream) {
+                        fail(pathOf(dir), errno);
+                        if(fd >= 0) {
+                            close(fd);
+                        }
+                        return; // `dir` and its parents stay, they cannot be emptied
+                    }
+                    os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+
+                    while(dirent* entry = readdir(dir->stream)) {
+                        const char* name = entry->d_name;
+                        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                            continue;
+                        }
+
+                        if(on_entry && (stopped || !on_entry())) {
+                            stopped = true;
+                            return; // leave the rest of the tree in place
+                        }
+
+                        struct stat st;
+                        bool has_stat = false;
+                        unsigned char type = entry->d_type;
+                        if(type == DT_UNKNOWN || type == DT_REG) {
+                            has_stat = fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+                            os::_private::countMetric(os::_private::Counter::Stats);
+                            if(has_stat) {
+                                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+                            }
+                        }
+
+                        if(type == DT_DIR) {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            dir->pending++;
+                            directories.emplace_back(dir, name, false);
+                            queue.push_back(&directories.back());
+                            outstanding++;
+                            if(idle == 0 && workers.size() < max_workers) {
+                                try {
+                                    workers.emplace_back(&TreeRemover::work, this);
+                                    continue;
+                                } catch(const std::system_error&) {
+                                    max_workers = workers.size(); // the threads already running take it
+                                }
+                            }
+                            cv.notify_one();
+                            continue;
+                        }
+
+                        if(unlinkat(fd, name, 0) != 0) {
+                            if(errno != ENOENT) {
+                                fail(pathOf(dir) + '/' + name, errno);
+                            }
+                            continue;
+                        }
+                        entries++;
+                        if(has_stat && type == DT_REG) {
+                            bytes += st.st_size;
+                        }
+                    }
+
+                    release(dir);
+                }
+
+                // Drops one pending reference and removes every directory that became empty.
+                void release(Directory* dir)
+                {
+                    while(dir && dir->pending.fetch_sub(1) == 1) {
+                        closedir(dir->stream);
+                        dir->stream = nullptr;
+                        if(!dir->keep) {
+                            int removed = dir->parent ? unlinkat(dirfd(dir->parent->stream), dir->name.c_str(), AT_REMOVEDIR) : rmdir(dir->name.c_str());
+                            if(removed != 0) {
+                                fail(pathOf(dir), errno);
+                                return;
+                            }
+                            entries++;
+                        }
+                        dir = dir->parent;
+                    }
+                }
+
+                static std::string pathOf(const Directory* dir)
+                {
+                    return dir->parent ? pathOf(dir->parent) + '/' + dir->name : dir->name;
+                }
+
+                void fail(const std::string& path, int code)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if(!error) {
+                        error = std::error_code(code, std::generic_category());
+                        error_path = path;
+                    }
+                }
+            };
+        #endif
+
+            /*
+                Deletes a path and everything under it.
+
+                Parameters:
+                `path`: Path to delete.
+                `keep_root`: Set to `true` to only delete the contents of the directory.
+                `stats`: Gets the number of entries and bytes that were removed.
+                `threads`: Most workers to use, started only while directories are waiting. (`0` for one per hardware thread)
+                `on_entry`: Called before each entry is removed. Return `false` to stop and leave the rest in place.
+            */
+            inline void removeTree(const std::filesystem::path& path, bool keep_root, RemoveStats& stats, unsigned int threads,
+                                   const std::function<bool()>& on_entry)
+            {
+                stats = RemoveStats();
+
+                #if defined(__linux__)
+                    TreeRemover(stats, on_entry).run(path, keep_root, threads);
+                #else
+                    std::filesystem::path root = path;
+                    if(!std::filesystem::is_directory(std::filesystem::symlink_status(root))) {
+                        stats.bytes = std::filesystem::is_regular_file(std::filesystem::symlink_status(root)) ? std::filesystem::file_size(root) : 0;
+                        stats.entries = std::filesystem::remove(root) ? 1 : 0;
+                        return;
+                    }
+
+                    for(const auto& entry : std::filesystem::recursive_directory_iterator(root)) {
+                        if(entry.is_regular_file() && !entry.is_symlink()) {
+                            stats.bytes += entry.file_size();
+                        }
+                        os::_private::countMetric(os::_private::Counter::Stats);
+                    }
+
+                    if(keep_root) {
+                        for(const auto& entry : std::filesystem::directory_iterator(root)) {
+                            stats.entries += std::filesystem::remove_all(entry.path());
+                        }
+                    } else {
+                        stats.entries = std::filesystem::remove_all(root);
+                    }
+                #endif
+            }
+
+        #if defined(__linux__)
+            // Writes every buffer in `iov`, continuing after partial writes.
+            inline bool writeAll(int fd, iovec* iov, int count)
+            {
+                while(count > 0) {
+                    ssize_t written = writev(fd, iov, count);
+                    if(written < 0) {
+                        if(errno == EINTR) {
+                            continue;
+                        }
+                        return false;
+                    }
+
+                    while(count > 0 && static_cast<std::size_t>(written) >= iov->iov_len) {
+                        written -= iov->iov_len;
+                        iov++;
+                        count--;
+                    }
+                    if(count > 0) {
+                        iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+                        iov->iov_len -= written;
+                    }
+                }
+                return true;
+            }
+
+            // Flushes a file or directory to disk.
+            inline bool syncPath(const std::filesystem::path& path)
+            {
+                int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                os::_private::countMetric(os::_private::Counter::Opens);
+                if(fd < 0) {
+                    return false;
+                }
+                bool synced = fsync(fd) == 0;
+                close(fd);
+                return synced;
+            }
+        #endif
+
+            /*
+                Writes buffers into a file.
+
+                Parameters:
+                `path`: File to write.
+                `data`: Buffers to write.
+                `count`: Number of buffers.
+                `lines`: Set to `true` to put a newline between buffers.
+                `write_option`: Set to `Atomic` to write a temporary file and rename it over `path`.
+                `durability`: `GroupCommit` flushes the data, and the directory when the file is new or replaced atomically.
+                              `Strict` always flushes both.
+            */
+            inline bool writeFile(const std::filesystem::path& path, const std::string* data, std::size_t count, bool lines,
+                                  const WriteOption& write_option, const Durability& durability)
+            {
+                bool atomic = write_option == WriteOption::Atomic;
+                std::filesystem::path target = path;
+                if(atomic) {
+                    target = path.parent_path() / ("." + path.filename().string() + ".tmp." + uniqueSuffix());
+                }
+
+                #if defined(__linux__)
+                    // A new name is only on disk once its directory is flushed
+                    bool created = atomic;
+                    if(!atomic && durability == Durability::GroupCommit) {
+                        struct stat st;
+                        os::_private::countMetric(os::_private::Counter::Stats);
+                        created = stat(path.c_str(), &st) != 0;
+                    }
+
+                    int fd = open(target.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (atomic ? O_EXCL : O_TRUNC), 0666);
+                    os::_private::countMetric(os::_private::Counter::Opens);
+                    if(fd < 0) {
+                        return false;
+                    }
+
+                    if(atomic) {
+                        struct stat st;
+                        os::_private::countMetric(os::_private::Counter::Stats);
+                        if(stat(path.c_str(), &st) == 0) {
+                            fchmod(fd, st.st_mode & 07777); // keep the permissions of the file being replaced
+                        }
+                    }
+
+                    static char newline = '\n';
+                    const int batch = IOV_MAX < 1024 ? IOV_MAX : 1024;
+                    iovec iov[1024];
+                    int n = 0;
+                    bool ok = true;
+                    std::uint64_t written = 0;
+                    for(std::size_t i = 0; i < count && ok; i++) {
+                        if(!data[i].empty()) {
+                            iov[n++] = {const_cast<char*>(data[i].data()), data[i].size()};
+                            written += data[i].size();
+                        }
+                        if(lines && i + 1 < count) {
+                            iov[n++] = {&newline, 1};
+                            written++;
+                        }
+                        if(n >= batch - 1) {
+                            ok = writeAll(fd, iov, n);
+                            n = 0;
+                        }
+                    }
+                    if(ok && n > 0) {
+                        ok = writeAll(fd, iov, n);
+                    }
+                    os::_private::countMetric(os::_private::Counter::BytesWritten, written);
+
+                    // The data has to be on disk before the rename, or a crash could leave an empty file
+                    if(ok && durability != Durability::None) {
+                        ok = (durability == Durability::Strict ? fsync(fd) : fdatasync(fd)) == 0;
+                    }
+                    ok = close(fd) == 0 && ok;
+
+                    if(ok && atomic) {
+                        ok = ::rename(target.c_str(), path.c_str()) == 0;
+                    }
+                    if(ok && (durability == Durability::Strict || (created && durability == Durability::GroupCommit))) {
+                        ok = syncPath(path.parent_path().empty() ? "." : path.parent_path());
+                    }
+
+                    if(!ok && atomic) {
+                        unlink(target.c_str());
+                    }
+                    return ok;
+                #else
+                    {
+                        std::vector<char> buffer(1 << 20);
+                        std::ofstream file;
+                        file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+                        file.open(target, std::ios::binary);
+                        os::_private::countMetric(os::_private::Counter::Opens);
+                        if(!file.is_open()) {
+                            return false;
+                        }
+
+                        for(std::size_t i = 0; i < count; i++) {
+                            file << data[i];
+                            if(lines && i + 1 < count) {
+                                file << '\n';
+                            }
+                        }
+                        os::_private::countMetric(os::_private::Counter::BytesWritten, static_cast<std::uint64_t>(std::streamoff(file.tellp())));
+                        file.close();
+                        if(!file) {
+                            std::error_code ec;
+                            std::filesystem::remove(target, ec);
+                            return false;
+                        }
+                    }
+
+                    if(atomic) {
+                        std::error_code ec;
+                        std::filesystem::rename(target, path, ec);
+                        if(ec) {
+                            std::filesystem::remove(target, ec);
+                            return false;
+                        }
+                    }
+                    return true;
+                #endif
+            }
+
+            /*
+                Collects what an operation wrote so it can be flushed to disk according to a `Durability`.
+
+                Notes:
+                - `Strict` flushes each file and its parent directory as soon as it is added.
+                - `GroupCommit` waits for `commit()`. A few files are flushed one by one, larger batches
+                  with one `syncfs` per filesystem.
+            */
+            class SyncBatch {
+                public:
+                    explicit SyncBatch(const Durability& durability) : durability(durability) {}
+
+                    // Records a file that was written through `fd`.
+                    bool addFile(int fd, const std::filesystem::path& path)
+                    {
+                        #if defined(__linux__)
+                            if(durability == Durability::Strict) {
+                                return fsync(fd) == 0 && syncPath(parentOf(path));
+                            } else if(durability == Durability::GroupCommit) {
+                                struct stat st;
+                                if(fstat(fd, &st) == 0) {
+                                    filesystems.emplace(st.st_dev, parentOf(path));
+                                }
+                                files.push_back(path);
+                                directories.insert(parentOf(path));
+                            }
+                        #endif
+                        return true;
+                    }
+
+                    // Records a directory that was created.
+                    bool addDirectory(const std::filesystem::path& path)
+                    {
+                        #if defined(__linux__)
+                            if(durability == Durability::Strict) {
+                                return syncPath(parentOf(path));
+                            } else if(durability == Durability::GroupCommit) {
+                                directories.insert(parentOf(path));
+                            }
+                        #endif
+                        return true;
+                    }
+
+                    // Flushes everything recorded since the last commit.
+                    bool commit()
+                    {
+                        bool ok = true;
+                        #if defined(__linux__)
+                            if(files.size() > max_file_syncs) {
+                                for(const auto& filesystem : filesystems) {
+                                    int fd = open(filesystem.second.c_str(), O_RDONLY | O_CLOEXEC);
+                                    ok = fd >= 0 && syncfs(fd) == 0 && ok;
+                                    if(fd >= 0) {
+                                        close(fd);
+                                    }
+                                }
+                            } else {
+                                for(const auto& file : files) {
+                                    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+                                    ok = fd >= 0 && fdatasync(fd) == 0 && ok;
+                                    if(fd >= 0) {
+                                        close(fd);
+                                    }
+                                }
+                                for(const auto& directory : directories) {
+                                    ok = syncPath(directory) && ok;
+                                }
+                            }
+                            files.clear();
+                            directories.clear();
+                            filesystems.clear();
+                        #endif
+                        return ok;
+                    }
+
+                private:
+                    static constexpr std::size_t max_file_syncs = 128;
+
+                    static std::filesystem::path parentOf(const std::filesystem::path& path)
+                    {
+                        std::filesystem::path parent = path.parent_path();
+                        return parent.empty() ? "." : parent;
+                    }
+
+                    Durability durability;
+                    std::vector<std::filesystem::path> files;
+                    std::set<std::filesystem::path> directories;
+                #if defined(__linux__)
+                    std::map<dev_t, std::filesystem::path> filesystems;
+                #endif
+            };
+
+        #if defined(__linux__)
+            constexpr std::size_t io_buffer_size = 1 << 20;
+
+            // Buffer for copying through user space, aligned for O_DIRECT and kept per thread so small files do not pay for an allocation each.
+            inline char* ioBuffer()
+            {
+                thread_local std::unique_ptr<char, decltype(&std::free)> buffer(nullptr, &std::free);
+                if(!buffer) {
+                    void* memory = nullptr;
+                    if(posix_memalign(&memory, 4096, io_buffer_size) != 0) {
+                        throw std::bad_alloc();
+                    }
+                    buffer.reset(static_cast<char*>(memory));
+                }
+                return buffer.get();
+            }
+
+            // Hashes a whole file from its start, whatever the offset of `file`. Reads aligned blocks, so it also takes O_DIRECT descriptors.
+            inline bool hashDescriptor(int file, std::uint64_t& hash)
+            {
+                char* buffer = ioBuffer();
+                off_t offset = 0;
+                hash = fnv_offset;
+                while(true) {
+                    ssize_t bytes = pread(file, buffer, io_buffer_size, offset);
+                    if(bytes < 0 && errno == EINTR) {
+                        continue;
+                    } else if(bytes <= 0) {
+                        return bytes == 0;
+                    }
+                    hash = hashBytes(hash, buffer, static_cast<std::size_t>(bytes));
+                    offset += bytes;
+                    os::_private::countMetric(os::_private::Counter::BytesRead, bytes);
+                }
+            }
+
+            /*
+                Hashes two whole files side by side, like `hashDescriptor()` on each.
+
+                Notes:
+                - Each FNV-1a step waits on the one before it, so the two hashes are advanced in the same loop
+                  where the processor can work on both at once.
+            */
+            inline bool hashDescriptors(int file1, int file2, std::uint64_t& hash1, std::uint64_t& hash2)
+            {
+                constexpr std::size_t half = io_buffer_size / 2;
+                char* buffer1 = ioBuffer();
+                char* buffer2 = buffer1 + half;
+                auto fill = [](int file, char* buffer, off_t offset, ssize_t& bytes) {
+                    do {
+                        bytes = pread(file, buffer, half, offset);
+                    } while(bytes < 0 && errno == EINTR);
+                    return bytes >= 0;
+                };
+
+                // each file moves on by what was read from it, so a short read skips nothing
+                off_t offset1 = 0;
+                off_t offset2 = 0;
+                hash1 = fnv_offset;
+                hash2 = fnv_offset;
+                while(true) {
+                    ssize_t bytes1 = 0;
+                    ssize_t bytes2 = 0;
+                    if(!fill(file1, buffer1, offset1, bytes1) || !fill(file2, buffer2, offset2, bytes2)) {
+                        return false;
+                    } else if(bytes1 == 0 && bytes2 == 0) {
+                        return true;
+                    }
+
+                    std::size_t both = static_cast<std::size_t>(std::min(bytes1, bytes2));
+                    for(std::size_t i = 0; i < both; i++) {
+                        hash1 = (hash1 ^ static_cast<unsigned char>(buffer1[i])) * 1099511628211ull;
+                        hash2 = (hash2 ^ static_cast<unsigned char>(buffer2[i])) * 1099511628211ull;
+                    }
+                    hash1 = hashBytes(hash1, buffer1 + both, static_cast<std::size_t>(bytes1) - both);
+                    hash2 = hashBytes(hash2, buffer2 + both, static_cast<std::size_t>(bytes2) - both);
+                    offset1 += bytes1;
+                    offset2 += bytes2;
+                    os::_private::countMetric(os::_private::Counter::BytesRead, bytes1 + bytes2);
+                }
+            }
+        #endif
+
+            /*
+                Hashes copied files and checks each copy against its source.
+
+                Notes:
+                - With `VerifyOption::Device` on Linux, the source is hashed as the copy streams it through user space and
+                  the copies are read back with O_DIRECT, so the check sees what reached the device rather than the pages
+                  just written. Reading a file that way waits for its writeback, so the files are kept open and read back
+                  128 at a time, after their writeback was started together.
+                - Makes itself the batch of the calling thread until it is destroyed.
+            */
+            class DigestBatch {
+                public:
+                    DigestBatch(CopyDigests& digests, const VerifyOption& verify) : digests(digests), verify(verify), previous(activeDigests())
+                    {
+                        activeDigests() = this;
+                    }
+
+                    ~DigestBatch()
+                    {
+                        activeDigests() = previous;
+                        #if defined(__linux__)
+                            for(const Check& check : pending) {
+                                close(check.file);
+                            }
+                        #endif
+                    }
+
+                    DigestBatch(const DigestBatch&) = delete;
+                    DigestBatch& operator=(const DigestBatch&) = delete;
+
+                #if defined(__linux__)
+                    // Whether copies hash the source on its way through user space, because the copy is read back from the device.
+                    bool hashesStream() const
+                    {
+                        return verify == VerifyOption::Device;
+                    }
+
+                    // Records the digest of `from` and checks its copy, hashing both through the descriptors still open from the copy.
+                    void add(const std::filesystem::path& from, int source, int destination)
+                    {
+                        std::uint64_t hash = 0;
+                        std::uint64_t copied = 0;
+                        bool ok = hashDescriptors(source, destination, hash, copied);
+                        if(ok) {
+                            digests.files[from.string()] = hash;
+                        }
+                        if(!ok || copied != hash) {
+                            digests.mismatched.push_back(from.string());
+                        }
+                    }
+
+                    // Records `hash`, taken while `from` was copied, and queues reading its copy `to` back from the device.
+                    void add(const std::filesystem::path& from, const std::filesystem::path& to, std::uint64_t hash, int destination)
+                    {
+                        digests.files[from.string()] = hash;
+                        sync_file_range(destination, 0, 0, SYNC_FILE_RANGE_WRITE); // overlaps with the next files
+                        int file = open(to.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+                        if(file < 0) { // not every filesystem takes O_DIRECT (tmpfs, for one)
+                            file = open(to.c_str(), O_RDONLY | O_CLOEXEC);
+                        }
+                        os::_private::countMetric(os::_private::Counter::Opens);
+                        if(file < 0) {
+                            digests.mismatched.push_back(from.string());
+                            return;
+                        }
+                        pending.push_back({from.string(), file, hash});
+                        if(pending.size() >= max_pending) {
+                            commit();
+                        }
+                    }
+                #else
+                    // Records the digest of `from` and checks its copy `to`.
+                    void add(const std::filesystem::path& from, const std::filesystem::path& to)
+                    {
+                        std::uint64_t hash = 0;
+                        std::uint64_t copied = 0;
+                        if(!hashFile(from, hash)) {
+                            digests.mismatched.push_back(from.string());
+                            return;
+                        }
+                        digests.files[from.string()] = hash;
+                        if(!hashFile(to, copied) || copied != hash) {
+                            digests.mismatched.push_back(from.string());
+                        }
+                    }
+                #endif
+
+                    // Checks the queued copies. Returns `false` if any copy so far did not match its source.
+                    bool commit()
+                    {
+                        #if defined(__linux__)
+                            for(const Check& check : pending) {
+                                std::uint64_t copied = 0;
+                                bool ok = hashDescriptor(check.file, copied);
+                                close(check.file);
+                                if(!ok || copied != check.hash) {
+                                    digests.mismatched.push_back(check.from);
+                                }
+                            }
+                            pending.clear();
+                        #endif
+                        return digests.mismatched.empty();
+                    }
+
+                private:
+                    struct Check {
+                        std::string from;
+                        int file;
+                        std::uint64_t hash;
+                    };
+                    static constexpr std::size_t max_pending = 128;
+
+                    CopyDigests& digests;
+                    VerifyOption verify;
+                    DigestBatch* previous;
+                    std::vector<Check> pending;
+            };
+
+            inline bool copyFile(const std::filesystem::path& from, const std::filesystem::path& to, SyncBatch& batch) 
+            {
+                std::filesystem::path parent_temp = to.parent_path();
+                os::_private::countMetric(os::_private::Counter::Stats);
+                if(!parent_temp.empty() && !std::filesystem::exists(parent_temp)) {
+                    std::filesystem::create_directories(parent_temp);
+                    batch.addDirectory(parent_temp);
+                }
+
+                #if defined(__linux__)
+                    int source = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+                    os::_private::countMetric(os::_private::Counter::Opens);
+                    if(source < 0) {
+                        return false;
+                    }
+
+                    DigestBatch* digests = _private::activeDigests(); // a verified copy may hash the copy through this descriptor
+                    int destination = open(to.c_str(), (digests ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+                    os::_private::countMetric(os::_private::Counter::Opens);
+                    if(destination < 0) {
+                        close(source);
+                        return false;
+                    }
+                    posix_fadvise(source, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+                    // Let the kernel copy (or share extents) without a round trip through user space,
+                    // in smaller chunks when a cancellation has to be noticed or a budget kept.
+                    // A copy read back from the device is hashed on its way through instead.
+                    bool ok = true;
+                    bool fallback = false;
+                    bool cancellable = _private::activeToken() != nullptr;
+                    bool streamed = digests && digests->hashesStream();
+                    std::uint64_t hash = fnv_offset;
+                    std::size_t chunk = _private::activeLimiter() ? 1 << 20 : cancellable ? 1 << 24 : 1 << 30;
+                    while(!streamed && !(cancellable && _private::isCancelled())) {
+                        ssize_t copied = copy_file_range(source, nullptr, destination, nullptr, chunk, 0);
+                        if(copied > 0) {
+                            os::_private::countMetric(os::_private::Counter::BytesRead, copied);
+                            os::_private::countMetric(os::_private::Counter::BytesWritten, copied);
+                            _private::throttle(static_cast<std::uintmax_t>(copied), 0);
+                            continue;
+                        } else if(copied == 0) {
+                            break;
+                        } else if(errno == EINTR) {
+                            continue;
+                        } else if(errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP) {
+                            fallback = true;
+                        } else {
+                            ok = false;
+                        }
+                        break;
+                    }
+
+                    if(fallback || streamed) {
+                        char* buffer = ioBuffer();
+                        while(ok && !(cancellable && _private::isCancelled())) {
+                            ssize_t bytes = read(source, buffer, io_buffer_size);
+                            if(bytes < 0 && errno == EINTR) {
+                                continue;
+                            } else if(bytes <= 0) {
+                                ok = bytes == 0;
+                                break;
+                            }
+
+                            if(streamed) {
+                                hash = hashBytes(hash, buffer, static_cast<std::size_t>(bytes));
+                            }
+                            iovec iov = {buffer, static_cast<std::size_t>(bytes)};
+                            ok = writeAll(destination, &iov, 1);
+                            os::_private::countMetric(os::_private::Counter::BytesRead, bytes);
+                            os::_private::countMetric(os::_private::Counter::BytesWritten, bytes);
+                            _private::throttle(static_cast<std::uintmax_t>(bytes), 0);
+                        }
+                    }
+
+                    if(cancellable && _private::isCancelled()) { // drop the partly copied file
+                        close(destination);
+                        close(source);
+                        std::error_code ec;
+                        std::filesystem::remove(to, ec);
+                        _private::checkCancelled();
+                    }
+
+                    if(ok && streamed) {
+                        digests->add(from, to, hash, destination);
+                    } else if(ok && digests) {
+                        digests->add(from, source, destination);
+                    }
+                    ok = ok && batch.addFile(destination, to);
+                    ok = close(destination) == 0 && ok;
+                    close(source);
+                    return ok;
+                #else
+                    std::ifstream source(from, std::ios::binary);
+                    os::_private::countMetric(os::_private::Counter::Opens, 2);
+                    if(!source.is_open()) {
+                        return false;
+                    }
+
+                    std::ofstream destination(to, std::ios::binary);
+                    if(!destination.is_open()) {
+                        source.close();
+                        return false;
+                    }
+
+                    destination << source.rdbuf(); 
+                    std::uint64_t copied = static_cast<std::uint64_t>(std::streamoff(destination.tellp()));
+                    os::_private::countMetric(os::_private::Counter::BytesRead, copied);
+                    os::_private::countMetric(os::_private::Counter::BytesWritten, copied);
+                    _private::throttle(copied, 0);
+
+                    if(!destination) {
+                        source.close();
+                        destination.close();
+                        return false;
+                    }
+
+                    source.close();
+                    destination.close();
+
+                    if(DigestBatch* digests = _private::activeDigests()) {
+                        digests->add(from, to);
+                    }
+                    return true;
+                #endif
+            }
+
+            /*
+                Builds a new directory next to `target` and swaps it in with a single rename.
+
+                Parameters:
+                `target`: Directory to replace. It is created if it does not exist.
+                `fill`: Fills the staging directory. The staging directory is dropped if it returns `false` or throws.
+
+                Notes:
+                - On Linux the trees are exchanged with `renameat2(RENAME_EXCHANGE)`, so readers always see either the
+                  old or the new tree. Elsewhere the old tree is renamed away first, leaving a short gap.
+                - The old tree is deleted in the background with `removeDeferred()`.
+            */
+            inline bool replaceDirectory(const std::filesystem::path& target, const std::function<bool(const std::filesystem::path&)>& fill)
+            {
+                std::filesystem::path directory = std::filesystem::absolute(target).lexically_normal();
+                if(directory.filename().empty()) {
+                    directory = directory.parent_path();
+                }
+                if(std::filesystem::exists(directory) && !std::filesystem::is_directory(directory)) {
+                    throw std::runtime_error(_private::errorMessage(__func__, "\"" + directory.filename().string() + "\" is a file"));
+                }
+
+                std::filesystem::path parent = directory.parent_path();
+                std::filesystem::create_directories(parent);
+                std::filesystem::path staging = parent / ("." + directory.filename().string() + ".staging." + uniqueSuffix());
+                std::filesystem::create_directory(staging);
+
+                bool filled = false;
+                try {
+                    filled = fill(staging);
+                } catch(...) {
+                    RemoveStats stats;
+                    removeTree(staging, false, stats);
+                    throw;
+                }
+                if(!filled) {
+                    RemoveStats stats;
+                    removeTree(staging, false, stats);
+                    return false;
+                }
+
+                if(!std::filesystem::exists(directory)) {
+                    std::filesystem::rename(staging, directory);
+                    return true;
+                }
+
+                #if defined(__linux__) && defined(SYS_renameat2)
+                    constexpr unsigned int rename_exchange = 1 << 1; // RENAME_EXCHANGE
+                    if(syscall(SYS_renameat2, AT_FDCWD, staging.c_str(), AT_FDCWD, directory.c_str(), rename_exchange) == 0) {
+                        path::removeDeferred(staging); // now holds the old tree
+                        return true;
+                    }
+                #endif
+
+                // The filesystem cannot exchange, so move the old tree aside first
+                std::filesystem::path old = parent / ("." + directory.filename().string() + ".old." + uniqueSuffix());
+                std::filesystem::rename(directory, old);
+                std::error_code ec;
+                std::filesystem::rename(staging, directory, ec);
+                if(ec) {
+                    std::filesystem::rename(old, directory);
+                    RemoveStats stats;
+                    removeTree(staging, false, stats);
+                    throw std::filesystem::filesystem_error("Failed to replace directory", staging, directory, ec);
+                }
+                path::removeDeferred(old);
+                return true;
+            }
+
+            // Copies a file next to `to`, then renames it over `to`.
+            inline bool replaceFile(const std::filesystem::path& from, const std::filesystem::path& to, SyncBatch& batch)
+            {
+                std::filesystem::path temp = to.parent_path() / ("." + to.filename().string() + ".tmp." + uniqueSuffix());
+                if(!copyFile(from, temp, batch) || !batch.commit()) {
+                    std::error_code ec;
+                    std::filesystem::remove(temp, ec);
+                    return false;
+                }
+
+                std::filesystem::rename(temp, to);
+                return batch.addDirectory(to);
+            }
+
+            inline bool copyTree(const std::filesystem::path& source, const std::filesystem::path& destination, 
+                                 const CopyOption& op, const TraversalOption& t_op, SyncBatch& batch)
+            {
+                if(!std::filesystem::exists(source)) {
+                    throw std::runtime_error(_private::errorMessage(__func__, "\"" + source.string() + "\" does not exist"));
+                }
+
+                char ch;
+                std::filesystem::path from = source;
+                std::filesystem::path to = destination;
+                if(std::filesystem::is_directory(from)) { // is directory
+
+                    // Create directory when destination does not exists
+                    if(!std::filesystem::exists(to)) {
+                        std::filesystem::create_directories(to);
+                        batch.addDirectory(to);
+                    }
+
+                    // Throw an error if a directory is being copied into a file
+                    if(!std::filesystem::is_directory(to)) {
+                        throw std::runtime_error(_private::errorMessage(__func__, "\"" + to.filename().string() + "\" is a file"));
+                    }
+
+                    // Remove all contents of directory when "OverwriteAll" option is active
+                    if(op == CopyOption::OverwriteAll) {
+                        RemoveStats stats;
+                        _private::removeTree(to, true, stats);
+                    } 
+
+                    // store the paths first before copying to prevent endless recursion
+                    std::vector<std::filesystem::path> paths;
+                    os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                    if(t_op == TraversalOption::Recursive) {
+                        // Get relative path to conserve memory
+                        for(const auto& entry : std::filesystem::recursive_directory_iterator(from)) {
+                            _private::checkCancelled();
+                            paths.push_back(std::filesystem::relative(entry.path(), from));
+                        }
+                    }
+
+                    // If "from" has a trailing separator, copy "from" directory with subdirectories
+                    if(!isDirectoryString(from)) {
+                        to = std::filesystem::weakly_canonical(to / from.filename());
+                        if(std::filesystem::create_directories(to)) {
+                            batch.addDirectory(to);
+                        }
+                        
+                        if(t_op == TraversalOption::NonRecursive) {
+                            return true;
+                        }
+                    } else if(t_op == TraversalOption::NonRecursive) {
+                        for(const auto& entry : std::filesystem::directory_iterator(from)) {
+                            paths.push_back(std::filesystem::relative(entry.path(), from));
+                        }
+                    }
+
+                    for(int i = 0; i < paths.size(); i++) {
+                        _private::checkCancelled();
+                        _private::throttle(0, 1);
+                        std::filesystem::path source = std::filesystem::weakly_canonical(from / paths[i]);
+                        std::filesystem::path copy_to = std::filesystem::weakly_canonical(to / paths[i]);
+                        bool is_source_dir = std::filesystem::is_directory(source);
+                        bool destination_exists = std::filesystem::exists(copy_to);
+                        os::_private::countMetric(os::_private::Counter::Stats, 4); // two canonicalizations, type and existence
+                        if(is_source_dir && t_op == TraversalOption::Recursive) {
+                            os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                        }
+                        
+                        // display warning
+                        if(op == CopyOption::None && destination_exists && ch != 'a' && ch != 'A') {
+                            ch = _private::copyWarning(path::relativePath(copy_to));
+                        }
+
+                        if(ch == 'x' || ch == 'X') {
+                            return false;
+                        }
+
+                        if(is_source_dir) { 
+                            if(std::filesystem::create_directories(copy_to)) {
+                                batch.addDirectory(copy_to);
+                            }
+                        } else if(!destination_exists || op == CopyOption::OverwriteExisting || ch == 'y' || ch == 'Y' || ch == 'a' || ch == 'A') {
+                            _private::copyFile(source, copy_to, batch);
+                        } 
+                    }
+                } else { // is file
+                    if(isDirectoryString(from)) {
+                        from = from.parent_path();
+                    }
+
+                    bool is_source_dir = std::filesystem::is_directory(from);
+                    bool is_destination_dir = std::filesystem::is_directory(to);
+
+                    if(is_destination_dir && op == CopyOption::OverwriteAll) {
+                        RemoveStats stats;
+                        _private::removeTree(to, true, stats);
+                    } 
+
+                    std::filesystem::path copy_to = std::filesystem::is_directory(to) ? std::filesystem::weakly_canonical(to / path::filename(from)) : to;
+                    bool destination_exists = std::filesystem::exists(copy_to);
+
+                    if(op == CopyOption::None && destination_exists && ch != 'a' && ch != 'A') {
+                        ch = _private::copyWarning(path::relativePath(copy_to));
+                    }
+
+                    if(ch == 'x' || ch == 'X') {
+                        return false;
+                    }
+
+                    if(is_source_dir) { 
+                        if(std::filesystem::create_directories(copy_to)) {
+                            batch.addDirectory(copy_to);
+                        }
+                    } else if(!destination_exists || op == CopyOption::OverwriteExisting || ch == 'y' || ch == 'Y' || ch == 'a' || ch == 'A') {
+                        _private::copyFile(from, copy_to, batch);
+                    } 
+                }
+
+                return true;
+            }
+
+            /*
+                Asks before a copy overwrites something, remembering "all" answers in `ch`.
+
+                Return Value:
+                - Returns `1` to write, `0` to skip and `-1` to cancel the copy.
+            */
+            inline int confirmCopy(const std::filesystem::path& to, bool destination_exists, const CopyOption& op, char& ch)
+            {
+                if(op == CopyOption::None && destination_exists && ch != 'a' && ch != 'A') {
+                    ch = _private::copyWarning(to);
+                }
+                if(ch == 'x' || ch == 'X') {
+                    return -1;
+                }
+                return !destination_exists || op == CopyOption::OverwriteExisting || ch == 'y' || ch == 'Y' || ch == 'a' || ch == 'A';
+            }
+
+            /*
+                Copies the entries of a tree one at a time, without following links.
+
+                Notes:
+                - What is already where an entry goes is replaced after asking, so nothing is ever written through a link.
+                  A directory is merged into, and never replaced by a file or link.
+                - Symbolic links are copied as links. With `share_inodes`, a file with several hard links is copied once
+                  and its other links are made hard links to that copy.
+                - Pipes, sockets and devices are skipped, and so is everything below a directory that was skipped.
+            */
+            class EntryCopier {
+                public:
+                    EntryCopier(const CopyOption& op, SyncBatch& batch, bool share_inodes = false) : op(op), batch(batch), share_inodes(share_inodes) {}
+
+                    // Copies `from` to `to`. Returns `1` once it is in place, `0` if it was skipped and `-1` if the user cancelled.
+                    int copy(const std::filesystem::path& from, const std::filesystem::path& to, std::filesystem::file_type type)
+                    {
+                        _private::checkCancelled();
+                        _private::throttle(0, 1);
+                        bool is_dir = type == std::filesystem::file_type::directory;
+                        if((!is_dir && type != std::filesystem::file_type::symlink && type != std::filesystem::file_type::regular) || isSkipped(to)) {
+                            return 0;
+                        }
+
+                        std::error_code ec;
+                        std::filesystem::file_status existing = std::filesystem::symlink_status(to, ec);
+                        os::_private::countMetric(os::_private::Counter::Stats);
+                        if(std::filesystem::is_directory(existing) && !is_dir) {
+                            return 0;
+                        }
+                        if(!std::filesystem::is_directory(existing)) {
+                            bool destination_exists = std::filesystem::exists(existing);
+                            int answer = confirmCopy(path::relativePath(to), destination_exists, op, ch);
+                            if(answer <= 0) {
+                                if(is_dir && answer == 0) {
+                                    skipped.push_back(to.native());
+                                }
+                                return answer;
+                            }
+                            if(destination_exists) {
+                                std::filesystem::remove(to);
+                            }
+                        }
+
+                        if(is_dir) {
+                            if(std::filesystem::create_directories(to)) {
+                                batch.addDirectory(to);
+                            }
+                            return 1;
+                        }
+                        if(type == std::filesystem::file_type::symlink) {
+                            makeParent(to);
+                            std::filesystem::copy_symlink(from, to);
+                            batch.addDirectory(to); // flushes the directory holding the link
+                            return 1;
+                        }
+
+                        #if defined(__linux__)
+                            struct stat info;
+                            if(share_inodes && lstat(from.c_str(), &info) == 0 && info.st_nlink > 1) {
+                                os::_private::countMetric(os::_private::Counter::Stats);
+                                auto copied = copies.find({info.st_dev, info.st_ino});
+                                if(copied != copies.end()) {
+                                    makeParent(to);
+                                    std::filesystem::create_hard_link(copied->second, to);
+                                    batch.addDirectory(to);
+                                    return 1;
+                                }
+                                copies.emplace(std::make_pair(info.st_dev, info.st_ino), to);
+                            }
+                        #endif
+                        if(!_private::copyFile(from, to, batch)) {
+                            throw std::filesystem::filesystem_error(_private::errorMessage("copy", "Failed to copy \"" + from.string() + "\""), from, to, _private::lastError());
+                        }
+                        return 1;
+                    }
+
+                private:
+                    bool isSkipped(const std::filesystem::path& to) const
+                    {
+                        for(const auto& directory : skipped) {
+                            const auto& name = to.native();
+                            if(name.size() > directory.size() && name.compare(0, directory.size(), directory) == 0 &&
+                               name[directory.size()] == std::filesystem::path::preferred_separator) {
+                                return true;
+                            }
+                        }
+                        return false;
+                    }
+
+                    void makeParent(const std::filesystem::path& to)
+                    {
+                        std::filesystem::path parent = to.parent_path();
+                        if(!parent.empty() && std::filesystem::create_directories(parent)) {
+                            batch.addDirectory(parent);
+                        }
+                    }
+
+                    CopyOption op;
+                    SyncBatch& batch;
+                    bool share_inodes;
+                    char ch = 0;
+                    std::vector<std::filesystem::path::string_type> skipped;
+                #if defined(__linux__)
+                    std::map<std::pair<dev_t, ino_t>, std::filesystem::path> copies; // first copy of each inode with several links
+                #endif
+            };
+
+            // Copies one file on a backend, taking its bytes from the budget of the limiter.
+            inline void copyFileOn(Backend& backend, const std::filesystem::path& from, const std::filesystem::path& to)
+            {
+                if(activeLimiter()) {
+                    _private::throttle(backend.fileSize(from), 0);
+                }
+                backend.copyFile(from, to);
+            }
+
+            // `copy()` written against a backend, following the native version path for path.
+            inline bool copyOn(Backend& backend, const std::filesystem::path& source, const std::filesystem::path& destination,
+                               const CopyOption& op, const TraversalOption& t_op)
+            {
+                std::filesystem::file_type source_type = backend.type(source);
+                if(source_type == std::filesystem::file_type::not_found) {
+                    _private::fail(_private::errorMessage("copy", "\"" + source.string() + "\" does not exist"), source, std::errc::no_such_file_or_directory);
+                }
+
+                RemoveStats stats;
+                bool is_destination_dir = backend.type(destination) == std::filesystem::file_type::directory;
+                if(op == CopyOption::ReplaceAll) {
+                    if(source_type != std::filesystem::file_type::directory && !is_destination_dir && !isDirectoryString(destination)) {
+                        backend.copyFile(source, destination);
+                        return true;
+                    }
+                    backend.removeAll(destination, false, stats);
+                    backend.createDirectories(destination);
+                    return copyOn(backend, source, destination, CopyOption::OverwriteExisting, t_op);
+                }
+
+                char ch = 0;
+                bool asks = op == CopyOption::None || op == CopyOption::SkipExisting; // whether an existing destination matters
+                if(source_type != std::filesystem::file_type::directory) {
+                    if(is_destination_dir && op == CopyOption::OverwriteAll) {
+                        backend.removeAll(destination, true, stats);
+                    }
+                    _private::throttle(0, 1);
+                    std::filesystem::path copy_to = is_destination_dir ? destination / source.filename() : destination;
+                    int answer = confirmCopy(copy_to, asks && backend.type(copy_to) != std::filesystem::file_type::not_found, op, ch);
+                    if(answer > 0) {
+                        copyFileOn(backend, source, copy_to);
+                    }
+                    return answer >= 0;
+                }
+
+                if(!is_destination_dir) {
+                    backend.createDirectories(destination);
+                }
+                if(op == CopyOption::OverwriteAll) {
+                    backend.removeAll(destination, true, stats);
+                }
+
+                // collected first, so a copy into the source itself does not go on forever
+                std::vector<std::pair<std::filesystem::path, std::filesystem::file_type>> paths;
+                std::filesystem::path to = destination;
+                if(!isDirectoryString(source)) {
+                    to = destination / source.filename();
+                    backend.createDirectories(to);
+                    if(t_op == TraversalOption::NonRecursive) {
+                        return true;
+                    }
+                }
+                walk(backend, source, t_op == TraversalOption::NonRecursive ? 0 : -1, [&](const std::filesystem::path& relative, std::filesystem::file_type type) {
+                    paths.emplace_back(relative, type);
+                    return true;
+                });
+
+                for(const auto& [relative, type] : paths) {
+                    _private::checkCancelled();
+                    _private::throttle(0, 1);
+                    std::filesystem::path copy_to = to / relative;
+                    int answer = confirmCopy(copy_to, asks && backend.type(copy_to) != std::filesystem::file_type::not_found, op, ch);
+                    if(answer < 0) {
+                        return false;
+                    }
+                    if(type == std::filesystem::file_type::directory) {
+                        backend.createDirectories(copy_to);
+                    } else if(answer > 0) {
+                        copyFileOn(backend, source / relative, copy_to);
+                    }
+                }
+                return true;
+            }
+
+            // `copy()` of selected paths written against a backend.
+            inline bool copyOn(Backend& backend, const std::filesystem::path& source, const std::set<std::string>& paths,
+                               const std::filesystem::path& destination, const CopyOption& op)
+            {
+                if(backend.type(source) == std::filesystem::file_type::not_found) {
+                    _private::fail(_private::errorMessage("copy", "\"" + source.string() + "\" does not exist"), source, std::errc::no_such_file_or_directory);
+                }
+
+                RemoveStats stats;
+                if(op == CopyOption::ReplaceAll) {
+                    backend.removeAll(destination, false, stats);
+                    backend.createDirectories(destination);
+                    return copyOn(backend, source, paths, destination, CopyOption::OverwriteExisting);
+                }
+                if(op == CopyOption::OverwriteAll) {
+                    backend.removeAll(destination, true, stats);
+                }
+
+                char ch = 0;
+                bool asks = op == CopyOption::None || op == CopyOption::SkipExisting;
+                for(const auto& i : paths) {
+                    _private::checkCancelled();
+                    _private::throttle(0, 1);
+                    std::filesystem::path copy_to = destination / i;
+                    int answer = confirmCopy(copy_to, asks && backend.type(copy_to) != std::filesystem::file_type::not_found, op, ch);
+                    if(answer < 0) {
+                        return false;
+                    }
+                    if(backend.type(source / i) == std::filesystem::file_type::directory) {
+                        backend.createDirectories(copy_to);
+                    } else if(answer > 0) {
+                        copyFileOn(backend, source / i, copy_to);
+                    }
+                }
+                return true;
+            }
+
+            inline bool copy(const std::filesystem::path& source, const std::filesystem::path& destination, 
+                             const CopyOption& op, const TraversalOption& t_op, const Durability& durability)
+            {
+                if(Backend* backend = activeBackend()) {
+                    return copyOn(*backend, source, destination, op, t_op);
+                }
+                SyncBatch batch(durability);
+                bool copied = false;
+                if(op == CopyOption::ReplaceAll && std::filesystem::exists(source)) {
+                    if(std::filesystem::is_directory(source) || std::filesystem::is_directory(destination) || isDirectoryString(destination)) {
+                        copied = replaceDirectory(destination, [&](const std::filesystem::path& staging) {
+                            return _private::copy(source, staging, CopyOption::OverwriteExisting, t_op, durability);
+                        });
+                        batch.addDirectory(destination);
+                    } else {
+                        copied = replaceFile(source, destination, batch);
+                    }
+                } else {
+                    copied = copyTree(source, destination, op, t_op, batch);
+                }
+                if(!batch.commit()) {
+                    throw std::runtime_error(_private::errorMessage(__func__, "Failed to flush \"" + destination.string() + "\" to disk"));
+                }
+                return copied;
+            }
+
+            inline bool copy(const std::filesystem::path& source, const std::set<std::string>& paths, 
+                             const std::filesystem::path& destination, const CopyOption& op, const Durability& durability,
+                             std::vector<std::filesystem::path>* copied)
+            {
+                if(Backend* backend = activeBackend()) {
+                    return copyOn(*backend, source, paths, destination, op);
+                }
+                if(!std::filesystem::exists(source)) {
+                    throw std::runtime_error(_private::errorMessage(__func__, "\"" + source.string() + "\" does not exist"));
+                }
+
+                if(op == CopyOption::ReplaceAll) {
+                    bool replaced = replaceDirectory(destination, [&](const std::filesystem::path& staging) {
+                        return _private::copy(source, paths, staging, CopyOption::OverwriteExisting, durability, copied);
+                    });
+                    SyncBatch batch(durability);
+                    if(!batch.addDirectory(destination) || !batch.commit()) {
+                        throw std::runtime_error(_private::errorMessage(__func__, "Failed to flush \"" + destination.string() + "\" to disk"));
+                    }
+                    return replaced;
+                }
+
+                SyncBatch batch(durability);
+                bool completed = true;
+
+                if(op == CopyOption::OverwriteAll) {
+                    RemoveStats stats;
+                    _private::removeTree(destination, true, stats);
+                }
+
+                // Paths are joined without resolving them, so a listed link is copied as a link
+                EntryCopier copier(op, batch);
+                for(const auto& i : paths) {
+                    std::filesystem::path from = source / i;
+                    std::filesystem::path relative = from.lexically_relative(source);
+                    if(relative.empty() || *relative.begin() == "..") { // listed by another spelling of `source`; only its parent is resolved
+                        relative = (std::filesystem::weakly_canonical(from.parent_path()) / from.filename()).lexically_relative(std::filesystem::weakly_canonical(source));
+                        if(relative.empty() || *relative.begin() == "..") {
+                            throw std::runtime_error(_private::errorMessage(__func__, "\"" + i + "\" is not inside \"" + source.string() + "\""));
+                        }
+                    }
+                    std::filesystem::path to = relative == "." ? destination : destination / relative;
+
+                    std::error_code ec;
+                    std::filesystem::file_type type = std::filesystem::symlink_status(from, ec).type();
+                    os::_private::countMetric(os::_private::Counter::Stats);
+                    int result = copier.copy(from, to, type);
+                    if(result < 0) {
+                        completed = false;
+                        break;
+                    }
+                    if(result > 0 && copied) {
+                        copied->push_back(from);
+                    }
+                }
+
+                if(!batch.commit()) {
+                    throw std::runtime_error(_private::errorMessage(__func__, "Failed to flush \"" + destination.string() + "\" to disk"));
+                }
+                return completed;
+            }
+
+            // Removes what a move copied, last first. Directories still holding entries that were not moved are kept.
+            inline void removeCopied(const std::vector<std::filesystem::path>& copied)
+            {
+                for(auto it = copied.rbegin(); it != copied.rend(); it++) {
+                    std::error_code ec;
+                    if(std::filesystem::is_directory(std::filesystem::symlink_status(*it, ec)) && !std::filesystem::is_empty(*it, ec)) {
+                        continue;
+                    }
+                    std::filesystem::remove(*it);
+                }
+            }
+
+            inline bool move(const std::filesystem::path& source, const std::filesystem::path& destination, 
+                             const CopyOption& op, const TraversalOption& t_op, const Durability& durability)
+            {
+                // The copy is flushed before the source is removed
+                if(!_private::copy(source, destination, op, t_op, durability)) {
+                    return false;
+                }
+
+                path::remove(source);
+                return true;
+            }
+
+            inline bool move(const std::filesystem::path& source, const std::set<std::string>& paths, 
+                             const std::filesystem::path& destination, const CopyOption& op, const Durability& durability)
+            {
+                if(!activeBackend()) {
+                    // The copy is flushed before anything is removed
+                    std::vector<std::filesystem::path> copied;
+                    if(!_private::copy(source, paths, destination, op, durability, &copied)) {
+                        return false;
+                    }
+                    removeCopied(copied);
+                    return true;
+                }
+
+                if(!_private::copy(source, paths, destination, op, durability)) {
+                    return false;
+                }
+
+                for(auto it = paths.rbegin(); it != paths.rend(); it++) {
+                    std::string full_path = path::joinPath(source, *it);
+
+                    if(isDirectory(full_path) && !isEmpty(full_path)) {
+                        continue;
+                    }
+
+                    path::remove(full_path);
+                }
+
+                return true;
+            }
+
+            /*
+                Copies a tree without following links, copying each inode with several links once.
+
+                Return Value:
+                - Returns `false` if the user cancelled.
+            */
+            inline bool copyLinkTree(const std::filesystem::path& source, const std::filesystem::path& destination, const CopyOption& op, SyncBatch& batch)
+            {
+                std::filesystem::file_status source_status = std::filesystem::symlink_status(source);
+                os::_private::countMetric(os::_private::Counter::Stats);
+                if(!std::filesystem::exists(source_status)) {
+                    throw std::runtime_error(_private::errorMessage("copy", "\"" + source.string() + "\" does not exist"));
+                }
+
+                std::filesystem::path from = source;
+                std::filesystem::path to = destination;
+                bool is_source_dir = std::filesystem::is_directory(source_status);
+                if(is_source_dir && std::filesystem::exists(to) && !std::filesystem::is_directory(to)) {
+                    throw std::runtime_error(_private::errorMessage("copy", "\"" + to.filename().string() + "\" is a file"));
+                }
+                if(op == CopyOption::OverwriteAll && std::filesystem::is_directory(to)) {
+                    RemoveStats stats;
+                    _private::removeTree(to, true, stats);
+                }
+                if(!is_source_dir || !isDirectoryString(from)) { // the source itself goes into `to`
+                    if(isDirectoryString(from)) {
+                        from = from.parent_path();
+                    }
+                    if(is_source_dir || std::filesystem::is_directory(to)) {
+                        to = to / path::filename(from);
+                    }
+                }
+
+                EntryCopier copier(op, batch, true);
+                int result = copier.copy(from, to, source_status.type());
+                if(result <= 0 || !is_source_dir) {
+                    return result >= 0;
+                }
+
+                os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                auto end = std::filesystem::recursive_directory_iterator();
+                for(auto it = std::filesystem::recursive_directory_iterator(from); it != end; it++) { // does not follow links to directories
+                    std::filesystem::file_status status = it->symlink_status();
+                    if(std::filesystem::is_directory(status)) {
+                        os::_private::countMetric(os::_private::Counter::DirectoriesWalked);
+                    }
+                    result = copier.copy(it->path(), to / it->path().lexically_relative(from), status.type());
+                    if(result < 0) {
+                        return false;
+                    } else if(result == 0 && std::filesystem::is_directory(status)) {
+                        it.disable_recursion_pending();
+                    }
+                }
+                return true;
+            }
+
+            inline bool copyLinks(const std::filesystem::path& source, const std::filesystem::path& destination,
+                                  const CopyOption& op, const Durability& durability)
+            {
+                SyncBatch batch(durability);
+                bool copied = false;
+                std::filesystem::file_status source_status = std::filesystem::symlink_status(source);
+                if(op == CopyOption::ReplaceAll && (std::filesystem::is_directory(source_status) || std::filesystem::is_directory(destination)
+                                                    || isDirectoryString(destination))) {
+                    copied = replaceDirectory(destination, [&](const std::filesystem::path& staging) {
+                        return _private::copyLinks(source, staging, CopyOption::OverwriteExisting, durability);
+                    });
+                    batch.addDirectory(destination);
+                } else if(op == CopyOption::ReplaceAll && std::filesystem::is_regular_file(source_status)) {
+                    copied = replaceFile(source, destination, batch);
+                } else {
+                    copied = copyLinkTree(source, destination, op == CopyOption::ReplaceAll ? CopyOption::OverwriteExisting : op, batch);
+                }
+                if(!batch.commit()) {
+                    throw std::runtime_error(_private::errorMessage(__func__, "Failed to flush \"" + destination.string() + "\" to disk"));
+                }
+                return copied;
+            }
+
+            /*
+                Copies the paths below `source` that `filter` does not exclude, as the walk reaches them.
+
+                Parameters:
+                `copied`: Gets the source paths that were copied, parents before what they hold.
+
+                Notes:
+                - Paths are joined as they are listed and never resolved. Entries are copied as `EntryCopier` does.
+            */
+            inline bool copyFiltered(const std::filesystem::path& source, const std::filesystem::path& destination, const Filter& filter,
+                                     const CopyOption& op, const Durability& durability, std::vector<std::filesystem::path>* copied)
+            {
+                if(op == CopyOption::ReplaceAll) {
+                    bool replaced = replaceDirectory(destination, [&](const std::filesystem::path& staging) {
+                        return copyFiltered(source, staging, filter, CopyOption::OverwriteExisting, durability, copied);
+                    });
+                    SyncBatch batch(durability);
+                    if(!batch.addDirectory(destination) || !batch.commit()) {
+                        throw std::runtime_error(_private::errorMessage("copy", "Failed to flush \"" + destination.string() + "\" to disk"));
+                    }
+                    return replaced;
+                }
+
+                SyncBatch batch(durability);
+                if(op == CopyOption::OverwriteAll) {
+                    RemoveStats stats;
+                    _private::removeTree(destination, true, stats);
+                }
+
+                EntryCopier copier(op, batch);
+                auto copyEntry = [&](const std::filesystem::path& from, const std::filesystem::path& to, std::filesystem::file_type type) {
+                    int result = copier.copy(from, to, type);
+                    if(result > 0 && copied) {
+                        copied->push_back(from);
+                    }
+                    return result;
+                };
+
+                std::filesystem::path root = destination;
+                if(!isDirectoryString(source)) { // the directory itself goes into `destination`
+                    root = destination / path::filename(source);
+                    int result = copyEntry(source, root, std::filesystem::file_type::directory);
+                    if(result <= 0) {
+                        return result == 0;
+                    }
+                }
+
+                bool cancelled = false;
+                std::error_code ec;
+                walkFiltered(source, filter, ec, [&](const std::string& relative, const std::string&, std::filesystem::file_type type) {
+                    cancelled = copyEntry(source / relative, root / relative, type) < 0;
+                    return !cancelled;
+                });
+                throwWalkError("copy", source, ec);
+
+                if(!batch.commit()) {
+                    throw std::runtime_error(_private::errorMessage("copy", "Failed to flush \"" + destination.string() + "\" to disk"));
+                }
+                return !cancelled;
+            }
+
+            inline bool moveFiltered(const std::filesystem::path& source, const std::filesystem::path& destination, const Filter& filter,
+                                     const CopyOption& op, const Durability& durability)
+            {
+                // The copy is flushed before anything is removed
+                std::vector<std::filesystem::path> copied;
+                if(!copyFiltered(source, destination, filter, op, durability, &copied)) {
+                    return false;
+                }
+
+                removeCopied(copied);
+                return true;
+            }
+
+            inline bool copyVerified(const std::filesystem::path& source, const std::filesystem::path& destination,
+                                     const CopyOption& op, CopyDigests& digests, const Durability& durability, const VerifyOption& verify)
+            {
+                digests = CopyDigests();
+                DigestBatch batch(digests, verify);
+                bool copied = _private::copy(source, destination, op, TraversalOption::Recursive, durability);
+                return batch.commit() && copied;
+            }
+        }
+    }
+
+    /*
+        Execute a command in the shell.
+
+        Return Value:
+        - Returns `true` if the command executes successfully. Else it will return `false`.
+
+        Parameters:
+        `command`: Command to execute.
+        `output`: A string reference to get the output of the executed command.
+        `mode`: Use `r` for read-mode, `w` for write-mode.
+    */
+    inline bool execute(const std::string& command, std::string& output, const std::string& mode = "r")
+    {
+        _private::MetricsScope metrics_scope(__func__);
+        // Open the pipe using platform-specific popen function
+        FILE* pipe = popen(command.c_str(), mode.c_str());
+        if(!pipe) {
+            return false;  // Command failed to execute
+        }
+
+        char buffer[65536];
+        output.clear();  // Clear the output string before capturing the result
+
+        // Read the command's output chunk by chunk
+        std::size_t bytes;
+        while((bytes = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+            output.append(buffer, bytes);  // Append each chunk to the output string
+        }
+
+        // Get the command exit status
+        int exit_code = pclose(pipe);
+        
+        // Return true if the command was successful (exit code is 0)
+        return (exit_code == 0);
+    }
+
+    /*
+        Execute a command in the shell.
+
+        Return Value:
+        - Returns `true` if the command executes successfully. Else it will return `false`.
 
-            Parameters:
-            `from`: Path to copy.
-            `to`: Path to copy to.
-        */
-        inline bool copy(const std::filesystem::path& from, const std::filesystem::path& to)
+        Parameters:
+        `command`: Command to execute.
+        `mode`: Use `r` for read-mode, `w` for write-mode.
+    */
+    inline bool execute(const std::string& command, const std::string& mode = "r")
+    {
+        _private::MetricsScope metrics_scope(__func__);
+        std::string dummy_output;
+        return execute(command, dummy_output, mode);
+    }
+    /*
+        Options for how streamed command output is handed to a callback.
+
+        Enumerations:
+        `Chunks`: As it is read from the pipe.
+        `Lines`: One line at a time, without the line break.
+    */
+    enum class OutputMode {Chunks, Lines};
+
+    // Result of a command run with `execute()`.
+    struct ExecuteResult {
+        int exit_code = -1; // exit status, `-1` if the command was ended by a signal
+        int signal = 0; // signal that ended the command, `0` if it exited on its own
+        std::string output; // everything written to standard output
+        std::string error; // everything written to standard error
+        std::chrono::nanoseconds duration {0}; // wall time from spawn to exit
+        bool timed_out = false; // `true` if the command was stopped for running too long
+    };
+
+    namespace _private {
+    #if !defined(_WIN32)
+        // A spawned command and the read ends of its output pipes.
+        struct Child {
+            pid_t pid = -1;
+            int output = -1;
+            int error = -1;
+            std::chrono::steady_clock::time_point start;
+        };
+
+        // Creates a pipe whose ends are closed on exec.
+        inline bool openPipe(int fds[2])
         {
-            return _private::copy(from, to, CopyOption::None, TraversalOption::Recursive);
+            #if defined(__linux__)
+                return pipe2(fds, O_CLOEXEC) == 0;
+            #else
+                if(pipe(fds) != 0) {
+                    return false;
+                }
+                fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+                fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+                return true;
+            #endif
         }
 
         /*
-            Copy a path to another path.
+            Starts a program without a shell, with the given standard streams.
+
+            Return Value:
+            - Returns `0` on success, or the `errno` value that stopped the program from starting.
 
             Parameters:
-            `from`: Path to copy.
-            `to`: Path to copy to.
-            `paths_to_copy`: Selected paths in `from` to be copied.
-            `op`: Copy option to use.
+            `argv`: Program to run, then its arguments. The program is looked up in `PATH`.
+            `input`: Descriptor to use as standard input, `-1` for `/dev/null`.
+            `output`: Descriptor to use as standard output.
+            `error`: Descriptor to use as standard error.
+            `group`: Process group to put the program in. `0` starts a new one, `-1` keeps the caller's.
+            `pid`: Receives the process ID.
+
+            Notes:
+            - The signal mask is cleared and `SIGPIPE` is reset to its default action.
         */
-        inline bool copy(const std::filesystem::path& from, const std::set<std::string>& paths_to_copy, const std::filesystem::path& to, const CopyOption& op = CopyOption::None)
+        inline int spawnProcess(const std::vector<std::string>& argv, int input, int output, int error, pid_t group, pid_t& pid)
         {
-            return _private::copy(from, paths_to_copy, to, op);
-        }
+            std::vector<char*> args;
+            for(const auto& arg : argv) {
+                args.push_back(const_cast<char*>(arg.c_str()));
+            }
+            args.push_back(nullptr);
 
-        /*
-            Moves a path to another path.
+            posix_spawn_file_actions_t actions;
+            posix_spawn_file_actions_init(&actions);
+            if(input < 0) {
+                posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+            } else {
+                posix_spawn_file_actions_adddup2(&actions, input, 0);
+            }
+            posix_spawn_file_actions_adddup2(&actions, output, 1);
+            posix_spawn_file_actions_adddup2(&actions, error, 2);
+
+            posix_spawnattr_t attributes;
+            posix_spawnattr_init(&attributes);
+            sigset_t mask;
+            sigemptyset(&mask);
+            posix_spawnattr_setsigmask(&attributes, &mask);
+            sigset_t defaults;
+            sigemptyset(&defaults);
+            sigaddset(&defaults, SIGPIPE);
+            posix_spawnattr_setsigdefault(&attributes, &defaults);
+            short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+            if(group >= 0) {
+                posix_spawnattr_setpgroup(&attributes, group);
+                flags |= POSIX_SPAWN_SETPGROUP;
+            }
+            posix_spawnattr_setflags(&attributes, flags);
 
-            Parameters:
-            `from`: Path to move.
-            `to`: Path to move to.
-            `traversal_option`: Traversal to use.
-            `copy_option`: Copy option to use. (Defaults `None`)
-        */
-        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to, const TraversalOption& traversal_option,
-                        const CopyOption& copy_option = CopyOption::None)
-        {
-            return _private::move(from, to, copy_option, traversal_option);
+            #if defined(__APPLE__)
+                char** environment = *_NSGetEnviron();
+            #else
+                char** environment = environ;
+            #endif
+            int code = posix_spawnp(&pid, args[0], &actions, &attributes, args.data(), environment);
+
+            posix_spawnattr_destroy(&attributes);
+            posix_spawn_file_actions_destroy(&actions);
+            if(code != 0) {
+                pid = -1;
+            }
+            return code;
         }
 
         /*
-            Moves a path to another path.
+            Starts a command without a shell, with its output and error sent to pipes.
+
+            Return Value:
+            - Returns `0` on success, or the `errno` value that stopped the command from starting.
 
             Parameters:
-            `from`: Path to move.
-            `to`: Path to move to.
-            `copy_option`: Copy option to use.
-            `traversal_option`: Traversal to use. (Defaults `Recursive`)
+            `argv`: Program to run, then its arguments. The program is looked up in `PATH`.
+            `child`: Receives the process and its pipes.
+            `own_group`: Set to `true` to start the command in a new process group, so it can be stopped
+                         together with everything it starts.
+
+            Notes:
+            - Standard input is `/dev/null`.
         */
-        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to, const CopyOption& copy_option,
-                         const TraversalOption& traversal_option = TraversalOption::Recursive)
+        inline int spawn(const std::vector<std::string>& argv, Child& child, bool own_group = false)
         {
-            return _private::move(from, to, copy_option, traversal_option);
-        }
+            int output[2];
+            int error[2];
+            if(!openPipe(output)) {
+                return errno;
+            }
+            if(!openPipe(error)) {
+                int code = errno;
+                close(output[0]);
+                close(output[1]);
+                return code;
+            }
+            #if defined(__linux__)
+                fcntl(output[1], F_SETPIPE_SZ, 1 << 18); // fewer wakeups for chatty commands
+            #endif
 
-        /*
-            Moves a path to another path.
+            child.start = std::chrono::steady_clock::now();
+            int code = spawnProcess(argv, -1, output[1], error[1], own_group ? 0 : -1, child.pid);
+            close(output[1]);
+            close(error[1]);
+            if(code != 0) {
+                close(output[0]);
+                close(error[0]);
+                return code;
+            }
 
-            Parameters:
-            `from`: Path to move.
-            `to`: Path to move to.
-        */
-        inline bool move(const std::filesystem::path& from, const std::filesystem::path& to)
-        {
-            return _private::move(from, to, CopyOption::None, TraversalOption::Recursive);
+            child.output = output[0];
+            child.error = error[0];
+            return 0;
         }
 
         /*
-            Move a path to another path.
+            Reads what is available from a pipe and appends it to a string.
 
-            Parameters:
-            `from`: Path to Move.
-            `to`: Path to move to.
-            `paths_to_move`: Selected paths in `from` to be moved.
-            `op`: Copy option to use. (Defaults `None`)
+            Return Value:
+            - Returns `false` once the pipe is at its end, after closing it and setting `fd` to `-1`.
         */
-        inline bool move(const std::filesystem::path& from, const std::set<std::string>& paths_to_move, const std::filesystem::path& to, const CopyOption& op = CopyOption::None)
+        inline bool readPipe(int& fd, std::string& into)
         {
-            return _private::move(from, paths_to_move, to, op);
+            constexpr std::size_t chunk = 65536;
+            std::size_t size = into.size();
+            into.resize(size + chunk);
+            ssize_t bytes;
+            do {
+                bytes = read(fd, &into[size], chunk);
+            } while(bytes < 0 && errno == EINTR);
+            into.resize(size + (bytes > 0 ? bytes : 0));
+
+            if(bytes > 0 || (bytes < 0 && errno == EAGAIN)) {
+                return true;
+            }
+            close(fd);
+            fd = -1;
+            return false;
         }
 
         /*
-            Deletes a given path if it exists.
+            Waits for a child to exit and records how it ended.
 
-            Notes:
-            - If the give path is a directory string (E.g. `home/user/`) then only the contents of 
-              the path will be deleted. 
+            Return Value:
+            - Returns `false` if `block` is not set and the child is still running.
         */
-        inline bool remove(const std::filesystem::path& path)
+        inline bool reap(Child& child, ExecuteResult& result, bool block = true)
         {
-            if(!std::filesystem::exists(path)) {
+            int status = 0;
+            pid_t pid;
+            while((pid = waitpid(child.pid, &status, block ? 0 : WNOHANG)) < 0 && errno == EINTR) {}
+            if(pid == 0) {
                 return false;
             }
+            result.duration = std::chrono::steady_clock::now() - child.start;
 
-            if(std::filesystem::is_directory(path)) {
-                if(isDirectoryString(path)) {
-                    for(const auto& entry : std::filesystem::directory_iterator(path)) {
-                        std::filesystem::remove_all(entry.path());
-                    }
-                } else {
-                    std::filesystem::remove_all(path);
-                }
-            } else {
-                std::filesystem::remove(path);
+            if(WIFEXITED(status)) {
+                result.exit_code = WEXITSTATUS(status);
+            } else if(WIFSIGNALED(status)) {
+                result.signal = WTERMSIG(status);
             }
-
+            child.pid = -1;
             return true;
         }
 
-        /*
-            Checks if two files or directories have the same content.
-
-            Notes:
-            - Both parameters need to point to either both a file or directory. Else it will throw an error.
-        */
-        inline bool hasSameContent(const std::filesystem::path& p1, const std::filesystem::path& p2)
+        // Closes the pipes of a child that are still open.
+        inline void closePipes(Child& child)
         {
-            if(!std::filesystem::exists(p1)) {
-                throw std::runtime_error(_private::errorMessage(__func__, "\"" + p1.string() + "\" does not exist"));
+            for(int* fd : {&child.output, &child.error}) {
+                if(*fd >= 0) {
+                    close(*fd);
+                    *fd = -1;
+                }
             }
+        }
 
-            if(!std::filesystem::exists(p2)) {
-                throw std::runtime_error(_private::errorMessage(__func__, "\"" + p2.string() + "\" does not exist"));
-            }
+        // Waits on many file descriptors at once, with epoll on Linux and poll elsewhere.
+        class Poller {
+            public:
+                Poller()
+                {
+                    #if defined(__linux__)
+                        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+                    #endif
+                }
 
-            bool is_p1_dir = std::filesystem::is_directory(p1);
-            bool is_p2_dir = std::filesystem::is_directory(p2);
+                ~Poller()
+                {
+                    #if defined(__linux__)
+                        if(epoll_fd >= 0) {
+                            close(epoll_fd);
+                        }
+                    #endif
+                }
 
-            if(is_p1_dir && !is_p2_dir || !is_p1_dir && is_p2_dir) {
-                throw std::runtime_error(_private::errorMessage(__func__, "Arguments need to be both files or both folders"));
-            }
+                Poller(const Poller&) = delete;
+                Poller& operator=(const Poller&) = delete;
+
+                // Watches `fd` for input, reporting it as `token`.
+                void add(int fd, std::uint64_t token)
+                {
+                    #if defined(__linux__)
+                        epoll_event event = {};
+                        event.events = EPOLLIN;
+                        event.data.u64 = token;
+                        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+                    #else
+                        fds.push_back({fd, POLLIN, 0});
+                        tokens.push_back(token);
+                    #endif
+                }
 
-            if(is_p1_dir && is_p2_dir) {
-                auto i = std::filesystem::recursive_directory_iterator(p1);
-                auto j = std::filesystem::recursive_directory_iterator(p2);
-                while(i != std::filesystem::recursive_directory_iterator() && j != std::filesystem::recursive_directory_iterator()) {
-                    if(std::filesystem::relative(i->path(), p1) != std::filesystem::relative(j->path(), p2)) {
-                        return false;
-                    }
-                    i++;
-                    j++;
+                // Stops watching `fd`.
+                void remove(int fd)
+                {
+                    #if defined(__linux__)
+                        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                    #else
+                        for(std::size_t i = 0; i < fds.size(); i++) {
+                            if(fds[i].fd == fd) {
+                                fds[i] = fds.back();
+                                tokens[i] = tokens.back();
+                                fds.pop_back();
+                                tokens.pop_back();
+                                break;
+                            }
+                        }
+                    #endif
                 }
 
-                if(i == std::filesystem::recursive_directory_iterator() && j == std::filesystem::recursive_directory_iterator()) {
-                    return true;
+                /*
+                    Waits until a descriptor is ready.
+
+                    Parameters:
+                    `timeout`: Longest time to wait in milliseconds, `-1` for no limit.
+                    `ready`: Receives the tokens of the ready descriptors.
+                */
+                void wait(int timeout, std::vector<std::uint64_t>& ready)
+                {
+                    ready.clear();
+                    #if defined(__linux__)
+                        epoll_event events[64];
+                        int count = epoll_wait(epoll_fd, events, 64, timeout);
+                        for(int i = 0; i < count; i++) {
+                            ready.push_back(events[i].data.u64);
+                        }
+                    #else
+                        if(poll(fds.data(), fds.size(), timeout) > 0) {
+                            for(std::size_t i = 0; i < fds.size(); i++) {
+                                if(fds[i].revents) {
+                                    ready.push_back(tokens[i]);
+                                }
+                            }
+                        }
+                    #endif
                 }
 
-                return false;
-            } else {
-                std::ifstream f1(p1, std::ifstream::binary|std::ifstream::ate);
-                std::ifstream f2(p2, std::ifstream::binary|std::ifstream::ate);
+            private:
+            #if defined(__linux__)
+                int epoll_fd = -1;
+            #else
+                std::vector<pollfd> fds;
+                std::vector<std::uint64_t> tokens;
+            #endif
+        };
 
-                if(f1.fail() || f2.fail()) {
-                    return false;
-                }
+        // Opens a descriptor that becomes readable when `pid` exits, or returns `-1` where that is not supported.
+        inline int openPidfd(pid_t pid)
+        {
+            #if defined(__linux__) && defined(SYS_pidfd_open)
+                return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+            #else
+                (void)pid;
+                return -1;
+            #endif
+        }
 
-                if(f1.tellg() != f2.tellg()) {
-                    return false;
+        // Time a command gets to exit after `SIGTERM` before it is killed.
+        constexpr std::chrono::seconds stop_grace {2};
+
+        // Splits streamed data into lines, keeping only the unfinished last line.
+        class LineBuffer {
+            public:
+                // Longest line kept; longer lines are handed over in pieces of this size.
+                static constexpr std::size_t max_line = 64 * 1024;
+
+                /*
+                    Hands every finished line in `data` to `on_line`.
+
+                    Return Value:
+                    - Returns `false` as soon as `on_line` does.
+                */
+                bool feed(std::string_view data, const std::function<bool(std::string_view)>& on_line)
+                {
+                    while(!data.empty()) {
+                        std::size_t end = data.find('\n');
+                        std::size_t room = max_line - pending.size();
+                        if(end == std::string_view::npos || end > room) {
+                            if(data.size() < room) {
+                                pending.append(data);
+                                break;
+                            }
+
+                            // Output without line breaks (binary data, progress bars using `\r`) is cut
+                            // into pieces instead of being kept whole
+                            pending.append(data.substr(0, room));
+                            data.remove_prefix(room);
+                            bool keep_going = on_line(pending);
+                            pending.clear();
+                            if(!keep_going) {
+                                return false;
+                            }
+                            continue;
+                        }
+
+                        std::string_view line = data.substr(0, end);
+                        data.remove_prefix(end + 1);
+                        if(!pending.empty()) {
+                            pending.append(line);
+                            line = pending;
+                        }
+                        if(!line.empty() && line.back() == '\r') {
+                            line.remove_suffix(1);
+                        }
+
+                        bool keep_going = on_line(line);
+                        pending.clear();
+                        if(!keep_going) {
+                            return false;
+                        }
+                    }
+                    return true;
                 }
 
-                f1.seekg(0, std::ifstream::beg);
-                f2.seekg(0, std::ifstream::beg);
-                return std::equal(std::istreambuf_iterator<char>(f1.rdbuf()),
-                                    std::istreambuf_iterator<char>(),
-                                    std::istreambuf_iterator<char>(f2.rdbuf()));
-            }
-        }
-        
-        inline std::string find(const std::filesystem::path& search_path, const std::string& file_to_find, int max_depth)
-        {
-            if(std::filesystem::exists(search_path)) {
-                for(auto i = std::filesystem::recursive_directory_iterator(search_path); i != std::filesystem::recursive_directory_iterator(); i++) {
-                    if(max_depth >= 0 && i.depth() >= max_depth) {
-                        i.disable_recursion_pending();
-                    } 
-                    if(i->path().filename() == file_to_find) {
-                        return i->path().string();
+                // Hands the last line to `on_line` if it did not end with a line break.
+                bool flush(const std::function<bool(std::string_view)>& on_line)
+                {
+                    if(pending.empty()) {
+                        return true;
                     }
+                    std::string line;
+                    line.swap(pending);
+                    return on_line(line);
                 }
-                return std::string();
-            } else {
-                throw std::runtime_error(_private::errorMessage(__func__, "Path does not exist"));
-            }
-        }
 
-        inline std::string find(const std::filesystem::path& search_path, const std::string& file_to_find, const TraversalOption& pt = TraversalOption::NonRecursive)
+            private:
+                std::string pending;
+        };
+
+        // Fills a result for a command that could not be started, the way a shell would.
+        inline void spawnFailed(const std::string& program, int code, ExecuteResult& result)
         {
-            int n = pt == TraversalOption::NonRecursive ? 0 : -1;
-            return path::find(search_path, file_to_find, n);
+            result.exit_code = code == ENOENT ? 127 : 126;
+            result.error = program + ": " + std::strerror(code) + "\n";
         }
+    #endif
+    }
 
-        inline std::vector<std::string> findAll(const std::filesystem::path& search_path, const std::string& file_to_find, int max_depth)
+    namespace _private {
+        // Runs a program and captures its output. Sets `ec` if it could not be started.
+        inline ExecuteResult runProgram(const std::vector<std::string>& argv, std::error_code& ec)
         {
-            std::vector<std::string> matches;
-            if(std::filesystem::exists(search_path)) {
-                for(auto i = std::filesystem::recursive_directory_iterator(search_path); i != std::filesystem::recursive_directory_iterator(); i++) {
-                    if(max_depth >= 0 && i.depth() >= max_depth) {
-                        i.disable_recursion_pending();
-                    } 
-                    if(i->path().filename() == file_to_find) {
-                        matches.push_back(i->path().string());
+            ExecuteResult result;
+            #if !defined(_WIN32)
+                _private::Child child;
+                int code = _private::spawn(argv, child);
+                if(code != 0) {
+                    ec = std::error_code(code, std::generic_category());
+                    return result;
+                }
+
+                // Drain both pipes together so a full one cannot stall the program
+                pollfd fds[2] = {{child.output, POLLIN, 0}, {child.error, POLLIN, 0}};
+                while(fds[0].fd >= 0 || fds[1].fd >= 0) {
+                    if(poll(fds, 2, -1) < 0) {
+                        if(errno == EINTR) {
+                            continue;
+                        }
+                        break;
+                    }
+                    if(fds[0].revents) {
+                        _private::readPipe(fds[0].fd, result.output);
+                    }
+                    if(fds[1].revents) {
+                        _private::readPipe(fds[1].fd, result.error);
+                    }
+                }
+                for(const auto& fd : fds) {
+                    if(fd.fd >= 0) {
+                        close(fd.fd);
                     }
                 }
-                return matches;
-            } else {
-                throw std::runtime_error(_private::errorMessage(__func__, "Path does not exist"));
-            }
-        }
 
-        inline std::vector<std::string> findAll(const std::filesystem::path& search_path, const std::string& file_to_find, const TraversalOption& pt = TraversalOption::NonRecursive)
-        {
-            int n = pt == TraversalOption::NonRecursive ? 0 : -1;
-            return path::findAll(search_path, file_to_find, n);
+                _private::reap(child, result);
+            #else
+                std::string command;
+                for(const auto& arg : argv) {
+                    command += (command.empty() ? "\"" : " \"") + arg + "\"";
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                FILE* pipe = popen(command.c_str(), "r");
+                if(!pipe) {
+                    result.exit_code = 127;
+                    ec = path::_private::lastError();
+                    return result;
+                }
+
+                char buffer[65536];
+                std::size_t bytes;
+                while((bytes = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+                    result.output.append(buffer, bytes);
+                }
+                result.exit_code = pclose(pipe);
+                result.duration = std::chrono::steady_clock::now() - start;
+            #endif
+            return result;
         }
+    }
 
-        namespace _private {
+    /*
+        Runs a program directly, without a shell, and captures its output.
 
-            inline std::string errorMessage(const std::string& function_name, const std::string& message)
-            {
-                std::string error = "[Error]";
-                #ifdef _DEBUG
-                    error.append("[" + function_name + "]");
-                #endif
-                error.push_back(' ');
-                error.append(message);
+        Return Value:
+        - Returns the exit code or signal, standard output, standard error and wall time of the program.
 
-                return error;
-            }
+        Parameters:
+        `argv`: Program to run, then its arguments. The program is looked up in `PATH`.
 
-            inline char copyWarning(const std::filesystem::path& path)
-            {
-                char ch;
-                std::cout << "[Warning] \"" << path.string() << "\" already exists. Would you like to overwrite?" << std::endl;
-                std::cout << "[Y] for yes, [N] for no, [A] for yes to all, [X] to cancel: ";
-                std::cin >> ch;
-                std::cin.clear();
-                std::cin.ignore(256, '\n');
-                return ch; 
+        Notes:
+        - If the program cannot be started, the exit code is `127` (not found) or `126`, like in a shell.
+        - Standard input of the program is `/dev/null`.
+        - On Windows, the program runs through the shell and only standard output is captured.
+    */
+    inline ExecuteResult execute(const std::vector<std::string>& argv)
+    {
+        _private::MetricsScope metrics_scope(__func__);
+        if(argv.empty()) {
+            throw std::runtime_error(path::_private::errorMessage(__func__, "No program given"));
+        }
+
+        std::error_code ec;
+        ExecuteResult result = _private::runProgram(argv, ec);
+        #if !defined(_WIN32)
+            if(ec) {
+                _private::spawnFailed(argv[0], ec.value(), result);
             }
+        #endif
+        return result;
+    }
 
-            inline bool copyFile(const std::filesystem::path& from, const std::filesystem::path& to) 
-            {
-                std::filesystem::path parent_temp = to.parent_path();
-                if(!parent_temp.empty() && !std::filesystem::exists(parent_temp)) {
-                    std::filesystem::create_directories(parent_temp);
-                }
+    /*
+        Runs a program directly, without a shell, and captures its output, without throwing.
 
-                std::ifstream source(from, std::ios::binary);
-                if(!source.is_open()) {
-                    return false;
-                }
+        Return Value:
+        - Returns the exit code or signal, standard output, standard error and wall time of the program.
 
-                std::ofstream destination(to, std::ios::binary);
-                if(!destination.is_open()) {
-                    source.close();
-                    return false;
-                }
+        Parameters:
+        `argv`: Program to run, then its arguments. The program is looked up in `PATH`.
+        `ec`: Gets the error if the program could not be started, `invalid_argument` if `argv` is empty.
 
-                destination << source.rdbuf(); 
+        Notes:
+        - A program that starts and then fails is not an error. Its exit code is in the result.
+    */
+    inline ExecuteResult execute(const std::vector<std::string>& argv, std::error_code& ec) noexcept
+    {
+        _private::MetricsScope metrics_scope(__func__);
+        ec.clear();
+        if(argv.empty()) {
+            ec = std::make_error_code(std::errc::invalid_argument);
+            return ExecuteResult();
+        }
 
-                if(!destination) {
-                    source.close();
-                    destination.close();
-                    return false;
-                }
+        try {
+            return _private::runProgram(argv, ec);
+        } catch(...) {
+            ec = path::_private::currentError();
+            return ExecuteResult();
+        }
+    }
+    /*
+        Runs a program directly, without a shell, and captures its output.
+
+        Parameters:
+        `argv`: Program to run, then its arguments.
+
+        Notes:
+        - Lets a braced list such as `{"ls"}` pick this overload instead of the shell one.
+    */
+    inline ExecuteResult execute(std::initializer_list<std::string> argv)
+    {
+        _private::MetricsScope metrics_scope(__func__);
+        return execute(std::vector<std::string>(argv));
+    }
+    /*
+        Runs many programs at once, each without a shell, and captures their output.
 
-                source.close();
-                destination.close();
+        Return Value:
+        - Returns the result of every command, in the same order as `commands`.
 
-                return true;
+        Parameters:
+        `commands`: Programs to run, each followed by its arguments.
+        `max_parallel`: Most commands running at the same time. (`0` for one per hardware thread)
+        `timeout`: Longest time each command may run, `0` for no limit. (Defaults `0`)
+        `fail_fast`: Set to `true` to stop everything once a command fails. (Defaults `false`)
+
+        Notes:
+        - The output of every running command is read on one thread, with epoll on Linux.
+        - A command past its timeout gets `SIGTERM`, then `SIGKILL` two seconds later, and has `timed_out` set.
+        - With `fail_fast`, commands still running are stopped the same way, and commands not started yet
+          are left with an exit code of `-1` and no signal.
+        - With a timeout or `fail_fast`, each command runs in its own process group so everything it starts
+          is stopped with it.
+    */
+    inline std::vector<ExecuteResult> executeMany(const std::vector<std::vector<std::string>>& commands, unsigned int max_parallel = 0,
+                                                  const std::chrono::milliseconds& timeout = std::chrono::milliseconds::zero(), bool fail_fast = false)
+    {
+        _private::MetricsScope metrics_scope(__func__);
+        for(const auto& argv : commands) {
+            if(argv.empty()) {
+                throw std::runtime_error(path::_private::errorMessage(__func__, "No program given"));
             }
+        }
+        if(max_parallel == 0) {
+            max_parallel = std::max(1u, std::thread::hardware_concurrency());
+        }
 
-            inline bool copy(const std::filesystem::path& source, const std::filesystem::path& destination, 
-                             const CopyOption& op, const TraversalOption& t_op)
-            {
-                if(!std::filesystem::exists(source)) {
-                    throw std::runtime_error(_private::errorMessage(__func__, "\"" + source.string() + "\" does not exist"));
+        std::vector<ExecuteResult> results(commands.size());
+        #if !defined(_WIN32)
+            using clock = std::chrono::steady_clock;
+
+            // A command that has been started and not reaped yet.
+            struct Running {
+                std::size_t index;
+                _private::Child child;
+                int exit = -1; // readable once the command exits
+                clock::time_point deadline = clock::time_point::max();
+                clock::time_point kill_at = clock::time_point::max();
+                bool terminated = false;
+            };
+
+            // Every descriptor is watched as index * 3 + one of these
+            constexpr std::uint64_t output_token = 0;
+            constexpr std::uint64_t error_token = 1;
+            constexpr std::uint64_t exit_token = 2;
+
+            bool own_group = timeout.count() > 0 || fail_fast;
+            std::deque<Running> running;
+            _private::Poller poller;
+            std::vector<std::uint64_t> ready;
+            std::size_t next = 0;
+            bool failed = false;
+
+            auto signal = [&](Running& command, int sig) {
+                kill(own_group ? -command.child.pid : command.child.pid, sig);
+            };
+
+            auto finished = [&](const ExecuteResult& result) {
+                if(fail_fast && (result.exit_code != 0 || result.timed_out)) {
+                    failed = true;
                 }
-
-                char ch;
-                std::filesystem::path from = source;
-                std::filesystem::path to = destination;
-                if(std::filesystem::is_directory(from)) { // is directory
-
-                    // Create directory when destination does not exists
-                    if(!std::filesystem::exists(to)) {
-                        std::filesystem::create_directories(to);
+            };
+
+            while(true) {
+                while(!failed && next < commands.size() && running.size() < max_parallel) {
+                    std::size_t index = next++;
+                    Running command;
+                    command.index = index;
+                    int code = _private::spawn(commands[index], command.child, own_group);
+                    if(code != 0) {
+                        _private::spawnFailed(commands[index][0], code, results[index]);
+                        finished(results[index]);
+                        continue;
                     }
 
-                    // Throw an error if a directory is being copied into a file
-                    if(!std::filesystem::is_directory(to)) {
-                        throw std::runtime_error(_private::errorMessage(__func__, "\"" + to.filename().string() + "\" is a file"));
+                    if(timeout.count() > 0) {
+                        command.deadline = command.child.start + timeout;
                     }
+                    poller.add(command.child.output, index * 3 + output_token);
+                    poller.add(command.child.error, index * 3 + error_token);
+                    command.exit = _private::openPidfd(command.child.pid);
+                    if(command.exit >= 0) {
+                        poller.add(command.exit, index * 3 + exit_token);
+                    }
+                    running.push_back(command);
+                }
+                if(running.empty()) {
+                    break;
+                }
 
-                    // Remove all contents of directory when "OverwriteAll" option is active
-                    if(op == CopyOption::OverwriteAll) {
-                        for(const auto& entry : std::filesystem::directory_iterator(to)) {
-                            path::remove(entry.path());
+                // Reap commands whose pipes are closed
+                bool draining = false;
+                for(auto it = running.begin(); it != running.end();) {
+                    if(it->child.output < 0 && it->child.error < 0) {
+                        if(_private::reap(it->child, results[it->index], false)) {
+                            if(it->exit >= 0) {
+                                poller.remove(it->exit);
+                                close(it->exit);
+                            }
+                            finished(results[it->index]);
+                            it = running.erase(it);
+                            continue;
                         }
-                    } 
 
-                    // store the paths first before copying to prevent endless recursion
-                    std::vector<std::filesystem::path> paths;
-                    if(t_op == TraversalOption::Recursive) {
-                        // Get relative path to conserve memory
-                        for(const auto& entry : std::filesystem::recursive_directory_iterator(from)) {
-                            paths.push_back(std::filesystem::relative(entry.path(), from));
-                        }
+                        // Without an exit descriptor, check again shortly
+                        draining = draining || it->exit < 0;
                     }
+                    it++;
+                }
+                if(running.empty()) {
+                    continue;
+                }
 
-                    // If "from" has a trailing separator, copy "from" directory with subdirectories
-                    if(!isDirectoryString(from)) {
-                        to = std::filesystem::weakly_canonical(to / from.filename());
-                        std::filesystem::create_directories(to);
-                        
-                        if(t_op == TraversalOption::NonRecursive) {
-                            return true;
-                        }
-                    } else if(t_op == TraversalOption::NonRecursive) {
-                        for(const auto& entry : std::filesystem::directory_iterator(from)) {
-                            paths.push_back(std::filesystem::relative(entry.path(), from));
+                // Stop the commands that have to go
+                auto now = clock::now();
+                auto wake = clock::time_point::max();
+                for(auto it = running.begin(); it != running.end(); it++) {
+                    if(!it->terminated && (failed || now >= it->deadline)) {
+                        results[it->index].timed_out = now >= it->deadline;
+                        signal(*it, SIGTERM);
+                        it->terminated = true;
+                        it->kill_at = now + _private::stop_grace;
+                    } else if(it->terminated && now >= it->kill_at) {
+                        signal(*it, SIGKILL);
+                        it->kill_at = clock::time_point::max();
+
+                        // Whatever escaped the process group may still hold the pipes
+                        for(int fd : {it->child.output, it->child.error}) {
+                            if(fd >= 0) {
+                                poller.remove(fd);
+                            }
                         }
+                        _private::closePipes(it->child);
                     }
+                    wake = std::min(wake, it->terminated ? it->kill_at : it->deadline);
+                }
 
-                    for(int i = 0; i < paths.size(); i++) {
-                        std::filesystem::path source = std::filesystem::weakly_canonical(from / paths[i]);
-                        std::filesystem::path copy_to = std::filesystem::weakly_canonical(to / paths[i]);
-                        bool is_source_dir = std::filesystem::is_directory(source);
-                        bool destination_exists = std::filesystem::exists(copy_to);
-                        
-                        // display warning
-                        if(op == CopyOption::None && destination_exists && ch != 'a' && ch != 'A') {
-                            ch = _private::copyWarning(path::relativePath(copy_to));
-                        }
-
-                        if(ch == 'x' || ch == 'X') {
-                            return false;
-                        }
+                int wait = -1;
+                if(draining) {
+                    wait = 10;
+                } else if(wake != clock::time_point::max()) {
+                    wait = static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(std::max(wake - now, clock::duration::zero())).count());
+                }
+                poller.wait(wait, ready);
 
-                        if(is_source_dir) { 
-                            std::filesystem::create_directories(copy_to);
-                        } else if(!destination_exists || op == CopyOption::OverwriteExisting || ch == 'y' || ch == 'Y' || ch == 'a' || ch == 'A') {
-                            _private::copyFile(source, copy_to);
-                        } 
-                    }
-                } else { // is file
-                    if(isDirectoryString(from)) {
-                        from = from.parent_path();
+                for(std::uint64_t token : ready) {
+                    std::size_t index = token / 3;
+                    auto it = std::find_if(running.begin(), running.end(), [&](const Running& command) { return command.index == index; });
+                    if(it == running.end()) {
+                        continue;
                     }
 
-                    bool is_source_dir = std::filesystem::is_directory(from);
-                    bool is_destination_dir = std::filesystem::is_directory(to);
-
-                    if(is_destination_dir && op == CopyOption::OverwriteAll) {
-                        for(const auto& entry : std::filesystem::directory_iterator(to)) {
-                            path::remove(entry.path());
-                        }
-                    } 
-
-                    std::filesystem::path copy_to = std::filesystem::is_directory(to) ? std::filesystem::weakly_canonical(to / path::filename(from)) : to;
-                    bool destination_exists = std::filesystem::exists(copy_to);
-
-                    if(op == CopyOption::None && destination_exists && ch != 'a' && ch != 'A') {
-                        ch = _private::copyWarning(path::relativePath(copy_to));
+                    if(token % 3 == exit_token) {
+                        // Stays readable, so stop watching it and reap once the pipes are drained
+                        poller.remove(it->exit);
+                        continue;
                     }
 
-                    if(ch == 'x' || ch == 'X') {
-                        return false;
+                    int& fd = token % 3 == error_token ? it->child.error : it->child.output;
+                    std::string& into = token % 3 == error_token ? results[index].error : results[index].output;
+                    int watched = fd;
+                    if(watched >= 0 && !_private::readPipe(fd, into)) {
+                        poller.remove(watched);
                     }
-
-                    if(is_source_dir) { 
-                        std::filesystem::create_directories(copy_to);
-                    } else if(!destination_exists || op == CopyOption::OverwriteExisting || ch == 'y' || ch == 'Y' || ch == 'a' || ch == 'A') {
-                        _private::copyFile(from, copy_to);
-                    } 
                 }
-
-                return true;
             }
-
-            inline bool copy(const std::filesystem::path& source, const std::set<std::string>& paths, 
-                             const std::filesystem::path& destination, const CopyOption& op)
-            {
-                if(!std::filesystem::exists(source)) {
-                    throw std::runtime_error(_private::errorMessage(__func__, "\"" + source.string() + "\" does not exist"));
+        #else
+            for(std::size_t i = 0; i < commands.size(); i++) {
+                results[i] = execute(commands[i]);
+                if(fail_fast && results[i].exit_code != 0) {
+                    break;
                 }
-
-                if(op == CopyOption::OverwriteAll) {
-                    for(const auto& entry : std::filesystem::directory_iterator(destination)) {
-                        path::remove(entry.path());
-                    }
+            }
+        #endif
+        return results;
+    }
+    namespace _private {
+        // Runs a program and streams its output to `on_output`. Sets `ec` if it could not be started.
+        inline ExecuteResult streamProgram(const std::vector<std::string>& argv, const std::function<bool(std::string_view data, bool from_error)>& on_output,
+                                           const OutputMode& mode, const std::chrono::milliseconds& timeout, std::error_code& ec)
+        {
+            ExecuteResult result;
+            _private::LineBuffer lines[2];
+            bool stopping = false;
+
+            // Passes data on, returns `false` once the callback asks to stop
+            auto deliver = [&](std::string_view data, bool from_error) {
+                if(mode == OutputMode::Chunks) {
+                    return on_output(data, from_error);
                 }
+                return lines[from_error].feed(data, [&](std::string_view line) { return on_output(line, from_error); });
+            };
 
-                char ch;
-                for(const auto& i : paths) {
-                    std::filesystem::path from = std::filesystem::weakly_canonical(source / i);
-                    std::filesystem::path to = std::filesystem::weakly_canonical(destination / std::filesystem::relative(from, source));
+            #if !defined(_WIN32)
+                using clock = std::chrono::steady_clock;
 
-                    bool destination_exists = std::filesystem::exists(to);
-                    bool is_source_dir = std::filesystem::is_directory(from);
-                    
-                    // display warning
-                    if(op == CopyOption::None && destination_exists && ch != 'a' && ch != 'A') {
-                        ch = _private::copyWarning(path::relativePath(to));
-                    }
+                _private::Child child;
+                int code = _private::spawn(argv, child, true);
+                if(code != 0) {
+                    ec = std::error_code(code, std::generic_category());
+                    return result;
+                }
 
-                    if(ch == 'x' || ch == 'X') {
-                        return false;
+                auto deadline = timeout.count() > 0 ? child.start + timeout : clock::time_point::max();
+                auto kill_at = clock::time_point::max();
+                auto stop = [&]() {
+                    if(!stopping) {
+                        kill(-child.pid, SIGTERM);
+                        stopping = true;
+                        kill_at = clock::now() + _private::stop_grace;
+                    }
+                };
+
+                // Stops the program when its time is up, returns how long to wait for the next check
+                auto check = [&]() {
+                    auto now = clock::now();
+                    if(!stopping && now >= deadline) {
+                        result.timed_out = true;
+                        stop();
+                    }
+                    if(stopping && now >= kill_at) {
+                        kill(-child.pid, SIGKILL);
+                        kill_at = clock::time_point::max();
+                        _private::closePipes(child); // whatever escaped the group may still hold them
                     }
 
-                    if(is_source_dir) { 
-                        std::filesystem::create_directories(to);
-                    } else if(!destination_exists || op == CopyOption::OverwriteExisting || ch == 'y' || ch == 'Y' || ch == 'a' || ch == 'A') {
-                        _private::copyFile(from, to);
-                    } 
-                }
-
-                return true;
-            }
+                    auto wake = stopping ? kill_at : deadline;
+                    if(wake == clock::time_point::max()) {
+                        return -1;
+                    }
+                    return static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(std::max(wake - now, clock::duration::zero())).count());
+                };
+
+                std::string buffer;
+                while(child.output >= 0 || child.error >= 0) {
+                    int wait = check();
+                    pollfd fds[2] = {{child.output, POLLIN, 0}, {child.error, POLLIN, 0}};
+                    if(poll(fds, 2, wait) < 0 && errno != EINTR) {
+                        break;
+                    }
 
-            inline bool move(const std::filesystem::path& source, const std::filesystem::path& destination, 
-                             const CopyOption& op, const TraversalOption& t_op)
-            {
-                if(!_private::copy(source, destination, op, t_op)) {
-                    return false;
+                    for(int stream = 0; stream < 2; stream++) {
+                        int& fd = stream ? child.error : child.output;
+                        if(fds[stream].revents && fd >= 0) {
+                            buffer.clear();
+                            _private::readPipe(fd, buffer);
+                            if(!stopping && !buffer.empty() && !deliver(buffer, stream)) {
+                                stop();
+                            }
+                        }
+                    }
                 }
+                _private::closePipes(child);
 
-                path::remove(source);
-                return true;
-            }
-
-            inline bool move(const std::filesystem::path& source, const std::set<std::string>& paths, 
-                             const std::filesystem::path& destination, const CopyOption& op)
-            {
-                if(!_private::copy(source, paths, destination, op)) {
-                    return false;
+                for(int stream = 0; stream < 2 && !stopping && mode == OutputMode::Lines; stream++) {
+                    if(!lines[stream].flush([&](std::string_view line) { return on_output(line, stream); })) {
+                        stop();
+                    }
                 }
 
-                for(auto it = paths.rbegin(); it != paths.rend(); it++) {
-                    std::string full_path = path::joinPath(source, *it);
-
-                    if(isDirectory(full_path) && !isEmpty(full_path)) {
-                        continue;
+                // The pipes are closed, but the program may take a moment to exit
+                if(deadline == clock::time_point::max() && !stopping) {
+                    _private::reap(child, result);
+                } else {
+                    while(!_private::reap(child, result, false)) {
+                        int wait = check();
+                        std::this_thread::sleep_for(std::chrono::milliseconds(wait < 0 || wait > 10 ? 10 : wait));
                     }
+                }
+            #else
+                std::string command;
+                for(const auto& arg : argv) {
+                    command += (command.empty() ? "\"" : " \"") + arg + "\"";
+                }
 
-                    path::remove(full_path);
+                auto start = std::chrono::steady_clock::now();
+                FILE* pipe = popen(command.c_str(), "r");
+                if(!pipe) {
+                    result.exit_code = 127;
+                    ec = path::_private::lastError();
+                    return result;
                 }
 
-                return true;
-            }
+                char buffer[65536];
+                std::size_t bytes;
+                while(!stopping && (bytes = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+                    stopping = !deliver(std::string_view(buffer, bytes), false);
+                }
+                if(!stopping && mode == OutputMode::Lines) {
+                    lines[0].flush([&](std::string_view line) { return on_output(line, false); });
+                }
+                result.exit_code = pclose(pipe);
+                result.duration = std::chrono::steady_clock::now() - start;
+            #endif
+            return result;
         }
     }
 
     /*
-        Execute a command in the shell.
+        Runs a program directly, without a shell, and streams its output to a callback.
 
         Return Value:
-        - Returns `true` if the command executes successfully. Else it will return `false`.
+        - Returns the exit code or signal, wall time and timeout flag of the program. The output itself is
+          only passed to `on_output`.
 
         Parameters:
-        `command`: Command to execute.
-        `output`: A string reference to get the output of the executed command.
-        `mode`: Use `r` for read-mode, `w` for write-mode.
+        `argv`: Program to run, then its arguments. The program is looked up in `PATH`.
+        `on_output`: Called with each chunk or line and whether it came from standard error. Return `false`
+                     to stop the program.
+        `mode`: Whether `on_output` gets chunks or lines. (Defaults `Lines`)
+        `timeout`: Longest time the program may run, `0` for no limit. (Defaults `0`)
+
+        Notes:
+        - Memory use does not grow with the amount of output. Lines longer than 64 KiB are handed over in 64 KiB pieces.
+        - Stopping, from the callback or the timeout, sends `SIGTERM` to the program's process group, then
+          `SIGKILL` two seconds later. Output after that is discarded.
+        - The program runs in its own process group so everything it starts is stopped with it.
+        - On Windows, the program runs through the shell, only standard output is streamed and the timeout is ignored.
     */
-    inline bool execute(const std::string& command, std::string& output, const std::string& mode = "r")
+    inline ExecuteResult execute(const std::vector<std::string>& argv, const std::function<bool(std::string_view data, bool from_error)>& on_output,
+                                 const OutputMode& mode = OutputMode::Lines, const std::chrono::milliseconds& timeout = std::chrono::milliseconds::zero())
     {
-        // Open the pipe using platform-specific popen function
-        FILE* pipe = popen(command.c_str(), mode.c_str());
-        if(!pipe) {
-            return false;  // Command failed to execute
-        }
-
-        char buffer[128];
-        output.clear();  // Clear the output string before capturing the result
-
-        // Read the command's output chunk by chunk
-        while(fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-            output.append(buffer);  // Append each chunk to the output string
+        _private::MetricsScope metrics_scope(__func__);
+        if(argv.empty()) {
+            throw std::runtime_error(path::_private::errorMessage(__func__, "No program given"));
         }
 
-        // Get the command exit status
-        int exit_code = pclose(pipe);
-        
-        // Return true if the command was successful (exit code is 0)
-        return (exit_code == 0);
+        std::error_code ec;
+        ExecuteResult result = _private::streamProgram(argv, on_output, mode, timeout, ec);
+        #if !defined(_WIN32)
+            if(ec) {
+                _private::spawnFailed(argv[0], ec.value(), result);
+            }
+        #endif
+        return result;
     }
 
     /*
-        Execute a command in the shell.
+        Runs a program directly, without a shell, and streams its output to a callback, without throwing.
 
         Return Value:
-        - Returns `true` if the command executes successfully. Else it will return `false`.
+        - Returns the exit code or signal, wall time and timeout flag of the program.
 
         Parameters:
-        `command`: Command to execute.
-        `mode`: Use `r` for read-mode, `w` for write-mode.
+        `argv`: Program to run, then its arguments. The program is looked up in `PATH`.
+        `on_output`: Called with each chunk or line and whether it came from standard error. Return `false`
+                     to stop the program.
+        `mode`: Whether `on_output` gets chunks or lines.
+        `timeout`: Longest time the program may run, `0` for no limit.
+        `ec`: Gets the error if the program could not be started, `invalid_argument` if `argv` is empty.
+
+        Notes:
+        - An exception thrown by `on_output` is caught and reported through `ec`. The program is then
+          left to finish on its own.
     */
-    inline bool execute(const std::string& command, const std::string& mode = "r")
+    inline ExecuteResult execute(const std::vector<std::string>& argv, const std::function<bool(std::string_view data, bool from_error)>& on_output,
+                                 const OutputMode& mode, const std::chrono::milliseconds& timeout, std::error_code& ec) noexcept
     {
-        std::string dummy_output;
-        return execute(command, dummy_output, mode);
+        _private::MetricsScope metrics_scope(__func__);
+        ec.clear();
+        if(argv.empty()) {
+            ec = std::make_error_code(std::errc::invalid_argument);
+            return ExecuteResult();
+        }
+
+        try {
+            return _private::streamProgram(argv, on_output, mode, timeout, ec);
+        } catch(...) {
+            ec = path::_private::currentError();
+            return ExecuteResult();
+        }
     }
+    /*
+        Programs connected so that each one's output is the next one's input, like `a | b | c` in a shell,
+        but without the shell.
+
+        Notes:
+        - Input and output files are handed to the first and last program directly, so their data never
+          passes through this process.
+        - A mapped file is fed to the first program with `vmsplice()` on Linux, which passes its pages to the
+          pipe without copying them. The mapping has to outlive `run()`.
+        - Without an output, the output of the last program is captured in its result.
+        - All programs run in one new process group.
+        - Not supported on Windows.
+    */
+    class Pipeline {
+        public:
+            Pipeline() = default;
+
+            /*
+                Parameters:
+                `stages`: Programs to run, each followed by its arguments, in pipeline order.
+            */
+            Pipeline(std::initializer_list<std::vector<std::string>> stages) : stages(stages) {}
+
+            // Appends a program to the end of the pipeline.
+            Pipeline& add(const std::vector<std::string>& argv)
+            {
+                stages.push_back(argv);
+                return *this;
+            }
+
+            // Reads the input of the first program from a descriptor, which is left open.
+            Pipeline& input(int fd)
+            {
+                clearInput();
+                input_fd = fd;
+                return *this;
+            }
+
+            // Reads the input of the first program from a file.
+            Pipeline& input(const std::filesystem::path& path)
+            {
+                clearInput();
+                input_path = path;
+                return *this;
+            }
+
+            // Feeds a mapped file to the first program.
+            Pipeline& input(const path::MappedFile& file)
+            {
+                clearInput();
+                input_data = file.view();
+                has_input_data = true;
+                return *this;
+            }
+
+            // Writes the output of the last program to a descriptor, which is left open.
+            Pipeline& output(int fd)
+            {
+                output_path.clear();
+                output_fd = fd;
+                return *this;
+            }
+
+            /*
+                Writes the output of the last program to a file.
+
+                Parameters:
+                `path`: File to write, created if it does not exist.
+                `append`: Set to `true` to add to the end of the file instead of replacing it. (Defaults `false`)
+            */
+            Pipeline& output(const std::filesystem::path& path, bool append = false)
+            {
+                output_fd = -1;
+                output_path = path;
+                append_output = append;
+                return *this;
+            }
+
+            /*
+                Runs the pipeline and waits for every program to exit.
+
+                Return Value:
+                - Returns the result of every program, in pipeline order, with its standard error. The last one
+                  also has the output when no output was set.
+
+                Notes:
+                - Throws `std::runtime_error` if the pipeline is empty or the input or output file cannot be opened.
+                - A program that cannot be started gets exit code `127` or `126`. The programs around it see
+                  the end of their input or a closed output, as in a shell.
+            */
+            std::vector<ExecuteResult> run() const
+            {
+                _private::MetricsScope metrics_scope("Pipeline::run");
+                if(stages.empty()) {
+                    throw std::runtime_error(path::_private::errorMessage(__func__, "Pipeline has no programs"));
+                }
+                for(const auto& argv : stages) {
+                    if(argv.empty()) {
+                        throw std::runtime_error(path::_private::errorMessage(__func__, "No program given"));
+                    }
+                }
+
+                std::vector<ExecuteResult> results(stages.size());
+                #if !defined(_WIN32)
+                    // Standard input of the first program, and the pipe end a mapped file is fed into
+                    int input = input_fd;
+                    int feed = -1;
+                    if(!input_path.empty()) {
+                        input = open(input_path.c_str(), O_RDONLY | O_CLOEXEC);
+                        if(input < 0) {
+                            throw std::runtime_error(path::_private::errorMessage(__func__, "\"" + input_path.string() + "\" could not be opened"));
+                        }
+                    } else if(has_input_data) {
+                        int fds[2];
+                        if(!_private::openPipe(fds)) {
+                            throw std::runtime_error(path::_private::errorMessage(__func__, "Failed to create a pipe"));
+                        }
+                        input = fds[0];
+                        feed = fds[1];
+                        fcntl(feed, F_SETFL, O_NONBLOCK);
+                        #if defined(__linux__)
+                            fcntl(feed, F_SETPIPE_SZ, 1 << 20);
+                        #endif
+                    }
+                    bool own_input = input != input_fd;
+
+                    // Standard output of the last program, and the pipe end it is captured from
+                    int output = output_fd;
+                    int capture = -1;
+                    if(!output_path.empty()) {
+                        output = open(output_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (append_output ? O_APPEND : O_TRUNC), 0666);
+                        if(output < 0) {
+                            if(own_input) {
+                                close(input);
+                            }
+                            if(feed >= 0) {
+                                close(feed);
+                            }
+                            throw std::runtime_error(path::_private::errorMessage(__func__, "\"" + output_path.string() + "\" could not be opened"));
+                        }
+                    } else if(output_fd < 0) {
+                        int fds[2];
+                        if(!_private::openPipe(fds)) {
+                            if(own_input) {
+                                close(input);
+                            }
+                            if(feed >= 0) {
+                                close(feed);
+                            }
+                            throw std::runtime_error(path::_private::errorMessage(__func__, "Failed to create a pipe"));
+                        }
+                        output = fds[1];
+                        capture = fds[0];
+                    }
+                    bool own_output = output != output_fd;
+
+                    std::vector<_private::Child> children(stages.size());
+                    pid_t group = 0;
+                    int previous = input;
+
+                    // Stops the programs already started and closes every descriptor still open
+                    auto abandon = [&](bool own_previous) {
+                        for(auto& child : children) {
+                            if(child.pid > 0) {
+                                kill(child.pid, SIGKILL);
+                                waitpid(child.pid, nullptr, 0);
+                            }
+                            _private::closePipes(child);
+                        }
+                        for(int fd : {own_previous ? previous : -1, own_output ? output : -1, capture, feed}) {
+                            if(fd >= 0) {
+                                close(fd);
+                            }
+                        }
+                    };
+
+                    for(std::size_t i = 0; i < stages.size(); i++) {
+                        bool last = i + 1 == stages.size();
+                        bool own_previous = i > 0 || own_input;
+                        int next[2] = {-1, -1};
+                        int error[2] = {-1, -1};
+                        if((!last && !_private::openPipe(next)) || !_private::openPipe(error)) {
+                            for(int fd : {next[0], next[1]}) {
+                                if(fd >= 0) {
+                                    close(fd);
+                                }
+                            }
+                            abandon(own_previous);
+                            throw std::runtime_error(path::_private::errorMessage(__func__, "Failed to create a pipe"));
+                        }
+
+                        _private::Child& child = children[i];
+                        child.start = std::chrono::steady_clock::now();
+                        int code = _private::spawnProcess(stages[i], previous, last ? output : next[1], error[1], group, child.pid);
+                        close(error[1]);
+                        if(!last) {
+                            close(next[1]);
+                        }
+                        if(previous >= 0 && own_previous) {
+                            close(previous);
+                        }
+
+                        if(code != 0) {
+                            _private::spawnFailed(stages[i][0], code, results[i]);
+                            close(error[0]);
+                        } else {
+                            child.error = error[0];
+                            group = group == 0 ? child.pid : group;
+                        }
+                        previous = next[0];
+                    }
+                    if(own_output) {
+                        close(output);
+                    }
+                    children.back().output = capture;
+
+                    // A program that stops reading early must not kill the caller with `SIGPIPE`
+                    sigset_t pipe_signal;
+                    sigset_t old_mask;
+                    sigemptyset(&pipe_signal);
+                    sigaddset(&pipe_signal, SIGPIPE);
+                    if(feed >= 0) {
+                        pthread_sigmask(SIG_BLOCK, &pipe_signal, &old_mask);
+                    }
+
+                    std::size_t fed = 0;
+                    std::vector<pollfd> fds;
+                    std::vector<int*> owners;
+                    while(true) {
+                        fds.clear();
+                        owners.clear();
+                        for(auto& child : children) {
+                            for(int* fd : {&child.output, &child.error}) {
+                                if(*fd >= 0) {
+                                    fds.push_back({*fd, POLLIN, 0});
+                                    owners.push_back(fd);
+                                }
+                            }
+                        }
+                        if(feed >= 0) {
+                            fds.push_back({feed, POLLOUT, 0});
+                            owners.push_back(&feed);
+                        }
+                        if(fds.empty()) {
+                            break;
+                        }
+
+                        if(poll(fds.data(), fds.size(), -1) < 0) {
+                            if(errno == EINTR) {
+                                continue;
+                            }
+                            break;
+                        }
+
+                        for(std::size_t i = 0; i < fds.size(); i++) {
+                            if(!fds[i].revents) {
+                                continue;
+                            }
+
+                            if(owners[i] == &feed) {
+                                std::size_t size = std::min<std::size_t>(input_data.size() - fed, 1 << 20);
+                                #if defined(__linux__)
+                                    iovec iov = {const_cast<char*>(input_data.data() + fed), size};
+                                    ssize_t bytes = size > 0 ? vmsplice(feed, &iov, 1, SPLICE_F_NONBLOCK) : 0;
+                                #else
+                                    ssize_t bytes = size > 0 ? write(feed, input_data.data() + fed, size) : 0;
+                                #endif
+                                if(bytes > 0) {
+                                    fed += bytes;
+                                }
+                                if(fed == input_data.size() || (bytes < 0 && errno != EAGAIN && errno != EINTR)) {
+                                    close(feed);
+                                    feed = -1;
+                                }
+                                continue;
+                            }
+
+                            std::size_t stage = 0;
+                            while(owners[i] != &children[stage].output && owners[i] != &children[stage].error) {
+                                stage++;
+                            }
+                            bool is_output = owners[i] == &children[stage].output;
+                            _private::readPipe(*owners[i], is_output ? results[stage].output : results[stage].error);
+                        }
+                    }
+
+                    if(has_input_data) {
+                        if(feed >= 0) {
+                            close(feed);
+                        }
+
+                        // Drop a `SIGPIPE` raised while feeding before it can be delivered
+                        if(!sigismember(&old_mask, SIGPIPE)) {
+                            sigset_t pending;
+                            sigpending(&pending);
+                            if(sigismember(&pending, SIGPIPE)) {
+                                int signal;
+                                sigwait(&pipe_signal, &signal);
+                            }
+                        }
+                        pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+                    }
+
+                    for(std::size_t i = 0; i < children.size(); i++) {
+                        _private::closePipes(children[i]);
+                        if(children[i].pid > 0) {
+                            _private::reap(children[i], results[i]);
+                        }
+                    }
+                #else
+                    throw std::runtime_error(path::_private::errorMessage(__func__, "Pipelines are not supported on this platform"));
+                #endif
+                return results;
+            }
+
+        private:
+            void clearInput()
+            {
+                input_fd = -1;
+                input_path.clear();
+                input_data = std::string_view();
+                has_input_data = false;
+            }
+
+            std::vector<std::vector<std::string>> stages;
+            int input_fd = -1;
+            std::filesystem::path input_path;
+            std::string_view input_data;
+            bool has_input_data = false;
+            int output_fd = -1;
+            std::filesystem::path output_path;
+            bool append_output = false;
+    };
 }
\ No newline at end of file
@@ -0,0 +1,33 @@
+#include <type_traits>
+#include "os.hpp"
+#include "gtest/gtest.h"
+
+// Built without OS_ENABLE_METRICS, unlike path_test.cpp, to check that metrics compile away.
+
+namespace path = os::path;
+
+std::string temp_path = path::joinPath(path::sourcePath(), "../test_path/temp_metrics_off");
+
+static_assert(!os::_private::metrics_enabled, "metrics must be off in this test");
+static_assert(std::is_empty<os::_private::MetricsScope>::value, "timing a call must not cost any state");
+
+TEST(metrics, disabled)
+{
+    std::string source = path::joinPath(temp_path, "source");
+    std::string destination = path::joinPath(temp_path, "destination");
+    ASSERT_TRUE(path::createFiles(source, {{"a.txt", "hello"}, {"dir/b.txt", "world!"}}));
+
+    os::resetMetrics();
+    EXPECT_TRUE(path::copy(source + path::directorySeparator(), destination, path::CopyOption::OverwriteExisting));
+    EXPECT_EQ(path::size(destination), 11);
+
+    os::Metrics metrics = os::metrics(true);
+    EXPECT_EQ(metrics.stats, 0);
+    EXPECT_EQ(metrics.opens, 0);
+    EXPECT_EQ(metrics.bytes_read, 0);
+    EXPECT_EQ(metrics.bytes_written, 0);
+    EXPECT_EQ(metrics.directories_walked, 0);
+    EXPECT_TRUE(metrics.latency.empty());
+
+    path::remove(temp_path);
+}
\ No newline at end of file
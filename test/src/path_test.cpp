@@ -1,4 +1,8 @@
 #include <unordered_set>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#define OS_ENABLE_METRICS
 #include "os.hpp"
 #include "gtest/gtest.h"
 
@@ -28,6 +32,77 @@ TEST(isValidFilenameChar, check)
     EXPECT_EQ(path::isValidFilenameChar('t'), true);
 }
 
+TEST(validateFilename, posix)
+{
+    using Platform = path::PlatformOption;
+    EXPECT_TRUE(path::validateFilename("test.txt", Platform::Posix));
+    EXPECT_TRUE(path::validateFilename("CON", Platform::Posix));
+    EXPECT_TRUE(path::validateFilename("a:b?c*", Platform::Posix));
+    EXPECT_FALSE(path::validateFilename("", Platform::Posix));
+    EXPECT_FALSE(path::validateFilename(".", Platform::Posix));
+    EXPECT_FALSE(path::validateFilename("..", Platform::Posix));
+    EXPECT_FALSE(path::validateFilename("a/b", Platform::Posix));
+    EXPECT_FALSE(path::validateFilename(std::string("a\0b", 3), Platform::Posix));
+    EXPECT_FALSE(path::validateFilename(std::string(256, 'a'), Platform::Posix));
+    EXPECT_FALSE(path::validateFilename(std::string(40, 'a') + "/", Platform::Posix));
+}
+
+TEST(validateFilename, windows)
+{
+    using Platform = path::PlatformOption;
+    EXPECT_TRUE(path::validateFilename("test.txt", Platform::Windows));
+    EXPECT_TRUE(path::validateFilename("CONSOLE", Platform::Windows));
+    EXPECT_TRUE(path::validateFilename("COMX", Platform::Windows));
+    EXPECT_FALSE(path::validateFilename("con", Platform::Windows));
+    EXPECT_FALSE(path::validateFilename("NUL.txt", Platform::Windows));
+    EXPECT_FALSE(path::validateFilename("lpt1", Platform::Windows));
+    EXPECT_FALSE(path::validateFilename("file.", Platform::Windows));
+    EXPECT_FALSE(path::validateFilename("file ", Platform::Windows));
+    EXPECT_FALSE(path::validateFilename("tab\tname", Platform::Windows));
+    EXPECT_FALSE(path::validateFilename(std::string(33, 'a') + "<", Platform::Windows));
+
+    for(char ch : {'<', '>', ':', '\"', '/', '\\', '|', '?', '*'}) {
+        EXPECT_FALSE(path::validateFilename(std::string(17, 'a') + ch + "b", Platform::Windows));
+    }
+}
+
+TEST(validateFilename, batch)
+{
+    std::vector<std::string> names = {"good.txt", "bad/name", "", "also_good"};
+    std::vector<bool> results = path::validateFilename(names, path::PlatformOption::Posix);
+    EXPECT_EQ(results, std::vector<bool>({true, false, false, true}));
+}
+
+TEST(sanitizeFilename, replace)
+{
+    using Platform = path::PlatformOption;
+    EXPECT_EQ(path::sanitizeFilename("a/b", Platform::Posix), "a_b");
+    EXPECT_EQ(path::sanitizeFilename("a:b", Platform::Posix), "a:b");
+    EXPECT_EQ(path::sanitizeFilename("a:b*c?", Platform::Windows), "a_b_c_");
+    EXPECT_EQ(path::sanitizeFilename("a/b", Platform::Posix, '-'), "a-b");
+    EXPECT_EQ(path::sanitizeFilename("a/b", Platform::Posix, '/'), "a_b");
+    EXPECT_EQ(path::sanitizeFilename("", Platform::Posix), "_");
+    EXPECT_EQ(path::sanitizeFilename("..", Platform::Posix), "__");
+    EXPECT_EQ(path::sanitizeFilename("file. ", Platform::Windows), "file__");
+    EXPECT_EQ(path::sanitizeFilename("CON", Platform::Windows), "CON_");
+    EXPECT_EQ(path::sanitizeFilename("nul.tar.gz", Platform::Windows), "nul_.tar.gz");
+    EXPECT_EQ(path::sanitizeFilename(std::string(300, 'a'), Platform::Posix).size(), 255);
+
+    std::string multibyte;
+    for(int i = 0; i < 100; i++) {
+        multibyte += "\xE2\x82\xAC"; // 3 byte UTF-8 character
+    }
+    EXPECT_EQ(path::sanitizeFilename(multibyte, Platform::Posix).size(), 255);
+    EXPECT_EQ(path::sanitizeFilename(multibyte + "a", Platform::Posix).size(), 255);
+
+    std::vector<std::string> names = {"a/b", "ok"};
+    EXPECT_EQ(path::sanitizeFilename(names, Platform::Posix), std::vector<std::string>({"a_b", "ok"}));
+
+    for(const auto& name : {std::string("a<b>c|d"), std::string("AUX"), std::string(". ."), std::string(300, '?')}) {
+        EXPECT_TRUE(path::validateFilename(path::sanitizeFilename(name, Platform::Windows), Platform::Windows));
+    }
+}
+
 TEST(hasFileExtension, check)
 {
     EXPECT_EQ(path::hasFileExtension("test.txt"), true);
@@ -156,6 +231,19 @@ TEST(hasSameContent, files)
     std::string test_suite_path = path::joinPath(test_path, "hasSameContent");
     ASSERT_TRUE(path::hasSameContent(path::joinPath(test_suite_path, "same3/shaggy.txt"), path::joinPath(test_suite_path, "same3/shaggy1.txt")));
     ASSERT_FALSE(path::hasSameContent(path::joinPath(test_suite_path, "same3/sand1.txt"), path::joinPath(test_suite_path, "same3/shaggy.txt")));
+
+    // both overloads share one implementation, down to the bytes they count
+    std::string shaggy = path::joinPath(test_suite_path, "same3/shaggy.txt");
+    std::string shaggy1 = path::joinPath(test_suite_path, "same3/shaggy1.txt");
+    std::error_code ec;
+    os::resetMetrics();
+    EXPECT_TRUE(path::hasSameContent(shaggy, shaggy1, ec));
+    EXPECT_FALSE(ec);
+    std::uint64_t bytes_read = os::metrics().bytes_read;
+    EXPECT_EQ(bytes_read, 2 * path::size(shaggy));
+    os::resetMetrics();
+    EXPECT_TRUE(path::hasSameContent(shaggy, shaggy1));
+    EXPECT_EQ(os::metrics().bytes_read, bytes_read);
 }
 
 TEST(isDirectoryString, working)
@@ -354,6 +442,77 @@ TEST(copy, custom_paths_no_parent)
     path::remove(to + path::directorySeparator());
 }
 
+TEST(copy, durability)
+{
+    std::string from = path::joinPath(temp_path, "from");
+    std::vector<std::pair<std::string, std::string>> entries;
+    for(int i = 0; i < 200; i++) {
+        entries.push_back({"dir" + std::to_string(i % 4) + "/file" + std::to_string(i) + ".txt", std::string(i, 'x')});
+    }
+    entries.push_back({"large.bin", std::string(3 << 20, 'y')});
+    ASSERT_TRUE(path::createFiles(from, entries));
+    std::uintmax_t expected = path::size(from);
+
+    for(auto durability : {path::Durability::None, path::Durability::GroupCommit, path::Durability::Strict}) {
+        std::string to = path::joinPath(temp_path, "to");
+        ASSERT_TRUE(path::copy(from + path::directorySeparator(), to, CopyOption::OverwriteAll, path::TraversalOption::Recursive, durability));
+        EXPECT_EQ(path::size(to), expected);
+        EXPECT_TRUE(path::hasSameContent(path::joinPath(from, "large.bin"), path::joinPath(to, "large.bin")));
+    }
+
+    std::set<std::string> paths = {path::joinPath(from, "large.bin")};
+    std::string moved = path::joinPath(temp_path, "moved");
+    ASSERT_TRUE(path::move(from, paths, moved, CopyOption::None, path::Durability::GroupCommit));
+    EXPECT_EQ(path::size(path::joinPath(moved, "large.bin")), 3 << 20);
+    EXPECT_FALSE(path::exists(path::joinPath(from, "large.bin")));
+
+    path::remove(temp_path);
+}
+
+TEST(copy, replace_all)
+{
+    std::string from = path::joinPath(temp_path, "from");
+    std::string to = path::joinPath(temp_path, "to");
+    ASSERT_TRUE(path::createFiles(from, {{"config.txt", "new"}, {"sub/a.txt", "a"}}));
+    ASSERT_TRUE(path::createFiles(to, {{"config.txt", "old"}, {"old.txt", "old"}}));
+
+    // the destination never goes missing while it is replaced
+    std::atomic<bool> done {false};
+    std::atomic<int> missing {0};
+    std::thread reader([&]() {
+        while(!done) {
+            if(!path::exists(path::joinPath(to, "config.txt"))) {
+                missing++;
+            }
+        }
+    });
+    for(int i = 0; i < 20; i++) {
+        ASSERT_TRUE(path::copy(from + path::directorySeparator(), to, CopyOption::ReplaceAll));
+    }
+    done = true;
+    reader.join();
+    EXPECT_EQ(missing, 0);
+
+    EXPECT_FALSE(path::exists(path::joinPath(to, "old.txt")));
+    EXPECT_EQ(path::size(path::joinPath(to, "config.txt")), 3);
+    EXPECT_TRUE(path::exists(path::joinPath(to, "sub/a.txt")));
+
+    // file to file
+    std::string single = path::joinPath(temp_path, "single.txt");
+    path::createFile(single, "previous", CopyOption::OverwriteExisting);
+    ASSERT_TRUE(path::copy(path::joinPath(from, "sub/a.txt"), single, CopyOption::ReplaceAll));
+    EXPECT_EQ(path::size(single), 1);
+
+    ASSERT_TRUE(path::createFiles(to, {{"only.txt", "x"}}, CopyOption::ReplaceAll));
+    EXPECT_EQ(path::size(to), 1);
+
+    // no staging directories or old trees are left behind
+    path::waitDeferred();
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(temp_path), std::filesystem::directory_iterator()), 3);
+
+    path::remove(temp_path);
+}
+
 TEST(move, working)
 {
     std::string test_suite_path = path::joinPath(test_path, "copy");
@@ -394,4 +553,1283 @@ TEST(move, custom_paths)
     path::copy(path::joinPath(test_suite_path, "source_copy") + path::directorySeparator(), from, CopyOption::OverwriteAll);
 
     path::remove(to + path::directorySeparator());
+}
+
+TEST(remove, stats)
+{
+    std::string root = path::joinPath(temp_path, "remove_stats");
+    for(int i = 0; i < 8; i++) {
+        std::string dir = path::joinPath({root, "dir" + std::to_string(i), "nested"});
+        path::createDirectory(dir);
+        path::createFile(path::joinPath(dir, "a.txt"), "12345", CopyOption::OverwriteExisting);
+        path::createFile(path::joinPath(root, "file" + std::to_string(i) + ".txt"), "123", CopyOption::OverwriteExisting);
+    }
+
+    path::RemoveStats stats;
+    ASSERT_TRUE(path::remove(root + path::directorySeparator(), stats));
+    EXPECT_TRUE(path::exists(root));
+    EXPECT_TRUE(path::isEmpty(root));
+    EXPECT_EQ(stats.entries, 8 * 4); // dirN, dirN/nested, dirN/nested/a.txt, fileN.txt
+    EXPECT_EQ(stats.bytes, 8 * (5 + 3));
+
+    path::createFile(path::joinPath(root, "last.txt"), "1", CopyOption::OverwriteExisting);
+    ASSERT_TRUE(path::remove(root, stats));
+    EXPECT_FALSE(path::exists(root));
+    EXPECT_EQ(stats.entries, 2);
+    EXPECT_EQ(stats.bytes, 1);
+
+    EXPECT_FALSE(path::remove(root, stats));
+    EXPECT_EQ(stats.entries, 0);
+
+    // every directory is opened through its parent, and all of them are closed again
+    std::filesystem::path deep = root;
+    for(int i = 0; i < 64; i++) {
+        deep /= "d";
+        path::createDirectory(deep / ("side" + std::to_string(i)));
+    }
+    path::createFile((deep / "leaf.txt").string(), "12", CopyOption::OverwriteExisting);
+    auto openDescriptors = []() {
+        return std::distance(std::filesystem::directory_iterator("/proc/self/fd"), std::filesystem::directory_iterator());
+    };
+    auto before = openDescriptors();
+    ASSERT_TRUE(path::remove(root, stats));
+    EXPECT_EQ(openDescriptors(), before);
+    EXPECT_FALSE(path::exists(root));
+    EXPECT_EQ(stats.entries, 1 + 64 * 2 + 1);
+    EXPECT_EQ(stats.bytes, 2);
+    path::remove(temp_path);
+}
+
+TEST(removeDeferred, directory)
+{
+    std::string root = path::joinPath(temp_path, "deferred");
+    std::string target = path::joinPath(root, "target");
+    for(int i = 0; i < 4; i++) {
+        path::createDirectory(path::joinPath(target, "dir" + std::to_string(i)));
+        path::createFile(path::joinPath(target, "dir" + std::to_string(i) + "/a.txt"), "hello", CopyOption::OverwriteExisting);
+    }
+
+    ASSERT_TRUE(path::removeDeferred(target));
+    EXPECT_FALSE(path::exists(target));
+    EXPECT_FALSE(path::removeDeferred(target));
+
+    path::waitDeferred();
+    EXPECT_FALSE(path::exists(path::joinPath(root, ".os_trash")));
+    EXPECT_TRUE(path::isEmpty(root));
+
+    path::remove(temp_path);
+}
+
+TEST(removeDeferred, contents_only)
+{
+    std::string root = path::joinPath(temp_path, "deferred");
+    std::string target = path::joinPath(root, "target");
+    path::createDirectory(path::joinPath(target, "sub"));
+    path::createFile(path::joinPath(target, "a.txt"), "hello", CopyOption::OverwriteExisting);
+
+    ASSERT_TRUE(path::removeDeferred(target + path::directorySeparator()));
+    EXPECT_TRUE(path::exists(target));
+    EXPECT_TRUE(path::isEmpty(target));
+
+    path::waitDeferred();
+    EXPECT_FALSE(path::exists(path::joinPath(root, ".os_trash")));
+
+    path::remove(temp_path);
+}
+
+TEST(removeDeferred, entry_not_moved)
+{
+    std::string root = path::joinPath(temp_path, "deferred");
+    std::string target = path::joinPath(root, "target");
+    std::string locked = path::joinPath(target, "locked.txt");
+    ASSERT_TRUE(path::createFiles(target, {{"a.txt", "hello"}, {"sub/b.txt", "world"}, {"locked.txt", "stay"}}));
+
+    // an immutable file cannot be renamed into the trash, nor deleted
+    auto setImmutable = [&](bool immutable) {
+        int file = open(locked.c_str(), O_RDONLY);
+        int flags = 0;
+        bool ok = file >= 0 && ioctl(file, FS_IOC_GETFLAGS, &flags) == 0;
+        flags = immutable ? flags | FS_IMMUTABLE_FL : flags & ~FS_IMMUTABLE_FL;
+        ok = ok && ioctl(file, FS_IOC_SETFLAGS, &flags) == 0;
+        close(file);
+        return ok;
+    };
+    if(!setImmutable(true)) {
+        path::remove(temp_path);
+        GTEST_SKIP() << "the filesystem or the user cannot make files immutable";
+    }
+
+    // the move stops at the first failure and the rest is deleted on the spot, which reports the file left behind
+    std::error_code ec;
+    EXPECT_FALSE(path::removeDeferred(target + path::directorySeparator(), ec));
+    EXPECT_TRUE(ec);
+    EXPECT_TRUE(path::exists(locked));
+    EXPECT_FALSE(path::exists(path::joinPath(target, "a.txt")));
+    EXPECT_FALSE(path::exists(path::joinPath(target, "sub")));
+
+    EXPECT_TRUE(setImmutable(false));
+    path::waitDeferred();
+    path::remove(temp_path);
+}
+
+TEST(removeDeferred, recover_leftovers)
+{
+    std::string root = path::joinPath(temp_path, "deferred");
+    std::string leftover = path::joinPath(root, ".os_trash/crashed.1.1.0");
+    path::createDirectory(path::joinPath(leftover, "sub"));
+    path::createFile(path::joinPath(leftover, "sub/a.txt"), "hello", CopyOption::OverwriteExisting);
+
+    ASSERT_TRUE(path::recoverDeferred(root));
+    path::waitDeferred();
+    EXPECT_FALSE(path::exists(path::joinPath(root, ".os_trash")));
+    EXPECT_FALSE(path::recoverDeferred(root));
+
+    path::remove(temp_path);
+}
+
+TEST(removeDeferred, rate_limit)
+{
+    std::string root = path::joinPath(temp_path, "deferred");
+    path::createDirectory(path::joinPath(root, "target"));
+    for(int i = 0; i < 10; i++) {
+        path::createFile(path::joinPath(root, "target/" + std::to_string(i) + ".txt"), "", CopyOption::OverwriteExisting);
+    }
+
+    path::configureDeferred(100, path::IOPriority::Idle);
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(path::removeDeferred(path::joinPath(root, "target")));
+    path::waitDeferred();
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(90));
+    path::configureDeferred(0);
+
+    path::remove(temp_path);
+}
+
+TEST(createFile, lines)
+{
+    std::string file = path::joinPath(temp_path, "lines.txt");
+    path::createDirectory(temp_path);
+
+    ASSERT_TRUE(path::createFile(file, std::vector<std::string>({"one", "", "three"}), CopyOption::OverwriteExisting));
+    std::ifstream in(file, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    EXPECT_EQ(content, "one\n\nthree");
+
+    std::vector<std::string> many(5000, "line");
+    ASSERT_TRUE(path::createFile(file, many, CopyOption::OverwriteExisting));
+    EXPECT_EQ(path::size(file), 5000 * 5 - 1);
+
+    path::remove(temp_path);
+}
+
+TEST(createFile, atomic)
+{
+    std::string file = path::joinPath(temp_path, "atomic.txt");
+    path::createDirectory(temp_path);
+    path::createFile(file, "old", CopyOption::OverwriteExisting);
+
+    ASSERT_TRUE(path::createFile(file, "new contents", CopyOption::OverwriteExisting, path::WriteOption::Atomic, path::Durability::Strict));
+    EXPECT_EQ(path::size(file), 12);
+    ASSERT_TRUE(path::createFile(file, std::vector<std::string>({"a", "b"}), CopyOption::OverwriteExisting, path::WriteOption::Atomic));
+    EXPECT_EQ(path::size(file), 3);
+
+    // no temporary files are left behind
+    EXPECT_EQ(std::distance(std::filesystem::directory_iterator(temp_path), std::filesystem::directory_iterator()), 1);
+
+    EXPECT_FALSE(path::createFile(path::joinPath(temp_path, "missing/file.txt"), "x", CopyOption::OverwriteExisting, path::WriteOption::Atomic));
+
+    // a direct write flushes the directory as well when it creates the file, and only then
+    std::string direct = path::joinPath(temp_path, "direct.txt");
+    os::resetMetrics();
+    ASSERT_TRUE(path::createFile(direct, "new", CopyOption::OverwriteExisting, path::WriteOption::Direct, path::Durability::GroupCommit));
+    EXPECT_EQ(os::metrics().opens, 2);
+    os::resetMetrics();
+    ASSERT_TRUE(path::createFile(direct, "again", CopyOption::OverwriteExisting, path::WriteOption::Direct, path::Durability::GroupCommit));
+    EXPECT_EQ(os::metrics().opens, 1);
+
+    path::remove(temp_path);
+}
+
+TEST(mapFile, view)
+{
+    std::string file = path::joinPath(temp_path, "mapped.txt");
+    path::createDirectory(temp_path);
+    path::createFile(file, "first\r\nsecond\n\nlast", CopyOption::OverwriteExisting);
+
+    path::MappedFile mapped = path::mapFile(file);
+    EXPECT_EQ(mapped.size(), 19);
+    EXPECT_EQ(mapped.view().substr(0, 5), "first");
+
+    std::vector<std::string> lines;
+    for(std::string_view line : path::RecordReader(mapped)) {
+        lines.push_back(std::string(line));
+    }
+    EXPECT_EQ(lines, std::vector<std::string>({"first", "second", "", "last"}));
+
+    path::MappedFile moved = std::move(mapped);
+    EXPECT_TRUE(mapped.empty());
+    EXPECT_EQ(moved.size(), 19);
+
+    path::createFile(file, "", CopyOption::OverwriteExisting);
+    path::MappedFile empty = path::mapFile(file, path::AccessPattern::Random);
+    EXPECT_TRUE(empty.empty());
+    EXPECT_EQ(path::RecordReader(empty).begin(), path::RecordReader(empty).end());
+
+    EXPECT_THROW(path::mapFile(path::joinPath(temp_path, "missing.txt")), std::runtime_error);
+    EXPECT_THROW(path::mapFile(temp_path), std::runtime_error);
+
+    path::remove(temp_path);
+}
+
+TEST(RecordReader, delimiter)
+{
+    std::string data("a\0bc\0\0d\0", 8);
+    path::RecordReader reader(data, '\0');
+    std::string_view record;
+    std::vector<std::string_view> records;
+    while(reader.next(record)) {
+        records.push_back(record);
+    }
+    EXPECT_EQ(records, std::vector<std::string_view>({"a", "bc", "", "d"}));
+
+    reader.reset();
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(record, "a");
+}
+
+TEST(createFiles, scaffold)
+{
+    std::string root = path::joinPath(temp_path, "scaffold");
+    std::vector<std::pair<std::string, std::string>> entries = {
+        {"README.md", "# readme"},
+        {"src/main.cpp", "int main() {}"},
+        {"src/util/util.hpp", "#pragma once"},
+        {"include/", ""},
+        {"test/a/b/c/test.txt", "abc"}
+    };
+
+    ASSERT_TRUE(path::createFiles(root, entries));
+    EXPECT_TRUE(path::isDirectory(path::joinPath(root, "include")));
+    EXPECT_TRUE(path::isEmpty(path::joinPath(root, "include")));
+    EXPECT_EQ(path::size(path::joinPath(root, "src/util/util.hpp")), 12);
+    EXPECT_EQ(path::size(path::joinPath(root, "test/a/b/c/test.txt")), 3);
+    EXPECT_EQ(path::size(root), 8 + 13 + 12 + 3);
+
+    std::vector<std::pair<std::string, std::string>> update = {{"README.md", "new"}, {"extra.txt", "x"}};
+    ASSERT_TRUE(path::createFiles(root, update, CopyOption::SkipExisting));
+    EXPECT_EQ(path::size(path::joinPath(root, "README.md")), 8);
+    ASSERT_TRUE(path::createFiles(root, update, CopyOption::OverwriteExisting));
+    EXPECT_EQ(path::size(path::joinPath(root, "README.md")), 3);
+    ASSERT_TRUE(path::createFiles(root, update, CopyOption::OverwriteAll));
+    EXPECT_FALSE(path::exists(path::joinPath(root, "src")));
+    EXPECT_TRUE(path::exists(path::joinPath(root, "extra.txt")));
+
+    EXPECT_THROW(path::createFiles(root, {{"../escape.txt", ""}}), std::runtime_error);
+    EXPECT_THROW(path::createFiles(root, {{"/absolute.txt", ""}}), std::runtime_error);
+
+    path::remove(temp_path);
+}
+
+TEST(createFiles, many)
+{
+    std::string root = path::joinPath(temp_path, "many");
+    std::vector<std::pair<std::string, std::string>> entries;
+    for(int i = 0; i < 500; i++) {
+        entries.push_back({"dir" + std::to_string(i % 20) + "/file" + std::to_string(i) + ".txt", std::to_string(i)});
+    }
+
+    ASSERT_TRUE(path::createFiles(root, entries, CopyOption::None, 4));
+    EXPECT_EQ(path::findAll(root, "file499.txt", Traversal::Recursive).size(), 1);
+    path::RemoveStats stats;
+    path::remove(root, stats);
+    EXPECT_EQ(stats.entries, 500 + 20 + 1);
+
+    path::remove(temp_path);
+}
+
+TEST(execute, argv)
+{
+    os::ExecuteResult result = os::execute({"sh", "-c", "echo out; echo err >&2; exit 3"});
+    EXPECT_EQ(result.exit_code, 3);
+    EXPECT_EQ(result.signal, 0);
+    EXPECT_EQ(result.output, "out\n");
+    EXPECT_EQ(result.error, "err\n");
+    EXPECT_GT(result.duration.count(), 0);
+
+    result = os::execute({"sh", "-c", "kill -9 $$"});
+    EXPECT_EQ(result.exit_code, -1);
+    EXPECT_EQ(result.signal, 9);
+
+    result = os::execute({"os-test-program-that-does-not-exist"});
+    EXPECT_EQ(result.exit_code, 127);
+    EXPECT_FALSE(result.error.empty());
+
+    // arguments are passed as they are, without a shell
+    result = os::execute({"echo", "$HOME", "a  b"});
+    EXPECT_EQ(result.output, "$HOME a  b\n");
+
+    EXPECT_THROW(os::execute(std::vector<std::string>()), std::runtime_error);
+}
+
+TEST(execute, large_output)
+{
+    // both streams are drained together, so neither pipe can fill up and stall the program
+    os::ExecuteResult result = os::execute({"sh", "-c", "head -c 3000000 /dev/zero >&2; head -c 5000000 /dev/zero"});
+    EXPECT_EQ(result.exit_code, 0);
+    EXPECT_EQ(result.error.size(), 3000000);
+    EXPECT_EQ(result.output.size(), 5000000);
+}
+
+TEST(executeMany, order)
+{
+    std::vector<std::vector<std::string>> commands;
+    for(int i = 0; i < 8; i++) {
+        commands.push_back({"sh", "-c", "sleep 0.$((8 - " + std::to_string(i) + ")); echo " + std::to_string(i) + "; echo e >&2"});
+    }
+    commands.push_back({"os-test-program-that-does-not-exist"});
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<os::ExecuteResult> results = os::executeMany(commands, 9);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1500));
+
+    ASSERT_EQ(results.size(), 9);
+    for(int i = 0; i < 8; i++) {
+        EXPECT_EQ(results[i].exit_code, 0);
+        EXPECT_EQ(results[i].output, std::to_string(i) + "\n");
+        EXPECT_EQ(results[i].error, "e\n");
+    }
+    EXPECT_EQ(results[8].exit_code, 127);
+
+    // no more than two at a time
+    start = std::chrono::steady_clock::now();
+    results = os::executeMany({{"sleep", "0.2"}, {"sleep", "0.2"}, {"sleep", "0.2"}, {"sleep", "0.2"}}, 2);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(400));
+}
+
+TEST(executeMany, timeout)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<os::ExecuteResult> results = os::executeMany({{"sleep", "5"}, {"sh", "-c", "sleep 5; echo late"}, {"echo", "quick"}},
+                                                             0, std::chrono::milliseconds(100));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+    EXPECT_TRUE(results[0].timed_out);
+    EXPECT_EQ(results[0].signal, SIGTERM);
+    EXPECT_TRUE(results[1].timed_out);
+    EXPECT_TRUE(results[1].output.empty());
+    EXPECT_FALSE(results[2].timed_out);
+    EXPECT_EQ(results[2].output, "quick\n");
+
+    // ignoring SIGTERM only buys the grace period
+    results = os::executeMany({{"sh", "-c", "trap '' TERM; sleep 5"}}, 1, std::chrono::milliseconds(100));
+    EXPECT_TRUE(results[0].timed_out);
+    EXPECT_EQ(results[0].signal, SIGKILL);
+}
+
+TEST(executeMany, fail_fast)
+{
+    std::vector<os::ExecuteResult> results = os::executeMany({{"sleep", "5"}, {"sh", "-c", "sleep 0.1; exit 2"}, {"echo", "never"}},
+                                                             2, std::chrono::milliseconds::zero(), true);
+    EXPECT_EQ(results[0].signal, SIGTERM);
+    EXPECT_FALSE(results[0].timed_out);
+    EXPECT_EQ(results[1].exit_code, 2);
+    EXPECT_EQ(results[2].exit_code, -1);
+    EXPECT_TRUE(results[2].output.empty());
+}
+
+TEST(execute, stream_lines)
+{
+    std::vector<std::string> output;
+    std::vector<std::string> error;
+    os::ExecuteResult result = os::execute({"sh", "-c", "printf 'a\\nb\\r\\nc'; echo err >&2"}, [&](std::string_view line, bool from_error) {
+        (from_error ? error : output).push_back(std::string(line));
+        return true;
+    });
+    EXPECT_EQ(result.exit_code, 0);
+    EXPECT_TRUE(result.output.empty());
+    EXPECT_EQ(output, std::vector<std::string>({"a", "b", "c"}));
+    EXPECT_EQ(error, std::vector<std::string>({"err"}));
+}
+
+TEST(execute, stream_chunks)
+{
+    std::size_t total = 0;
+    std::size_t largest = 0;
+    os::ExecuteResult result = os::execute({"head", "-c", "10000000", "/dev/zero"}, [&](std::string_view chunk, bool) {
+        total += chunk.size();
+        largest = std::max(largest, chunk.size());
+        return true;
+    }, os::OutputMode::Chunks);
+    EXPECT_EQ(result.exit_code, 0);
+    EXPECT_EQ(total, 10000000);
+    EXPECT_LE(largest, 65536);
+}
+
+TEST(execute, stream_long_line)
+{
+    // output without line breaks is handed over in bounded pieces instead of piling up
+    std::size_t total = 0;
+    std::size_t largest = 0;
+    std::size_t lines = 0;
+    os::ExecuteResult result = os::execute({"sh", "-c", "head -c 1000000 /dev/zero | tr '\\0' x; printf '\\nend\\n'"}, [&](std::string_view line, bool) {
+        total += line.size();
+        largest = std::max(largest, line.size());
+        lines++;
+        return true;
+    });
+    EXPECT_EQ(result.exit_code, 0);
+    EXPECT_EQ(total, 1000000 + 3);
+    EXPECT_EQ(largest, 65536);
+    EXPECT_EQ(lines, 1000000 / 65536 + 2);
+}
+
+TEST(execute, stream_stop)
+{
+    // the callback stops a program that would never end
+    int count = 0;
+    os::ExecuteResult result = os::execute({"yes"}, [&](std::string_view, bool) {
+        return ++count < 100;
+    });
+    EXPECT_EQ(count, 100);
+    EXPECT_EQ(result.signal, SIGTERM);
+    EXPECT_FALSE(result.timed_out);
+
+    auto start = std::chrono::steady_clock::now();
+    result = os::execute({"sh", "-c", "echo started; sleep 5"}, [&](std::string_view, bool) { return true; },
+                         os::OutputMode::Lines, std::chrono::milliseconds(100));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+    EXPECT_TRUE(result.timed_out);
+    EXPECT_EQ(result.signal, SIGTERM);
+}
+
+TEST(Pipeline, stages)
+{
+    std::vector<os::ExecuteResult> results = os::Pipeline({{"printf", "b\\na\\nc\\n"}, {"sh", "-c", "echo sorting >&2; sort"}, {"head", "-n", "2"}}).run();
+    ASSERT_EQ(results.size(), 3);
+    for(const auto& result : results) {
+        EXPECT_EQ(result.exit_code, 0);
+    }
+    EXPECT_EQ(results[1].error, "sorting\n");
+    EXPECT_EQ(results[2].output, "a\nb\n");
+
+    results = os::Pipeline().add({"echo", "x"}).add({"os-test-program-that-does-not-exist"}).add({"cat"}).run();
+    EXPECT_EQ(results[1].exit_code, 127);
+    EXPECT_EQ(results[2].exit_code, 0);
+    EXPECT_TRUE(results[2].output.empty());
+
+    EXPECT_THROW(os::Pipeline().run(), std::runtime_error);
+}
+
+TEST(Pipeline, files)
+{
+    std::string input = path::joinPath(temp_path, "input.txt");
+    std::string output = path::joinPath(temp_path, "output.txt");
+    path::createDirectory(temp_path);
+    std::vector<std::string> lines;
+    for(int i = 0; i < 1000; i++) {
+        lines.push_back(i % 3 ? "skip" : "keep");
+    }
+    path::createFile(input, lines, CopyOption::OverwriteExisting);
+
+    std::vector<os::ExecuteResult> results = os::Pipeline({{"grep", "keep"}, {"wc", "-l"}}).input(input).output(output).run();
+    EXPECT_EQ(results[1].exit_code, 0);
+    EXPECT_TRUE(results[1].output.empty());
+    EXPECT_EQ(path::size(output), 4);
+
+    // a large mapped file, fed without copying
+    std::string large = path::joinPath(temp_path, "large.bin");
+    path::createFile(large, std::string(20000000, 'z'), CopyOption::OverwriteExisting);
+    path::MappedFile mapped = path::mapFile(large);
+    results = os::Pipeline({{"wc", "-c"}}).input(mapped).run();
+    EXPECT_EQ(results[0].output, "20000000\n");
+
+    // a program that stops reading early does not take the caller down
+    results = os::Pipeline({{"head", "-c", "10"}}).input(mapped).run();
+    EXPECT_EQ(results[0].output.size(), 10);
+
+    EXPECT_THROW(os::Pipeline({{"cat"}}).input(path::joinPath(temp_path, "missing.txt")).run(), std::runtime_error);
+
+    path::remove(temp_path);
+}
+
+TEST(Pipeline, out_of_descriptors)
+{
+    auto openDescriptors = []() {
+        return std::distance(std::filesystem::directory_iterator("/proc/self/fd"), std::filesystem::directory_iterator());
+    };
+
+    // leave room for the output pipe and the first stage only, so a later pipe cannot be created
+    rlimit limit;
+    ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &limit), 0);
+    auto before = openDescriptors();
+    rlimit low = limit;
+    low.rlim_cur = static_cast<rlim_t>(before + 6);
+    ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &low), 0);
+    EXPECT_THROW(os::Pipeline({{"cat"}, {"cat"}, {"cat"}, {"cat"}}).run(), std::runtime_error);
+    ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &limit), 0);
+
+    // nothing is left open and the pipeline still works with enough descriptors
+    EXPECT_EQ(openDescriptors(), before);
+    std::vector<os::ExecuteResult> results = os::Pipeline({{"echo", "ok"}, {"cat"}}).run();
+    EXPECT_EQ(results[1].output, "ok\n");
+}
+
+TEST(diff, change_sets)
+{
+    std::string old_root = path::joinPath(temp_path, "old");
+    std::string new_root = path::joinPath(temp_path, "new");
+    ASSERT_TRUE(path::createFiles(old_root, {
+        {"same.txt", "same"},
+        {"grown.txt", "a"},
+        {"gone.txt", "gone"},
+        {"gone/a/b.txt", "b"},
+        {"dir_to_file/c.txt", "c"},
+        {"file_to_dir", "d"},
+        {"sub/edited.txt", "abc"}
+    }));
+    ASSERT_TRUE(path::createFiles(new_root, {
+        {"same.txt", "same"},
+        {"grown.txt", "bb"},
+        {"added.txt", "new"},
+        {"added/x/y.txt", "y"},
+        {"dir_to_file", "c"},
+        {"file_to_dir/d.txt", "d"},
+        {"sub/edited.txt", "abd"}
+    }));
+    // same size and time, so only reading the contents finds the edit
+    auto time = std::filesystem::last_write_time(path::joinPath(old_root, "sub/edited.txt"));
+    std::filesystem::last_write_time(path::joinPath(new_root, "sub/edited.txt"), time);
+    std::filesystem::last_write_time(path::joinPath(new_root, "same.txt"), std::filesystem::last_write_time(path::joinPath(old_root, "same.txt")));
+
+    path::TreeDiff changes = path::diff(old_root, new_root, path::CompareOption::Bytes);
+    std::set<std::string> added = {"added", "added.txt", path::joinPath("added", "x"), path::joinPath("added", "x/y.txt"), path::joinPath("file_to_dir", "d.txt")};
+    EXPECT_EQ(changes.added, added);
+    EXPECT_EQ(changes.removed, std::set<std::string>({"gone", "gone.txt"}));
+    EXPECT_EQ(changes.type_changed, std::set<std::string>({"dir_to_file", "file_to_dir"}));
+    EXPECT_EQ(changes.modified, std::set<std::string>({"grown.txt", path::joinPath("sub", "edited.txt")}));
+    EXPECT_EQ(path::diff(old_root, new_root, path::CompareOption::Hash).modified, changes.modified);
+    EXPECT_EQ(path::diff(old_root, new_root, path::CompareOption::Metadata, 1).modified, std::set<std::string>({"grown.txt"}));
+
+    // apply the changes, after which both trees are the same
+    for(const auto& i : changes.removed) {
+        path::remove(path::joinPath(old_root, i));
+    }
+    for(const auto& i : changes.type_changed) {
+        path::remove(path::joinPath(old_root, i));
+    }
+    path::copy(new_root, changes.changes(), old_root, CopyOption::OverwriteExisting);
+    EXPECT_TRUE(path::diff(old_root, new_root, path::CompareOption::Bytes).empty());
+
+    EXPECT_THROW(path::diff(path::joinPath(temp_path, "missing"), new_root), std::runtime_error);
+    EXPECT_THROW(path::diff(old_root, path::joinPath(new_root, "same.txt")), std::runtime_error);
+    std::error_code ec;
+    EXPECT_TRUE(path::diff(old_root, path::joinPath(new_root, "same.txt"), path::CompareOption::Metadata, 0, ec).empty());
+    EXPECT_EQ(ec, std::errc::not_a_directory);
+
+    path::remove(temp_path);
+}
+
+TEST(diff, links)
+{
+    std::string old_root = path::joinPath(temp_path, "old");
+    std::string new_root = path::joinPath(temp_path, "new");
+    std::string outside = path::joinPath(temp_path, "outside");
+    ASSERT_TRUE(path::createFiles(old_root, {{"a.txt", "a"}}));
+    ASSERT_TRUE(path::createFiles(new_root, {{"a.txt", "a"}}));
+    ASSERT_TRUE(path::createFiles(outside, {{"keep.txt", "keep"}, {"other.txt", "other"}}));
+    std::filesystem::create_symlink("../outside/keep.txt", std::filesystem::path(new_root) / "link.txt");
+    std::filesystem::create_symlink("../outside/keep.txt", std::filesystem::path(old_root) / "moved.txt");
+    std::filesystem::create_symlink("../outside/other.txt", std::filesystem::path(new_root) / "moved.txt");
+    std::filesystem::last_write_time(path::joinPath(new_root, "a.txt"), std::filesystem::last_write_time(path::joinPath(old_root, "a.txt")));
+
+    path::TreeDiff changes = path::diff(old_root, new_root);
+    EXPECT_EQ(changes.added, std::set<std::string>({"link.txt"}));
+    EXPECT_EQ(changes.modified, std::set<std::string>({"moved.txt"}));
+
+    // the links are copied as links, and nothing is written through them
+    path::copy(new_root, changes.changes(), old_root, CopyOption::OverwriteExisting);
+    EXPECT_TRUE(std::filesystem::is_symlink(std::filesystem::path(old_root) / "link.txt"));
+    EXPECT_EQ(std::filesystem::read_symlink(std::filesystem::path(old_root) / "moved.txt"), "../outside/other.txt");
+    EXPECT_EQ(path::size(path::joinPath(outside, "keep.txt")), 4);
+    EXPECT_EQ(path::size(path::joinPath(outside, "other.txt")), 5);
+    EXPECT_TRUE(path::diff(old_root, new_root).empty());
+
+    // moving a listed link removes the link, not its target
+    std::string moved_root = path::joinPath(temp_path, "moved");
+    EXPECT_TRUE(path::move(new_root, {"link.txt"}, moved_root));
+    EXPECT_TRUE(std::filesystem::is_symlink(std::filesystem::path(moved_root) / "link.txt"));
+    EXPECT_FALSE(std::filesystem::exists(std::filesystem::symlink_status(std::filesystem::path(new_root) / "link.txt")));
+    EXPECT_EQ(path::size(path::joinPath(outside, "keep.txt")), 4);
+
+    path::remove(temp_path);
+}
+
+TEST(Watcher, batches)
+{
+    std::string root = path::joinPath(temp_path, "watched");
+    ASSERT_TRUE(path::createFiles(root, {{"old.txt", "old"}}));
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    path::TreeDiff seen;
+    path::Watcher watcher(root, [&](const path::TreeDiff& changes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        seen.added.insert(changes.added.begin(), changes.added.end());
+        seen.removed.insert(changes.removed.begin(), changes.removed.end());
+        seen.modified.insert(changes.modified.begin(), changes.modified.end());
+        cv.notify_all();
+    }, std::chrono::milliseconds(100));
+    auto wait = [&](std::set<std::string> path::TreeDiff::* set, const std::string& path) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cv.wait_for(lock, std::chrono::seconds(5), [&]() { return (seen.*set).count(path) > 0; });
+    };
+
+    // a new directory is watched, and what was created in it before that is found
+    path::createFile(path::joinPath(root, "a.txt"), "a");
+    path::createFiles(root, {{"sub/deeper/b.txt", "b"}});
+    EXPECT_TRUE(wait(&path::TreeDiff::added, "a.txt"));
+    EXPECT_TRUE(wait(&path::TreeDiff::added, path::joinPath("sub", "deeper/b.txt")));
+    EXPECT_TRUE(wait(&path::TreeDiff::added, "sub"));
+
+    path::createFile(path::joinPath(root, "sub/deeper/b.txt"), "changed", CopyOption::OverwriteExisting);
+    EXPECT_TRUE(wait(&path::TreeDiff::modified, path::joinPath("sub", "deeper/b.txt")));
+
+    // created and removed within one batch, so never reported
+    path::createFile(path::joinPath(root, "temporary.txt"), "t");
+    path::remove(path::joinPath(root, "temporary.txt"));
+    path::remove(path::joinPath(root, "old.txt"));
+    EXPECT_TRUE(wait(&path::TreeDiff::removed, "old.txt"));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(seen.added.count("temporary.txt"), 0);
+        EXPECT_EQ(seen.removed.count("temporary.txt"), 0);
+    }
+
+    EXPECT_THROW(path::Watcher(path::joinPath(temp_path, "missing"), [](const path::TreeDiff&) {}), std::runtime_error);
+
+    path::remove(temp_path);
+}
+
+TEST(MemoryBackend, operations)
+{
+    path::MemoryBackend memory;
+    struct Restore { // puts the native filesystem back before `memory` goes, even when an assertion returns early
+        ~Restore() { path::setBackend(nullptr); }
+    } restore;
+    EXPECT_EQ(path::setBackend(&memory), nullptr);
+
+    ASSERT_TRUE(path::createDirectory("project/src"));
+    EXPECT_TRUE(path::createFile("project/src/main.cpp", "int main() {}"));
+    EXPECT_TRUE(path::createFile("project/README.md", std::vector<std::string>{"# title", "text"}));
+    EXPECT_TRUE(path::exists("project/src/main.cpp"));
+    EXPECT_TRUE(path::isDirectory("/project/src"));
+    EXPECT_TRUE(path::isFile("./project/README.md"));
+    EXPECT_FALSE(path::isEmpty("project"));
+    EXPECT_EQ(path::size("project"), 13 + 12);
+    EXPECT_EQ(path::find("project", "main.cpp", path::TraversalOption::Recursive), (std::filesystem::path("project") / "src" / "main.cpp").string());
+    EXPECT_EQ(path::findAll("project", "main.cpp", path::TraversalOption::NonRecursive).size(), 0);
+
+    ASSERT_TRUE(path::copy("project", "backup"));
+    EXPECT_TRUE(path::hasSameContent("project", "backup/project"));
+    ASSERT_TRUE(path::copy("project/", "flat"));
+    EXPECT_TRUE(path::isFile("flat/src/main.cpp"));
+    EXPECT_THROW(path::copy("project", "linked", CopyOption::None, path::LinkOption::Preserve), std::runtime_error);
+    EXPECT_FALSE(path::exists("linked"));
+    ASSERT_TRUE(path::createFile("project/data.bin", std::string(5000, 'x')));
+    path::RateLimiter limiter(20000, 0); // 5 kB at 20 kB/s
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(path::copy("project", "limited", CopyOption::None, limiter));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(150));
+    EXPECT_TRUE(path::hasSameContent("project", "limited/project"));
+    ASSERT_TRUE(path::move("flat", "moved"));
+    EXPECT_FALSE(path::exists("flat"));
+    path::rename("moved", "renamed");
+
+    path::RemoveStats stats;
+    EXPECT_TRUE(path::remove("renamed", stats));
+    EXPECT_EQ(stats.entries, 5);
+    EXPECT_EQ(stats.bytes, 13 + 12);
+    EXPECT_FALSE(path::exists("renamed"));
+
+    std::error_code ec;
+    EXPECT_EQ(path::size("missing", ec), -1);
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+    EXPECT_FALSE(path::copy("missing", "backup", ec));
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+    EXPECT_TRUE(path::findAll("missing", "main.cpp", -1, ec).empty());
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+    EXPECT_FALSE(path::createFile("nowhere/file.txt", "x", ec));
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+
+    EXPECT_EQ(path::setBackend(nullptr), &memory);
+    EXPECT_FALSE(path::exists("backup/project"));
+}
+
+TEST(pack, round_trip)
+{
+    std::string source = path::joinPath(temp_path, "source");
+    std::string archive = path::joinPath(temp_path, "source.tar");
+    std::string long_name = "sub/" + std::string(150, 'n') + ".txt";
+    ASSERT_TRUE(path::createFiles(source, {
+        {"a.txt", "a"},
+        {"empty.txt", ""},
+        {"sub/b.txt", "bb"},
+        {"sub/empty/", ""},
+        {long_name, "long"},
+        {"huge.bin", std::string(3 << 20, 'h')}
+    }));
+
+    ASSERT_TRUE(path::pack(source, std::filesystem::path(archive)));
+    ASSERT_TRUE(path::unpack(std::filesystem::path(archive), path::joinPath(temp_path, "unpacked")));
+    EXPECT_TRUE(path::diff(source, path::joinPath(temp_path, "unpacked/source"), path::CompareOption::Bytes).empty());
+
+    // a trailing separator packs only the contents, and conflicts follow `CopyOption`
+    std::string contents = path::joinPath(temp_path, "contents");
+    ASSERT_TRUE(path::pack(source + path::directorySeparator(), std::filesystem::path(archive), 2));
+    ASSERT_TRUE(path::unpack(std::filesystem::path(archive), contents, CopyOption::None, 2));
+    EXPECT_TRUE(path::diff(source, contents, path::CompareOption::Bytes).empty());
+    path::createFile(path::joinPath(contents, "a.txt"), "changed", CopyOption::OverwriteExisting);
+    EXPECT_TRUE(path::unpack(std::filesystem::path(archive), contents, CopyOption::SkipExisting));
+    EXPECT_EQ(path::diff(source, contents, path::CompareOption::Bytes).modified, std::set<std::string>({"a.txt"}));
+    EXPECT_TRUE(path::unpack(std::filesystem::path(archive), contents, CopyOption::OverwriteExisting));
+    EXPECT_TRUE(path::diff(source, contents, path::CompareOption::Bytes).empty());
+
+    std::error_code ec;
+    EXPECT_FALSE(path::pack(path::joinPath(temp_path, "missing"), std::filesystem::path(archive), 0, ec));
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+
+    path::remove(temp_path);
+}
+
+TEST(pack, hostile_archive)
+{
+    // Builds a ustar archive by hand, since pack() never writes entries like these
+    std::string tar;
+    auto add = [&](const std::string& name, char type, const std::string& data = "", const std::string& link = "") {
+        char header[512] = {};
+        std::snprintf(header, 100, "%s", name.c_str());
+        std::snprintf(header + 100, 8, "%07o", 0644);
+        std::snprintf(header + 124, 12, "%011o", static_cast<unsigned int>(data.size()));
+        std::snprintf(header + 136, 12, "%011o", 0);
+        header[156] = type;
+        std::snprintf(header + 157, 100, "%s", link.c_str());
+        std::memcpy(header + 257, "ustar\0" "00", 8);
+        std::memset(header + 148, ' ', 8);
+        unsigned int checksum = 0;
+        for(unsigned char c : header) {
+            checksum += c;
+        }
+        std::snprintf(header + 148, 8, "%06o", checksum);
+        tar.append(header, 512);
+        tar.append(data);
+        tar.append((512 - data.size() % 512) % 512, '\0');
+    };
+
+    std::string outside = path::joinPath(temp_path, "outside");
+    std::string destination = path::joinPath(temp_path, "destination");
+    ASSERT_TRUE(path::createFiles(outside, {{"secret.txt", "secret"}}));
+    add("../escaped.txt", '0', "x");
+    add(path::joinPath(temp_path, "absolute.txt"), '0', "x");
+    add("esc", '2', "", outside);
+    add("esc/planted.txt", '0', "x");
+    add("hard", '1', "", "../outside/secret.txt");
+    add("ok.txt", '0', "ok");
+    tar.append(1024, '\0');
+    std::string archive = path::joinPath(temp_path, "hostile.tar");
+    path::createFile(archive, tar, CopyOption::OverwriteExisting);
+
+    // the harmless entry is unpacked, the others are refused and nothing is written outside the destination
+    EXPECT_FALSE(path::unpack(std::filesystem::path(archive), destination, CopyOption::OverwriteExisting));
+    EXPECT_EQ(path::mapFile(path::joinPath(destination, "ok.txt")).view(), "ok");
+    EXPECT_FALSE(path::exists(path::joinPath(temp_path, "escaped.txt")));
+    EXPECT_FALSE(path::exists(path::joinPath(temp_path, "absolute.txt")));
+    EXPECT_FALSE(path::exists(path::joinPath(outside, "planted.txt")));
+    EXPECT_FALSE(std::filesystem::exists(std::filesystem::path(destination) / "hard"));
+    EXPECT_EQ(std::filesystem::hard_link_count(path::joinPath(outside, "secret.txt")), 1);
+    EXPECT_EQ(path::mapFile(path::joinPath(outside, "secret.txt")).view(), "secret");
+
+    path::remove(temp_path);
+}
+
+TEST(glob, patterns)
+{
+    std::string root = path::joinPath(temp_path, "glob");
+    ASSERT_TRUE(path::createFiles(root, {
+        {"src/test_a.cpp", ""},
+        {"src/main.cpp", ""},
+        {"src/x/test_b.cpp", ""},
+        {"src/x/y/test_c.cpp", ""},
+        {"src/x/y/notes.txt", ""},
+        {"src/.cache/test_d.cpp", ""},
+        {"docs/test_e.cpp", ""}
+    }));
+    auto matches = [&](const std::string& pattern) {
+        std::vector<std::string> found;
+        for(const auto& i : path::glob(root + "/" + pattern)) {
+            found.push_back(i.substr(root.size() + 1));
+        }
+        return found;
+    };
+
+    EXPECT_EQ(matches("src/**/test_*.cpp"), std::vector<std::string>({"src/test_a.cpp", "src/x/test_b.cpp", "src/x/y/test_c.cpp"}));
+    EXPECT_EQ(matches("*/test_?.cpp"), std::vector<std::string>({"docs/test_e.cpp", "src/test_a.cpp"}));
+    EXPECT_EQ(matches("src/[!t]*"), std::vector<std::string>({"src/main.cpp", "src/x"}));
+    EXPECT_EQ(matches("src/*/"), std::vector<std::string>({"src/x/"}));
+    EXPECT_EQ(matches("src/.*/*.cpp"), std::vector<std::string>({"src/.cache/test_d.cpp"}));
+    EXPECT_TRUE(matches("src/missing/*").empty());
+
+    // literal components are looked up, and only the directories the pattern can reach are listed
+    os::resetMetrics();
+    EXPECT_EQ(matches("src/x/y/*.txt"), std::vector<std::string>({"src/x/y/notes.txt"}));
+    EXPECT_EQ(os::metrics().directories_walked, 1);
+
+    path::Glob results = path::glob(root + "/src/**");
+    std::string first;
+    ASSERT_TRUE(results.next(first));
+    EXPECT_EQ(first, root + "/src");
+
+    path::remove(temp_path);
+}
+
+TEST(filter, rules)
+{
+    path::Filter filter("# build output\nnode_modules/\n*.log\n!keep.log\n/build\ndocs/**/*.tmp\n");
+    EXPECT_TRUE(filter.excludes("node_modules", true));
+    EXPECT_TRUE(filter.excludes("web/node_modules", true));
+    EXPECT_FALSE(filter.excludes("node_modules", false));
+    EXPECT_TRUE(filter.excludes("a/b/.debug.log", false));
+    EXPECT_FALSE(filter.excludes("a/keep.log", false));
+    EXPECT_TRUE(filter.excludes("build", true));
+    EXPECT_FALSE(filter.excludes("src/build", true));
+    EXPECT_TRUE(filter.excludes("docs/x.tmp", false));
+    EXPECT_TRUE(filter.excludes("docs/a/b/x.tmp", false));
+    EXPECT_FALSE(filter.excludes("src/x.tmp", false));
+
+    std::string source = path::joinPath(temp_path, "source");
+    std::string destination = path::joinPath(temp_path, "destination");
+    ASSERT_TRUE(path::createFiles(source, {
+        {"main.cpp", "int main;"},
+        {"run.log", "log"},
+        {".git/HEAD", "ref"},
+        {"node_modules/lib/index.js", "js"},
+        {"src/util.cpp", "util"},
+        {"src/node_modules/x.js", "x"}
+    }));
+    path::Filter ignore = path::Filter().exclude(".git/").exclude("node_modules/").exclude("*.log");
+
+    // excluded directories are not opened
+    os::resetMetrics();
+    EXPECT_EQ(path::size(source, ignore), 13);
+    EXPECT_EQ(os::metrics().directories_walked, 2);
+    EXPECT_EQ(path::findAll(source, "index.js", ignore), std::vector<std::string>());
+    EXPECT_EQ(path::find(source, "util.cpp", ignore), source + "/src/util.cpp");
+
+    // links are copied as links, never resolved into the path they are copied to
+    std::string kept = path::joinPath(temp_path, "outside/keep.txt");
+    ASSERT_TRUE(path::createFiles(path::joinPath(temp_path, "outside"), {{"keep.txt", "kept"}}));
+    std::filesystem::create_symlink("../outside/keep.txt", std::filesystem::path(source) / "link.txt");
+
+    EXPECT_TRUE(path::copy(source + "/", destination, ignore, CopyOption::OverwriteExisting));
+    EXPECT_TRUE(std::filesystem::is_symlink(std::filesystem::path(destination) / "link.txt"));
+    EXPECT_EQ(std::filesystem::read_symlink(std::filesystem::path(destination) / "link.txt"), "../outside/keep.txt");
+    EXPECT_EQ(path::mapFile(kept).view(), "kept");
+    EXPECT_TRUE(path::exists(path::joinPath(destination, "src/util.cpp")));
+    EXPECT_FALSE(path::exists(path::joinPath(destination, "run.log")));
+    EXPECT_FALSE(path::exists(path::joinPath(destination, "src/node_modules")));
+    EXPECT_FALSE(path::exists(path::joinPath(destination, ".git")));
+
+    // only the selected paths are removed, and directories holding excluded ones are kept
+    EXPECT_TRUE(path::remove(source, ignore));
+    EXPECT_FALSE(path::exists(path::joinPath(source, "main.cpp")));
+    EXPECT_TRUE(path::exists(path::joinPath(source, "run.log")));
+    EXPECT_TRUE(path::exists(path::joinPath(source, "src/node_modules/x.js")));
+    EXPECT_FALSE(path::exists(path::joinPath(source, "src/util.cpp")));
+
+    // a filtered move takes links along as links and leaves the excluded paths behind
+    std::string moved = path::joinPath(temp_path, "moved");
+    ASSERT_TRUE(path::createFiles(source, {{"a.txt", "a"}}));
+    std::filesystem::create_symlink("a.txt", std::filesystem::path(source) / "a.lnk");
+    EXPECT_TRUE(path::move(source, moved, ignore, CopyOption::OverwriteExisting));
+    EXPECT_TRUE(std::filesystem::is_symlink(std::filesystem::path(moved) / "source/a.lnk"));
+    EXPECT_EQ(path::mapFile(std::filesystem::path(moved) / "source/a.lnk").view(), "a");
+    EXPECT_FALSE(std::filesystem::exists(std::filesystem::symlink_status(std::filesystem::path(source) / "a.lnk")));
+    EXPECT_FALSE(path::exists(path::joinPath(source, "a.txt")));
+    EXPECT_TRUE(path::exists(path::joinPath(source, "run.log")));
+    EXPECT_FALSE(path::exists(path::joinPath(moved, "source/run.log")));
+    EXPECT_EQ(path::mapFile(kept).view(), "kept");
+
+    path::remove(temp_path);
+}
+
+TEST(async, cancellation)
+{
+    std::string source = path::joinPath(temp_path, "source");
+    std::string destination = path::joinPath(temp_path, "destination");
+    ASSERT_TRUE(path::createFiles(source, {{"a.txt", "hello"}, {"b.txt", "hello"}, {"dir/c.txt", "world!"}}));
+
+    EXPECT_EQ(path::sizeAsync(source).get(), 16);
+    EXPECT_TRUE(path::copyAsync(source + "/", destination, CopyOption::OverwriteExisting).get());
+    EXPECT_TRUE(path::diff(source, destination, path::CompareOption::Bytes).empty());
+
+    std::uint64_t hash = path::hashAsync(path::joinPath(source, "a.txt")).get();
+    EXPECT_EQ(hash, path::hashAsync(path::joinPath(source, "b.txt")).get());
+    EXPECT_NE(hash, path::hashAsync(path::joinPath(source, "dir/c.txt")).get());
+    EXPECT_THROW(path::hashAsync(source).get(), std::filesystem::filesystem_error);
+
+    // a cancelled operation stops before touching anything and its future reports the cancellation
+    path::CancellationToken token;
+    token.cancel();
+    std::future<bool> copied = path::copyAsync(source, path::joinPath(temp_path, "cancelled"), CopyOption::OverwriteExisting, token);
+    try {
+        copied.get();
+        FAIL() << "the copy was not cancelled";
+    } catch(const std::system_error& e) {
+        EXPECT_EQ(e.code(), std::errc::operation_canceled);
+    }
+    EXPECT_FALSE(path::exists(path::joinPath(temp_path, "cancelled")));
+    EXPECT_THROW(path::removeAsync(destination, token).get(), std::system_error);
+    EXPECT_TRUE(path::exists(destination));
+
+    EXPECT_TRUE(path::moveAsync(destination, path::joinPath(temp_path, "moved"), CopyOption::OverwriteExisting).get());
+    EXPECT_FALSE(path::exists(destination));
+    EXPECT_TRUE(path::removeAsync(path::joinPath(temp_path, "moved")).get());
+    EXPECT_FALSE(path::exists(path::joinPath(temp_path, "moved")));
+
+    path::remove(temp_path);
+}
+
+TEST(async, cancel_midway)
+{
+    std::string source = path::joinPath(temp_path, "source");
+    std::string stream = path::joinPath(source, "stream");
+    ASSERT_TRUE(path::createFiles(source, {{"a.txt", "hello"}}));
+    ASSERT_EQ(mkfifo(stream.c_str(), 0644), 0);
+
+    // The copies block reading the pipe, so they are cancelled while inside that file
+    auto openWriter = [&]() {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        int writer = -1;
+        while(writer < 0 && std::chrono::steady_clock::now() < deadline) {
+            writer = open(stream.c_str(), O_WRONLY | O_NONBLOCK); // fails until the copy opens the other end
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return writer;
+    };
+    auto expectCancelled = [](std::future<bool>& future) {
+        try {
+            future.get();
+            ADD_FAILURE() << "the operation was not cancelled";
+        } catch(const std::system_error& e) {
+            EXPECT_EQ(e.code(), std::errc::operation_canceled);
+        }
+    };
+
+    // a partly copied file is removed
+    std::string partial = path::joinPath(temp_path, "partial.bin");
+    path::CancellationToken token;
+    std::future<bool> copied = path::copyAsync(stream, partial, CopyOption::OverwriteExisting, token);
+    int writer = openWriter();
+    ASSERT_GE(writer, 0);
+    std::string chunk(4096, 'x');
+    ASSERT_EQ(write(writer, chunk.data(), chunk.size()), 4096);
+    while(!std::filesystem::exists(partial) || std::filesystem::file_size(partial) == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    token.cancel();
+    close(writer);
+    expectCancelled(copied);
+    EXPECT_FALSE(path::exists(partial));
+
+    // `ReplaceAll` drops its staging directory and leaves the old tree in place
+    std::string destination = path::joinPath(temp_path, "destination");
+    ASSERT_TRUE(path::createFiles(destination, {{"old.txt", "old"}}));
+    token = path::CancellationToken();
+    copied = path::copyAsync(source + path::directorySeparator(), destination, CopyOption::ReplaceAll, token);
+    writer = openWriter();
+    ASSERT_GE(writer, 0);
+    token.cancel();
+    close(writer);
+    expectCancelled(copied);
+    std::set<std::string> left;
+    for(const auto& entry : std::filesystem::directory_iterator(temp_path)) {
+        left.insert(entry.path().filename().string());
+    }
+    EXPECT_EQ(left, std::set<std::string>({"source", "destination"}));
+    EXPECT_TRUE(path::exists(path::joinPath(destination, "old.txt")));
+    EXPECT_FALSE(path::exists(path::joinPath(destination, "a.txt")));
+
+    // a cancelled move keeps its source
+    token = path::CancellationToken();
+    std::future<bool> moved = path::moveAsync(source, path::joinPath(temp_path, "moved"), CopyOption::OverwriteExisting, token);
+    writer = openWriter();
+    ASSERT_GE(writer, 0);
+    token.cancel();
+    close(writer);
+    expectCancelled(moved);
+    EXPECT_TRUE(path::exists(path::joinPath(source, "a.txt")));
+    EXPECT_TRUE(std::filesystem::is_fifo(stream));
+
+    // a removal stops partway, leaving what it had not reached
+    std::string tree = path::joinPath(temp_path, "tree");
+    std::vector<std::pair<std::string, std::string>> files;
+    for(int i = 0; i < 20; i++) {
+        for(int j = 0; j < 50; j++) {
+            files.push_back({"d" + std::to_string(i) + "/f" + std::to_string(j), ""});
+        }
+    }
+    ASSERT_TRUE(path::createFiles(tree, files));
+    auto directories = [&]() { return std::distance(std::filesystem::directory_iterator(tree), std::filesystem::directory_iterator()); };
+    token = path::CancellationToken();
+    std::future<bool> removed = path::removeAsync(tree, token);
+    while(directories() == 20) {
+        std::this_thread::yield();
+    }
+    token.cancel();
+    expectCancelled(removed);
+    EXPECT_GT(directories(), 0);
+
+    path::remove(temp_path);
+}
+
+TEST(throttle, rate_limiter)
+{
+    std::string source = path::joinPath(temp_path, "source");
+    std::string destination = path::joinPath(temp_path, "destination");
+    std::vector<std::pair<std::string, std::string>> files;
+    for(int i = 0; i < 20; i++) {
+        files.push_back({"f" + std::to_string(i) + ".dat", std::string(20000, 'x')});
+    }
+    ASSERT_TRUE(path::createFiles(source, files));
+
+    // 400 kB at 2 MB/s, starting from an empty bucket
+    path::RateLimiter limiter(2000000, 0, path::IOPriority::Idle);
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(path::copy(source + "/", destination, CopyOption::OverwriteExisting, limiter));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(150));
+    EXPECT_TRUE(path::diff(source, destination, path::CompareOption::Bytes).empty());
+
+    // copies of a limiter share one budget: two copies of 21 entries running together at 50 entries per
+    // second take over 700 ms, where each on a budget of its own would be done in about 400 ms
+    std::string second = path::joinPath(temp_path, "second");
+    path::RateLimiter entries(0, 50);
+    start = std::chrono::steady_clock::now();
+    std::thread other([&, shared = entries]() {
+        EXPECT_TRUE(path::copy(source + "/", second, CopyOption::OverwriteExisting, shared));
+    });
+    EXPECT_TRUE(path::copy(source + "/", destination, CopyOption::OverwriteExisting, entries));
+    other.join();
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(700));
+    EXPECT_TRUE(path::diff(source, second, path::CompareOption::Bytes).empty());
+
+    path::RateLimiter quick(0, 10000);
+    EXPECT_TRUE(path::remove(destination, quick));
+    EXPECT_TRUE(path::move(source, destination, CopyOption::OverwriteExisting, quick));
+    EXPECT_FALSE(path::exists(source));
+    EXPECT_TRUE(path::exists(path::joinPath(destination, "source/f19.dat")));
+
+    path::remove(temp_path);
+}
+
+TEST(copy, preserve_links)
+{
+    std::string source = path::joinPath(temp_path, "source");
+    std::string destination = path::joinPath(temp_path, "destination");
+    ASSERT_TRUE(path::createFiles(source, {{"data.bin", std::string(4096, 'x')}, {"dir/", ""}}));
+    std::filesystem::create_hard_link(path::joinPath(source, "data.bin"), path::joinPath(source, "dir/hard.bin"));
+    std::filesystem::create_symlink("../data.bin", path::joinPath(source, "dir/soft.bin"));
+    std::filesystem::create_directory_symlink("..", path::joinPath(source, "dir/loop"));
+
+    // the data is written once, and the loop is copied as a link instead of being followed
+    os::resetMetrics();
+    EXPECT_TRUE(path::copy(source, destination, CopyOption::OverwriteExisting, path::LinkOption::Preserve));
+    EXPECT_EQ(os::metrics().bytes_written, 4096);
+
+    std::filesystem::path copy = std::filesystem::path(destination) / "source"; // joinPath() would resolve the links
+    EXPECT_TRUE(std::filesystem::equivalent(copy / "data.bin", copy / "dir/hard.bin"));
+    EXPECT_FALSE(std::filesystem::equivalent(copy / "data.bin", path::joinPath(source, "data.bin")));
+    EXPECT_EQ(std::filesystem::hard_link_count(copy / "data.bin"), 2);
+    EXPECT_TRUE(std::filesystem::is_symlink(copy / "dir/soft.bin"));
+    EXPECT_EQ(std::filesystem::read_symlink(copy / "dir/soft.bin"), "../data.bin");
+    EXPECT_EQ(std::filesystem::read_symlink(copy / "dir/loop"), "..");
+
+    // copying again replaces the links in place instead of writing through them
+    EXPECT_TRUE(path::copy(source + "/", copy.string(), CopyOption::OverwriteExisting, path::LinkOption::Preserve));
+    EXPECT_EQ(std::filesystem::read_symlink(copy / "dir/soft.bin"), "../data.bin");
+    EXPECT_EQ(path::size(path::joinPath(source, "data.bin")), 4096);
+
+    // a link to a directory where the copy puts a directory is replaced, not written through
+    std::string outside = path::joinPath(temp_path, "outside");
+    std::string linked = path::joinPath(temp_path, "linked");
+    ASSERT_TRUE(path::createFiles(path::joinPath(temp_path, "tree"), {{"x/f.txt", "f"}}));
+    ASSERT_TRUE(path::createDirectory(outside));
+    std::filesystem::create_directories(std::filesystem::path(linked) / "tree");
+    std::filesystem::create_directory_symlink(outside, std::filesystem::path(linked) / "tree/x");
+    EXPECT_TRUE(path::copy(path::joinPath(temp_path, "tree"), linked, CopyOption::OverwriteExisting, path::LinkOption::Preserve));
+    EXPECT_FALSE(path::exists(path::joinPath(outside, "f.txt")));
+    EXPECT_FALSE(std::filesystem::is_symlink(std::filesystem::path(linked) / "tree/x"));
+    EXPECT_TRUE(std::filesystem::exists(std::filesystem::path(linked) / "tree/x/f.txt"));
+
+    // without permission to overwrite, the directory is skipped along with its contents
+    std::filesystem::remove_all(std::filesystem::path(linked) / "tree/x");
+    std::filesystem::create_directory_symlink(outside, std::filesystem::path(linked) / "tree/x");
+    EXPECT_TRUE(path::copy(path::joinPath(temp_path, "tree"), linked, CopyOption::SkipExisting, path::LinkOption::Preserve));
+    EXPECT_FALSE(path::exists(path::joinPath(outside, "f.txt")));
+    EXPECT_TRUE(std::filesystem::is_symlink(std::filesystem::path(linked) / "tree/x"));
+
+    path::remove(temp_path);
+}
+
+TEST(copy, verified)
+{
+    std::string source = path::joinPath(temp_path, "source");
+    std::string destination = path::joinPath(temp_path, "destination");
+    ASSERT_TRUE(path::createFiles(source, {{"a.bin", std::string(100000, 'a')}, {"dir/b.txt", "world!"}, {"dir/empty.txt", ""}}));
+
+    // the kernel copies the source, then the source and the copy are each hashed once
+    path::CopyDigests digests;
+    os::resetMetrics();
+    EXPECT_TRUE(path::copy(source + path::directorySeparator(), destination, CopyOption::OverwriteExisting, digests));
+    EXPECT_EQ(os::metrics().bytes_read, 3 * 100006);
+    EXPECT_EQ(os::metrics().bytes_written, 100006);
+
+    ASSERT_EQ(digests.files.size(), 3);
+    EXPECT_TRUE(digests.mismatched.empty());
+    for(const auto& [file, hash] : digests.files) {
+        EXPECT_EQ(hash, path::hashAsync(file).get()) << file;
+    }
+    EXPECT_EQ(digests.files[path::joinPath(source, "dir/b.txt")], path::hashAsync(path::joinPath(destination, "dir/b.txt")).get());
+
+    // the digests are replaced on every call, and kept for a file copied through a temporary name
+    std::string single = path::joinPath(temp_path, "single.txt");
+    std::error_code ec;
+    EXPECT_TRUE(path::copy(path::joinPath(source, "dir/b.txt"), single, CopyOption::ReplaceAll, digests, path::Durability::None,
+                           path::VerifyOption::Cache, ec));
+    EXPECT_FALSE(ec);
+    ASSERT_EQ(digests.files.size(), 1);
+    EXPECT_EQ(digests.files.begin()->second, path::hashAsync(single).get());
+
+    // reading back from the device hashes the source while copying it, so each side is read once
+    path::CopyDigests device;
+    os::resetMetrics();
+    EXPECT_TRUE(path::copy(source + path::directorySeparator(), destination, CopyOption::ReplaceAll, device, path::Durability::None,
+                           path::VerifyOption::Device));
+    EXPECT_EQ(os::metrics().bytes_read, 2 * 100006);
+    EXPECT_TRUE(device.mismatched.empty());
+    EXPECT_EQ(device.files.size(), 3);
+    EXPECT_EQ(device.files[path::joinPath(source, "a.bin")], path::hashAsync(path::joinPath(destination, "a.bin")).get());
+
+    path::waitDeferred();
+    path::remove(temp_path);
+}
+
+TEST(metrics, counters)
+{
+    path::createDirectory(temp_path);
+    std::string source = path::joinPath(temp_path, "source");
+    std::string destination = path::joinPath(temp_path, "destination");
+    path::createFiles(source, {{"a.txt", "hello"}, {"dir/b.txt", "world!"}, {"dir/sub/", ""}});
+
+    os::resetMetrics();
+    EXPECT_TRUE(path::copy(source + path::directorySeparator(), destination, CopyOption::OverwriteExisting));
+    EXPECT_EQ(path::size(destination), 11);
+
+    os::Metrics metrics = os::metrics();
+    EXPECT_EQ(metrics.opens, 4);
+    EXPECT_EQ(metrics.bytes_read, 11);
+    EXPECT_EQ(metrics.bytes_written, 11);
+    EXPECT_GE(metrics.directories_walked, 3);
+    EXPECT_GT(metrics.stats, 0);
+    ASSERT_EQ(metrics.latency.count("copy"), 1);
+    EXPECT_EQ(metrics.latency["copy"].count, 1);
+    EXPECT_EQ(metrics.latency.count("copyTree"), 0); // only public functions are timed
+    EXPECT_EQ(metrics.latency["size"].count, 1);
+    EXPECT_LE(metrics.latency["copy"].percentile(0.5), metrics.latency["copy"].max);
+
+    // Counters of threads that already exited are kept
+    std::thread([&]() { path::createFile(path::joinPath(temp_path, "thread.txt"), "12345", CopyOption::OverwriteExisting); }).join();
+    metrics = os::metrics(true);
+    EXPECT_EQ(metrics.bytes_written, 16);
+    EXPECT_EQ(metrics.latency["createFile"].count, 1);
+
+    metrics = os::metrics();
+    EXPECT_EQ(metrics.opens, 0);
+    EXPECT_TRUE(metrics.latency.empty());
+
+    path::remove(temp_path);
+}
+
+TEST(errorCode, missing_paths)
+{
+    path::createDirectory(temp_path);
+    std::string missing = path::joinPath(temp_path, "missing");
+    std::string file = path::joinPath(temp_path, "file.txt");
+    std::error_code ec;
+
+    EXPECT_FALSE(path::exists(missing, ec));
+    EXPECT_FALSE(ec);
+    EXPECT_FALSE(path::isDirectory(missing, ec));
+    EXPECT_FALSE(ec);
+
+    EXPECT_EQ(path::find(missing, "a.txt", path::TraversalOption::Recursive, ec), "");
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+    EXPECT_TRUE(path::findAll(missing, "a.txt", -1, ec).empty());
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+    EXPECT_EQ(path::size(missing, ec), -1);
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+    EXPECT_FALSE(path::copy(missing, temp_path, ec));
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+    EXPECT_FALSE(path::move(missing, temp_path, ec));
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+    EXPECT_FALSE(path::hasSameContent(missing, temp_path, ec));
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+    EXPECT_TRUE(path::mapFile(missing, path::AccessPattern::Sequential, ec).empty());
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+    EXPECT_FALSE(path::remove(missing, ec));
+    EXPECT_FALSE(ec);
+
+    EXPECT_TRUE(path::createFile(file, "hello", CopyOption::OverwriteExisting, path::WriteOption::Direct, path::Durability::None, ec));
+    EXPECT_FALSE(ec);
+    EXPECT_FALSE(path::createFile(path::joinPath(missing, "file.txt"), "hello", CopyOption::OverwriteExisting, path::WriteOption::Direct, path::Durability::None, ec));
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+    EXPECT_FALSE(path::hasSameContent(file, temp_path, ec));
+    EXPECT_EQ(ec, std::errc::invalid_argument);
+    EXPECT_TRUE(path::mapFile(temp_path, path::AccessPattern::Sequential, ec).empty());
+    EXPECT_EQ(ec, std::errc::is_a_directory);
+
+    // Successful calls clear the error
+    EXPECT_EQ(path::find(temp_path, "file.txt", path::TraversalOption::Recursive, ec), file);
+    EXPECT_FALSE(ec);
+    EXPECT_EQ(path::size(file, ec), 5);
+    EXPECT_FALSE(ec);
+    EXPECT_TRUE(path::hasSameContent(file, file, ec));
+    EXPECT_FALSE(ec);
+    EXPECT_TRUE(path::copy(file, path::joinPath(temp_path, "copy.txt"), CopyOption::None, path::TraversalOption::Recursive, path::Durability::None, ec));
+    EXPECT_FALSE(ec);
+    EXPECT_TRUE(path::remove(temp_path, ec));
+    EXPECT_FALSE(ec);
+}
+
+TEST(errorCode, execute)
+{
+    std::error_code ec;
+    os::ExecuteResult result = os::execute({"os-test-missing-program"}, ec);
+    EXPECT_EQ(ec, std::errc::no_such_file_or_directory);
+    EXPECT_EQ(result.exit_code, -1);
+    EXPECT_TRUE(result.error.empty());
+
+    result = os::execute(std::vector<std::string>(), ec);
+    EXPECT_EQ(ec, std::errc::invalid_argument);
+
+    result = os::execute({"sh", "-c", "exit 3"}, ec);
+    EXPECT_FALSE(ec);
+    EXPECT_EQ(result.exit_code, 3);
+
+    int lines = 0;
+    result = os::execute({"printf", "a\\nb\\n"}, [&](std::string_view, bool) { lines++; return true; }, os::OutputMode::Lines,
+                         std::chrono::milliseconds::zero(), ec);
+    EXPECT_FALSE(ec);
+    EXPECT_EQ(lines, 2);
+
+    // The throwing overload still reports a missing program like a shell
+    EXPECT_EQ(os::execute({"os-test-missing-program"}).exit_code, 127);
 }
\ No newline at end of file